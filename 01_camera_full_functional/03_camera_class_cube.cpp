@@ -91,7 +91,7 @@ int main( )
 
   glViewport( 0, 0, screenWidth, screenHeight );
   // important for 3d correct rendering
-  glEnable(GL_DEPTH_TEST);
+  SharedGLState().enable(GL_DEPTH_TEST);
   
 
   char vertex_shader[1024 * 256];
@@ -175,7 +175,7 @@ int main( )
   glGenBuffers(1, &ibo);
 
   // Bind the Vertex Array Object first, then bind and set vertex buffer(s) and attribute pointer(s).
-  glBindVertexArray(VAO);
+  SharedGLState().bindVertexArray(VAO);
 
   glBindBuffer( GL_ARRAY_BUFFER, VBO );
   glBufferData( GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW );
@@ -191,11 +191,11 @@ int main( )
   glEnableVertexAttribArray( 1 );
 
   glBindBuffer(GL_ARRAY_BUFFER, 0); // First unbind vbo - Don't unbind ibo before VAO
-  glBindVertexArray(0); // Unbind VAO
+  SharedGLState().bindVertexArray(0); // Unbind VAO
 
   glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
 
-  glUseProgram(shaderProgram);
+  SharedGLState().useProgram(shaderProgram);
 
   // create transformations
   glm::mat4 model(1.0f);
@@ -226,11 +226,10 @@ int main( )
     
   
       glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-      glBindVertexArray( VAO );
+      SharedGLState().bindVertexArray(VAO); // only issued on the first frame, nothing else binds a VAO
      // glDrawArrays( GL_TRIANGLES, 0, 6 );
      // glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
       glDrawElements(GL_TRIANGLES, sizeof(index), GL_UNSIGNED_INT, 0);
-      glBindVertexArray(0);
       // Swap the screen buffers
       glfwSwapBuffers( g_window );
       glfwPollEvents();
@@ -241,6 +240,8 @@ int main( )
   glDeleteBuffers( 1, &VBO );
   glDeleteBuffers(1, &ibo);
 
+  std::cout << "GL_STATE:: " << SharedGLState().counters().issued << " calls issued, " << SharedGLState().counters().skipped << " skipped" << std::endl;
+
   // Terminate GLFW, clearing any resources allocated by GLFW.
   glfwTerminate( );
 
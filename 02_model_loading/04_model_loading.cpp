@@ -4,10 +4,19 @@
 #include "gl_utils.h" // parser for shader source files
 
 #include <filesystem.h>
-#include <shader_m.h>
+#include <shader.h>
 #include <camera.h>
 #include <model.h>
+#include <headless_benchmark.h>
+#include <profiler.h>
+#ifdef PROFILER_OVERLAY // needs FreeType; the Win32 Debug configuration defines it and links common/msvc110/freetype.lib
+#include <profiler_overlay.h>
+#endif
 
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <random>
 #include <string>
 #include <fstream>
 #include <sstream>
@@ -23,12 +32,30 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void processInput(GLFWwindow *window);
+int runViewer(GLFWwindow *window, const BenchmarkSettings &benchmark);
+void cursorRay(GLFWwindow *window, glm::vec3 &origin, glm::vec3 &direction);
 std::string openAndReadFile(const char* filePath);
 unsigned int loadCubemap(vector<std::string> faces);
 
 // settings
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
+const size_t TEXTURE_UPLOAD_BUDGET = 8 * 1024 * 1024; // bytes of streamed texture data uploaded per frame
+const VertexFormat MODEL_VERTEX_FORMAT = VERTEX_FORMAT_FLOAT; // VERTEX_FORMAT_PACKED: 20 byte quantized vertices
+const unsigned int LOD_LEVELS = 4;            // simplified levels generated per mesh (0 turns LODs off)
+const float LOD_PIXEL_ERROR = 1.0f;           // largest on-screen error, in pixels, a LOD may show; [ and ] halve/double it
+const unsigned int LOD_TRIANGLE_BUDGET = 0;   // triangles per frame the LODs are coarsened to fit; 0 = no budget
+const bool GEOMETRY_ARENA = true;            // meshes share one vertex/index buffer per format, draws sharing textures merge into multi-draws
+const bool UNIFORM_BLOCKS = true;            // camera, lights and per-draw transforms go through uniform buffers streamed by a UniformRing
+const InstanceFormat STRESS_INSTANCE_FORMAT = INSTANCE_TRS; // --instances: 32 byte TRS, or INSTANCE_MAT4 for full matrices
+const SkinningMode MODEL_SKINNING = SKINNING_CPU; // rigged models play their first animation, skinned on the CPU or (SKINNING_GPU) in the vertex shader
+const bool RELEASE_CPU_GEOMETRY = true;      // meshes free their vertex/index arrays once uploaded; picking keeps its own BVH copy
+#ifdef _WIN32
+const char *PROFILER_FONT = "C:/Windows/Fonts/consola.ttf"; // any TrueType font; without it the profiler overlay stays hidden
+#else
+const char *PROFILER_FONT = "/usr/share/fonts/truetype/dejavu/DejaVuSansMono.ttf";
+#endif
+const char *PROFILER_TRACE = "profiler_trace.json"; // T writes the last frames' CPU/GPU scopes here, for chrome://tracing
 
 // camera
 Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
@@ -43,9 +70,25 @@ float lastFrame = 0.0f;
 float ColorLerp = 1.0f;
 bool showTexture = false;
 bool togglePressed;
-
-int main()
+bool cursorCaptured = true; // the mouse steers the camera; C releases the cursor to pick with it
+bool cursorTogglePressed;
+bool pickPressed;
+float lodPixelError = LOD_PIXEL_ERROR;
+bool lodKeyPressed;
+bool showProfiler = true; // P toggles the profiler overlay
+bool profilerKeyPressed;
+bool traceRequested;      // T: write PROFILER_TRACE at the end of the frame
+bool traceKeyPressed;
+bool memoryRequested;     // I: print the model's and the process's memory at the end of the frame
+bool memoryKeyPressed;
+
+int main(int argc, char **argv)
 {
+    // --benchmark <frames> renders a scripted camera path offscreen and reports timings instead of opening the viewer
+    BenchmarkSettings benchmark;
+    if (!parseBenchmarkArguments(argc, argv, benchmark, SCR_WIDTH, SCR_HEIGHT))
+        return -1;
+
     // glfw: initialize and configure
     // ------------------------------
     glfwInit();
@@ -56,6 +99,8 @@ int main()
 #ifdef __APPLE__
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE); // uncomment this statement to fix compilation on OS X
 #endif
+    if (benchmark.enabled)
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE); // only provides the context, frames go to an offscreen framebuffer
 
     // glfw window creation
     // --------------------
@@ -67,12 +112,17 @@ int main()
         return -1;
     }
     glfwMakeContextCurrent(window);
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-    glfwSetCursorPosCallback(window, mouse_callback);
-    glfwSetScrollCallback(window, scroll_callback);
+    if (!benchmark.enabled)
+    {
+        glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+        glfwSetCursorPosCallback(window, mouse_callback);
+        glfwSetScrollCallback(window, scroll_callback);
 
-    // tell GLFW to capture our mouse
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+        // tell GLFW to capture our mouse
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    }
+    else
+        glfwSwapInterval(0);
 
     if (gl3wInit()) {
         std::cout << "failed to initialize OpenGL\n" << std::endl;
@@ -84,28 +134,70 @@ int main()
         return -1;
     }
 
-    // configure global opengl state
-    // -----------------------------
-    glEnable(GL_DEPTH_TEST);
+    // everything owning GL objects lives in runViewer, so it is destroyed while the context still exists
+    int result = runViewer(window, benchmark);
 
-    // build and compile shaders
-    // -------------------------
-    Shader ourShader("1.model_loading.vs", "1.model_loading.fs");
-    Shader skyboxShader("6.1.skybox.vs", "6.1.skybox.fs");
+    // glfw: terminate, clearing all previously allocated GLFW resources.
+    // ------------------------------------------------------------------
+    glfwTerminate();
+    return result;
+}
 
-    std::string content = openAndReadFile("currentFile.txt");
+// loads the model and runs the viewer loop, or the headless benchmark; returns the exit code
+int runViewer(GLFWwindow *window, const BenchmarkSettings &benchmark)
+{
+    // configure global opengl state (through SharedGLState, which every draw path uses to skip redundant calls)
+    // -----------------------------
+    GLStateCache &glState = SharedGLState();
+    glState.enable(GL_DEPTH_TEST);
+
+    std::string content = benchmark.modelPath.empty() ? openAndReadFile("currentFile.txt") : benchmark.modelPath;
     std::cout << "Path file Content is: " << content << endl;
     // load models
     // -----------
+    // textures are decoded in the background and show up over the first frames
+    TextureStreamer textureStreamer;
+    ModelLoadOptions loadOptions;
+    loadOptions.textureStreamer = &textureStreamer;
+    loadOptions.vertexFormat = MODEL_VERTEX_FORMAT;
+    loadOptions.optimizeMeshes = true; // same pipeline as 03_benchmarks/bake_mesh_cache, so a baked cache is picked up
+    loadOptions.buildPickingBvh = !benchmark.enabled; // left click picks the triangle under the cursor
+    loadOptions.lodLevels = LOD_LEVELS; // built on the first import and kept in the mesh cache
+    loadOptions.geometryArena = GEOMETRY_ARENA;
+    loadOptions.skinning = MODEL_SKINNING;
+    loadOptions.releaseCpuCopies = RELEASE_CPU_GEOMETRY;
    //Model ourModel(FileSystem::getPath("data/cyborg/cyborg.obj"));
     //Model ourModel(FileSystem::getPath("data/nanosuit/nanosuit.obj"));
     //Model ourModel(FileSystem::getPath("data/planet/planet.obj"));
     // Model ourModel(FileSystem::getPath("data/EsquiloNormal/EsquiloNormal.obj"));
      //Model ourModel(FileSystem::getPath("data/PandaNormal/PandaNormal.obj"));
-    Model ourModel(FileSystem::getPath(content));
+    std::chrono::steady_clock::time_point loadStart = std::chrono::steady_clock::now();
+    Model ourModel(FileSystem::getPath(content), false, loadOptions);
+    std::chrono::steady_clock::time_point loadEnd = std::chrono::steady_clock::now();
+    TextureRegistry::shared().printStats(std::cout);
+    ourModel.printMemoryStats(std::cout, "model");
    // Model ourModel(FileSystem::getPath("data/TerrenoNormal/parqueNormal.obj"));
    //  Model ourModel(FileSystem::getPath("data/TenisNormal/TenisNormal.obj"));
 
+    // build and compile shaders
+    // -------------------------
+    // after the model, whose vertex layout picks the variant: rigged models draw float vertices, skinned on the GPU
+    // with SKINNED. --instances draws the model with Model::DrawInstanced, which needs the matching instanced shader
+    // variant (and keeps plain uniforms); the render queue path reads its uniforms from the FrameBlock / DrawBlock of
+    // UNIFORM_BLOCKS
+    bool uniformBlocks = UNIFORM_BLOCKS && !benchmark.instances;
+    std::string shaderDefines;
+    if (MODEL_VERTEX_FORMAT == VERTEX_FORMAT_PACKED && !ourModel.skinned())
+        shaderDefines += "#define PACKED_VERTICES\n";
+    if (ourModel.skinned() && MODEL_SKINNING == SKINNING_GPU)
+        shaderDefines += "#define SKINNED\n";
+    if (benchmark.instances)
+        shaderDefines += STRESS_INSTANCE_FORMAT == INSTANCE_TRS ? "#define INSTANCED_TRS\n" : "#define INSTANCED\n";
+    if (uniformBlocks)
+        shaderDefines += "#define UNIFORM_BLOCKS\n";
+    Shader ourShader("1.model_loading.vs", "1.model_loading.fs", nullptr, shaderDefines.empty() ? nullptr : shaderDefines.c_str());
+    Shader skyboxShader("6.1.skybox.vs", "6.1.skybox.fs");
+
     // draw in wireframe
     //glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
@@ -160,7 +252,7 @@ int main()
     unsigned int skyboxVAO, skyboxVBO;
     glGenVertexArrays(1, &skyboxVAO);
     glGenBuffers(1, &skyboxVBO);
-    glBindVertexArray(skyboxVAO);
+    glState.bindVertexArray(skyboxVAO);
     glBindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), &skyboxVertices, GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
@@ -176,10 +268,185 @@ int main()
         FileSystem::getPath("data/textures/skybox/back.jpg")
     };
     unsigned int cubemapTexture = loadCubemap(faces);
+    if (benchmark.enabled)
+    {
+        textureStreamer.finish(); // every frame of a benchmark run shows the final textures
+        ourModel.updateTextures();
+    }
+    std::chrono::steady_clock::time_point uploadEnd = std::chrono::steady_clock::now();
 
     skyboxShader.use();
     skyboxShader.setInt("skybox", 0);
 
+    // resolve uniform locations once; the render loop only passes these handles around
+    UniformHandle projectionLoc = ourShader.uniform("projection");
+    UniformHandle viewLoc = ourShader.uniform("view");
+    UniformHandle modelLoc = ourShader.uniform("model");
+    UniformHandle matColorLoc = ourShader.uniform("matColor");
+    UniformHandle lerpIntensityLoc = ourShader.uniform("lerpIntensity");
+    UniformHandle viewPosLoc = ourShader.uniform("viewPos");
+    UniformHandle lightColorLoc = ourShader.uniform("lightColor");
+    UniformHandle lightPosLoc = ourShader.uniform("lightPos");
+    UniformHandle skyboxViewLoc = skyboxShader.uniform("view");
+    UniformHandle skyboxProjectionLoc = skyboxShader.uniform("projection");
+
+    glm::mat4 model;
+    model = glm::translate(model, glm::vec3(0.0f, -1.75f, 0.0f)); // translate it down so it's at the center of the scene
+    model = glm::scale(model, glm::vec3(0.2f, 0.2f, 0.2f));	// it's a bit too big for our scene, so scale it down
+
+    ourModel.lodSettings.triangleBudget = LOD_TRIANGLE_BUDGET;
+
+    // stress mode: a square field of copies around the single model's place, each turned at random
+    vector<InstanceTRS> instances;
+    vector<glm::mat4> instanceMatrices;
+    if (benchmark.instances)
+    {
+        glm::vec3 low(FLT_MAX), high(-FLT_MAX);
+        for (unsigned int i = 0; i < ourModel.meshes.size(); i++)
+        {
+            low = glm::min(low, ourModel.meshes[i].bounds.min);
+            high = glm::max(high, ourModel.meshes[i].bounds.max);
+        }
+        const float scale = 0.2f;
+        float spacing = std::max(high.x - low.x, high.z - low.z) * scale * 1.25f;
+        unsigned int side = (unsigned int)std::ceil(std::sqrt((double)benchmark.instances));
+        std::mt19937 random(7); // fixed, so benchmark runs draw the same field
+        std::uniform_real_distribution<float> angle(0.0f, 6.2831853f);
+        for (unsigned int i = 0; i < benchmark.instances; i++)
+        {
+            glm::vec3 position((i % side - (side - 1) * 0.5f) * spacing, -1.75f, (i / side - (side - 1) * 0.5f) * spacing);
+            glm::quat rotation = glm::angleAxis(angle(random), glm::vec3(0.0f, 1.0f, 0.0f));
+            if (STRESS_INSTANCE_FORMAT == INSTANCE_TRS)
+                instances.push_back(makeInstanceTRS(position, scale, rotation));
+            else
+                instanceMatrices.push_back(glm::translate(glm::mat4(), position) * glm::mat4_cast(rotation) * glm::scale(glm::mat4(), glm::vec3(scale)));
+        }
+        std::cout << "INSTANCING:: " << benchmark.instances << " copies, " << side << " x " << side << " grid" << std::endl;
+    }
+    float viewportHeight = (float)(benchmark.enabled ? benchmark.height : SCR_HEIGHT);
+
+    // the model's meshes go through a render queue: sorted by program, textures, VAO and depth, binds filtered by glState
+    RenderQueue renderQueue;
+    std::vector<double> stateChanges, stateChangesSaved; // per frame, for the benchmark results
+    // a frame's FrameUniforms and at most one DrawUniforms per mesh, persistently mapped on GL 4.4
+    UniformRing uniformRing(sizeof(FrameUniforms) + ourModel.meshes.size() * sizeof(DrawUniforms));
+    size_t uniformFrameBytes = uniformRing.aligned(sizeof(FrameUniforms)) + ourModel.meshes.size() * uniformRing.aligned(sizeof(DrawUniforms));
+    if (uniformBlocks)
+        std::cout << "UNIFORM_RING:: " << (uniformRing.persistent() ? "persistent mapping" : "glBufferSubData orphaning") << std::endl;
+
+    // CPU/GPU timing scopes of the viewer; off in benchmark mode, which times whole frames itself
+    Profiler profiler(!benchmark.enabled);
+
+    // draws the model and the skybox for one frame, seen from eye and animated to seconds (the wall clock in the
+    // viewer, a fixed step per frame in the benchmark)
+    auto renderScene = [&](const glm::mat4 &view, const glm::vec3 &eye, float aspect, float seconds) {
+        ResetDrawCounters(); // per frame draw calls and binds, shown in the window title
+        glState.resetCounters(); // GL state calls issued and skipped this frame, also in the title
+        glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        // don't forget to enable shader before setting uniforms
+        ourShader.use();
+
+        // view/projection transformations
+        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), aspect, 0.1f, 1000.0f);
+        glm::vec3 color = glm::vec3(0.8f, 0.8f, 0.8f);
+        glm::vec3 lightPos(-5.0f, -5.75f, 0.0f);
+        profiler.begin("uniforms", PROFILE_CPU | PROFILE_GPU);
+        if (uniformBlocks)
+        {
+            // one FrameUniforms for the whole frame; the render queue adds the DrawUniforms of the meshes
+            uniformRing.beginFrame(uniformFrameBytes);
+            FrameUniforms frame = {};
+            frame.projection = projection;
+            frame.view = view;
+            frame.viewPos = eye;
+            frame.lerpIntensity = ColorLerp;
+            frame.lightPos = lightPos;
+            frame.lightColor = glm::vec3(1.0f, 1.0f, 1.0f);
+            frame.matColor = color;
+            GLintptr frameBlock = uniformRing.allocate(&frame, sizeof(frame));
+            uniformRing.bind(UNIFORM_BLOCK_FRAME, frameBlock, sizeof(frame));
+        }
+        else
+        {
+            ourShader.setMat4(projectionLoc, projection);
+            ourShader.setMat4(viewLoc, view);
+
+            // render the loaded model
+            ourShader.setMat4(modelLoc, model);
+            ourShader.setVec3(matColorLoc, color);
+            ourShader.setFloat(lerpIntensityLoc, ColorLerp);
+            ourShader.setVec3(viewPosLoc, eye);
+
+            //ourShader.setVec3("objectColor", 1.0f, 0.5f, 0.31f);
+            ourShader.setVec3(lightColorLoc, 1.0f, 1.0f, 1.0f);
+
+            ourShader.setVec3(lightPosLoc, lightPos);
+        }
+        profiler.end(); // uniforms
+
+        // meshes outside the view frustum are skipped, the others drawn at the LOD their distance allows
+        LodView lodView;
+        lodView.eye = eye;
+        lodView.fovY = glm::radians(camera.Zoom);
+        lodView.viewportHeight = viewportHeight;
+        ourModel.lodSettings.pixelError = lodPixelError;
+        profiler.begin("Model::Draw", PROFILE_CPU | PROFILE_GPU);
+        {
+            ProfileScope animateScope(profiler, "Model::Animate");
+            ourModel.Animate(0, seconds); // nothing to do unless the model is rigged
+        }
+        if (!instances.empty())
+            ourModel.DrawInstanced(ourShader, instances.data(), instances.size());
+        else if (!instanceMatrices.empty())
+            ourModel.DrawInstanced(ourShader, instanceMatrices.data(), instanceMatrices.size());
+        else
+        {
+            renderQueue.clear();
+            ourModel.Enqueue(renderQueue, ourShader, projection * view, model, lodView);
+            renderQueue.flush(glState, uniformBlocks ? &uniformRing : nullptr);
+            if (benchmark.enabled)
+            {
+                stateChanges.push_back(renderQueue.stats().stateChanges);
+                stateChangesSaved.push_back(renderQueue.stats().stateChangesSaved);
+            }
+        }
+        profiler.end(); // Model::Draw
+        profiler.begin("skybox", PROFILE_CPU | PROFILE_GPU);
+        glState.depthFunc(GL_LEQUAL);  // change depth function so depth test passes when values are equal to depth buffer's content
+        skyboxShader.use();
+        skyboxShader.setMat4(skyboxViewLoc, glm::mat4(glm::mat3(view))); // remove translation from the view matrix
+        skyboxShader.setMat4(skyboxProjectionLoc, projection);
+        // skybox cube
+        glState.bindVertexArray(skyboxVAO);
+        glState.bindTexture(0, GL_TEXTURE_CUBE_MAP, cubemapTexture);
+        glDrawArrays(GL_TRIANGLES, 0, 36);
+        glState.depthFunc(GL_LESS); // set depth function back to default
+        profiler.end(); // skybox
+        if (uniformBlocks)
+            uniformRing.endFrame();
+    };
+
+    if (benchmark.enabled)
+    {
+        BenchmarkResults results;
+        results.model = content;
+        results.loadMs = std::chrono::duration<double, std::milli>(loadEnd - loadStart).count();
+        results.uploadMs = std::chrono::duration<double, std::milli>(uploadEnd - loadEnd).count();
+        bool succeeded = runHeadlessBenchmark(benchmark, results, renderScene);
+        results.stateChanges = stateChanges;
+        results.stateChangesSaved = stateChangesSaved;
+        succeeded = succeeded && writeBenchmarkResults(results, benchmark.outputPath);
+        return succeeded ? 0 : -1;
+    }
+
+#ifdef PROFILER_OVERLAY
+    // the rolling statistics over the frame; P hides them
+    ProfilerOverlay profilerOverlay(PROFILER_FONT, "profiler_overlay.vs", "profiler_overlay.fs");
+#endif
+
+    float lastTitleUpdate = 0.0f;
     while (!glfwWindowShouldClose(window))
     {
         // per-frame time logic
@@ -187,67 +454,92 @@ int main()
         float currentFrame = glfwGetTime();
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
-        
+        profiler.beginFrame();
         
         // input
         // -----
+        profiler.begin("input", PROFILE_CPU);
         processInput(window);
-  
-
-        // render
-        // ------
-        glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        // don't forget to enable shader before setting uniforms
-        ourShader.use();
+        // left click: ray cast from the camera through the cursor (the screen centre while it is captured)
+        if (glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS && !pickPressed)
+        {
+            glm::vec3 rayOrigin, rayDirection;
+            cursorRay(window, rayOrigin, rayDirection);
+            ModelPick picked;
+            std::chrono::steady_clock::time_point pickStart = std::chrono::steady_clock::now();
+            bool hit = ourModel.pick(rayOrigin, rayDirection, model, picked);
+            double pickMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - pickStart).count();
+            if (hit)
+                std::cout << "PICK:: mesh " << picked.mesh << ", triangle " << picked.hit.triangle << " at (" << picked.position.x << ", "
+                          << picked.position.y << ", " << picked.position.z << "), " << pickMs << " ms" << std::endl;
+            else
+                std::cout << "PICK:: nothing under the cursor, " << pickMs << " ms" << std::endl;
+            pickPressed = true;
+        }
+        if (glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_RELEASE) pickPressed = false;
+        profiler.end(); // input
 
-        // view/projection transformations
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 1000.0f);
-        glm::mat4 view = camera.GetViewMatrix();
-        ourShader.setMat4("projection", projection);
-        ourShader.setMat4("view", view);
-
-        // render the loaded model
-        glm::mat4 model;
-        model = glm::translate(model, glm::vec3(0.0f, -1.75f, 0.0f)); // translate it down so it's at the center of the scene
-        model = glm::scale(model, glm::vec3(0.2f, 0.2f, 0.2f));	// it's a bit too big for our scene, so scale it down
-        ourShader.setMat4("model", model);
-        glm::vec3 color = glm::vec3(0.8f, 0.8f, 0.8f);
-        ourShader.setVec3("matColor", color);
-        ourShader.setFloat("lerpIntensity", ColorLerp);
-        ourShader.setVec3("viewPos", camera.Position);
+        // upload whatever textures finished decoding, within this frame's budget
+        {
+            ProfileScope uploadScope(profiler, "texture uploads");
+            textureStreamer.update(TEXTURE_UPLOAD_BUDGET);
+            ourModel.updateTextures(); // duplicates found by the decoders since the last frame
+        }
 
-        //ourShader.setVec3("objectColor", 1.0f, 0.5f, 0.31f);
-        ourShader.setVec3("lightColor", 1.0f, 1.0f, 1.0f);
-        
-        glm::vec3 lightPos(-5.0f, -5.75f, 0.0f);
+        // render
+        // ------
+        renderScene(camera.GetViewMatrix(), camera.Position, (float)SCR_WIDTH / (float)SCR_HEIGHT, (float)glfwGetTime());
 
-        ourShader.setVec3("lightPos", lightPos);
+        // show how many meshes the frustum culling let through, a few times per second
+        if (currentFrame - lastTitleUpdate > 0.25f)
+        {
+            CullStats cull = ourModel.cullStats();
+            std::string title = content + " - " + std::to_string(cull.visible) + " meshes drawn, " + std::to_string(cull.culled) + " culled, " +
+                                std::to_string(ourModel.drawnTriangles()) + " triangles";
+            if (benchmark.instances)
+                title = content + " - " + std::to_string(benchmark.instances) + " instances, " + std::to_string(ourModel.drawnTriangles()) + " triangles";
+            const DrawCounters &counters = drawCounters();
+            title += ", " + std::to_string(counters.drawCalls) + " draws, " + std::to_string(counters.vaoBinds) + " VAO binds, " +
+                     std::to_string(counters.textureBinds) + " texture binds";
+            if (!benchmark.instances)
+                title += ", " + std::to_string(renderQueue.stats().stateChanges) + " state changes (" +
+                         std::to_string(renderQueue.stats().stateChangesSaved) + " saved)";
+            title += ", GL state calls " + std::to_string(glState.counters().issued) + " issued / " +
+                     std::to_string(glState.counters().skipped) + " skipped";
+            glfwSetWindowTitle(window, title.c_str());
+            lastTitleUpdate = currentFrame;
+        }
 
-        ourModel.Draw(ourShader);
-        glDepthFunc(GL_LEQUAL);  // change depth function so depth test passes when values are equal to depth buffer's content
-        skyboxShader.use();
-        view = glm::mat4(glm::mat3(camera.GetViewMatrix())); // remove translation from the view matrix
-        skyboxShader.setMat4("view", view);
-        skyboxShader.setMat4("projection", projection);
-        // skybox cube
-        glBindVertexArray(skyboxVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
-        glDepthFunc(GL_LESS); // set depth function back to default
+#ifdef PROFILER_OVERLAY
+        if (showProfiler)
+        {
+            ProfileScope overlayScope(profiler, "overlay");
+            int framebufferWidth, framebufferHeight;
+            glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+            profilerOverlay.draw(profiler, framebufferWidth, framebufferHeight);
+        }
+#endif
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
         // -------------------------------------------------------------------------------
+        profiler.begin("swap", PROFILE_CPU); // waits here for vsync, or for the GPU to catch up
         glfwSwapBuffers(window);
         glfwPollEvents();
+        profiler.end(); // swap
+        profiler.endFrame();
+        if (traceRequested)
+        {
+            profiler.writeChromeTrace(PROFILER_TRACE);
+            traceRequested = false;
+        }
+        if (memoryRequested)
+        {
+            ourModel.printMemoryStats(std::cout, "model", true);
+            PrintProcessMemory(std::cout);
+            memoryRequested = false;
+        }
     }
-
-    // glfw: terminate, clearing all previously allocated GLFW resources.
-    // ------------------------------------------------------------------
-    glfwTerminate();
     return 0;
 }
 
@@ -296,6 +588,31 @@ void processInput(GLFWwindow *window)
     if(glfwGetKey(window, GLFW_KEY_M) == GLFW_RELEASE) togglePressed = false;
     
 
+    if (glfwGetKey(window, GLFW_KEY_C) == GLFW_PRESS && !cursorTogglePressed) {
+        cursorCaptured = !cursorCaptured;
+        glfwSetInputMode(window, GLFW_CURSOR, cursorCaptured ? GLFW_CURSOR_DISABLED : GLFW_CURSOR_NORMAL);
+        firstMouse = true;
+        cursorTogglePressed = true;
+    }
+    if (glfwGetKey(window, GLFW_KEY_C) == GLFW_RELEASE) cursorTogglePressed = false;
+
+    bool lodKey = glfwGetKey(window, GLFW_KEY_LEFT_BRACKET) == GLFW_PRESS || glfwGetKey(window, GLFW_KEY_RIGHT_BRACKET) == GLFW_PRESS;
+    if (lodKey && !lodKeyPressed) {
+        lodPixelError *= glfwGetKey(window, GLFW_KEY_RIGHT_BRACKET) == GLFW_PRESS ? 2.0f : 0.5f;
+        std::cout << "LOD:: pixel error " << lodPixelError << std::endl;
+    }
+    lodKeyPressed = lodKey;
+
+    if (glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS && !profilerKeyPressed)
+        showProfiler = !showProfiler;
+    profilerKeyPressed = glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS;
+    if (glfwGetKey(window, GLFW_KEY_T) == GLFW_PRESS && !traceKeyPressed)
+        traceRequested = true;
+    traceKeyPressed = glfwGetKey(window, GLFW_KEY_T) == GLFW_PRESS;
+    if (glfwGetKey(window, GLFW_KEY_I) == GLFW_PRESS && !memoryKeyPressed)
+        memoryRequested = true;
+    memoryKeyPressed = glfwGetKey(window, GLFW_KEY_I) == GLFW_PRESS;
+
     if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
         camera.ProcessKeyboard(FORWARD, deltaTime);
     if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
@@ -319,6 +636,9 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 // -------------------------------------------------------
 void mouse_callback(GLFWwindow* window, double xpos, double ypos)
 {
+    if (!cursorCaptured)
+        return;
+
     if (firstMouse)
     {
         lastX = xpos;
@@ -335,6 +655,27 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos)
     camera.ProcessMouseMovement(xoffset, yoffset);
 }
 
+// world space ray from the camera through the cursor, or through the screen centre while the cursor is captured
+// ---------------------------------------------------------------------------------------------------------------
+void cursorRay(GLFWwindow *window, glm::vec3 &origin, glm::vec3 &direction)
+{
+    int width, height;
+    glfwGetWindowSize(window, &width, &height);
+    double x = width * 0.5, y = height * 0.5;
+    if (!cursorCaptured)
+        glfwGetCursorPos(window, &x, &y);
+    float ndcX = 2.0f * (float)x / (float)width - 1.0f;
+    float ndcY = 1.0f - 2.0f * (float)y / (float)height;
+
+    // same projection as the render loop; unproject the cursor on the near and far planes
+    glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 1000.0f);
+    glm::mat4 unproject = glm::inverse(projection * camera.GetViewMatrix());
+    glm::vec4 nearPoint = unproject * glm::vec4(ndcX, ndcY, -1.0f, 1.0f);
+    glm::vec4 farPoint = unproject * glm::vec4(ndcX, ndcY, 1.0f, 1.0f);
+    origin = glm::vec3(nearPoint) / nearPoint.w;
+    direction = glm::normalize(glm::vec3(farPoint) / farPoint.w - origin);
+}
+
 // glfw: whenever the mouse scroll wheel scrolls, this callback is called
 // ----------------------------------------------------------------------
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
@@ -355,7 +696,7 @@ unsigned int loadCubemap(vector<std::string> faces)
 {
     unsigned int textureID;
     glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+    SharedGLState().bindTexture(0, GL_TEXTURE_CUBE_MAP, textureID);
 
     int width, height, nrChannels;
     for (unsigned int i = 0; i < faces.size(); i++)
@@ -0,0 +1,12 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+in vec4 Color;
+
+uniform sampler2D glyphs; // coverage in the red channel; the panel quads sample a fully covered texel
+
+void main()
+{
+    FragColor = vec4(Color.rgb, Color.a * texture(glyphs, TexCoords).r);
+}
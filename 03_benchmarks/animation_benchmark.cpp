@@ -0,0 +1,180 @@
+/*
+Animation sampling benchmark.
+Measures how many instances of an animated skeleton one thread poses per millisecond with the samplers of
+utils/skeleton.h and utils/animation_sampler.h, on a synthetic rig so it runs without a rigged asset or a GL context:
+ - "binary search": SampleClip, every track searched for every pose
+ - "cursor":        SampleClip with an AnimationCursor per instance, stepping forward from the last keys
+ - "compressed":    SampleCompressedClip on the clip resampled at 30 frames/s, quantised
+Every instance plays the same clip from its own start time and advances 1/60 s per frame, looping. Each sampler is
+timed alone and followed by BuildSkinPalette (the whole CPU pose); each case repeats until it has run for at least
+0.5 s. Before timing, the cursor poses are checked to equal the binary search ones over a few loops of the clip, and
+the largest position and rotation errors of the compressed clip are printed with its size.
+Usage: animation_benchmark [instances] [bones] [keys per second]
+Dependencies:
+GLM and the GL3W headers (skeleton.h includes mesh.h); no GL context.
+*/
+#include <GL/gl3w.h> // here: we need compile gl3w.c - utils dir
+
+#include <skeleton.h>
+#include <animation_sampler.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+// runs body until 0.5 s have passed and returns the seconds per call
+template<typename F>
+double timePerCall(F body)
+{
+    body(); // warm-up
+    size_t calls = 0;
+    Clock::time_point start = Clock::now();
+    double elapsed = 0.0;
+    do
+    {
+        body();
+        calls++;
+        elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    } while(elapsed < 0.5);
+    return elapsed / calls;
+}
+
+// every node hangs off a random earlier one and sways and bobs over a four second clip. Keys are spaced unevenly, as
+// exporters leave them after key reduction, and the scale track is a single key, as it usually is.
+void buildRig(unsigned int bones, float keysPerSecond, std::mt19937 &random, Skeleton &skeleton, AnimationClip &clip)
+{
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    clip.name = "synthetic";
+    clip.ticksPerSecond = 1000.0f;
+    clip.duration = 4000.0f;
+    unsigned int keys = std::max(2u, (unsigned int)(keysPerSecond * 4.0f));
+    for(unsigned int i = 0; i < bones; i++)
+    {
+        SkeletonNode node;
+        node.name = "bone" + std::to_string(i);
+        node.parent = i ? (int)(random() % i) : -1;
+        node.transform = glm::translate(glm::mat4(), glm::vec3(unit(random), unit(random), unit(random)) * 0.2f);
+        skeleton.nodes.push_back(node);
+        skeleton.nodeIndex[node.name] = i;
+        skeleton.addBone(node.name, glm::inverse(node.transform));
+
+        AnimationChannel channel;
+        channel.node = i;
+        glm::vec3 axis = glm::normalize(glm::vec3(unit(random), unit(random), unit(random)));
+        glm::vec3 rest = glm::vec3(node.transform[3]);
+        for(unsigned int k = 0; k < keys; k++)
+        {
+            float jitter = k > 0 && k + 1 < keys ? 0.3f * unit(random) : 0.0f; // the first and last keys stay at the ends
+            float time = (k + jitter) * clip.duration / (keys - 1);
+            float phase = time / clip.duration * 6.2831853f;
+            channel.positions.add(time, rest + glm::vec3(0.0f, 0.05f * std::sin(phase * 2.0f), 0.0f));
+            channel.rotations.add(time, glm::angleAxis(1.2f * std::sin(phase + i), axis));
+        }
+        channel.scales.add(0.0f, glm::vec3(1.0f));
+        clip.channels.push_back(channel);
+        clip.nodeChannel.push_back((int)i);
+    }
+    skeleton.globalInverse = glm::mat4();
+}
+
+// rotation part of a local transform, for comparing poses
+float rotationError(const glm::mat4 &a, const glm::mat4 &b)
+{
+    float d = std::fabs(glm::dot(glm::quat_cast(glm::mat3(a)), glm::quat_cast(glm::mat3(b))));
+    return 2.0f * std::acos(std::min(d, 1.0f));
+}
+
+void report(const char *name, unsigned int instances, double seconds, double posedSeconds)
+{
+    std::printf("%-16s %10.1f instances/ms sampling %10.1f instances/ms with BuildSkinPalette\n", name,
+                instances / (seconds * 1e3), instances / (posedSeconds * 1e3));
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int instanceCount = argc > 1 ? (unsigned int)std::atoi(argv[1]) : 500;
+    unsigned int boneCount = argc > 2 ? (unsigned int)std::atoi(argv[2]) : 64;
+    float keysPerSecond = argc > 3 ? (float)std::atof(argv[3]) : 30.0f;
+    if(instanceCount == 0 || boneCount == 0 || keysPerSecond <= 0.0f)
+    {
+        std::printf("usage: animation_benchmark [instances] [bones] [keys per second]\n");
+        return -1;
+    }
+
+    std::mt19937 random(11);
+    Skeleton skeleton;
+    AnimationClip clip;
+    buildRig(boneCount, keysPerSecond, random, skeleton, clip);
+    CompressedClip compressed;
+    CompressClip(clip, 30.0f, compressed);
+    std::vector<float> start(instanceCount);
+    std::uniform_real_distribution<float> offset(0.0f, 4.0f);
+    for(unsigned int i = 0; i < instanceCount; i++)
+        start[i] = offset(random);
+    std::printf("%u instances, %u bones, %zu keys per track, %zu bytes of keys, %zu bytes compressed at 30 frames/s\n",
+                instanceCount, boneCount, clip.channels[0].rotations.size(), AnimationClipBytes(clip), compressed.bytes());
+
+    // the cursor must land on the keys the search finds, through several loops and a seek back
+    std::vector<glm::mat4> local, reference, global, palette;
+    AnimationCursor check;
+    float positionError = 0.0f, angleError = 0.0f;
+    for(unsigned int frame = 0; frame < 1000; frame++)
+    {
+        float seconds = frame == 500 ? 1.3f : frame / 60.0f;
+        SampleClip(clip, skeleton, seconds, reference);
+        SampleClip(clip, skeleton, seconds, check, local);
+        for(unsigned int b = 0; b < boneCount; b++)
+            if(local[b] != reference[b])
+            {
+                std::printf("ERROR::ANIMATION_BENCHMARK:: cursor and binary search disagree at %g s, node %u\n", seconds, b);
+                return -1;
+            }
+        SampleCompressedClip(compressed, skeleton, seconds, local);
+        for(unsigned int b = 0; b < boneCount; b++)
+        {
+            positionError = std::max(positionError, glm::length(glm::vec3(local[b][3] - reference[b][3])));
+            angleError = std::max(angleError, rotationError(local[b], reference[b]));
+        }
+    }
+    std::printf("cursor matches binary search; compressed: largest position error %g, rotation error %g degrees\n",
+                positionError, glm::degrees(angleError));
+
+    std::vector<AnimationCursor> cursors(instanceCount);
+    float time = 0.0f;
+    bool posed = false;
+    // one frame of every instance with sample(instance, seconds)
+    auto frame = [&](auto sample) {
+        time += 1.0f / 60.0f;
+        for(unsigned int i = 0; i < instanceCount; i++)
+        {
+            sample(i, start[i] + time);
+            if(posed)
+                BuildSkinPalette(skeleton, local, global, palette);
+        }
+    };
+    auto search = [&](unsigned int, float seconds) { SampleClip(clip, skeleton, seconds, local); };
+    auto cursor = [&](unsigned int i, float seconds) { SampleClip(clip, skeleton, seconds, cursors[i], local); };
+    auto packed = [&](unsigned int, float seconds) { SampleCompressedClip(compressed, skeleton, seconds, local); };
+
+    double searchTime = timePerCall([&]() { frame(search); });
+    double cursorTime = timePerCall([&]() { frame(cursor); });
+    double packedTime = timePerCall([&]() { frame(packed); });
+    posed = true;
+    double searchPosed = timePerCall([&]() { frame(search); });
+    double cursorPosed = timePerCall([&]() { frame(cursor); });
+    double packedPosed = timePerCall([&]() { frame(packed); });
+    report("binary search", instanceCount, searchTime, searchPosed);
+    report("cursor", instanceCount, cursorTime, cursorPosed);
+    report("compressed", instanceCount, packedTime, packedPosed);
+    return 0;
+}
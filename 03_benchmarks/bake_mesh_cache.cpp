@@ -0,0 +1,150 @@
+/*
+Offline mesh cache baker.
+Imports the given models with Assimp, runs the CPU mesh pipeline Model would run (Model::runMeshPipeline: vertex
+welding and, by default, the mesh_optimizer.h passes and a 4 level LOD chain per mesh) and writes <model>.meshcache next to each one, printing the
+post-transform cache ACMR/ATVR of every mesh before and after. No window or GL context is needed, so this can run
+in CI; Model then picks the baked cache up as long as it is loaded with the same ModelLoadOptions and through the
+same path (FileSystem::getPath(<path relative to the repository root>), like 04_model_loading).
+Usage: bake_mesh_cache [--no-optimize] [--lods N] [model paths relative to the repository root...]
+       --lods 0 bakes no LOD chains
+       without model arguments every model listed in 02_model_loading/file.txt is baked
+Dependencies:
+GLM and Assimp, like 04_model_loading.
+*/
+#define STB_IMAGE_IMPLEMENTATION
+#include <GL/gl3w.h> // here: we need compile gl3w.c - utils dir
+
+#include <filesystem.h>
+#include <model.h>
+#include <mesh_cache.h>
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// what writeMeshCache needs of a Mesh, without the GL buffers
+struct BakedMesh {
+    vector<Vertex> vertices;
+    vector<unsigned int> indices;
+    vector<Texture> textures; // only type and path are used
+    MeshLodChain lodChain;
+};
+
+// same depth-first order as Model::processNode
+void collectMeshes(const aiNode *node, const aiScene *scene, vector<const aiMesh*> &order)
+{
+    for(unsigned int i = 0; i < node->mNumMeshes; i++)
+        order.push_back(scene->mMeshes[node->mMeshes[i]]);
+    for(unsigned int i = 0; i < node->mNumChildren; i++)
+        collectMeshes(node->mChildren[i], scene, order);
+}
+
+// same material slots, in the same order, as Model::processMaterial
+void collectTextures(const aiMaterial *material, vector<Texture> &textures)
+{
+    static const aiTextureType types[] = { aiTextureType_DIFFUSE, aiTextureType_SPECULAR, aiTextureType_HEIGHT, aiTextureType_AMBIENT };
+    static const char *names[] = { "texture_diffuse", "texture_specular", "texture_normal", "texture_height" };
+    for(unsigned int slot = 0; slot < 4; slot++)
+    {
+        for(unsigned int i = 0; i < material->GetTextureCount(types[slot]); i++)
+        {
+            Texture texture;
+            texture.id = 0;
+            texture.type = names[slot];
+            material->GetTexture(types[slot], i, &texture.path);
+            textures.push_back(texture);
+        }
+    }
+}
+
+bool bakeModel(const std::string &modelPath, const ModelLoadOptions &options)
+{
+    std::string path = FileSystem::getPath(modelPath);
+    Assimp::Importer importer;
+    const aiScene *scene = importer.ReadFile(path, MODEL_IMPORT_FLAGS);
+    if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+    {
+        std::cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << std::endl;
+        return false;
+    }
+
+    vector<const aiMesh*> order;
+    collectMeshes(scene->mRootNode, scene, order);
+    for(unsigned int i = 0; i < order.size(); i++)
+        if(order[i]->mNumBones)
+        {
+            // Model never reads the cache of a rigged model: it needs the skeleton and animations from Assimp
+            std::cout << modelPath << ": skipped, rigged models are not cached" << std::endl;
+            return true;
+        }
+    vector<BakedMesh> meshes(order.size());
+    vector<MeshPipelineReport> reports(order.size());
+    std::cout << modelPath << ": " << order.size() << " meshes" << std::endl;
+    for(unsigned int i = 0; i < order.size(); i++)
+    {
+        BakedMesh &mesh = meshes[i];
+        Model::processMesh(order[i], mesh.vertices, mesh.indices);
+        reports[i] = Model::runMeshPipeline(options, mesh.vertices, mesh.indices, &mesh.lodChain);
+        collectTextures(scene->mMaterials[order[i]->mMaterialIndex], mesh.textures);
+    }
+    Model::printPipelineReports(reports);
+
+    if(!writeMeshCache(path, options.cacheKey(), meshes))
+    {
+        std::cout << "ERROR::BAKE:: could not write " << meshCachePath(path) << std::endl;
+        return false;
+    }
+    std::cout << "  wrote " << meshCachePath(path) << std::endl;
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    ModelLoadOptions options;
+    options.optimizeMeshes = true;
+    options.lodLevels = 4; // what 04_model_loading loads with
+    std::vector<std::string> models;
+    for(int i = 1; i < argc; i++)
+    {
+        if(std::strcmp(argv[i], "--no-optimize") == 0)
+            options.optimizeMeshes = false;
+        else if(std::strcmp(argv[i], "--lods") == 0 && i + 1 < argc)
+            options.lodLevels = (unsigned int)std::atoi(argv[++i]);
+        else
+            models.push_back(argv[i]);
+    }
+    if(models.empty())
+    {
+        std::ifstream list(FileSystem::getPath("02_model_loading/file.txt"));
+        std::string line;
+        while(std::getline(list, line))
+        {
+            if(!line.empty() && line[line.size() - 1] == '\r')
+                line.erase(line.size() - 1);
+            if(!line.empty())
+                models.push_back(line);
+        }
+    }
+    if(models.empty())
+    {
+        std::cout << "usage: bake_mesh_cache [--no-optimize] [--lods N] [model paths relative to the repository root...]" << std::endl;
+        return -1;
+    }
+
+    std::cout << std::setprecision(3);
+    int failed = 0;
+    for(unsigned int i = 0; i < models.size(); i++)
+    {
+        if(!bakeModel(models[i], options))
+            failed++;
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,246 @@
+/*
+BVH benchmark.
+Builds utils/bvh.h over synthetic scenes of 1k to 1M random boxes (constant density, so the frusta and rays see a
+similar amount of the scene at every size) and times, per scene:
+ - the binned SAH build, its node count and SAH cost
+ - frustum queries against the linear BoundsArray::cull Model uses for small models
+ - closest box along a ray and box overlap queries against brute force (on a subset, the brute force is slow)
+ - refit after every box moved a little, and update() after every box moved somewhere else entirely
+The BVH results are checked against the brute force ones; a mismatch is reported and fails the run.
+Nothing is drawn, no window or GL context is needed.
+Usage: bvh_benchmark [largest scene, in boxes (default 1000000)]
+Dependencies:
+GLM.
+*/
+#include <bvh.h>
+#include <frustum.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+double millisecondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// count boxes of size 0.2..1 scattered through a cube sized for about one box per 8 unit cells
+void makeScene(size_t count, std::mt19937 &random, float &side, std::vector<BoundingBox> &boxes)
+{
+    side = 2.0f * std::cbrt((float)count);
+    std::uniform_real_distribution<float> position(0.0f, side), size(0.2f, 1.0f);
+    boxes.resize(count);
+    for(size_t i = 0; i < count; i++)
+    {
+        glm::vec3 center(position(random), position(random), position(random));
+        glm::vec3 half(size(random) * 0.5f, size(random) * 0.5f, size(random) * 0.5f);
+        boxes[i].min = center - half;
+        boxes[i].max = center + half;
+    }
+}
+
+// a camera inside the scene looking somewhere random, seeing about a fixed distance
+Frustum randomFrustum(std::mt19937 &random, float side)
+{
+    std::uniform_real_distribution<float> position(0.0f, side), direction(-1.0f, 1.0f);
+    glm::vec3 eye(position(random), position(random), position(random));
+    glm::vec3 forward(direction(random), direction(random), direction(random) + 0.01f);
+    glm::mat4 view = glm::lookAt(eye, eye + glm::normalize(forward), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 40.0f);
+    return extractFrustum(projection * view);
+}
+
+bool boxInFrustum(const Frustum &frustum, const BoundingBox &box)
+{
+    glm::vec3 center = (box.min + box.max) * 0.5f, extent = (box.max - box.min) * 0.5f;
+    for(int i = 0; i < 6; i++)
+    {
+        const glm::vec4 &p = frustum.planes[i];
+        if(p.x * center.x + p.y * center.y + p.z * center.z + p.w + std::fabs(p.x) * extent.x + std::fabs(p.y) * extent.y + std::fabs(p.z) * extent.z < 0.0f)
+            return false;
+    }
+    return true;
+}
+
+int runScene(size_t count, std::mt19937 &random)
+{
+    const int FRUSTUM_QUERIES = 64;
+    const int RAY_QUERIES = 4096, RAY_CHECKS = 256;
+    const int OVERLAP_QUERIES = 4096, OVERLAP_CHECKS = 256;
+    int failures = 0;
+
+    float side;
+    std::vector<BoundingBox> boxes;
+    makeScene(count, random, side, boxes);
+    std::cout << count << " boxes" << std::endl;
+
+    Bvh bvh;
+    Clock::time_point start = Clock::now();
+    bvh.build(boxes.data(), boxes.size());
+    double buildMs = millisecondsSince(start);
+    std::cout << "  build " << buildMs << " ms, " << bvh.nodeCount() << " nodes, SAH cost " << bvh.sahCost() << std::endl;
+
+    // frustum: BVH against the SoA linear cull (sphere and box) and a plain box loop for the expected count
+    BoundsArray linear;
+    for(size_t i = 0; i < count; i++)
+    {
+        MeshBounds bounds;
+        bounds.min = boxes[i].min;
+        bounds.max = boxes[i].max;
+        bounds.center = (boxes[i].min + boxes[i].max) * 0.5f;
+        bounds.radius = glm::length(boxes[i].max - boxes[i].min) * 0.5f;
+        linear.add(bounds);
+    }
+    std::vector<unsigned char> visibility(count);
+    double bvhMs = 0.0, linearMs = 0.0;
+    size_t bvhVisible = 0, linearVisible = 0;
+    for(int q = 0; q < FRUSTUM_QUERIES; q++)
+    {
+        Frustum frustum = randomFrustum(random, side);
+        size_t found = 0;
+        start = Clock::now();
+        bvh.queryFrustum(frustum, [&found](unsigned int) { found++; });
+        bvhMs += millisecondsSince(start);
+        start = Clock::now();
+        CullStats stats = linear.cull(frustum, visibility.data());
+        linearMs += millisecondsSince(start);
+        bvhVisible += found;
+        linearVisible += stats.visible;
+
+        size_t expected = 0;
+        for(size_t i = 0; i < count; i++)
+            expected += boxInFrustum(frustum, boxes[i]);
+        if(found != expected)
+        {
+            std::cout << "  MISMATCH frustum query: BVH " << found << ", expected " << expected << std::endl;
+            failures++;
+        }
+    }
+    std::cout << "  frustum: BVH " << bvhMs / FRUSTUM_QUERIES << " ms, linear " << linearMs / FRUSTUM_QUERIES
+              << " ms per query (" << bvhVisible / FRUSTUM_QUERIES << " / " << linearVisible / FRUSTUM_QUERIES << " visible)" << std::endl;
+
+    // rays: closest box hit
+    std::uniform_real_distribution<float> position(0.0f, side), direction(-1.0f, 1.0f);
+    std::vector<glm::vec3> origins(RAY_QUERIES), directions(RAY_QUERIES);
+    for(int q = 0; q < RAY_QUERIES; q++)
+    {
+        origins[q] = glm::vec3(position(random), position(random), position(random));
+        directions[q] = glm::normalize(glm::vec3(direction(random), direction(random), direction(random) + 0.01f));
+    }
+    std::vector<float> nearest(RAY_QUERIES);
+    start = Clock::now();
+    for(int q = 0; q < RAY_QUERIES; q++)
+    {
+        float closest = FLT_MAX;
+        bvh.queryRay(origins[q], directions[q], FLT_MAX, [&closest](unsigned int, float t) {
+            closest = std::min(closest, t);
+            return closest;
+        });
+        nearest[q] = closest;
+    }
+    double rayMs = millisecondsSince(start);
+    start = Clock::now();
+    for(int q = 0; q < RAY_CHECKS; q++)
+    {
+        glm::vec3 inverse = 1.0f / directions[q];
+        float closest = FLT_MAX, t;
+        for(size_t i = 0; i < count; i++)
+        {
+            if(rayHitsBox(origins[q], inverse, closest, boxes[i], t))
+                closest = std::min(closest, t);
+        }
+        if(closest != nearest[q])
+        {
+            std::cout << "  MISMATCH ray " << q << ": BVH " << nearest[q] << ", expected " << closest << std::endl;
+            failures++;
+        }
+    }
+    double bruteRayMs = millisecondsSince(start);
+    std::cout << "  rays: BVH " << RAY_QUERIES / rayMs / 1000.0 << " Mrays/s, brute force "
+              << RAY_CHECKS / bruteRayMs / 1000.0 << " Mrays/s" << std::endl;
+
+    // overlap queries with boxes about the size of the scene's own
+    std::vector<BoundingBox> probes(OVERLAP_QUERIES);
+    for(int q = 0; q < OVERLAP_QUERIES; q++)
+    {
+        glm::vec3 center(position(random), position(random), position(random));
+        probes[q].min = center - glm::vec3(1.0f);
+        probes[q].max = center + glm::vec3(1.0f);
+    }
+    std::vector<size_t> overlaps(OVERLAP_QUERIES);
+    start = Clock::now();
+    for(int q = 0; q < OVERLAP_QUERIES; q++)
+    {
+        size_t found = 0;
+        bvh.queryOverlap(probes[q], [&found](unsigned int) { found++; });
+        overlaps[q] = found;
+    }
+    double overlapMs = millisecondsSince(start);
+    start = Clock::now();
+    for(int q = 0; q < OVERLAP_CHECKS; q++)
+    {
+        size_t expected = 0;
+        for(size_t i = 0; i < count; i++)
+            expected += boxesOverlap(boxes[i], probes[q]);
+        if(expected != overlaps[q])
+        {
+            std::cout << "  MISMATCH overlap query " << q << ": BVH " << overlaps[q] << ", expected " << expected << std::endl;
+            failures++;
+        }
+    }
+    double bruteOverlapMs = millisecondsSince(start);
+    std::cout << "  overlap: BVH " << overlapMs * 1000.0 / OVERLAP_QUERIES << " us, brute force "
+              << bruteOverlapMs * 1000.0 / OVERLAP_CHECKS << " us per query" << std::endl;
+
+    // small motion: refit keeps the tree good
+    std::uniform_real_distribution<float> jitter(-0.25f, 0.25f);
+    for(size_t i = 0; i < count; i++)
+    {
+        glm::vec3 offset(jitter(random), jitter(random), jitter(random));
+        boxes[i].min += offset;
+        boxes[i].max += offset;
+    }
+    float builtCost = bvh.sahCost();
+    start = Clock::now();
+    bool rebuilt = bvh.update(boxes.data());
+    double refitMs = millisecondsSince(start);
+    std::cout << "  small motion: update " << refitMs << " ms (" << (rebuilt ? "rebuilt" : "refit") << "), SAH cost "
+              << builtCost << " -> " << bvh.sahCost() << std::endl;
+
+    // everything teleports: refit alone would leave a useless tree, update rebuilds
+    std::vector<BoundingBox> moved;
+    makeScene(count, random, side, moved);
+    start = Clock::now();
+    bvh.refit(moved.data());
+    double teleportRefitMs = millisecondsSince(start);
+    float refitCost = bvh.sahCost();
+    bvh.refit(boxes.data());
+    start = Clock::now();
+    rebuilt = bvh.update(moved.data());
+    double teleportMs = millisecondsSince(start);
+    std::cout << "  teleport: refit " << teleportRefitMs << " ms (SAH cost " << refitCost << "), update " << teleportMs
+              << " ms (" << (rebuilt ? "rebuilt" : "refit") << ", SAH cost " << bvh.sahCost() << ")" << std::endl;
+    return failures;
+}
+
+int main(int argc, char **argv)
+{
+    size_t largest = argc > 1 ? (size_t)std::atol(argv[1]) : 1000000;
+    std::mt19937 random(12345);
+    std::cout << std::setprecision(4);
+    int failures = 0;
+    for(size_t count = 1000; count <= largest; count *= 10)
+        failures += runScene(count, random);
+    if(failures)
+        std::cout << failures << " mismatches" << std::endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,183 @@
+/*
+Draw packet microbenchmark.
+Loads a model (nanosuit by default) into a hidden window and measures the CPU time per frame spent submitting it:
+ - "per-mesh strings": the old Mesh::Draw, building "texture_diffuseN" names with a stringstream and calling
+   glGetUniformLocation for every texture of every mesh, every frame
+ - "draw packets": Model::Draw on meshes with their own VAO and buffers, sampler units assigned once and a tight
+   loop over precomputed DrawPackets
+ - "geometry arena": Model::Draw on meshes suballocated from the shared GeometryArena, one VAO for the whole model and
+   the meshes sharing their textures merged into glMultiDrawElementsBaseVertex calls
+Draw calls, VAO binds and texture binds per frame (DrawCounters) are printed for the last two.
+The GPU is drained with glFinish after each frame, outside the timed region.
+Usage: draw_packets_benchmark [model path relative to the repository root] [frames]
+Dependencies:
+GLM, GL3W, GLFW3 and Assimp, like 04_model_loading.
+*/
+#define STB_IMAGE_IMPLEMENTATION
+#include <GL/gl3w.h> // here: we need compile gl3w.c - utils dir
+#include <GLFW/glfw3.h>
+
+#include <filesystem.h>
+#include <shader.h>
+#include <model.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// the per-frame work Mesh::Draw used to do, kept here as the baseline
+void drawMeshWithStrings(GLuint program, const Mesh &mesh)
+{
+    unsigned int diffuseNr  = 1;
+    unsigned int specularNr = 1;
+    unsigned int normalNr   = 1;
+    unsigned int heightNr   = 1;
+    for(unsigned int i = 0; i < mesh.textures.size(); i++)
+    {
+        glActiveTexture(GL_TEXTURE0 + i);
+        stringstream ss;
+        string number;
+        string name = mesh.textures[i].type;
+        if(name == "texture_diffuse")
+            ss << diffuseNr++;
+        else if(name == "texture_specular")
+            ss << specularNr++;
+        else if(name == "texture_normal")
+            ss << normalNr++;
+        else if(name == "texture_height")
+            ss << heightNr++;
+        number = ss.str();
+        glUniform1i(glGetUniformLocation(program, (name + number).c_str()), i);
+        glBindTexture(GL_TEXTURE_2D, mesh.textures[i].id);
+    }
+    glBindVertexArray(mesh.VAO);
+    glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)mesh.indices.size(), mesh.indexType, (const void*)mesh.packet.indexOffset, mesh.packet.baseVertex);
+    glBindVertexArray(0);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+struct Timings {
+    double mean, median, min;
+};
+
+// runs draw() for the given number of frames and returns the CPU microseconds spent inside it per frame
+template<typename F>
+Timings measure(unsigned int frames, F draw)
+{
+    std::vector<double> samples;
+    samples.reserve(frames);
+    for(unsigned int i = 0; i < frames + frames / 10; i++)
+    {
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        draw();
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        glFinish();
+        if(i >= frames / 10) // the first 10% are warm-up
+            samples.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+    }
+    Timings t;
+    t.mean = 0.0;
+    for(unsigned int i = 0; i < samples.size(); i++)
+        t.mean += samples[i];
+    t.mean /= samples.size();
+    std::sort(samples.begin(), samples.end());
+    t.median = samples[samples.size() / 2];
+    t.min = samples[0];
+    return t;
+}
+
+void report(const char *name, const Timings &t)
+{
+    std::cout << name << ": mean " << t.mean << " us, median " << t.median << " us, min " << t.min << " us per frame" << std::endl;
+}
+
+// the DrawCounters of a single frame of draw()
+template<typename F>
+void reportCounters(const char *name, F draw)
+{
+    ResetDrawCounters();
+    draw();
+    const DrawCounters &counters = drawCounters();
+    std::cout << name << ": " << counters.drawCalls << " draw calls for " << counters.mergedDraws << " meshes, " << counters.vaoBinds
+              << " VAO binds, " << counters.textureBinds << " texture binds per frame" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    std::string modelPath = argc > 1 ? argv[1] : "data/nanosuit/nanosuit.obj";
+    unsigned int frames = argc > 2 ? (unsigned int)std::atoi(argv[2]) : 1000;
+    if(frames < 10)
+        frames = 10;
+
+    glfwInit();
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+#ifdef __APPLE__
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+    GLFWwindow* window = glfwCreateWindow(800, 600, "draw packets benchmark", NULL, NULL);
+    if (window == NULL)
+    {
+        std::cout << "Failed to create GLFW window" << std::endl;
+        glfwTerminate();
+        return -1;
+    }
+    glfwMakeContextCurrent(window);
+    glfwSwapInterval(0);
+    if (gl3wInit()) {
+        std::cout << "failed to initialize OpenGL\n" << std::endl;
+        return -1;
+    }
+    glEnable(GL_DEPTH_TEST);
+
+    Shader shader("../02_model_loading/1.model_loading.vs", "../02_model_loading/1.model_loading.fs");
+    ModelLoadOptions ownBuffers;
+    ownBuffers.geometryArena = false;
+    Model model(FileSystem::getPath(modelPath), false, ownBuffers);
+    Model arenaModel(FileSystem::getPath(modelPath));
+    unsigned int textures = 0;
+    for(unsigned int i = 0; i < model.meshes.size(); i++)
+        textures += (unsigned int)model.meshes[i].textures.size();
+    std::cout << modelPath << ": " << model.meshes.size() << " meshes, " << textures << " texture bindings, " << frames << " frames" << std::endl;
+
+    shader.use();
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 1000.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 3.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 transform = glm::scale(glm::translate(glm::mat4(), glm::vec3(0.0f, -1.75f, 0.0f)), glm::vec3(0.2f));
+    shader.setMat4("projection", projection);
+    shader.setMat4("view", view);
+    shader.setMat4("model", transform);
+    shader.setMat3("normalMatrix", NormalMatrix(transform));
+
+    Timings before = measure(frames, [&]() {
+        for(unsigned int i = 0; i < model.meshes.size(); i++)
+            drawMeshWithStrings(shader.ID, model.meshes[i]);
+    });
+    SharedGLState().invalidate(); // the baseline binds with raw GL calls
+    Timings after = measure(frames, [&]() {
+        model.Draw(shader);
+    });
+    Timings arena = measure(frames, [&]() {
+        arenaModel.Draw(shader);
+    });
+
+    report("per-mesh strings", before);
+    report("draw packets    ", after);
+    report("geometry arena  ", arena);
+    std::cout << "speedup (median): " << before.median / after.median << "x, " << before.median / arena.median << "x with the arena" << std::endl;
+    reportCounters("draw packets    ", [&]() { model.Draw(shader); });
+    reportCounters("geometry arena  ", [&]() { arenaModel.Draw(shader); });
+
+    glfwTerminate();
+    return 0;
+}
@@ -0,0 +1,333 @@
+/*
+maths_funcs benchmark.
+Checks the SIMD backend of utils/maths_funcs.cpp against its scalar reference (namespace maths_scalar), then times
+both, next to glm's scalar operators and, where GLM_ARCH has SSE2, the glm_mat4_* functions of glm/simd/matrix.h,
+on the same data:
+ - mat4 * vec4, mat4 * mat4, determinant, inverse, slerp (one call per item)
+ - the batches: transform_points (vec3), transform_vec4s and multiply_mat4s over arrays
+Output follows Google Benchmark's console format: each case runs until it has taken at least --min_time seconds, and
+the time per iteration and items per second are printed; compile with -mavx (/arch:AVX) for the AVX paths and with
+-DMATHS_FUNCS_SCALAR to see the scalar code behind the maths_funcs API.
+Usage: maths_benchmark [--min_time=seconds] [items per batch]
+Dependencies:
+GLM; no GL context.
+*/
+#include <maths_funcs.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/simd/matrix.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+// written by every case so the compiler cannot drop the work
+volatile float sink;
+
+struct BenchmarkCase {
+    std::string name;
+    size_t itemsPerIteration;
+    void (*run)();
+};
+
+std::vector<BenchmarkCase> cases;
+size_t batchSize = 1024;
+
+// the inputs, shared by every implementation
+std::vector<mat4> matricesA, matricesB, matricesOut;
+std::vector<vec4> vectors, vectorsOut;
+std::vector<vec3> points, pointsOut;
+std::vector<versor> rotationsA, rotationsB;
+std::vector<glm::mat4> glmA, glmB, glmOut;
+std::vector<glm::vec4> glmVectors, glmVectorsOut;
+std::vector<glm::quat> glmRotationsA, glmRotationsB;
+
+void registerCase(const std::string &name, size_t items, void (*run)())
+{
+    BenchmarkCase c;
+    c.name = name;
+    c.itemsPerIteration = items;
+    c.run = run;
+    cases.push_back(c);
+}
+
+void fillInputs()
+{
+    std::mt19937 random(11);
+    std::uniform_real_distribution<float> value(-2.0f, 2.0f);
+    for(size_t i = 0; i < batchSize; i++)
+    {
+        mat4 a, b;
+        for(int k = 0; k < 16; k++)
+        {
+            a.m[k] = value(random);
+            b.m[k] = value(random);
+        }
+        matricesA.push_back(a);
+        matricesB.push_back(b);
+        vectors.push_back(vec4(value(random), value(random), value(random), 1.0f));
+        points.push_back(vec3(value(random), value(random), value(random)));
+        versor q = quat_from_axis_rad(value(random), value(random), value(random), value(random));
+        versor r = quat_from_axis_rad(value(random), value(random), value(random), value(random));
+        rotationsA.push_back(normalise(q));
+        rotationsB.push_back(normalise(r));
+    }
+    matricesOut.resize(batchSize);
+    vectorsOut.resize(batchSize);
+    pointsOut.resize(batchSize);
+    for(size_t i = 0; i < batchSize; i++)
+    {
+        glm::mat4 a, b;
+        memcpy(&a[0][0], matricesA[i].m, sizeof(float) * 16);
+        memcpy(&b[0][0], matricesB[i].m, sizeof(float) * 16);
+        glmA.push_back(a);
+        glmB.push_back(b);
+        glmVectors.push_back(glm::vec4(vectors[i].v[0], vectors[i].v[1], vectors[i].v[2], vectors[i].v[3]));
+        glmRotationsA.push_back(glm::quat(rotationsA[i].q[0], rotationsA[i].q[1], rotationsA[i].q[2], rotationsA[i].q[3]));
+        glmRotationsB.push_back(glm::quat(rotationsB[i].q[0], rotationsB[i].q[1], rotationsB[i].q[2], rotationsB[i].q[3]));
+    }
+    glmOut.resize(batchSize);
+    glmVectorsOut.resize(batchSize);
+}
+
+// largest difference between two float arrays, relative to the larger magnitude (absolute below 1)
+float maxError(const float *a, const float *b, size_t count)
+{
+    float worst = 0.0f;
+    for(size_t i = 0; i < count; i++)
+    {
+        float scale = std::max(1.0f, std::max(std::fabs(a[i]), std::fabs(b[i])));
+        worst = std::max(worst, std::fabs(a[i] - b[i]) / scale);
+    }
+    return worst;
+}
+
+// the backend against maths_scalar; false if any result is off by more than float rounding
+bool checkBackend()
+{
+    float multiplyVector = 0.0f, multiplyMatrix = 0.0f, det = 0.0f, inv = 0.0f, slerped = 0.0f, batches = 0.0f;
+    for(size_t i = 0; i < batchSize; i++)
+    {
+        vec4 v = matricesA[i] * vectors[i];
+        vec4 vr = maths_scalar::multiply(matricesA[i], vectors[i]);
+        multiplyVector = std::max(multiplyVector, maxError(v.v, vr.v, 4));
+        mat4 m = matricesA[i] * matricesB[i];
+        mat4 mr = maths_scalar::multiply(matricesA[i], matricesB[i]);
+        multiplyMatrix = std::max(multiplyMatrix, maxError(m.m, mr.m, 16));
+        float d = determinant(matricesA[i]), dr = maths_scalar::determinant(matricesA[i]);
+        det = std::max(det, maxError(&d, &dr, 1));
+        if(std::fabs(dr) > 1e-2f)
+        {
+            mat4 n = inverse(matricesA[i]);
+            mat4 nr = maths_scalar::inverse(matricesA[i]);
+            inv = std::max(inv, maxError(n.m, nr.m, 16) * std::fabs(dr)); // inverses of nearly singular matrices
+        }                                                                  // are ill-conditioned for both
+        versor q = rotationsA[i], r = rotationsB[i], qr = rotationsA[i], rr = rotationsB[i];
+        versor s = slerp(q, r, 0.3f), sr = maths_scalar::slerp(qr, rr, 0.3f);
+        slerped = std::max(slerped, maxError(s.q, sr.q, 4));
+    }
+    transform_vec4s(matricesA[0], vectors.data(), vectorsOut.data(), batchSize);
+    std::vector<vec4> vectorsReference(batchSize);
+    maths_scalar::transform_vec4s(matricesA[0], vectors.data(), vectorsReference.data(), batchSize);
+    batches = std::max(batches, maxError(vectorsOut[0].v, vectorsReference[0].v, batchSize * 4));
+    transform_points(matricesA[0], points.data(), pointsOut.data(), batchSize);
+    std::vector<vec3> pointsReference(batchSize);
+    maths_scalar::transform_points(matricesA[0], points.data(), pointsReference.data(), batchSize);
+    batches = std::max(batches, maxError(pointsOut[0].v, pointsReference[0].v, batchSize * 3));
+    multiply_mat4s(matricesA.data(), matricesB.data(), matricesOut.data(), batchSize);
+    std::vector<mat4> matricesReference(batchSize);
+    maths_scalar::multiply_mat4s(matricesA.data(), matricesB.data(), matricesReference.data(), batchSize);
+    batches = std::max(batches, maxError(matricesOut[0].m, matricesReference[0].m, batchSize * 16));
+
+    printf("backend %s vs scalar, largest relative error: mat4*vec4 %g, mat4*mat4 %g, determinant %g, inverse %g, "
+           "slerp %g, batches %g\n", maths_backend(), multiplyVector, multiplyMatrix, det, inv, slerped, batches);
+    const float tolerance = 1e-4f;
+    return multiplyVector < tolerance && multiplyMatrix < tolerance && det < tolerance && inv < tolerance &&
+           slerped < tolerance && batches < tolerance;
+}
+
+void registerCases()
+{
+    size_t n = batchSize;
+    // one call per item
+    registerCase("mat4*vec4/scalar", n, [] {
+        for(size_t i = 0; i < batchSize; i++) vectorsOut[i] = maths_scalar::multiply(matricesA[i], vectors[i]);
+        sink = vectorsOut[0].v[0];
+    });
+    registerCase(std::string("mat4*vec4/") + maths_backend(), n, [] {
+        for(size_t i = 0; i < batchSize; i++) vectorsOut[i] = matricesA[i] * vectors[i];
+        sink = vectorsOut[0].v[0];
+    });
+    registerCase("mat4*vec4/glm", n, [] {
+        for(size_t i = 0; i < batchSize; i++) glmVectorsOut[i] = glmA[i] * glmVectors[i];
+        sink = glmVectorsOut[0].x;
+    });
+    registerCase("mat4*mat4/scalar", n, [] {
+        for(size_t i = 0; i < batchSize; i++) matricesOut[i] = maths_scalar::multiply(matricesA[i], matricesB[i]);
+        sink = matricesOut[0].m[0];
+    });
+    registerCase(std::string("mat4*mat4/") + maths_backend(), n, [] {
+        for(size_t i = 0; i < batchSize; i++) matricesOut[i] = matricesA[i] * matricesB[i];
+        sink = matricesOut[0].m[0];
+    });
+    registerCase("mat4*mat4/glm", n, [] {
+        for(size_t i = 0; i < batchSize; i++) glmOut[i] = glmA[i] * glmB[i];
+        sink = glmOut[0][0][0];
+    });
+    registerCase("determinant/scalar", n, [] {
+        float sum = 0.0f;
+        for(size_t i = 0; i < batchSize; i++) sum += maths_scalar::determinant(matricesA[i]);
+        sink = sum;
+    });
+    registerCase(std::string("determinant/") + maths_backend(), n, [] {
+        float sum = 0.0f;
+        for(size_t i = 0; i < batchSize; i++) sum += determinant(matricesA[i]);
+        sink = sum;
+    });
+    registerCase("determinant/glm", n, [] {
+        float sum = 0.0f;
+        for(size_t i = 0; i < batchSize; i++) sum += glm::determinant(glmA[i]);
+        sink = sum;
+    });
+    registerCase("inverse/scalar", n, [] {
+        for(size_t i = 0; i < batchSize; i++) matricesOut[i] = maths_scalar::inverse(matricesA[i]);
+        sink = matricesOut[0].m[0];
+    });
+    registerCase(std::string("inverse/") + maths_backend(), n, [] {
+        for(size_t i = 0; i < batchSize; i++) matricesOut[i] = inverse(matricesA[i]);
+        sink = matricesOut[0].m[0];
+    });
+    registerCase("inverse/glm", n, [] {
+        for(size_t i = 0; i < batchSize; i++) glmOut[i] = glm::inverse(glmA[i]);
+        sink = glmOut[0][0][0];
+    });
+    registerCase("slerp/scalar", n, [] {
+        float sum = 0.0f;
+        for(size_t i = 0; i < batchSize; i++) sum += maths_scalar::slerp(rotationsA[i], rotationsB[i], 0.3f).q[0];
+        sink = sum;
+    });
+    registerCase(std::string("slerp/") + maths_backend(), n, [] {
+        float sum = 0.0f;
+        for(size_t i = 0; i < batchSize; i++) sum += slerp(rotationsA[i], rotationsB[i], 0.3f).q[0];
+        sink = sum;
+    });
+    registerCase("slerp/glm", n, [] {
+        float sum = 0.0f;
+        for(size_t i = 0; i < batchSize; i++) sum += glm::slerp(glmRotationsA[i], glmRotationsB[i], 0.3f).w;
+        sink = sum;
+    });
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+    // glm's SIMD building blocks, on glm_vec4 (__m128) columns
+    registerCase("mat4*vec4/glm_simd", n, [] {
+        for(size_t i = 0; i < batchSize; i++)
+        {
+            glm_vec4 columns[4] = { _mm_loadu_ps(&glmA[i][0][0]), _mm_loadu_ps(&glmA[i][1][0]), _mm_loadu_ps(&glmA[i][2][0]), _mm_loadu_ps(&glmA[i][3][0]) };
+            _mm_storeu_ps(&glmVectorsOut[i][0], glm_mat4_mul_vec4(columns, _mm_loadu_ps(&glmVectors[i][0])));
+        }
+        sink = glmVectorsOut[0].x;
+    });
+    registerCase("mat4*mat4/glm_simd", n, [] {
+        for(size_t i = 0; i < batchSize; i++)
+        {
+            glm_vec4 a[4], b[4], out[4];
+            for(int c = 0; c < 4; c++)
+            {
+                a[c] = _mm_loadu_ps(&glmA[i][c][0]);
+                b[c] = _mm_loadu_ps(&glmB[i][c][0]);
+            }
+            glm_mat4_mul(a, b, out);
+            for(int c = 0; c < 4; c++)
+                _mm_storeu_ps(&glmOut[i][c][0], out[c]);
+        }
+        sink = glmOut[0][0][0];
+    });
+    registerCase("inverse/glm_simd", n, [] {
+        for(size_t i = 0; i < batchSize; i++)
+        {
+            glm_vec4 a[4], out[4];
+            for(int c = 0; c < 4; c++)
+                a[c] = _mm_loadu_ps(&glmA[i][c][0]);
+            glm_mat4_inverse(a, out);
+            for(int c = 0; c < 4; c++)
+                _mm_storeu_ps(&glmOut[i][c][0], out[c]);
+        }
+        sink = glmOut[0][0][0];
+    });
+#endif
+    // the batches
+    registerCase("transform_points/scalar", n, [] {
+        maths_scalar::transform_points(matricesA[0], points.data(), pointsOut.data(), batchSize);
+        sink = pointsOut[0].v[0];
+    });
+    registerCase(std::string("transform_points/") + maths_backend(), n, [] {
+        transform_points(matricesA[0], points.data(), pointsOut.data(), batchSize);
+        sink = pointsOut[0].v[0];
+    });
+    registerCase("transform_vec4s/scalar", n, [] {
+        maths_scalar::transform_vec4s(matricesA[0], vectors.data(), vectorsOut.data(), batchSize);
+        sink = vectorsOut[0].v[0];
+    });
+    registerCase(std::string("transform_vec4s/") + maths_backend(), n, [] {
+        transform_vec4s(matricesA[0], vectors.data(), vectorsOut.data(), batchSize);
+        sink = vectorsOut[0].v[0];
+    });
+    registerCase("multiply_mat4s/scalar", n, [] {
+        maths_scalar::multiply_mat4s(matricesA.data(), matricesB.data(), matricesOut.data(), batchSize);
+        sink = matricesOut[0].m[0];
+    });
+    registerCase(std::string("multiply_mat4s/") + maths_backend(), n, [] {
+        multiply_mat4s(matricesA.data(), matricesB.data(), matricesOut.data(), batchSize);
+        sink = matricesOut[0].m[0];
+    });
+}
+
+int main(int argc, char **argv)
+{
+    double minTime = 0.5;
+    for(int i = 1; i < argc; i++)
+    {
+        if(strncmp(argv[i], "--min_time=", 11) == 0)
+            minTime = atof(argv[i] + 11);
+        else
+            batchSize = (size_t)std::max(1, atoi(argv[i]));
+    }
+    fillInputs();
+    if(!checkBackend())
+    {
+        printf("ERROR::MATHS_BENCHMARK:: the %s backend does not match the scalar code\n", maths_backend());
+        return 1;
+    }
+    registerCases();
+
+    printf("%-32s %14s %14s %12s %16s\n", "Benchmark", "Time", "CPU", "Iterations", "items_per_second");
+    printf("%s\n", std::string(92, '-').c_str());
+    for(size_t c = 0; c < cases.size(); c++)
+    {
+        // grow the iteration count until a run takes minTime, as Google Benchmark does
+        size_t iterations = 1;
+        double seconds = 0.0;
+        while(true)
+        {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            for(size_t i = 0; i < iterations; i++)
+                cases[c].run();
+            seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if(seconds >= minTime || iterations >= 1000000000)
+                break;
+            double grow = seconds > 0.0 ? minTime * 1.4 / seconds : 10.0;
+            iterations = (size_t)(iterations * std::min(10.0, std::max(grow, 2.0)));
+        }
+        double nanoseconds = seconds * 1e9 / iterations;
+        double itemsPerSecond = cases[c].itemsPerIteration * iterations / seconds;
+        printf("%-32s %11.0f ns %11.0f ns %12zu %14.4gM/s\n", cases[c].name.c_str(), nanoseconds, nanoseconds,
+               iterations, itemsPerSecond / 1e6);
+    }
+    return 0;
+}
@@ -0,0 +1,143 @@
+/*
+Normal matrix benchmark.
+Loads a model (ConchaHigh by default) into a hidden window and measures the GPU time per frame of drawing it with the
+two variants of 1.model_loading.vs:
+ - "per vertex": NORMAL_MATRIX_PER_VERTEX, transpose(inverse(mat3(model))) evaluated for every vertex
+ - "per draw":   the "normalMatrix" uniform, computed once on the CPU with NormalMatrix (mesh.h)
+Each is timed twice: in an 8x8 viewport, where almost nothing is rasterised and the vertex stage is the frame, and in
+an 800x600 one, for the share of a normal frame. GPU times come from GL_TIME_ELAPSED queries, so software rasterisers
+like llvmpipe (headless runs) are measured the same way as a GPU.
+Usage: normal_matrix_benchmark [model path relative to the repository root] [frames]
+Dependencies:
+GLM, GL3W, GLFW3 and Assimp, like 04_model_loading.
+*/
+#define STB_IMAGE_IMPLEMENTATION
+#include <GL/gl3w.h> // here: we need compile gl3w.c - utils dir
+#include <GLFW/glfw3.h>
+
+#include <filesystem.h>
+#include <shader.h>
+#include <model.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+struct Timings {
+    double mean, median, min;
+};
+
+// draws the model with shader for the given number of frames and returns the GPU milliseconds per frame
+Timings measure(unsigned int frames, Shader &shader, Model &model, GLuint query)
+{
+    shader.use();
+    std::vector<double> samples;
+    samples.reserve(frames);
+    for(unsigned int i = 0; i < frames + frames / 10; i++)
+    {
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glBeginQuery(GL_TIME_ELAPSED, query);
+        model.Draw(shader);
+        glEndQuery(GL_TIME_ELAPSED);
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+        if(i >= frames / 10) // the first 10% are warm-up
+            samples.push_back(nanoseconds / 1.0e6);
+    }
+    Timings t;
+    t.mean = 0.0;
+    for(unsigned int i = 0; i < samples.size(); i++)
+        t.mean += samples[i];
+    t.mean /= samples.size();
+    std::sort(samples.begin(), samples.end());
+    t.median = samples[samples.size() / 2];
+    t.min = samples[0];
+    return t;
+}
+
+void report(const char *name, const Timings &t)
+{
+    std::cout << name << ": mean " << t.mean << " ms, median " << t.median << " ms, min " << t.min << " ms per frame" << std::endl;
+}
+
+// the uniforms of 1.model_loading.vs/.fs, the same for both variants
+void setUniforms(Shader &shader, const glm::mat4 &transform)
+{
+    shader.use();
+    shader.setMat4("projection", glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 1000.0f));
+    shader.setMat4("view", glm::lookAt(glm::vec3(0.0f, 0.0f, 3.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f)));
+    shader.setMat4("model", transform);
+    shader.setMat3("normalMatrix", NormalMatrix(transform)); // ignored by the per vertex variant
+    shader.setVec3("viewPos", glm::vec3(0.0f, 0.0f, 3.0f));
+    shader.setVec3("lightPos", glm::vec3(-5.0f, -5.75f, 0.0f));
+    shader.setVec3("lightColor", glm::vec3(1.0f));
+    shader.setVec3("matColor", glm::vec3(0.8f));
+    shader.setFloat("lerpIntensity", 0.0f);
+}
+
+int main(int argc, char **argv)
+{
+    std::string modelPath = argc > 1 ? argv[1] : "data/ConchaHigh/ConchaHigh.obj";
+    unsigned int frames = argc > 2 ? (unsigned int)std::atoi(argv[2]) : 200;
+    if(frames < 10)
+        frames = 10;
+
+    glfwInit();
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+#ifdef __APPLE__
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+    GLFWwindow* window = glfwCreateWindow(800, 600, "normal matrix benchmark", NULL, NULL);
+    if (window == NULL)
+    {
+        std::cout << "Failed to create GLFW window" << std::endl;
+        glfwTerminate();
+        return -1;
+    }
+    glfwMakeContextCurrent(window);
+    glfwSwapInterval(0);
+    if (gl3wInit()) {
+        std::cout << "failed to initialize OpenGL\n" << std::endl;
+        return -1;
+    }
+    glEnable(GL_DEPTH_TEST);
+
+    Shader perVertex("../02_model_loading/1.model_loading.vs", "../02_model_loading/1.model_loading.fs", nullptr, "#define NORMAL_MATRIX_PER_VERTEX\n");
+    Shader perDraw("../02_model_loading/1.model_loading.vs", "../02_model_loading/1.model_loading.fs");
+    Model model(FileSystem::getPath(modelPath)); // Model::Draw without a view: every mesh at full resolution
+    size_t vertices = 0;
+    for(unsigned int i = 0; i < model.meshes.size(); i++)
+        vertices += model.meshes[i].vertexCount();
+    std::cout << modelPath << ": " << model.meshes.size() << " meshes, " << vertices << " vertices, " << frames << " frames" << std::endl;
+
+    glm::mat4 transform = glm::scale(glm::translate(glm::mat4(), glm::vec3(0.0f, -1.75f, 0.0f)), glm::vec3(0.2f));
+    setUniforms(perVertex, transform);
+    setUniforms(perDraw, transform);
+    GLuint query;
+    glGenQueries(1, &query);
+
+    glViewport(0, 0, 8, 8);
+    Timings vertexBoundBefore = measure(frames, perVertex, model, query);
+    Timings vertexBoundAfter = measure(frames, perDraw, model, query);
+    glViewport(0, 0, 800, 600);
+    Timings fullBefore = measure(frames, perVertex, model, query);
+    Timings fullAfter = measure(frames, perDraw, model, query);
+
+    report("8x8 per vertex     ", vertexBoundBefore);
+    report("8x8 per draw       ", vertexBoundAfter);
+    report("800x600 per vertex ", fullBefore);
+    report("800x600 per draw   ", fullAfter);
+    std::cout << "speedup (median): " << vertexBoundBefore.median / vertexBoundAfter.median << "x vertex bound, "
+              << fullBefore.median / fullAfter.median << "x at 800x600" << std::endl;
+
+    glfwTerminate();
+    return 0;
+}
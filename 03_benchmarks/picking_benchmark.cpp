@@ -0,0 +1,264 @@
+/*
+Picking ray throughput benchmark.
+Merges all meshes of each model into one triangle soup (converted exactly like Model does) and builds the 4-wide
+triangle BVH of utils/triangle_bvh.h over it, serially and on a thread pool. Then casts rays from points around the
+model at random points inside its bounds and reports:
+ - the time of a single closest-hit query (what a click in 04_model_loading costs)
+ - Mrays/s on one core and on all cores
+The first rays are checked against a brute force loop over every triangle; a mismatch fails the run.
+Nothing is drawn, no window or GL context is needed.
+Usage: picking_benchmark [--rays N] [--sphere <triangles>] [model paths relative to the repository root...]
+       --sphere adds a generated UV sphere of about that many triangles; without models or --sphere every model
+       listed in 02_model_loading/file.txt is measured
+Dependencies:
+GLM and Assimp, like 04_model_loading.
+*/
+#define STB_IMAGE_IMPLEMENTATION
+#include <GL/gl3w.h> // here: we need compile gl3w.c - utils dir
+
+#include <filesystem.h>
+#include <model.h>
+#include <thread_pool.h>
+#include <triangle_bvh.h>
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+double millisecondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+struct Soup {
+    std::string name;
+    vector<Vertex> vertices;
+    vector<unsigned int> indices;
+};
+
+bool loadSoup(const std::string &modelPath, Soup &soup)
+{
+    Assimp::Importer importer;
+    const aiScene *scene = importer.ReadFile(FileSystem::getPath(modelPath), MODEL_IMPORT_FLAGS);
+    if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+    {
+        std::cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << std::endl;
+        return false;
+    }
+    ModelLoadOptions options;
+    soup.name = modelPath;
+    for(unsigned int i = 0; i < scene->mNumMeshes; i++)
+    {
+        vector<Vertex> vertices;
+        vector<unsigned int> indices;
+        Model::processMesh(scene->mMeshes[i], vertices, indices);
+        Model::runMeshPipeline(options, vertices, indices);
+        unsigned int base = (unsigned int)soup.vertices.size();
+        soup.vertices.insert(soup.vertices.end(), vertices.begin(), vertices.end());
+        for(size_t j = 0; j < indices.size(); j++)
+            soup.indices.push_back(base + indices[j]);
+    }
+    return true;
+}
+
+void makeSphere(unsigned int triangles, Soup &soup)
+{
+    unsigned int rings = std::max(2u, (unsigned int)std::sqrt(triangles / 4.0)), segments = 2 * rings;
+    soup.name = "sphere";
+    for(unsigned int r = 0; r <= rings; r++)
+    {
+        for(unsigned int s = 0; s <= segments; s++)
+        {
+            float theta = 3.14159265f * r / rings, phi = 6.2831853f * s / segments;
+            Vertex vertex = {};
+            vertex.Position = glm::vec3(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+            vertex.Normal = vertex.Position;
+            soup.vertices.push_back(vertex);
+        }
+    }
+    for(unsigned int r = 0; r < rings; r++)
+    {
+        for(unsigned int s = 0; s < segments; s++)
+        {
+            unsigned int a = r * (segments + 1) + s, b = a + segments + 1;
+            unsigned int quad[6] = { a, b, a + 1, a + 1, b, b + 1 };
+            soup.indices.insert(soup.indices.end(), quad, quad + 6);
+        }
+    }
+}
+
+// closest t over every triangle, the reference for the BVH
+float bruteForce(const Soup &soup, const glm::vec3 &origin, const glm::vec3 &direction)
+{
+    float closest = FLT_MAX;
+    for(size_t i = 0; i < soup.indices.size(); i += 3)
+    {
+        glm::vec3 v0 = soup.vertices[soup.indices[i]].Position;
+        glm::vec3 e1 = soup.vertices[soup.indices[i + 1]].Position - v0, e2 = soup.vertices[soup.indices[i + 2]].Position - v0;
+        glm::vec3 p = glm::cross(direction, e2);
+        float determinant = glm::dot(e1, p);
+        if(determinant == 0.0f)
+            continue;
+        float inverse = 1.0f / determinant;
+        glm::vec3 s = origin - v0;
+        float u = glm::dot(s, p) * inverse;
+        if(u < 0.0f || u > 1.0f)
+            continue;
+        glm::vec3 q = glm::cross(s, e1);
+        float v = glm::dot(direction, q) * inverse;
+        if(v < 0.0f || u + v > 1.0f)
+            continue;
+        float t = glm::dot(e2, q) * inverse;
+        if(t >= 0.0f && t < closest)
+            closest = t;
+    }
+    return closest;
+}
+
+int measure(const Soup &soup, size_t rayCount, ThreadPool *pool) // pool: nullptr on a single hardware thread
+{
+    const size_t CHECKED_RAYS = 64, CHUNK = 1024;
+    std::cout << soup.name << ": " << soup.indices.size() / 3 << " triangles" << std::endl;
+
+    TriangleBvh bvh;
+    Clock::time_point start = Clock::now();
+    bvh.build(soup.vertices, soup.indices);
+    double serialMs = millisecondsSince(start);
+    start = Clock::now();
+    bvh.build(soup.vertices, soup.indices, pool);
+    double parallelMs = millisecondsSince(start);
+    size_t threads = pool ? pool->size() + 1 : 1;
+    std::cout << "  build: " << serialMs << " ms on one thread, " << parallelMs << " ms on " << threads << " threads; "
+              << bvh.nodeCount() << " nodes, " << (bvh.memoryBytes() >> 10) << " KiB" << std::endl;
+
+    // rays from a sphere around the bounds towards random points inside them
+    glm::vec3 low(FLT_MAX), high(-FLT_MAX);
+    for(size_t i = 0; i < soup.vertices.size(); i++)
+    {
+        low = glm::min(low, soup.vertices[i].Position);
+        high = glm::max(high, soup.vertices[i].Position);
+    }
+    glm::vec3 center = (low + high) * 0.5f;
+    float radius = glm::length(high - low) * 0.75f + 1e-3f;
+    std::mt19937 random(4321);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f), signedUnit(-1.0f, 1.0f);
+    std::vector<glm::vec3> origins(rayCount), directions(rayCount);
+    for(size_t i = 0; i < rayCount; i++)
+    {
+        glm::vec3 around = glm::normalize(glm::vec3(signedUnit(random), signedUnit(random), signedUnit(random)) + glm::vec3(1e-4f));
+        glm::vec3 target = low + (high - low) * glm::vec3(unit(random), unit(random), unit(random));
+        origins[i] = center + around * radius;
+        directions[i] = glm::normalize(target - origins[i]);
+    }
+
+    std::vector<float> distances(rayCount);
+    auto castChunk = [&](size_t chunk) {
+        size_t end = std::min(rayCount, (chunk + 1) * CHUNK);
+        for(size_t i = chunk * CHUNK; i < end; i++)
+        {
+            RayHit hit;
+            distances[i] = bvh.intersect(origins[i], directions[i], FLT_MAX, hit) ? hit.distance : FLT_MAX;
+        }
+    };
+    size_t chunks = (rayCount + CHUNK - 1) / CHUNK;
+    start = Clock::now();
+    for(size_t chunk = 0; chunk < chunks; chunk++)
+        castChunk(chunk);
+    double singleMs = millisecondsSince(start);
+    start = Clock::now();
+    if(pool)
+        pool->parallelFor(chunks, castChunk);
+    else
+        for(size_t chunk = 0; chunk < chunks; chunk++)
+            castChunk(chunk);
+    double allMs = millisecondsSince(start);
+
+    size_t hits = 0;
+    for(size_t i = 0; i < rayCount; i++)
+        hits += distances[i] != FLT_MAX;
+    std::cout << "  pick: " << singleMs * 1000.0 / rayCount << " us per ray (" << 100.0 * hits / rayCount << "% hit)" << std::endl;
+    std::cout << "  throughput: " << rayCount / singleMs / 1000.0 << " Mrays/s on one core, " << rayCount / allMs / 1000.0
+              << " Mrays/s on " << threads << " threads" << std::endl;
+
+    int failures = 0;
+    for(size_t i = 0; i < std::min(CHECKED_RAYS, rayCount); i++)
+    {
+        float expected = bruteForce(soup, origins[i], directions[i]);
+        if(std::fabs(expected - distances[i]) > 1e-4f * std::max(1.0f, expected))
+        {
+            std::cout << "  MISMATCH ray " << i << ": BVH " << distances[i] << ", expected " << expected << std::endl;
+            failures++;
+        }
+    }
+    return failures;
+}
+
+int main(int argc, char **argv)
+{
+    size_t rayCount = 1000000;
+    std::vector<Soup> soups;
+    std::vector<std::string> models;
+    for(int i = 1; i < argc; i++)
+    {
+        if(std::strcmp(argv[i], "--rays") == 0 && i + 1 < argc)
+            rayCount = (size_t)std::atol(argv[++i]);
+        else if(std::strcmp(argv[i], "--sphere") == 0 && i + 1 < argc)
+        {
+            soups.push_back(Soup());
+            makeSphere((unsigned int)std::atol(argv[++i]), soups.back());
+        }
+        else
+            models.push_back(argv[i]);
+    }
+    if(models.empty() && soups.empty())
+    {
+        std::ifstream list(FileSystem::getPath("02_model_loading/file.txt"));
+        std::string line;
+        while(std::getline(list, line))
+        {
+            if(!line.empty() && line[line.size() - 1] == '\r')
+                line.erase(line.size() - 1);
+            if(!line.empty())
+                models.push_back(line);
+        }
+    }
+    for(size_t i = 0; i < models.size(); i++)
+    {
+        soups.push_back(Soup());
+        if(!loadSoup(models[i], soups.back()))
+            soups.pop_back();
+    }
+    if(soups.empty() || rayCount == 0)
+    {
+        std::cout << "usage: picking_benchmark [--rays N] [--sphere <triangles>] [model paths relative to the repository root...]" << std::endl;
+        return -1;
+    }
+
+    // ThreadPool(0) would mean one worker per hardware thread: a single core gets no pool
+    unsigned int threads = ThreadPool::defaultWorkerCount();
+    std::unique_ptr<ThreadPool> pool;
+    if(threads > 1)
+        pool.reset(new ThreadPool(threads - 1)); // the calling thread works too
+    std::cout << std::setprecision(4);
+    int failures = 0;
+    for(size_t i = 0; i < soups.size(); i++)
+        failures += measure(soups[i], rayCount, pool.get());
+    if(failures)
+        std::cout << failures << " mismatches" << std::endl;
+    return failures ? 1 : 0;
+}
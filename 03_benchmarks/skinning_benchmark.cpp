@@ -0,0 +1,197 @@
+/*
+Skinning benchmark.
+Measures the CPU side of skeletal animation (utils/skeleton.h, utils/skinning.h) on a synthetic rig, so it runs
+without a rigged asset or a GL context:
+ - posing: SampleClip + BuildSkinPalette for a branching skeleton with an animated channel on every node
+ - skinning: SkinVerticesScalar and SkinVertices (SSE unless built with -DSKINNING_SCALAR) on one thread, then
+   SkinVerticesParallel across ThreadPools of 2, 4, ... up to the hardware threads
+The vertices carry 1 to 4 influences in the mix a character usually has (most of them 1 or 2). Results are vertices
+skinned per second, and per core for the parallel runs; each case repeats until it has run for at least 0.5 s.
+SkinVertices is first checked against SkinVerticesScalar.
+Usage: skinning_benchmark [vertices] [bones]
+Dependencies:
+GLM and the GL3W headers (skinning.h includes mesh.h); no GL context.
+*/
+#include <GL/gl3w.h> // here: we need compile gl3w.c - utils dir
+
+#include <skeleton.h>
+#include <skinning.h>
+#include <thread_pool.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+// runs body until 0.5 s have passed and returns the seconds per call
+template<typename F>
+double timePerCall(F body)
+{
+    body(); // warm-up
+    size_t calls = 0;
+    Clock::time_point start = Clock::now();
+    double elapsed = 0.0;
+    do
+    {
+        body();
+        calls++;
+        elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    } while(elapsed < 0.5);
+    return elapsed / calls;
+}
+
+// every node hangs off a random earlier one and turns about its own axis over a two second clip
+void buildRig(unsigned int bones, std::mt19937 &random, Skeleton &skeleton, AnimationClip &clip)
+{
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    clip.name = "synthetic";
+    clip.duration = 48.0f;
+    clip.ticksPerSecond = 24.0f;
+    for(unsigned int i = 0; i < bones; i++)
+    {
+        SkeletonNode node;
+        node.name = "bone" + std::to_string(i);
+        node.parent = i ? (int)(random() % i) : -1;
+        node.transform = glm::translate(glm::mat4(), glm::vec3(unit(random), unit(random), unit(random)) * 0.2f);
+        skeleton.nodes.push_back(node);
+        skeleton.nodeIndex[node.name] = i;
+        skeleton.addBone(node.name, glm::inverse(node.transform));
+
+        AnimationChannel channel;
+        channel.node = i;
+        glm::vec3 axis = glm::normalize(glm::vec3(unit(random), unit(random), unit(random)) + glm::vec3(0.0f, 0.0f, 1.5f));
+        for(unsigned int k = 0; k <= 24; k++)
+        {
+            float time = k * 2.0f;
+            channel.positions.add(time, glm::vec3(node.transform[3]));
+            channel.rotations.add(time, glm::angleAxis(0.5f * std::sin(time * 0.26f), axis));
+            channel.scales.add(time, glm::vec3(1.0f));
+        }
+        clip.channels.push_back(channel);
+        clip.nodeChannel.push_back((int)i);
+    }
+    skeleton.globalInverse = glm::mat4();
+}
+
+void buildVertices(size_t count, unsigned int bones, std::mt19937 &random, std::vector<Vertex> &vertices, std::vector<BoneInfluence> &influences)
+{
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    vertices.resize(count);
+    influences.resize(count);
+    for(size_t i = 0; i < count; i++)
+    {
+        Vertex &v = vertices[i];
+        v.Position = glm::vec3(unit(random), unit(random), unit(random));
+        v.Normal = glm::normalize(glm::vec3(unit(random), unit(random), 1.0f));
+        v.TexCoords = glm::vec2(unit(random), unit(random));
+        v.Tangent = glm::normalize(glm::cross(v.Normal, glm::vec3(0.0f, 1.0f, 0.0f)));
+        v.Bitangent = glm::cross(v.Normal, v.Tangent);
+
+        // 40% one bone, 35% two, 15% three, 10% four
+        unsigned int roll = random() % 100;
+        unsigned int used = roll < 40 ? 1 : roll < 75 ? 2 : roll < 90 ? 3 : 4;
+        SkinnedVertex s = SkinnedVertex();
+        unsigned int first = random() % bones;
+        for(unsigned int j = 0; j < used; j++)
+            AddBoneInfluence(s, (first + j * 3) % bones, 0.1f + 0.9f * (unit(random) * 0.5f + 0.5f));
+        float sum = s.Weights.x + s.Weights.y + s.Weights.z + s.Weights.w;
+        for(unsigned int j = 0; j < MAX_BONE_INFLUENCES; j++)
+        {
+            influences[i].bones[j] = (uint16_t)s.Bones[j];
+            influences[i].weights[j] = s.Weights[j] / sum;
+        }
+    }
+}
+
+void report(const char *name, size_t vertices, double seconds, unsigned int cores)
+{
+    double perSecond = vertices / seconds;
+    std::printf("%-28s %10.3f ms %10.2f Mvertices/s %10.2f Mvertices/s per core\n", name, seconds * 1e3, perSecond / 1e6, perSecond / 1e6 / cores);
+}
+
+int main(int argc, char **argv)
+{
+    size_t vertexCount = argc > 1 ? (size_t)std::atol(argv[1]) : 500000;
+    unsigned int boneCount = argc > 2 ? (unsigned int)std::atoi(argv[2]) : 64;
+    if(vertexCount == 0 || boneCount == 0 || boneCount > 65535)
+    {
+        std::printf("usage: skinning_benchmark [vertices] [bones (1..65535)]\n");
+        return -1;
+    }
+
+    std::mt19937 random(7);
+    Skeleton skeleton;
+    AnimationClip clip;
+    buildRig(boneCount, random, skeleton, clip);
+    std::vector<Vertex> bind, skinned(vertexCount), reference(vertexCount);
+    std::vector<BoneInfluence> influences;
+    buildVertices(vertexCount, boneCount, random, bind, influences);
+    std::vector<glm::mat4> local, global, palette;
+    SampleClip(clip, skeleton, 0.8f, local);
+    BuildSkinPalette(skeleton, local, global, palette);
+
+    std::printf("%zu vertices, %u bones, %s kernel, %u hardware threads\n", vertexCount, boneCount,
+#ifdef SKINNING_SSE
+                "SSE",
+#else
+                "scalar",
+#endif
+                ThreadPool::defaultWorkerCount());
+
+    SkinVerticesScalar(bind.data(), influences.data(), palette.data(), reference.data(), vertexCount);
+    SkinVertices(bind.data(), influences.data(), palette.data(), skinned.data(), vertexCount);
+    float worst = 0.0f;
+    for(size_t i = 0; i < vertexCount; i++)
+    {
+        worst = std::max(worst, glm::length(skinned[i].Position - reference[i].Position));
+        worst = std::max(worst, glm::length(skinned[i].Normal - reference[i].Normal));
+        worst = std::max(worst, glm::length(skinned[i].Bitangent - reference[i].Bitangent));
+    }
+    std::printf("SkinVertices vs SkinVerticesScalar: largest difference %g\n", worst);
+    if(worst > 1e-4f)
+    {
+        std::printf("ERROR::SKINNING_BENCHMARK:: kernels disagree\n");
+        return -1;
+    }
+
+    float seconds = 0.0f;
+    double pose = timePerCall([&]() {
+        seconds += 1.0f / 60.0f;
+        SampleClip(clip, skeleton, seconds, local);
+        BuildSkinPalette(skeleton, local, global, palette);
+    });
+    std::printf("%-28s %10.3f us per pose (%u nodes)\n", "SampleClip+BuildSkinPalette", pose * 1e6, boneCount);
+
+    report("SkinVerticesScalar 1 thread", vertexCount, timePerCall([&]() {
+        SkinVerticesScalar(bind.data(), influences.data(), palette.data(), skinned.data(), vertexCount);
+    }), 1);
+    report("SkinVertices 1 thread", vertexCount, timePerCall([&]() {
+        SkinVertices(bind.data(), influences.data(), palette.data(), skinned.data(), vertexCount);
+    }), 1);
+    std::vector<unsigned int> threadCounts; // 2, 4, 8, ... and all of them
+    unsigned int hardware = ThreadPool::defaultWorkerCount();
+    for(unsigned int threads = 2; threads < hardware; threads *= 2)
+        threadCounts.push_back(threads);
+    if(hardware > 1)
+        threadCounts.push_back(hardware);
+    for(size_t t = 0; t < threadCounts.size(); t++)
+    {
+        unsigned int threads = threadCounts[t];
+        ThreadPool pool(threads - 1); // the calling thread works too
+        char name[64];
+        std::snprintf(name, sizeof(name), "SkinVerticesParallel %u", threads);
+        report(name, vertexCount, timePerCall([&]() {
+            SkinVerticesParallel(bind.data(), influences.data(), palette.data(), skinned.data(), vertexCount, &pool);
+        }), threads);
+    }
+    return 0;
+}
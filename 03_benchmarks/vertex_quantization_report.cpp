@@ -0,0 +1,128 @@
+/*
+Vertex quantization report.
+Converts every mesh of the given models exactly like Model does, packs it into the VERTEX_FORMAT_PACKED layout
+(utils/vertex_format.h) and prints the vertex buffer size before/after and the worst case error of each attribute,
+per mesh and per asset. Nothing is uploaded, no window or GL context is needed.
+Usage: vertex_quantization_report [model paths relative to the repository root...]
+       without arguments every model listed in 02_model_loading/file.txt is checked
+Dependencies:
+GLM and Assimp, like 04_model_loading.
+*/
+#define STB_IMAGE_IMPLEMENTATION
+#include <GL/gl3w.h> // here: we need compile gl3w.c - utils dir
+
+#include <filesystem.h>
+#include <model.h>
+#include <vertex_format.h>
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+struct AssetTotals {
+    size_t vertices;
+    size_t floatBytes;
+    size_t packedBytes;
+    QuantizationError worst;
+};
+
+void accumulate(QuantizationError &worst, const QuantizationError &e)
+{
+    worst.position = std::max(worst.position, e.position);
+    worst.positionRelative = std::max(worst.positionRelative, e.positionRelative);
+    worst.normalDegrees = std::max(worst.normalDegrees, e.normalDegrees);
+    worst.tangentDegrees = std::max(worst.tangentDegrees, e.tangentDegrees);
+    worst.texCoord = std::max(worst.texCoord, e.texCoord);
+    worst.bitangentSignFlips += e.bitangentSignFlips;
+}
+
+void printError(const QuantizationError &e)
+{
+    std::cout << "position " << e.position << " (" << e.positionRelative << " of the bounds diagonal), normal "
+              << e.normalDegrees << " deg, tangent " << e.tangentDegrees << " deg, uv " << e.texCoord
+              << ", bitangent flips " << e.bitangentSignFlips;
+}
+
+bool reportModel(const std::string &modelPath)
+{
+    Assimp::Importer importer;
+    const aiScene *scene = importer.ReadFile(FileSystem::getPath(modelPath), MODEL_IMPORT_FLAGS);
+    if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+    {
+        std::cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << std::endl;
+        return false;
+    }
+
+    AssetTotals totals;
+    std::memset(&totals, 0, sizeof(totals));
+    std::cout << modelPath << ": " << scene->mNumMeshes << " meshes" << std::endl;
+    for(unsigned int i = 0; i < scene->mNumMeshes; i++)
+    {
+        vector<Vertex> vertices;
+        vector<unsigned int> indices;
+        Model::processMesh(scene->mMeshes[i], vertices, indices);
+
+        vector<PackedVertex> packed;
+        PackedVertexDecode decode;
+        packVertices(vertices, packed, decode);
+        QuantizationError error = measureQuantizationError(vertices, packed, decode);
+
+        totals.vertices += vertices.size();
+        totals.floatBytes += vertices.size() * sizeof(Vertex);
+        totals.packedBytes += packed.size() * sizeof(PackedVertex);
+        accumulate(totals.worst, error);
+
+        std::cout << "  mesh " << i << " \"" << scene->mMeshes[i]->mName.C_Str() << "\": " << vertices.size() << " vertices, ";
+        printError(error);
+        std::cout << std::endl;
+    }
+
+    std::cout << "  total: " << totals.vertices << " vertices, " << (totals.floatBytes >> 10) << " KiB -> "
+              << (totals.packedBytes >> 10) << " KiB ("
+              << (totals.floatBytes ? 100.0 * totals.packedBytes / totals.floatBytes : 0.0) << "%)" << std::endl;
+    std::cout << "  worst: ";
+    printError(totals.worst);
+    std::cout << std::endl;
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<std::string> models;
+    for(int i = 1; i < argc; i++)
+        models.push_back(argv[i]);
+    if(models.empty())
+    {
+        std::ifstream list(FileSystem::getPath("02_model_loading/file.txt"));
+        std::string line;
+        while(std::getline(list, line))
+        {
+            if(!line.empty() && line[line.size() - 1] == '\r')
+                line.erase(line.size() - 1);
+            if(!line.empty())
+                models.push_back(line);
+        }
+    }
+    if(models.empty())
+    {
+        std::cout << "usage: vertex_quantization_report [model paths relative to the repository root...]" << std::endl;
+        return -1;
+    }
+
+    std::cout << std::setprecision(4) << "Vertex " << sizeof(Vertex) << " bytes, PackedVertex " << sizeof(PackedVertex) << " bytes" << std::endl;
+    int failed = 0;
+    for(unsigned int i = 0; i < models.size(); i++)
+    {
+        if(!reportModel(models[i]))
+            failed++;
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,271 @@
+#ifndef ANIMATION_SAMPLER_H
+#define ANIMATION_SAMPLER_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <skeleton.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Playing many instances of a clip. SampleClip (skeleton.h) binary searches every track of every node for every pose,
+// which adds up with hundreds of animated instances. Two cheaper samplers writing the same local transforms
+// BuildSkinPalette reads:
+//   AnimationCursor  - per instance, the key each track was last sampled at. Playback moves forward a little each
+//                      frame, so the next key is that one or a step after it: amortised O(1) per track. Going back
+//                      (the clip looped, a seek) costs one binary search.
+//   CompressedClip   - the clip resampled at a uniform rate and quantised: rotations in 48 bits (smallest three),
+//                      positions and scales in 16 bits per component over the channel's range. Frames are stored
+//                      frame major, so a pose reads two adjacent runs of memory found by one multiply; no search and
+//                      no per instance state.
+
+// per instance playback state of one clip; sampling a different clip resets it
+struct AnimationCursor {
+    const AnimationClip *clip;  // clip the keys index into
+    std::vector<uint32_t> keys; // per channel: its position, rotation and scale key
+
+    AnimationCursor() : clip(nullptr) {}
+};
+
+inline void ResetCursor(AnimationCursor &cursor, const AnimationClip &clip)
+{
+    cursor.clip = &clip;
+    cursor.keys.assign(clip.channels.size() * 3, 0);
+}
+
+// key at or before time, stepping forward from the previous one; a few steps, then a binary search over the rest
+// for large jumps, or over the whole track if time went back
+inline uint32_t AdvanceKey(const std::vector<float> &times, uint32_t key, float time)
+{
+    if(time < times[key])
+        return (uint32_t)FindAnimationKey(times, time);
+    uint32_t last = (uint32_t)times.size() - 1;
+    for(unsigned int step = 0; step < 4; step++)
+    {
+        if(key == last || times[key + 1] > time)
+            return key;
+        key++;
+    }
+    return (uint32_t)(std::upper_bound(times.begin() + key, times.end(), time) - times.begin()) - 1;
+}
+
+// SampleClip through a cursor: the same transforms, without searching
+inline void SampleClip(const AnimationClip &clip, const Skeleton &skeleton, float seconds, AnimationCursor &cursor, std::vector<glm::mat4> &local)
+{
+    if(cursor.clip != &clip || cursor.keys.size() != clip.channels.size() * 3)
+        ResetCursor(cursor, clip);
+    float ticks = ClipTicks(clip, seconds);
+    local.resize(skeleton.nodes.size());
+    for(size_t i = 0; i < skeleton.nodes.size(); i++)
+    {
+        int c = i < clip.nodeChannel.size() ? clip.nodeChannel[i] : -1;
+        if(c < 0)
+        {
+            local[i] = skeleton.nodes[i].transform;
+            continue;
+        }
+        const AnimationChannel &channel = clip.channels[c];
+        uint32_t *keys = &cursor.keys[c * 3];
+        keys[0] = AdvanceKey(channel.positions.times, keys[0], ticks);
+        keys[1] = AdvanceKey(channel.rotations.times, keys[1], ticks);
+        keys[2] = AdvanceKey(channel.scales.times, keys[2], ticks);
+        local[i] = ComposeTransform(InterpolateTrack(channel.positions, keys[0], ticks), InterpolateTrack(channel.rotations, keys[1], ticks),
+                                    InterpolateTrack(channel.scales, keys[2], ticks));
+    }
+}
+
+// a unit quaternion in 48 bits: the three smallest components in 15 bits each, the index of the largest (rebuilt
+// from the unit length) in the top bits of the first two words
+struct PackedQuat {
+    uint16_t v[3];
+};
+
+// a vec3 as 16 bit fractions of its channel's range
+struct PackedVec3 {
+    uint16_t v[3];
+};
+
+// one channel at one frame, 18 bytes against the 40 of the floats
+struct PackedTransform {
+    PackedQuat rotation;
+    PackedVec3 position;
+    PackedVec3 scale;
+};
+
+inline PackedQuat PackQuat(const glm::quat &q)
+{
+    float c[4] = { q.x, q.y, q.z, q.w };
+    unsigned int largest = 0;
+    for(unsigned int i = 1; i < 4; i++)
+        if(std::fabs(c[i]) > std::fabs(c[largest]))
+            largest = i;
+    float sign = c[largest] < 0.0f ? -1.0f : 1.0f; // q and -q are the same rotation: keep the dropped one positive
+    uint16_t bits[3];
+    unsigned int k = 0;
+    for(unsigned int i = 0; i < 4; i++)
+    {
+        if(i == largest)
+            continue;
+        float v = glm::clamp(c[i] * sign * 0.70710678f, -0.5f, 0.5f) + 0.5f; // the others are within +-1/sqrt(2)
+        bits[k++] = (uint16_t)(v * 32767.0f + 0.5f);
+    }
+    PackedQuat p;
+    p.v[0] = (uint16_t)(bits[0] | ((largest & 1u) << 15));
+    p.v[1] = (uint16_t)(bits[1] | ((largest >> 1) << 15));
+    p.v[2] = bits[2];
+    return p;
+}
+
+inline glm::quat UnpackQuat(const PackedQuat &p)
+{
+    unsigned int largest = (p.v[0] >> 15) | ((p.v[1] >> 15) << 1);
+    float c[4];
+    float sum = 0.0f;
+    unsigned int k = 0;
+    for(unsigned int i = 0; i < 4; i++)
+    {
+        if(i == largest)
+            continue;
+        c[i] = ((p.v[k++] & 0x7fff) / 32767.0f - 0.5f) * 1.41421356f;
+        sum += c[i] * c[i];
+    }
+    c[largest] = std::sqrt(std::max(0.0f, 1.0f - sum));
+    return glm::quat(c[3], c[0], c[1], c[2]);
+}
+
+inline PackedVec3 PackVec3(const glm::vec3 &v, const glm::vec3 &min, const glm::vec3 &step)
+{
+    PackedVec3 p;
+    for(int i = 0; i < 3; i++)
+        p.v[i] = step[i] > 0.0f ? (uint16_t)glm::clamp((v[i] - min[i]) / step[i] + 0.5f, 0.0f, 65535.0f) : 0;
+    return p;
+}
+
+inline glm::vec3 UnpackVec3(const PackedVec3 &p, const glm::vec3 &min, const glm::vec3 &step)
+{
+    return min + glm::vec3(p.v[0], p.v[1], p.v[2]) * step;
+}
+
+// an AnimationClip resampled at a uniform rate, the last frame at the clip's end
+struct CompressedClip {
+    std::string name;
+    float duration;         // ticks
+    float ticksPerSecond;
+    float framesPerTick;
+    unsigned int frameCount;
+    std::vector<unsigned int> channelNodes;
+    std::vector<glm::vec3> positionMin, positionStep; // per channel: position = min + packed * step
+    std::vector<glm::vec3> scaleMin, scaleStep;
+    std::vector<PackedTransform> frames;              // frame f of channel c at f * channelNodes.size() + c
+    std::vector<int> nodeChannel;                     // as AnimationClip::nodeChannel
+
+    size_t bytes() const
+    {
+        return frames.size() * sizeof(PackedTransform) + channelNodes.size() * (sizeof(unsigned int) + 4 * sizeof(glm::vec3)) +
+               nodeChannel.size() * sizeof(int);
+    }
+};
+
+// memory of a clip's keys, to set against CompressedClip::bytes
+inline size_t AnimationClipBytes(const AnimationClip &clip)
+{
+    size_t bytes = clip.nodeChannel.size() * sizeof(int);
+    for(size_t c = 0; c < clip.channels.size(); c++)
+    {
+        const AnimationChannel &channel = clip.channels[c];
+        bytes += channel.positions.size() * (sizeof(float) + sizeof(glm::vec3)) + channel.rotations.size() * (sizeof(float) + sizeof(glm::quat)) +
+                 channel.scales.size() * (sizeof(float) + sizeof(glm::vec3)) + sizeof(unsigned int);
+    }
+    return bytes;
+}
+
+// range a track's values are quantised over: 65536 steps from min
+inline void QuantisationRange(const std::vector<glm::vec3> &values, glm::vec3 &min, glm::vec3 &step)
+{
+    glm::vec3 max = values[0];
+    min = values[0];
+    for(size_t i = 1; i < values.size(); i++)
+    {
+        min = glm::min(min, values[i]);
+        max = glm::max(max, values[i]);
+    }
+    step = (max - min) / 65535.0f;
+}
+
+// resamples clip at framesPerSecond (rounded up so that whole frames span the clip) and quantises it
+inline void CompressClip(const AnimationClip &clip, float framesPerSecond, CompressedClip &out)
+{
+    out.name = clip.name;
+    out.duration = clip.duration;
+    out.ticksPerSecond = clip.ticksPerSecond;
+    out.frameCount = clip.duration > 0.0f ? (unsigned int)std::ceil(clip.duration / clip.ticksPerSecond * framesPerSecond) + 1 : 1;
+    out.framesPerTick = out.frameCount > 1 ? (out.frameCount - 1) / clip.duration : 0.0f;
+    out.nodeChannel = clip.nodeChannel;
+    size_t channels = clip.channels.size();
+    out.channelNodes.resize(channels);
+    out.positionMin.resize(channels);
+    out.positionStep.resize(channels);
+    out.scaleMin.resize(channels);
+    out.scaleStep.resize(channels);
+    out.frames.resize(out.frameCount * channels);
+
+    std::vector<glm::vec3> positions(out.frameCount), scales(out.frameCount);
+    for(size_t c = 0; c < channels; c++)
+    {
+        const AnimationChannel &channel = clip.channels[c];
+        out.channelNodes[c] = channel.node;
+        for(unsigned int f = 0; f < out.frameCount; f++)
+        {
+            float ticks = out.frameCount > 1 ? f / out.framesPerTick : 0.0f;
+            positions[f] = SampleTrack(channel.positions, ticks);
+            scales[f] = SampleTrack(channel.scales, ticks);
+            out.frames[f * channels + c].rotation = PackQuat(SampleTrack(channel.rotations, ticks));
+        }
+        QuantisationRange(positions, out.positionMin[c], out.positionStep[c]);
+        QuantisationRange(scales, out.scaleMin[c], out.scaleStep[c]);
+        for(unsigned int f = 0; f < out.frameCount; f++)
+        {
+            out.frames[f * channels + c].position = PackVec3(positions[f], out.positionMin[c], out.positionStep[c]);
+            out.frames[f * channels + c].scale = PackVec3(scales[f], out.scaleMin[c], out.scaleStep[c]);
+        }
+    }
+}
+
+// SampleClip for a CompressedClip: blends the two frames around the time, rotations by normalised lerp (the frames
+// are close enough for it to stay within the quantisation error of a slerp)
+inline void SampleCompressedClip(const CompressedClip &clip, const Skeleton &skeleton, float seconds, std::vector<glm::mat4> &local)
+{
+    float frame = LoopTicks(seconds, clip.duration, clip.ticksPerSecond) * clip.framesPerTick;
+    unsigned int first = clip.frameCount > 1 ? std::min((unsigned int)frame, clip.frameCount - 2) : 0;
+    unsigned int second = clip.frameCount > 1 ? first + 1 : 0;
+    float f = clip.frameCount > 1 ? glm::clamp(frame - first, 0.0f, 1.0f) : 0.0f;
+
+    local.resize(skeleton.nodes.size());
+    for(size_t i = 0; i < skeleton.nodes.size(); i++)
+        if(i >= clip.nodeChannel.size() || clip.nodeChannel[i] < 0)
+            local[i] = skeleton.nodes[i].transform;
+    size_t channels = clip.channelNodes.size();
+    if(channels == 0) // every channel of the clip was dropped on import: frames is empty
+        return;
+    const PackedTransform *a = &clip.frames[first * channels];
+    const PackedTransform *b = &clip.frames[second * channels];
+    for(size_t c = 0; c < channels; c++)
+    {
+        glm::quat ra = UnpackQuat(a[c].rotation);
+        glm::quat rb = UnpackQuat(b[c].rotation);
+        if(glm::dot(ra, rb) < 0.0f)
+            rb = -rb;
+        glm::quat rotation = glm::normalize(ra * (1.0f - f) + rb * f);
+        glm::vec3 position = glm::mix(UnpackVec3(a[c].position, clip.positionMin[c], clip.positionStep[c]),
+                                      UnpackVec3(b[c].position, clip.positionMin[c], clip.positionStep[c]), f);
+        glm::vec3 scale = glm::mix(UnpackVec3(a[c].scale, clip.scaleMin[c], clip.scaleStep[c]),
+                                   UnpackVec3(b[c].scale, clip.scaleMin[c], clip.scaleStep[c]), f);
+        local[clip.channelNodes[c]] = ComposeTransform(position, rotation, scale);
+    }
+}
+
+#endif
@@ -0,0 +1,501 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <glm/glm.hpp>
+
+#include <frustum.h>
+#include <thread_pool.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Bounding volume hierarchy over axis aligned boxes (one per mesh, object, triangle...), built with binned SAH
+// into a flat node array and queried with frusta, rays and boxes.
+
+struct BoundingBox {
+    glm::vec3 min, max;
+};
+
+inline BoundingBox emptyBox()
+{
+    BoundingBox box;
+    box.min = glm::vec3(FLT_MAX);
+    box.max = glm::vec3(-FLT_MAX);
+    return box;
+}
+
+inline void growBox(BoundingBox &box, const BoundingBox &other)
+{
+    box.min = glm::min(box.min, other.min);
+    box.max = glm::max(box.max, other.max);
+}
+
+inline float boxArea(const BoundingBox &box)
+{
+    glm::vec3 e = glm::max(box.max - box.min, glm::vec3(0.0f));
+    return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+}
+
+inline bool boxesOverlap(const BoundingBox &a, const BoundingBox &b)
+{
+    return a.min.x <= b.max.x && a.max.x >= b.min.x &&
+           a.min.y <= b.max.y && a.max.y >= b.min.y &&
+           a.min.z <= b.max.z && a.max.z >= b.min.z;
+}
+
+// slab test; on a hit tNear is where the ray enters the box (0 if it starts inside)
+inline bool rayHitsBox(const glm::vec3 &origin, const glm::vec3 &inverseDirection, float tMax, const BoundingBox &box, float &tNear)
+{
+    glm::vec3 t0 = (box.min - origin) * inverseDirection;
+    glm::vec3 t1 = (box.max - origin) * inverseDirection;
+    glm::vec3 tSmall = glm::min(t0, t1), tBig = glm::max(t0, t1);
+    float enter = std::max(std::max(tSmall.x, tSmall.y), std::max(tSmall.z, 0.0f));
+    float exit = std::min(std::min(tBig.x, tBig.y), std::min(tBig.z, tMax));
+    tNear = enter;
+    return enter <= exit;
+}
+
+// 32 bytes, two per cache line. Interior nodes have count == 0 and their children at first and first + 1;
+// leaves reference primitives[first .. first + count).
+struct BvhNode {
+    glm::vec3 min;
+    unsigned int first;
+    glm::vec3 max;
+    unsigned int count;
+};
+
+class Bvh
+{
+public:
+    static const unsigned int BIN_COUNT = 16;
+    static const unsigned int MAX_LEAF_SIZE = 8;
+    static const unsigned int MAX_DEPTH = 60;    // deeper nodes stay leaves, whatever their size: keeps the query stacks bounded
+    static const size_t PARALLEL_GRAIN = 4096;   // smallest subtree handed to a worker by a parallel build
+
+    Bvh() : builtCost(0.0f) {}
+
+    // builds the tree over boxes[0 .. count); primitive ids reported by the queries index this array. With a pool,
+    // the top of the tree is split on this thread and the subtrees below it are built on the pool's workers.
+    void build(const BoundingBox *boxes, size_t count, ThreadPool *pool = nullptr)
+    {
+        this->boxes.assign(boxes, boxes + count);
+        primitives.resize(count);
+        centroids.resize(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            primitives[i] = (unsigned int)i;
+            centroids[i] = (boxes[i].min + boxes[i].max) * 0.5f;
+        }
+        nodes.clear();
+        if (count == 0)
+        {
+            builtCost = 0.0f;
+            return;
+        }
+        nodes.reserve(2 * count - 1);
+        BvhNode root;
+        root.first = 0;
+        root.count = (unsigned int)count;
+        nodes.push_back(root);
+
+        // nodes of at most grain primitives are left for the pool: about 8 subtrees per thread
+        size_t grain = pool ? std::max<size_t>(PARALLEL_GRAIN, count / (8 * (pool->size() + 1))) : 0;
+        std::vector<PendingNode> frontier;
+        splitDown(nodes, PendingNode(0, 0), grain, frontier);
+        if (frontier.empty())
+        {
+            builtCost = sahCost();
+            return;
+        }
+
+        // subtrees only touch their own range of primitives, so they can be split concurrently into local arrays
+        std::vector< std::vector<BvhNode> > subtrees(frontier.size());
+        pool->parallelFor(frontier.size(), [&](size_t i) {
+            subtrees[i].push_back(nodes[frontier[i].first]);
+            std::vector<PendingNode> none;
+            splitDown(subtrees[i], PendingNode(0, frontier[i].second), 0, none);
+        });
+        // then appended; local node k > 0 becomes node offset + k, local node 0 replaces the frontier node
+        for (size_t i = 0; i < frontier.size(); i++)
+        {
+            std::vector<BvhNode> &subtree = subtrees[i];
+            unsigned int offset = (unsigned int)nodes.size() - 1;
+            for (size_t k = 0; k < subtree.size(); k++)
+            {
+                if (!subtree[k].count)
+                    subtree[k].first += offset;
+            }
+            nodes[frontier[i].first] = subtree[0];
+            nodes.insert(nodes.end(), subtree.begin() + 1, subtree.end());
+        }
+        builtCost = sahCost();
+    }
+
+    // new boxes for the same primitives (e.g. after objects moved): recomputes the node bounds bottom-up, keeping the
+    // topology. Cheap, but the tree degrades the further things move from where they were at build time.
+    void refit(const BoundingBox *boxes)
+    {
+        std::copy(boxes, boxes + this->boxes.size(), this->boxes.begin());
+        for (size_t i = nodes.size(); i-- > 0;)
+        {
+            BvhNode &node = nodes[i];
+            BoundingBox bounds = emptyBox();
+            if (node.count)
+            {
+                for (unsigned int p = node.first; p < node.first + node.count; p++)
+                    growBox(bounds, this->boxes[primitives[p]]);
+            }
+            else
+            {
+                growBox(bounds, nodeBox(nodes[node.first]));
+                growBox(bounds, nodeBox(nodes[node.first + 1]));
+            }
+            node.min = bounds.min;
+            node.max = bounds.max;
+        }
+    }
+
+    // refits, then rebuilds from scratch if the SAH cost grew past rebuildRatio times the cost right after the last
+    // build. Returns true if it rebuilt.
+    bool update(const BoundingBox *boxes, float rebuildRatio = 1.5f)
+    {
+        refit(boxes);
+        if (sahCost() <= builtCost * rebuildRatio)
+            return false;
+        build(boxes, this->boxes.size());
+        return true;
+    }
+
+    // expected cost of a random query, in units of one box test (traversal steps count 1, primitive tests 1 each)
+    float sahCost() const
+    {
+        if (nodes.empty())
+            return 0.0f;
+        float rootArea = boxArea(nodeBox(nodes[0]));
+        if (rootArea <= 0.0f)
+            return (float)nodes[0].count;
+        float cost = 0.0f;
+        for (size_t i = 0; i < nodes.size(); i++)
+            cost += boxArea(nodeBox(nodes[i])) / rootArea * (nodes[i].count ? (float)nodes[i].count : 1.0f);
+        return cost;
+    }
+
+    // visit(primitive) for every primitive whose box is inside or crossing the frustum. Planes a node lies fully
+    // inside of are not tested again below it; a node inside all six has its whole subtree reported untested.
+    template<typename Visit>
+    void queryFrustum(const Frustum &frustum, Visit visit) const
+    {
+        if (nodes.empty())
+            return;
+        StackEntry stack[64];
+        int top = 0;
+        stack[top].node = 0;
+        stack[top++].planes = 0x3f;
+        while (top > 0)
+        {
+            StackEntry entry = stack[--top];
+            const BvhNode &node = nodes[entry.node];
+            unsigned int planes = entry.planes;
+            if (!classify(frustum, node.min, node.max, planes))
+                continue;
+            if (node.count)
+            {
+                for (unsigned int p = node.first; p < node.first + node.count; p++)
+                {
+                    unsigned int leafPlanes = planes;
+                    const BoundingBox &box = boxes[primitives[p]];
+                    if (!leafPlanes || classify(frustum, box.min, box.max, leafPlanes))
+                        visit(primitives[p]);
+                }
+            }
+            else if (!planes)
+                visitSubtree(entry.node, visit);
+            else
+            {
+                stack[top].node = node.first;
+                stack[top++].planes = planes;
+                stack[top].node = node.first + 1;
+                stack[top++].planes = planes;
+            }
+        }
+    }
+
+    // visit(primitive, tNear) for the primitives whose box the ray enters before tMax, nearer subtrees first.
+    // visit returns the new tMax: return the distance of an actual hit to get closest-hit traversal, or tMax
+    // unchanged to see every box along the ray.
+    template<typename Visit>
+    void queryRay(const glm::vec3 &origin, const glm::vec3 &direction, float tMax, Visit visit) const
+    {
+        if (nodes.empty())
+            return;
+        glm::vec3 inverseDirection = 1.0f / direction;
+        float tNear;
+        if (!rayHitsBox(origin, inverseDirection, tMax, nodeBox(nodes[0]), tNear))
+            return;
+        RayEntry stack[64];
+        int top = 0;
+        stack[top].node = 0;
+        stack[top++].tNear = tNear;
+        while (top > 0)
+        {
+            RayEntry entry = stack[--top];
+            if (entry.tNear > tMax)
+                continue;
+            const BvhNode &node = nodes[entry.node];
+            if (node.count)
+            {
+                for (unsigned int p = node.first; p < node.first + node.count; p++)
+                {
+                    if (rayHitsBox(origin, inverseDirection, tMax, boxes[primitives[p]], tNear))
+                        tMax = visit(primitives[p], tNear);
+                }
+                continue;
+            }
+            float tLeft, tRight;
+            bool hitLeft = rayHitsBox(origin, inverseDirection, tMax, nodeBox(nodes[node.first]), tLeft);
+            bool hitRight = rayHitsBox(origin, inverseDirection, tMax, nodeBox(nodes[node.first + 1]), tRight);
+            // push the farther child first so the nearer one is popped next
+            if (hitLeft && hitRight)
+            {
+                bool leftFirst = tLeft <= tRight;
+                stack[top].node = leftFirst ? node.first + 1 : node.first;
+                stack[top++].tNear = leftFirst ? tRight : tLeft;
+                stack[top].node = leftFirst ? node.first : node.first + 1;
+                stack[top++].tNear = leftFirst ? tLeft : tRight;
+            }
+            else if (hitLeft || hitRight)
+            {
+                stack[top].node = hitLeft ? node.first : node.first + 1;
+                stack[top++].tNear = hitLeft ? tLeft : tRight;
+            }
+        }
+    }
+
+    // visit(primitive) for every primitive whose box overlaps the given one
+    template<typename Visit>
+    void queryOverlap(const BoundingBox &box, Visit visit) const
+    {
+        if (nodes.empty())
+            return;
+        unsigned int stack[64];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0)
+        {
+            const BvhNode &node = nodes[stack[--top]];
+            if (!boxesOverlap(nodeBox(node), box))
+                continue;
+            if (node.count)
+            {
+                for (unsigned int p = node.first; p < node.first + node.count; p++)
+                {
+                    if (boxesOverlap(boxes[primitives[p]], box))
+                        visit(primitives[p]);
+                }
+            }
+            else
+            {
+                stack[top++] = node.first;
+                stack[top++] = node.first + 1;
+            }
+        }
+    }
+
+    size_t nodeCount() const { return nodes.size(); }
+    size_t primitiveCount() const { return boxes.size(); }
+    const BoundingBox &primitiveBox(unsigned int primitive) const { return boxes[primitive]; }
+    // raw tree, for converting it into other layouts: node 0 is the root, leaf ranges index leafPrimitive
+    const BvhNode &node(unsigned int index) const { return nodes[index]; }
+    unsigned int leafPrimitive(unsigned int index) const { return primitives[index]; }
+
+private:
+    struct StackEntry {
+        unsigned int node;
+        unsigned int planes; // bit i set: plane i still needs testing
+    };
+    struct RayEntry {
+        unsigned int node;
+        float tNear;
+    };
+
+    typedef std::pair<unsigned int, unsigned int> PendingNode; // (node, depth)
+
+    std::vector<BvhNode> nodes;
+    std::vector<unsigned int> primitives; // leaf order
+    std::vector<BoundingBox> boxes;       // by primitive id
+    std::vector<glm::vec3> centroids;     // by primitive id, build only
+    float builtCost;
+
+    static BoundingBox nodeBox(const BvhNode &node)
+    {
+        BoundingBox box;
+        box.min = node.min;
+        box.max = node.max;
+        return box;
+    }
+
+    // false if the box is outside one of the planes in the mask; clears the bits of the planes it is fully inside
+    static bool classify(const Frustum &frustum, const glm::vec3 &min, const glm::vec3 &max, unsigned int &planes)
+    {
+        glm::vec3 center = (min + max) * 0.5f;
+        glm::vec3 extent = (max - min) * 0.5f;
+        for (int i = 0; i < 6; i++)
+        {
+            if (!(planes & (1u << i)))
+                continue;
+            const glm::vec4 &plane = frustum.planes[i];
+            float distance = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+            float radius = std::fabs(plane.x) * extent.x + std::fabs(plane.y) * extent.y + std::fabs(plane.z) * extent.z;
+            if (distance + radius < 0.0f)
+                return false;
+            if (distance - radius >= 0.0f)
+                planes &= ~(1u << i);
+        }
+        return true;
+    }
+
+    template<typename Visit>
+    void visitSubtree(unsigned int root, Visit &visit) const
+    {
+        unsigned int stack[64];
+        int top = 0;
+        stack[top++] = root;
+        while (top > 0)
+        {
+            const BvhNode &node = nodes[stack[--top]];
+            if (node.count)
+            {
+                for (unsigned int p = node.first; p < node.first + node.count; p++)
+                    visit(primitives[p]);
+            }
+            else
+            {
+                stack[top++] = node.first;
+                stack[top++] = node.first + 1;
+            }
+        }
+    }
+
+    // splits start and its descendants in out; children are always appended after their parent (refit relies on
+    // it). Nodes of at most grain primitives (grain > 0) are not split but added to frontier instead.
+    void splitDown(std::vector<BvhNode> &out, PendingNode start, size_t grain, std::vector<PendingNode> &frontier)
+    {
+        std::vector<PendingNode> pending(1, start);
+        while (!pending.empty())
+        {
+            PendingNode next = pending.back();
+            pending.pop_back();
+            BvhNode node = out[next.first];
+            if (grain && node.count <= grain)
+            {
+                frontier.push_back(next);
+                continue;
+            }
+            bool split = splitNode(node, next.second < MAX_DEPTH, out);
+            out[next.first] = node;
+            if (split)
+            {
+                pending.push_back(PendingNode(node.first, next.second + 1));
+                pending.push_back(PendingNode(node.first + 1, next.second + 1));
+            }
+        }
+    }
+
+    // sets the node's bounds and, if allowed and the binned SAH finds a split cheaper than keeping it a leaf,
+    // partitions its primitives and appends its two children to out (node then points at them)
+    bool splitNode(BvhNode &node, bool allowed, std::vector<BvhNode> &out)
+    {
+        unsigned int first = node.first, count = node.count;
+        BoundingBox bounds = emptyBox(), centroidBounds = emptyBox();
+        for (unsigned int p = first; p < first + count; p++)
+        {
+            growBox(bounds, boxes[primitives[p]]);
+            centroidBounds.min = glm::min(centroidBounds.min, centroids[primitives[p]]);
+            centroidBounds.max = glm::max(centroidBounds.max, centroids[primitives[p]]);
+        }
+        node.min = bounds.min;
+        node.max = bounds.max;
+        if (count <= 2 || !allowed)
+            return false;
+
+        // sweep the bins of every axis for the cheapest plane
+        float bestCost = FLT_MAX;
+        int bestAxis = -1;
+        unsigned int bestBin = 0;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float low = centroidBounds.min[axis], extent = centroidBounds.max[axis] - low;
+            if (extent <= 0.0f)
+                continue;
+            float scale = BIN_COUNT / extent;
+            BoundingBox binBoxes[BIN_COUNT];
+            unsigned int binCounts[BIN_COUNT] = { 0 };
+            for (unsigned int b = 0; b < BIN_COUNT; b++)
+                binBoxes[b] = emptyBox();
+            for (unsigned int p = first; p < first + count; p++)
+            {
+                unsigned int b = std::min(BIN_COUNT - 1, (unsigned int)((centroids[primitives[p]][axis] - low) * scale));
+                binCounts[b]++;
+                growBox(binBoxes[b], boxes[primitives[p]]);
+            }
+            // leftArea[i]/leftCount[i]: bins 0..i; the right side is accumulated in the second sweep
+            float leftArea[BIN_COUNT - 1];
+            unsigned int leftCount[BIN_COUNT - 1];
+            BoundingBox sweep = emptyBox();
+            unsigned int sum = 0;
+            for (unsigned int b = 0; b < BIN_COUNT - 1; b++)
+            {
+                growBox(sweep, binBoxes[b]);
+                sum += binCounts[b];
+                leftArea[b] = boxArea(sweep);
+                leftCount[b] = sum;
+            }
+            sweep = emptyBox();
+            sum = 0;
+            for (unsigned int b = BIN_COUNT - 1; b > 0; b--)
+            {
+                growBox(sweep, binBoxes[b]);
+                sum += binCounts[b];
+                if (!sum || !leftCount[b - 1])
+                    continue;
+                float cost = leftArea[b - 1] * leftCount[b - 1] + boxArea(sweep) * sum;
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestBin = b;
+                }
+            }
+        }
+
+        // compare with intersecting every primitive of a leaf (one traversal step costs about one box test)
+        float leafCost = boxArea(bounds) * count;
+        if (bestAxis < 0 || (count <= MAX_LEAF_SIZE && bestCost + boxArea(bounds) >= leafCost))
+            return false;
+
+        float low = centroidBounds.min[bestAxis];
+        float scale = BIN_COUNT / (centroidBounds.max[bestAxis] - low);
+        // primitives is shared, but concurrent splits only ever touch their own node's range of it
+        unsigned int *begin = primitives.data() + first;
+        unsigned int *middle = std::partition(begin, begin + count, [&](unsigned int primitive) {
+            return std::min(BIN_COUNT - 1, (unsigned int)((centroids[primitive][bestAxis] - low) * scale)) < bestBin;
+        });
+        unsigned int leftCountFinal = (unsigned int)(middle - begin);
+
+        BvhNode child;
+        child.first = first;
+        child.count = leftCountFinal;
+        out.push_back(child);
+        child.first = first + leftCountFinal;
+        child.count = count - leftCountFinal;
+        out.push_back(child);
+        node.first = (unsigned int)out.size() - 2;
+        node.count = 0;
+        return true;
+    }
+};
+#endif
@@ -0,0 +1,177 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+// View frustum culling against per-mesh bounding volumes.
+
+// the six clip planes (left, right, bottom, top, near, far) as ax + by + cz + d >= 0 inside, normalised
+struct Frustum {
+    glm::vec4 planes[6];
+};
+
+// Gribb/Hartmann plane extraction. With clip = projection * view * model the planes live in the model's space,
+// so model space bounds can be tested without transforming them.
+inline Frustum extractFrustum(const glm::mat4 &clip)
+{
+    // glm is column major: row i is (clip[0][i], clip[1][i], clip[2][i], clip[3][i])
+    glm::vec4 row0(clip[0][0], clip[1][0], clip[2][0], clip[3][0]);
+    glm::vec4 row1(clip[0][1], clip[1][1], clip[2][1], clip[3][1]);
+    glm::vec4 row2(clip[0][2], clip[1][2], clip[2][2], clip[3][2]);
+    glm::vec4 row3(clip[0][3], clip[1][3], clip[2][3], clip[3][3]);
+    Frustum frustum;
+    frustum.planes[0] = row3 + row0;
+    frustum.planes[1] = row3 - row0;
+    frustum.planes[2] = row3 + row1;
+    frustum.planes[3] = row3 - row1;
+    frustum.planes[4] = row3 + row2;
+    frustum.planes[5] = row3 - row2;
+    for (int i = 0; i < 6; i++)
+    {
+        float length = glm::length(glm::vec3(frustum.planes[i]));
+        if (length > 0.0f)
+            frustum.planes[i] /= length;
+    }
+    return frustum;
+}
+
+// axis aligned box and bounding sphere of a mesh, in model space
+struct MeshBounds {
+    glm::vec3 min, max;
+    glm::vec3 center;   // sphere
+    float radius;
+};
+
+// AABB plus a Ritter sphere (tighter than the box's circumsphere for most meshes); V needs a Position member
+template<typename V>
+MeshBounds computeMeshBounds(const std::vector<V> &vertices)
+{
+    MeshBounds bounds;
+    bounds.min = bounds.max = bounds.center = glm::vec3(0.0f);
+    bounds.radius = 0.0f;
+    if (vertices.empty())
+        return bounds;
+
+    bounds.min = bounds.max = vertices[0].Position;
+    for (size_t i = 1; i < vertices.size(); i++)
+    {
+        bounds.min = glm::min(bounds.min, vertices[i].Position);
+        bounds.max = glm::max(bounds.max, vertices[i].Position);
+    }
+
+    // Ritter: start from the farthest pair found from an arbitrary point, then grow to enclose the rest
+    size_t a = 0, b = 0;
+    float farthest = -1.0f;
+    for (size_t i = 0; i < vertices.size(); i++)
+    {
+        float d = glm::dot(vertices[i].Position - vertices[0].Position, vertices[i].Position - vertices[0].Position);
+        if (d > farthest)
+            farthest = d, a = i;
+    }
+    farthest = -1.0f;
+    for (size_t i = 0; i < vertices.size(); i++)
+    {
+        float d = glm::dot(vertices[i].Position - vertices[a].Position, vertices[i].Position - vertices[a].Position);
+        if (d > farthest)
+            farthest = d, b = i;
+    }
+    glm::vec3 center = (vertices[a].Position + vertices[b].Position) * 0.5f;
+    float radius = std::sqrt(farthest) * 0.5f;
+    for (size_t i = 0; i < vertices.size(); i++)
+    {
+        glm::vec3 offset = vertices[i].Position - center;
+        float distance = glm::length(offset);
+        if (distance > radius)
+        {
+            float grown = (radius + distance) * 0.5f;
+            center += offset * ((grown - radius) / distance);
+            radius = grown;
+        }
+    }
+
+    // keep whichever sphere is smaller: Ritter's or the one around the box
+    glm::vec3 boxCenter = (bounds.min + bounds.max) * 0.5f;
+    float boxRadius = 0.0f;
+    for (size_t i = 0; i < vertices.size(); i++)
+        boxRadius = std::max(boxRadius, glm::length(vertices[i].Position - boxCenter));
+    if (boxRadius < radius)
+        center = boxCenter, radius = boxRadius;
+    bounds.center = center;
+    bounds.radius = radius;
+    return bounds;
+}
+
+struct CullStats {
+    unsigned int visible;
+    unsigned int culled;
+};
+
+// Bounds of many meshes in structure-of-arrays form: every field is its own contiguous float array, so the plane
+// tests in cull() run over plain streams the compiler can vectorise (no gathers, no per-mesh branches).
+class BoundsArray
+{
+public:
+    void clear()
+    {
+        sphereX.clear(); sphereY.clear(); sphereZ.clear(); sphereRadius.clear();
+        boxX.clear(); boxY.clear(); boxZ.clear();
+        extentX.clear(); extentY.clear(); extentZ.clear();
+    }
+
+    void add(const MeshBounds &bounds)
+    {
+        sphereX.push_back(bounds.center.x);
+        sphereY.push_back(bounds.center.y);
+        sphereZ.push_back(bounds.center.z);
+        sphereRadius.push_back(bounds.radius);
+        glm::vec3 center = (bounds.min + bounds.max) * 0.5f;
+        glm::vec3 extent = (bounds.max - bounds.min) * 0.5f;
+        boxX.push_back(center.x);
+        boxY.push_back(center.y);
+        boxZ.push_back(center.z);
+        extentX.push_back(extent.x);
+        extentY.push_back(extent.y);
+        extentZ.push_back(extent.z);
+    }
+
+    size_t size() const { return sphereX.size(); }
+
+    // visible[i] = 1 if mesh i may intersect the frustum (both its sphere and its box are inside or crossing every
+    // plane), else 0. Conservative: never rejects a visible mesh.
+    CullStats cull(const Frustum &frustum, unsigned char *visible) const
+    {
+        size_t count = size();
+        for (size_t i = 0; i < count; i++)
+            visible[i] = 1;
+        for (int p = 0; p < 6; p++)
+        {
+            const float a = frustum.planes[p].x, b = frustum.planes[p].y, c = frustum.planes[p].z, d = frustum.planes[p].w;
+            const float absA = std::fabs(a), absB = std::fabs(b), absC = std::fabs(c);
+            const float *sx = sphereX.data(), *sy = sphereY.data(), *sz = sphereZ.data(), *sr = sphereRadius.data();
+            const float *bx = boxX.data(), *by = boxY.data(), *bz = boxZ.data();
+            const float *ex = extentX.data(), *ey = extentY.data(), *ez = extentZ.data();
+            for (size_t i = 0; i < count; i++)
+            {
+                float sphereDistance = a * sx[i] + b * sy[i] + c * sz[i] + d + sr[i];
+                float boxDistance = a * bx[i] + b * by[i] + c * bz[i] + d + absA * ex[i] + absB * ey[i] + absC * ez[i];
+                visible[i] &= (unsigned char)((sphereDistance >= 0.0f) & (boxDistance >= 0.0f));
+            }
+        }
+        CullStats stats = { 0, 0 };
+        for (size_t i = 0; i < count; i++)
+            stats.visible += visible[i];
+        stats.culled = (unsigned int)count - stats.visible;
+        return stats;
+    }
+
+private:
+    std::vector<float> sphereX, sphereY, sphereZ, sphereRadius;
+    std::vector<float> boxX, boxY, boxZ;
+    std::vector<float> extentX, extentY, extentZ;
+};
+#endif
@@ -0,0 +1,121 @@
+#ifndef GEOMETRY_ARENA_H
+#define GEOMETRY_ARENA_H
+
+#include <GL/gl3w.h> // here: we need compile gl3w.c - utils dir
+
+#include <gl_state.h>
+#include <cstddef>
+
+// Where a mesh landed in a GeometryArena: its indices are relative to its own first vertex, so they are drawn with
+// glDrawElementsBaseVertex / glMultiDrawElementsBaseVertex (GL 3.2) and never need rewriting.
+struct GeometryRange {
+    GLint baseVertex;       // first vertex of the mesh in the arena's vertex buffer
+    GLintptr indexOffset;   // bytes into the arena's index buffer
+};
+
+// One vertex buffer, one index buffer and one VAO shared by every mesh of a vertex layout and index type.
+// Meshes are appended one after the other (nothing is ever freed: like Mesh's own buffers, the GL objects go away
+// with the context), so a whole scene draws from a single VAO and draws that share their textures can be merged into
+// one multi-draw.
+// When a buffer fills up it is replaced by one twice the size and the old contents copied over on the GPU
+// (glCopyBufferSubData); the VAO keeps its name, so ranges and packets handed out before stay valid.
+class GeometryArena
+{
+public:
+    // setAttributes describes the vertex layout for the VAO and the buffer bound to GL_ARRAY_BUFFER (Mesh's layouts)
+    GeometryArena(GLsizei vertexStride, GLenum indexType, void (*setAttributes)())
+        : vertexStride(vertexStride), indexType(indexType), setAttributes(setAttributes),
+          vao(0), vbo(0), ebo(0), vertexCapacity(0), vertexCount(0), indexCapacity(0), indexBytes(0)
+    {
+    }
+
+    // uploads count vertices of vertexStride bytes and indexCount indices of the arena's index type
+    GeometryRange allocate(const void *vertices, size_t count, const void *indices, size_t indexCount)
+    {
+        size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+        reserve(vertexCount + count, indexBytes + indexCount * indexSize);
+        GeometryRange range;
+        range.baseVertex = (GLint)vertexCount;
+        range.indexOffset = (GLintptr)indexBytes;
+
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)(vertexCount * vertexStride), count * vertexStride, vertices);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, ebo); // the element binding belongs to a VAO; leave whatever is bound alone
+        glBufferSubData(GL_COPY_WRITE_BUFFER, range.indexOffset, indexCount * indexSize, indices);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        vertexCount += count;
+        indexBytes += indexCount * indexSize;
+        return range;
+    }
+
+    GLuint vertexArray() const { return vao; }
+    GLenum type() const { return indexType; }
+    size_t vertexBytes() const { return vertexCount * vertexStride; }
+    size_t indexBufferBytes() const { return indexBytes; }
+    size_t capacityBytes() const { return vertexCapacity * vertexStride + indexCapacity; } // what the two buffers were created with
+
+private:
+    static const size_t MIN_VERTICES = 65536;
+    static const size_t MIN_INDEX_BYTES = 256 * 1024;
+
+    void reserve(size_t vertices, size_t indices)
+    {
+        if(!vao)
+            glGenVertexArrays(1, &vao);
+        if(vertices > vertexCapacity)
+        {
+            size_t capacity = vertexCapacity ? vertexCapacity : MIN_VERTICES;
+            while(capacity < vertices)
+                capacity *= 2;
+            vbo = grow(vbo, vertexCount * vertexStride, capacity * vertexStride);
+            vertexCapacity = capacity;
+            SharedGLState().bindVertexArray(vao);
+            glBindBuffer(GL_ARRAY_BUFFER, vbo);
+            setAttributes();
+            SharedGLState().bindVertexArray(0);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+        if(indices > indexCapacity)
+        {
+            size_t capacity = indexCapacity ? indexCapacity : MIN_INDEX_BYTES;
+            while(capacity < indices)
+                capacity *= 2;
+            ebo = grow(ebo, indexBytes, capacity);
+            indexCapacity = capacity;
+            SharedGLState().bindVertexArray(vao);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+            SharedGLState().bindVertexArray(0);
+        }
+    }
+
+    // a new buffer of the given size holding the first used bytes of buffer (if any), which is deleted
+    static GLuint grow(GLuint buffer, size_t used, size_t bytes)
+    {
+        GLuint grown;
+        glGenBuffers(1, &grown);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+        glBufferData(GL_COPY_WRITE_BUFFER, bytes, NULL, GL_STATIC_DRAW);
+        if(used)
+        {
+            glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, used);
+            glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        if(buffer)
+            glDeleteBuffers(1, &buffer);
+        return grown;
+    }
+
+    GLsizei vertexStride;
+    GLenum indexType;
+    void (*setAttributes)();
+    GLuint vao, vbo, ebo;
+    size_t vertexCapacity, vertexCount; // in vertices
+    size_t indexCapacity, indexBytes;   // in bytes
+
+    GeometryArena(const GeometryArena&);
+    GeometryArena &operator=(const GeometryArena&);
+};
+#endif
@@ -0,0 +1,219 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <GL/gl3w.h> // here: we need compile gl3w.c - utils dir
+
+#include <cstring>
+
+// texture units GLStateCache shadows (MAX_PACKET_TEXTURES of mesh.h plus spare units)
+const unsigned int GL_STATE_TEXTURE_UNITS = 32;
+// indexed uniform buffer binding points GLStateCache shadows (UNIFORM_BLOCK_* of uniform_ring.h plus spare points)
+const unsigned int GL_STATE_UNIFORM_BINDINGS = 8;
+
+// calls GLStateCache was asked for since the last resetCounters
+struct GLStateCounters {
+    unsigned int issued;    // reached GL
+    unsigned int skipped;   // already in place, filtered out
+};
+
+// capabilities GLStateCache shadows for enable/disable; others are passed through
+const GLenum GL_STATE_CAPABILITIES[] = { GL_DEPTH_TEST, GL_CULL_FACE, GL_BLEND, GL_STENCIL_TEST, GL_SCISSOR_TEST };
+const unsigned int GL_STATE_CAPABILITY_COUNT = sizeof(GL_STATE_CAPABILITIES) / sizeof(GL_STATE_CAPABILITIES[0]);
+
+// Shadow copy of the state the draw paths change all the time: the program, the VAO, the 2D / cube map texture of
+// every unit (plus the active unit, which glBindTexture depends on), the uniform buffer range of the first binding
+// points, the depth function and the common enable bits.
+// A call that would leave GL as it is never reaches the driver. The cache only knows what went through it: after GL
+// was changed behind its back (raw gl* calls, another library) call invalidate() and the next call of each kind is
+// issued again. SharedGLState() is the instance all the draw and upload paths of this repository use.
+class GLStateCache
+{
+public:
+    GLStateCache()
+    {
+        invalidate();
+        resetCounters();
+    }
+
+    // forgets everything; the next request for each binding is issued
+    void invalidate()
+    {
+        program = UNKNOWN;
+        vao = UNKNOWN;
+        activeUnit = UNKNOWN;
+        depthFunction = UNKNOWN;
+        for(unsigned int i = 0; i < GL_STATE_TEXTURE_UNITS; i++)
+            textures2D[i] = texturesCube[i] = UNKNOWN;
+        for(unsigned int i = 0; i < GL_STATE_CAPABILITY_COUNT; i++)
+            capabilities[i] = UNKNOWN;
+        for(unsigned int i = 0; i < GL_STATE_UNIFORM_BINDINGS; i++)
+        {
+            uniformBuffers[i].buffer = UNKNOWN;
+            uniformBuffers[i].offset = 0;
+            uniformBuffers[i].size = 0;
+        }
+    }
+
+    // each returns true if the call was issued, false if the binding was already in place
+    bool useProgram(GLuint id)
+    {
+        if(!change(program, id))
+            return false;
+        glUseProgram(id);
+        return true;
+    }
+
+    bool bindVertexArray(GLuint id)
+    {
+        if(!change(vao, id))
+            return false;
+        glBindVertexArray(id);
+        return true;
+    }
+
+    bool activeTexture(GLuint unit)
+    {
+        if(!change(activeUnit, unit))
+            return false;
+        glActiveTexture(GL_TEXTURE0 + unit);
+        return true;
+    }
+
+    // binds texture to target (GL_TEXTURE_2D or GL_TEXTURE_CUBE_MAP) of unit, switching the active unit only if needed
+    bool bindTexture(GLuint unit, GLenum target, GLuint texture)
+    {
+        GLuint &bound = target == GL_TEXTURE_CUBE_MAP ? texturesCube[unit] : textures2D[unit];
+        if(!change(bound, texture))
+            return false;
+        activeTexture(unit);
+        glBindTexture(target, texture);
+        return true;
+    }
+
+    // glBindBufferRange(GL_UNIFORM_BUFFER, ...): a new buffer, offset or size of the range is issued
+    bool bindUniformBuffer(GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+    {
+        if(index < GL_STATE_UNIFORM_BINDINGS)
+        {
+            UniformBufferRange &bound = uniformBuffers[index];
+            if(bound.buffer == buffer && bound.offset == offset && bound.size == size)
+            {
+                stats.skipped++;
+                return false;
+            }
+            bound.buffer = buffer;
+            bound.offset = offset;
+            bound.size = size;
+        }
+        stats.issued++;
+        glBindBufferRange(GL_UNIFORM_BUFFER, index, buffer, offset, size);
+        return true;
+    }
+
+    bool depthFunc(GLenum func)
+    {
+        if(!change(depthFunction, func))
+            return false;
+        glDepthFunc(func);
+        return true;
+    }
+
+    bool enable(GLenum capability)
+    {
+        return setCapability(capability, true);
+    }
+
+    bool disable(GLenum capability)
+    {
+        return setCapability(capability, false);
+    }
+
+    const GLStateCounters &counters() const { return stats; }
+
+    void resetCounters()
+    {
+        stats.issued = 0;
+        stats.skipped = 0;
+    }
+
+private:
+    static const GLuint UNKNOWN = ~0u; // never a valid GL name
+
+    // updates the shadow value and counts the request
+    bool change(GLuint &current, GLuint value)
+    {
+        if(current == value)
+        {
+            stats.skipped++;
+            return false;
+        }
+        current = value;
+        stats.issued++;
+        return true;
+    }
+
+    bool setCapability(GLenum capability, bool enabled)
+    {
+        unsigned int i = 0;
+        while(i < GL_STATE_CAPABILITY_COUNT && GL_STATE_CAPABILITIES[i] != capability)
+            i++;
+        if(i < GL_STATE_CAPABILITY_COUNT && !change(capabilities[i], enabled ? 1u : 0u))
+            return false;
+        if(i == GL_STATE_CAPABILITY_COUNT)
+            stats.issued++;
+        if(enabled)
+            glEnable(capability);
+        else
+            glDisable(capability);
+        return true;
+    }
+
+    struct UniformBufferRange {
+        GLuint buffer;
+        GLintptr offset;
+        GLsizeiptr size;
+    };
+
+    GLuint program, vao, activeUnit, depthFunction;
+    GLuint capabilities[GL_STATE_CAPABILITY_COUNT];
+    GLuint textures2D[GL_STATE_TEXTURE_UNITS];
+    GLuint texturesCube[GL_STATE_TEXTURE_UNITS];
+    UniformBufferRange uniformBuffers[GL_STATE_UNIFORM_BINDINGS];
+    GLStateCounters stats;
+
+    GLStateCache(const GLStateCache&);
+    GLStateCache &operator=(const GLStateCache&);
+};
+
+// the tracker Mesh, Model, RenderQueue, the texture uploads, the skybox and the 01_camera demos go through
+// (one GL context per program, so one shadow copy)
+inline GLStateCache &SharedGLState()
+{
+    static GLStateCache state;
+    return state;
+}
+
+inline bool HasGLExtension(const char *name)
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for(GLint i = 0; i < count; i++)
+    {
+        const char *extension = (const char*)glGetStringi(GL_EXTENSIONS, (GLuint)i);
+        if(extension && strcmp(extension, name) == 0)
+            return true;
+    }
+    return false;
+}
+
+// Streaming buffers, rewritten every frame, follow one policy. The GL 3.3 baseline orphans the storage on each rewrite
+// (glBufferData with NULL at the same size, then glBufferSubData), so the driver keeps the old block alive for draws
+// still in flight instead of stalling. Where GL 4.4 / ARB_buffer_storage is also present, a buffer may instead stay
+// persistently and coherently mapped, be written in place and fence each frame's region. UniformRing does that;
+// InstanceBuffer always orphans, because its size follows each call's instance count and every reallocation would
+// re-point the mesh VAOs' instance attributes.
+inline bool PersistentMappingSupported()
+{
+    return glBufferStorage != nullptr && (gl3wIsSupported(4, 4) || HasGLExtension("GL_ARB_buffer_storage"));
+}
+#endif
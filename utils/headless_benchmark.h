@@ -0,0 +1,374 @@
+#ifndef HEADLESS_BENCHMARK_H
+#define HEADLESS_BENCHMARK_H
+
+#include <GL/gl3w.h> // here: we need compile gl3w.c - utils dir
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Pieces of the non-interactive benchmark mode of 04_model_loading: command line, offscreen render target,
+// GPU timer queries, the scripted camera path and the CSV/JSON report.
+//
+//   04_model_loading --benchmark <frames> [--model <path relative to the repository root>] [--size <w>x<h>] [--out <file>]
+//                    [--instances <count>]
+//
+// --out ending in .json writes JSON, any other name CSV; without --out the CSV goes to stdout.
+// --instances (also without --benchmark) is the instancing stress mode: that many copies of the model in a grid.
+
+struct BenchmarkSettings {
+    bool enabled;
+    unsigned int frames;
+    unsigned int width, height;
+    std::string modelPath;  // empty: the one named in currentFile.txt
+    std::string outputPath; // empty: stdout
+    unsigned int instances; // > 0: draw that many copies with Model::DrawInstanced instead of the model once
+};
+
+// returns false (after printing the usage) on malformed arguments; without --benchmark settings.enabled stays false
+inline bool parseBenchmarkArguments(int argc, char **argv, BenchmarkSettings &settings, unsigned int defaultWidth, unsigned int defaultHeight)
+{
+    settings.enabled = false;
+    settings.frames = 0;
+    settings.width = defaultWidth;
+    settings.height = defaultHeight;
+    settings.modelPath.clear();
+    settings.outputPath.clear();
+    settings.instances = 0;
+    bool valid = true;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--benchmark" && hasValue)
+        {
+            settings.enabled = true;
+            settings.frames = (unsigned int)std::atoi(argv[++i]);
+        }
+        else if (arg == "--model" && hasValue)
+            settings.modelPath = argv[++i];
+        else if (arg == "--out" && hasValue)
+            settings.outputPath = argv[++i];
+        else if (arg == "--instances" && hasValue)
+            settings.instances = (unsigned int)std::atoi(argv[++i]);
+        else if (arg == "--size" && hasValue)
+            valid = std::sscanf(argv[++i], "%ux%u", &settings.width, &settings.height) == 2 && valid;
+        else
+            valid = false;
+    }
+    if (settings.enabled && (settings.frames == 0 || settings.width == 0 || settings.height == 0))
+        valid = false;
+    if (!valid)
+    {
+        std::cout << "usage: " << argv[0] << " [--benchmark <frames> [--model <path>] [--size <w>x<h>] [--out <file.csv|file.json>]] [--instances <count>]" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// framebuffer object with an RGBA8 colour and a depth/stencil renderbuffer, so rendering needs no visible window
+class OffscreenTarget
+{
+public:
+    OffscreenTarget(unsigned int width, unsigned int height) : width(width), height(height)
+    {
+        glGenFramebuffers(1, &fbo);
+        glGenRenderbuffers(2, renderbuffers);
+        glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+        complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        if (!complete)
+            std::cout << "ERROR::FRAMEBUFFER:: offscreen target is not complete" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    ~OffscreenTarget()
+    {
+        glDeleteFramebuffers(1, &fbo);
+        glDeleteRenderbuffers(2, renderbuffers);
+    }
+
+    bool isComplete() const { return complete; }
+
+    void bind() const
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glViewport(0, 0, width, height);
+    }
+
+    // tightly packed RGBA8 rows, bottom row first
+    void readPixels(std::vector<unsigned char> &pixels) const
+    {
+        pixels.resize((size_t)width * height * 4);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    }
+
+private:
+    unsigned int width, height;
+    GLuint fbo;
+    GLuint renderbuffers[2];
+    bool complete;
+
+    OffscreenTarget(const OffscreenTarget&);
+    OffscreenTarget &operator=(const OffscreenTarget&);
+};
+
+// GL_TIME_ELAPSED queries over a small ring, read back a few frames late so the CPU never waits on the GPU
+// except in finish(). Does nothing if the implementation has no timer (GL_QUERY_COUNTER_BITS == 0).
+class GpuFrameTimer
+{
+public:
+    static const unsigned int LATENCY = 4;
+
+    GpuFrameTimer() : frame(0), collected(0)
+    {
+        GLint bits = 0;
+        glGetQueryiv(GL_TIME_ELAPSED, GL_QUERY_COUNTER_BITS, &bits);
+        supported = bits > 0;
+        if (supported)
+            glGenQueries(LATENCY, queries);
+    }
+
+    ~GpuFrameTimer()
+    {
+        if (supported)
+            glDeleteQueries(LATENCY, queries);
+    }
+
+    bool isSupported() const { return supported; }
+
+    void begin()
+    {
+        if (!supported)
+            return;
+        if (frame - collected == LATENCY) // the slot is still busy with an old frame: collect it first
+            collect();
+        glBeginQuery(GL_TIME_ELAPSED, queries[frame % LATENCY]);
+    }
+
+    void end()
+    {
+        if (!supported)
+            return;
+        glEndQuery(GL_TIME_ELAPSED);
+        frame++;
+    }
+
+    // waits for every outstanding query; milliseconds() then holds one value per frame
+    void finish()
+    {
+        while (supported && collected < frame)
+            collect();
+    }
+
+    const std::vector<double> &milliseconds() const { return results; }
+
+private:
+    void collect()
+    {
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(queries[collected % LATENCY], GL_QUERY_RESULT, &nanoseconds);
+        results.push_back(nanoseconds / 1.0e6);
+        collected++;
+    }
+
+    GLuint queries[LATENCY];
+    bool supported;
+    unsigned int frame, collected;
+    std::vector<double> results;
+
+    GpuFrameTimer(const GpuFrameTimer&);
+    GpuFrameTimer &operator=(const GpuFrameTimer&);
+};
+
+// animation clock of a benchmark run: frame i shows the scene at i / BENCHMARK_FRAME_RATE seconds, however long the
+// frames took, so animated models pose (and checksum) the same on every run
+const float BENCHMARK_FRAME_RATE = 60.0f;
+
+// deterministic camera path: one orbit around the origin per run, bobbing up and down; the camera looks at the origin
+inline glm::vec3 benchmarkCameraPosition(unsigned int frame, unsigned int frames, float radius)
+{
+    float t = frames > 1 ? (float)frame / (float)(frames - 1) : 0.0f;
+    float angle = t * 6.28318531f;
+    return glm::vec3(radius * std::sin(angle), 0.5f * std::sin(2.0f * angle), radius * std::cos(angle));
+}
+
+// 64-bit FNV-1a of the image, printed as 16 hex digits
+inline std::string imageChecksum(const std::vector<unsigned char> &pixels)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < pixels.size(); i++)
+        hash = (hash ^ pixels[i]) * 1099511628211ULL;
+    std::ostringstream out;
+    out << std::hex << std::setw(16) << std::setfill('0') << hash;
+    return out.str();
+}
+
+struct BenchmarkResults {
+    std::string model;
+    unsigned int width, height;
+    unsigned int instances;     // copies drawn per frame by the instancing stress mode, 0 without it
+    double loadMs;      // Model construction: import or mesh cache, mesh pipeline, vertex/index buffer uploads
+    double uploadMs;    // waiting for the streamed textures to be decoded and uploaded
+    std::vector<double> cpuFrameMs; // command submission per frame
+    std::vector<double> gpuFrameMs; // timer queries per frame; empty if unsupported
+    std::vector<double> stateChanges;      // per frame, binds the render queue issued; empty if the frame drew without it
+    std::vector<double> stateChangesSaved; // per frame, binds its sorting and state filtering saved
+    std::string checksum;           // of the last frame
+};
+
+struct BenchmarkSummary {
+    double mean, median, p95, max;
+};
+
+inline BenchmarkSummary summarize(std::vector<double> samples)
+{
+    BenchmarkSummary s = { 0.0, 0.0, 0.0, 0.0 };
+    if (samples.empty())
+        return s;
+    for (size_t i = 0; i < samples.size(); i++)
+        s.mean += samples[i];
+    s.mean /= samples.size();
+    std::sort(samples.begin(), samples.end());
+    s.median = samples[samples.size() / 2];
+    s.p95 = samples[std::min(samples.size() - 1, samples.size() * 95 / 100)];
+    s.max = samples.back();
+    return s;
+}
+
+// renders settings.frames frames along benchmarkCameraPosition into an offscreen target and fills the frame timings,
+// size and checksum of results. renderFrame(view, eye, aspect, seconds) draws one frame into the bound framebuffer,
+// animated to the given time.
+template<typename RenderFrame>
+bool runHeadlessBenchmark(const BenchmarkSettings &settings, BenchmarkResults &results, RenderFrame renderFrame)
+{
+    OffscreenTarget target(settings.width, settings.height);
+    if (!target.isComplete())
+        return false;
+    target.bind();
+    GpuFrameTimer gpuTimer;
+    results.width = settings.width;
+    results.height = settings.height;
+    results.instances = settings.instances;
+    results.cpuFrameMs.clear();
+    float aspect = (float)settings.width / (float)settings.height;
+    for (unsigned int frame = 0; frame < settings.frames; frame++)
+    {
+        glm::vec3 eye = benchmarkCameraPosition(frame, settings.frames, 3.0f);
+        glm::mat4 view = glm::lookAt(eye, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        gpuTimer.begin();
+        renderFrame(view, eye, aspect, frame / BENCHMARK_FRAME_RATE);
+        gpuTimer.end();
+        results.cpuFrameMs.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    gpuTimer.finish();
+    results.gpuFrameMs = gpuTimer.milliseconds();
+
+    std::vector<unsigned char> pixels;
+    target.readPixels(pixels);
+    results.checksum = imageChecksum(pixels);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    return true;
+}
+
+// CSV: one "phase,frame,ms" row per phase and per frame, then the checksum.
+// JSON: a single object with the same data plus mean/median/p95/max per frame phase.
+inline bool writeBenchmarkResults(const BenchmarkResults &results, const std::string &path)
+{
+    std::ofstream file;
+    if (!path.empty())
+    {
+        file.open(path.c_str(), std::ios::trunc);
+        if (!file)
+        {
+            std::cout << "ERROR::BENCHMARK:: cannot write " << path << std::endl;
+            return false;
+        }
+    }
+    std::ostream &out = path.empty() ? std::cout : file;
+    out << std::setprecision(6);
+
+    bool json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+    if (!json)
+    {
+        out << "phase,frame,ms\n";
+        out << "load,," << results.loadMs << "\n";
+        out << "upload,," << results.uploadMs << "\n";
+        if (results.instances)
+            out << "instances,," << results.instances << "\n";
+        for (size_t i = 0; i < results.cpuFrameMs.size(); i++)
+            out << "cpu_frame," << i << "," << results.cpuFrameMs[i] << "\n";
+        for (size_t i = 0; i < results.gpuFrameMs.size(); i++)
+            out << "gpu_frame," << i << "," << results.gpuFrameMs[i] << "\n";
+        for (size_t i = 0; i < results.stateChanges.size(); i++)
+            out << "state_changes," << i << "," << results.stateChanges[i] << "\n";
+        for (size_t i = 0; i < results.stateChangesSaved.size(); i++)
+            out << "state_changes_saved," << i << "," << results.stateChangesSaved[i] << "\n";
+        out << "checksum,," << results.checksum << "\n";
+        return (bool)out;
+    }
+
+    auto writeSeries = [&](const char *name, const std::vector<double> &samples) {
+        out << "  \"" << name << "\": ";
+        if (samples.empty())
+        {
+            out << "null";
+            return;
+        }
+        BenchmarkSummary s = summarize(samples);
+        out << "{ \"mean\": " << s.mean << ", \"median\": " << s.median << ", \"p95\": " << s.p95 << ", \"max\": " << s.max << ", \"frames\": [";
+        for (size_t i = 0; i < samples.size(); i++)
+            out << (i ? ", " : "") << samples[i];
+        out << "] }";
+    };
+    std::string model;
+    for (size_t i = 0; i < results.model.size(); i++)
+    {
+        char c = results.model[i];
+        if (c == '"' || c == '\\')
+            model += '\\';
+        model += c;
+    }
+    out << "{\n";
+    out << "  \"model\": \"" << model << "\",\n";
+    out << "  \"width\": " << results.width << ",\n";
+    out << "  \"height\": " << results.height << ",\n";
+    out << "  \"load_ms\": " << results.loadMs << ",\n";
+    out << "  \"upload_ms\": " << results.uploadMs << ",\n";
+    out << "  \"instances\": " << results.instances << ",\n";
+    writeSeries("cpu_frame_ms", results.cpuFrameMs);
+    out << ",\n";
+    writeSeries("gpu_frame_ms", results.gpuFrameMs);
+    out << ",\n";
+    writeSeries("state_changes", results.stateChanges);
+    out << ",\n";
+    writeSeries("state_changes_saved", results.stateChangesSaved);
+    out << ",\n";
+    out << "  \"checksum\": \"" << results.checksum << "\"\n";
+    out << "}\n";
+    return (bool)out;
+}
+#endif
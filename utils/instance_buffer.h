@@ -0,0 +1,97 @@
+#ifndef INSTANCE_BUFFER_H
+#define INSTANCE_BUFFER_H
+
+#include <GL/gl3w.h> // here: we need compile gl3w.c - utils dir
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstddef>
+
+// Per-instance transforms for Model::DrawInstanced. Two layouts, each matching a variant of 1.model_loading.vs:
+//   INSTANCE_MAT4: a full model matrix per instance (64 bytes), shader built with INSTANCED
+//   INSTANCE_TRS:  translation, uniform scale and a rotation quaternion (32 bytes), shader built with INSTANCED_TRS;
+//                  half the upload and the normal matrix is just the rotation
+// Either way the instance transform takes the place of the model uniform.
+enum InstanceFormat {
+    INSTANCE_MAT4,
+    INSTANCE_TRS
+};
+
+// first vertex attribute location of the instance data (a mat4 takes 5..8, TRS 5..6)
+const GLuint INSTANCE_ATTRIBUTE_LOCATION = 5;
+
+struct InstanceTRS {
+    glm::vec4 translationScale; // xyz translation, w uniform scale
+    glm::vec4 rotation;         // unit quaternion, (x, y, z, w)
+};
+
+inline InstanceTRS makeInstanceTRS(const glm::vec3 &translation, float scale, const glm::quat &rotation)
+{
+    InstanceTRS instance;
+    instance.translationScale = glm::vec4(translation, scale);
+    instance.rotation = glm::vec4(rotation.x, rotation.y, rotation.z, rotation.w);
+    return instance;
+}
+
+inline GLsizei instanceStride(InstanceFormat format)
+{
+    return format == INSTANCE_MAT4 ? (GLsizei)sizeof(glm::mat4) : (GLsizei)sizeof(InstanceTRS);
+}
+
+// One vertex buffer holding this frame's instances, kept for the lifetime of its owner. Every upload orphans the
+// storage and fills the fresh one, the GL 3.3 path of the streaming buffer policy in gl_state.h (which explains why
+// it never takes the persistent mapping). The storage only grows, to the next power of two, so steady state uploads
+// never reallocate on our side.
+class InstanceBuffer
+{
+public:
+    InstanceBuffer() : vbo(0), capacity(0) {}
+    ~InstanceBuffer()
+    {
+        if(vbo)
+            glDeleteBuffers(1, &vbo);
+    }
+
+    // replaces the contents with bytes of instance data; leaves the buffer bound to GL_ARRAY_BUFFER
+    void upload(const void *data, size_t bytes)
+    {
+        if(!vbo)
+            glGenBuffers(1, &vbo);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        if(bytes > capacity)
+        {
+            capacity = 4096;
+            while(capacity < bytes)
+                capacity *= 2;
+        }
+        glBufferData(GL_ARRAY_BUFFER, capacity, NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, data);
+    }
+
+    // points the instance attributes of the bound VAO at this buffer, advancing once per instance.
+    // The VAO remembers the buffer, so this is only needed once per VAO (and format): later uploads reuse the name.
+    void attach(InstanceFormat format) const
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        GLsizei stride = instanceStride(format);
+        GLuint columns = format == INSTANCE_MAT4 ? 4 : 2;
+        for(GLuint i = 0; i < columns; i++)
+        {
+            glEnableVertexAttribArray(INSTANCE_ATTRIBUTE_LOCATION + i);
+            glVertexAttribPointer(INSTANCE_ATTRIBUTE_LOCATION + i, 4, GL_FLOAT, GL_FALSE, stride, (void*)(i * sizeof(glm::vec4)));
+            glVertexAttribDivisor(INSTANCE_ATTRIBUTE_LOCATION + i, 1);
+        }
+        // a mat4 VAO switched to TRS must not keep reading the two leftover columns
+        for(GLuint i = columns; i < 4; i++)
+            glDisableVertexAttribArray(INSTANCE_ATTRIBUTE_LOCATION + i);
+    }
+
+private:
+    GLuint vbo;
+    size_t capacity;
+
+    InstanceBuffer(const InstanceBuffer&);
+    InstanceBuffer &operator=(const InstanceBuffer&);
+};
+#endif
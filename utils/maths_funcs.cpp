@@ -16,6 +16,15 @@
 #include <stdio.h>
 #define _USE_MATH_DEFINES
 #include <math.h>
+#include <string.h>
+#if defined( MATHS_FUNCS_SSE )
+#include <xmmintrin.h>
+#if defined( MATHS_FUNCS_AVX )
+#include <immintrin.h>
+#endif
+#elif defined( MATHS_FUNCS_NEON )
+#include <arm_neon.h>
+#endif
 
 /*--------------------------------CONSTRUCTORS--------------------------------*/
 vec2::vec2() {}
@@ -289,26 +298,26 @@ mat4 identity_mat4() {
  3  7 11 15
 */
 
-vec4 mat4::operator*( const vec4 &rhs ) {
+vec4 maths_scalar::multiply( const mat4 &mm, const vec4 &rhs ) {
 	// 0x + 4y + 8z + 12w
-	float x = m[0] * rhs.v[0] + m[4] * rhs.v[1] + m[8] * rhs.v[2] + m[12] * rhs.v[3];
+	float x = mm.m[0] * rhs.v[0] + mm.m[4] * rhs.v[1] + mm.m[8] * rhs.v[2] + mm.m[12] * rhs.v[3];
 	// 1x + 5y + 9z + 13w
-	float y = m[1] * rhs.v[0] + m[5] * rhs.v[1] + m[9] * rhs.v[2] + m[13] * rhs.v[3];
+	float y = mm.m[1] * rhs.v[0] + mm.m[5] * rhs.v[1] + mm.m[9] * rhs.v[2] + mm.m[13] * rhs.v[3];
 	// 2x + 6y + 10z + 14w
-	float z = m[2] * rhs.v[0] + m[6] * rhs.v[1] + m[10] * rhs.v[2] + m[14] * rhs.v[3];
+	float z = mm.m[2] * rhs.v[0] + mm.m[6] * rhs.v[1] + mm.m[10] * rhs.v[2] + mm.m[14] * rhs.v[3];
 	// 3x + 7y + 11z + 15w
-	float w = m[3] * rhs.v[0] + m[7] * rhs.v[1] + m[11] * rhs.v[2] + m[15] * rhs.v[3];
+	float w = mm.m[3] * rhs.v[0] + mm.m[7] * rhs.v[1] + mm.m[11] * rhs.v[2] + mm.m[15] * rhs.v[3];
 	return vec4( x, y, z, w );
 }
 
-mat4 mat4::operator*( const mat4 &rhs ) {
+mat4 maths_scalar::multiply( const mat4 &mm, const mat4 &rhs ) {
 	mat4 r = zero_mat4();
 	int r_index = 0;
 	for ( int col = 0; col < 4; col++ ) {
 		for ( int row = 0; row < 4; row++ ) {
 			float sum = 0.0f;
 			for ( int i = 0; i < 4; i++ ) {
-				sum += rhs.m[i + col * 4] * m[row + i * 4];
+				sum += rhs.m[i + col * 4] * mm.m[row + i * 4];
 			}
 			r.m[r_index] = sum;
 			r_index++;
@@ -327,7 +336,7 @@ mat4 &mat4::operator=( const mat4 &rhs ) {
 // returns a scalar value with the determinant for a 4x4 matrix
 // see
 // http://www.euclideanspace.com/maths/algebra/matrix/functions/determinant/fourD/index.htm
-float determinant( const mat4 &mm ) {
+float maths_scalar::determinant( const mat4 &mm ) {
 	return mm.m[12] * mm.m[9] * mm.m[6] * mm.m[3] -
 				 mm.m[8] * mm.m[13] * mm.m[6] * mm.m[3] -
 				 mm.m[12] * mm.m[5] * mm.m[10] * mm.m[3] +
@@ -358,8 +367,8 @@ float determinant( const mat4 &mm ) {
 matrix). see
 http://www.euclideanspace.com/maths/algebra/matrix/functions/inverse/fourD/index.htm
 */
-mat4 inverse( const mat4 &mm ) {
-	float det = determinant( mm );
+mat4 maths_scalar::inverse( const mat4 &mm ) {
+	float det = maths_scalar::determinant( mm );
 	/* there is no inverse if determinant is zero (not likely unless scale is
 	broken) */
 	if ( 0.0f == det ) {
@@ -618,7 +627,7 @@ float dot( const versor &q, const versor &r ) {
 	return q.q[0] * r.q[0] + q.q[1] * r.q[1] + q.q[2] * r.q[2] + q.q[3] * r.q[3];
 }
 
-versor slerp( versor &q, versor &r, float t ) {
+versor maths_scalar::slerp( versor &q, versor &r, float t ) {
 	// angle between q0-q1
 	float cos_half_theta = dot( q, r );
 	// as found here
@@ -655,3 +664,365 @@ versor slerp( versor &q, versor &r, float t ) {
 	}
 	return result;
 }
+
+/*-------------------------------SCALAR BATCHES-------------------------------*/
+void maths_scalar::transform_points( const mat4 &m, const vec3 *in, vec3 *out,
+																		 size_t count ) {
+	for ( size_t i = 0; i < count; i++ ) {
+		vec4 r = multiply( m, vec4( in[i], 1.0f ) );
+		out[i] = vec3( r.v[0], r.v[1], r.v[2] );
+	}
+}
+
+void maths_scalar::transform_vec4s( const mat4 &m, const vec4 *in, vec4 *out,
+																		size_t count ) {
+	for ( size_t i = 0; i < count; i++ ) {
+		out[i] = multiply( m, in[i] );
+	}
+}
+
+void maths_scalar::multiply_mat4s( const mat4 *a, const mat4 *b, mat4 *out,
+																	 size_t count ) {
+	for ( size_t i = 0; i < count; i++ ) {
+		mat4 r = multiply( a[i], b[i] ); // not straight into out[i], which may be a[i] or b[i]
+		out[i] = r;
+	}
+}
+
+/*--------------------------------SIMD BACKEND--------------------------------*/
+// Column-major like the rest of the file, so a matrix times a vector is the sum of
+// the columns scaled by the vector's components, 4 lanes at a time. The loads are
+// unaligned: the structs only hold plain float arrays.
+#if defined( MATHS_FUNCS_SSE )
+
+static inline __m128 splat( __m128 v, int lane ) {
+	switch ( lane ) {
+	case 0: return _mm_shuffle_ps( v, v, _MM_SHUFFLE( 0, 0, 0, 0 ) );
+	case 1: return _mm_shuffle_ps( v, v, _MM_SHUFFLE( 1, 1, 1, 1 ) );
+	case 2: return _mm_shuffle_ps( v, v, _MM_SHUFFLE( 2, 2, 2, 2 ) );
+	default: return _mm_shuffle_ps( v, v, _MM_SHUFFLE( 3, 3, 3, 3 ) );
+	}
+}
+
+static inline __m128 combine( __m128 c0, __m128 c1, __m128 c2, __m128 c3, __m128 v ) {
+	return _mm_add_ps( _mm_add_ps( _mm_mul_ps( c0, splat( v, 0 ) ), _mm_mul_ps( c1, splat( v, 1 ) ) ),
+										 _mm_add_ps( _mm_mul_ps( c2, splat( v, 2 ) ), _mm_mul_ps( c3, splat( v, 3 ) ) ) );
+}
+
+// sum of the 4 lanes, in every lane
+static inline __m128 horizontal_sum( __m128 v ) {
+	v = _mm_add_ps( v, _mm_shuffle_ps( v, v, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+	return _mm_add_ps( v, _mm_shuffle_ps( v, v, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+}
+
+static inline void mul_mat4_vec4( const float *m, const float *v, float *out ) {
+	__m128 r = combine( _mm_loadu_ps( m ), _mm_loadu_ps( m + 4 ), _mm_loadu_ps( m + 8 ),
+											_mm_loadu_ps( m + 12 ), _mm_loadu_ps( v ) );
+	_mm_storeu_ps( out, r );
+}
+
+// out = a * b; out may be a or b (all of a is loaded first, each column of b before
+// the same column of out is written)
+static inline void mul_mat4_mat4( const float *a, const float *b, float *out ) {
+#if defined( MATHS_FUNCS_AVX )
+	// two columns of the result per 8-wide register: both halves hold the same column
+	// of a, and an in-lane shuffle splats one component of each column of b
+	__m128 a0 = _mm_loadu_ps( a ), a1 = _mm_loadu_ps( a + 4 );
+	__m128 a2 = _mm_loadu_ps( a + 8 ), a3 = _mm_loadu_ps( a + 12 );
+	__m256 c0 = _mm256_insertf128_ps( _mm256_castps128_ps256( a0 ), a0, 1 );
+	__m256 c1 = _mm256_insertf128_ps( _mm256_castps128_ps256( a1 ), a1, 1 );
+	__m256 c2 = _mm256_insertf128_ps( _mm256_castps128_ps256( a2 ), a2, 1 );
+	__m256 c3 = _mm256_insertf128_ps( _mm256_castps128_ps256( a3 ), a3, 1 );
+	for ( int col = 0; col < 16; col += 8 ) {
+		__m256 bb = _mm256_loadu_ps( b + col );
+		__m256 r = _mm256_add_ps(
+			_mm256_add_ps( _mm256_mul_ps( c0, _mm256_shuffle_ps( bb, bb, 0x00 ) ),
+										 _mm256_mul_ps( c1, _mm256_shuffle_ps( bb, bb, 0x55 ) ) ),
+			_mm256_add_ps( _mm256_mul_ps( c2, _mm256_shuffle_ps( bb, bb, 0xAA ) ),
+										 _mm256_mul_ps( c3, _mm256_shuffle_ps( bb, bb, 0xFF ) ) ) );
+		_mm256_storeu_ps( out + col, r );
+	}
+#else
+	__m128 c0 = _mm_loadu_ps( a ), c1 = _mm_loadu_ps( a + 4 );
+	__m128 c2 = _mm_loadu_ps( a + 8 ), c3 = _mm_loadu_ps( a + 12 );
+	for ( int col = 0; col < 16; col += 4 ) {
+		_mm_storeu_ps( out + col, combine( c0, c1, c2, c3, _mm_loadu_ps( b + col ) ) );
+	}
+#endif
+}
+
+// 2x2 blocks of a 4x4 matrix as ( a b c d ) = | a b |
+//                                             | c d |
+// block * block
+static inline __m128 mat2_mul( __m128 x, __m128 y ) {
+	return _mm_add_ps( _mm_mul_ps( x, _mm_shuffle_ps( y, y, _MM_SHUFFLE( 3, 0, 3, 0 ) ) ),
+										 _mm_mul_ps( _mm_shuffle_ps( x, x, _MM_SHUFFLE( 2, 3, 0, 1 ) ),
+																 _mm_shuffle_ps( y, y, _MM_SHUFFLE( 1, 2, 1, 2 ) ) ) );
+}
+
+// adjugate( block ) * block
+static inline __m128 mat2_adj_mul( __m128 x, __m128 y ) {
+	return _mm_sub_ps( _mm_mul_ps( _mm_shuffle_ps( x, x, _MM_SHUFFLE( 0, 0, 3, 3 ) ), y ),
+										 _mm_mul_ps( _mm_shuffle_ps( x, x, _MM_SHUFFLE( 2, 2, 1, 1 ) ),
+																 _mm_shuffle_ps( y, y, _MM_SHUFFLE( 1, 0, 3, 2 ) ) ) );
+}
+
+// block * adjugate( block )
+static inline __m128 mat2_mul_adj( __m128 x, __m128 y ) {
+	return _mm_sub_ps( _mm_mul_ps( x, _mm_shuffle_ps( y, y, _MM_SHUFFLE( 0, 3, 0, 3 ) ) ),
+										 _mm_mul_ps( _mm_shuffle_ps( x, x, _MM_SHUFFLE( 2, 3, 0, 1 ) ),
+																 _mm_shuffle_ps( y, y, _MM_SHUFFLE( 1, 2, 1, 2 ) ) ) );
+}
+
+// Inverse by 2x2 blocks: with M = | A B |, the inverse is 1/|M| * | X Y | where
+//                                 | C D |                          | Z W |
+// X# = |D|A - B(D#C), Y# = |B|C - D(A#B)#, Z# = |C|B - A(D#C)#, W# = |A|D - C(A#B)
+// and |M| = |A||D| + |B||C| - tr((A#B)(D#C)) (# is the adjugate). The rows are taken
+// as columns here; the inverse of the transpose is the transpose of the inverse, so
+// the result is the column-major inverse all the same. Returns |M| in every lane.
+static inline __m128 inverse_sse( const float *m, float *out ) {
+	__m128 r0 = _mm_loadu_ps( m ), r1 = _mm_loadu_ps( m + 4 );
+	__m128 r2 = _mm_loadu_ps( m + 8 ), r3 = _mm_loadu_ps( m + 12 );
+	__m128 A = _mm_movelh_ps( r0, r1 );
+	__m128 B = _mm_movehl_ps( r1, r0 );
+	__m128 C = _mm_movelh_ps( r2, r3 );
+	__m128 D = _mm_movehl_ps( r3, r2 );
+
+	// ( |A| |B| |C| |D| )
+	__m128 det_sub = _mm_sub_ps(
+		_mm_mul_ps( _mm_shuffle_ps( r0, r2, _MM_SHUFFLE( 2, 0, 2, 0 ) ),
+								_mm_shuffle_ps( r1, r3, _MM_SHUFFLE( 3, 1, 3, 1 ) ) ),
+		_mm_mul_ps( _mm_shuffle_ps( r0, r2, _MM_SHUFFLE( 3, 1, 3, 1 ) ),
+								_mm_shuffle_ps( r1, r3, _MM_SHUFFLE( 2, 0, 2, 0 ) ) ) );
+	__m128 det_a = splat( det_sub, 0 );
+	__m128 det_b = splat( det_sub, 1 );
+	__m128 det_c = splat( det_sub, 2 );
+	__m128 det_d = splat( det_sub, 3 );
+
+	__m128 d_c = mat2_adj_mul( D, C );
+	__m128 a_b = mat2_adj_mul( A, B );
+	__m128 x = _mm_sub_ps( _mm_mul_ps( det_d, A ), mat2_mul( B, d_c ) );
+	__m128 w = _mm_sub_ps( _mm_mul_ps( det_a, D ), mat2_mul( C, a_b ) );
+	__m128 y = _mm_sub_ps( _mm_mul_ps( det_b, C ), mat2_mul_adj( D, a_b ) );
+	__m128 z = _mm_sub_ps( _mm_mul_ps( det_c, B ), mat2_mul_adj( A, d_c ) );
+
+	__m128 tr = horizontal_sum(
+		_mm_mul_ps( a_b, _mm_shuffle_ps( d_c, d_c, _MM_SHUFFLE( 3, 1, 2, 0 ) ) ) );
+	__m128 det = _mm_sub_ps( _mm_add_ps( _mm_mul_ps( det_a, det_d ), _mm_mul_ps( det_b, det_c ) ), tr );
+	if ( out ) {
+		__m128 inv_det = _mm_div_ps( _mm_setr_ps( 1.0f, -1.0f, -1.0f, 1.0f ), det );
+		x = _mm_mul_ps( x, inv_det );
+		y = _mm_mul_ps( y, inv_det );
+		z = _mm_mul_ps( z, inv_det );
+		w = _mm_mul_ps( w, inv_det );
+		// the adjugate of each block and the store order in one shuffle
+		_mm_storeu_ps( out, _mm_shuffle_ps( x, y, _MM_SHUFFLE( 1, 3, 1, 3 ) ) );
+		_mm_storeu_ps( out + 4, _mm_shuffle_ps( x, y, _MM_SHUFFLE( 0, 2, 0, 2 ) ) );
+		_mm_storeu_ps( out + 8, _mm_shuffle_ps( z, w, _MM_SHUFFLE( 1, 3, 1, 3 ) ) );
+		_mm_storeu_ps( out + 12, _mm_shuffle_ps( z, w, _MM_SHUFFLE( 0, 2, 0, 2 ) ) );
+	}
+	return det;
+}
+
+static inline float dot4( const float *a, const float *b ) {
+	return _mm_cvtss_f32( horizontal_sum( _mm_mul_ps( _mm_loadu_ps( a ), _mm_loadu_ps( b ) ) ) );
+}
+
+// out = a * s + b * t
+static inline void blend4( const float *a, float s, const float *b, float t, float *out ) {
+	_mm_storeu_ps( out, _mm_add_ps( _mm_mul_ps( _mm_loadu_ps( a ), _mm_set1_ps( s ) ),
+																	_mm_mul_ps( _mm_loadu_ps( b ), _mm_set1_ps( t ) ) ) );
+}
+
+#elif defined( MATHS_FUNCS_NEON )
+
+static inline void mul_mat4_vec4( const float *m, const float *v, float *out ) {
+	float32x4_t r = vmulq_n_f32( vld1q_f32( m ), v[0] );
+	r = vmlaq_n_f32( r, vld1q_f32( m + 4 ), v[1] );
+	r = vmlaq_n_f32( r, vld1q_f32( m + 8 ), v[2] );
+	r = vmlaq_n_f32( r, vld1q_f32( m + 12 ), v[3] );
+	vst1q_f32( out, r );
+}
+
+// out = a * b; out may be a or b
+static inline void mul_mat4_mat4( const float *a, const float *b, float *out ) {
+	float32x4_t c0 = vld1q_f32( a ), c1 = vld1q_f32( a + 4 );
+	float32x4_t c2 = vld1q_f32( a + 8 ), c3 = vld1q_f32( a + 12 );
+	for ( int col = 0; col < 16; col += 4 ) {
+		float32x4_t bb = vld1q_f32( b + col );
+		float32x4_t r = vmulq_lane_f32( c0, vget_low_f32( bb ), 0 );
+		r = vmlaq_lane_f32( r, c1, vget_low_f32( bb ), 1 );
+		r = vmlaq_lane_f32( r, c2, vget_high_f32( bb ), 0 );
+		r = vmlaq_lane_f32( r, c3, vget_high_f32( bb ), 1 );
+		vst1q_f32( out + col, r );
+	}
+}
+
+static inline float dot4( const float *a, const float *b ) {
+	float32x4_t p = vmulq_f32( vld1q_f32( a ), vld1q_f32( b ) );
+	float32x2_t s = vadd_f32( vget_low_f32( p ), vget_high_f32( p ) );
+	return vget_lane_f32( vpadd_f32( s, s ), 0 );
+}
+
+// out = a * s + b * t
+static inline void blend4( const float *a, float s, const float *b, float t, float *out ) {
+	vst1q_f32( out, vmlaq_n_f32( vmulq_n_f32( vld1q_f32( a ), s ), vld1q_f32( b ), t ) );
+}
+
+#endif
+
+/*---------------------------BACKEND ENTRY POINTS-----------------------------*/
+vec4 mat4::operator*( const vec4 &rhs ) {
+#if defined( MATHS_FUNCS_SSE ) || defined( MATHS_FUNCS_NEON )
+	vec4 r;
+	mul_mat4_vec4( m, rhs.v, r.v );
+	return r;
+#else
+	return maths_scalar::multiply( *this, rhs );
+#endif
+}
+
+mat4 mat4::operator*( const mat4 &rhs ) {
+#if defined( MATHS_FUNCS_SSE ) || defined( MATHS_FUNCS_NEON )
+	mat4 r;
+	mul_mat4_mat4( m, rhs.m, r.m );
+	return r;
+#else
+	return maths_scalar::multiply( *this, rhs );
+#endif
+}
+
+// NEON has no 4-lane horizontal shuffles to speak of: the cofactor expansion below
+// stays scalar there
+float determinant( const mat4 &mm ) {
+#if defined( MATHS_FUNCS_SSE )
+	return _mm_cvtss_f32( inverse_sse( mm.m, NULL ) );
+#else
+	return maths_scalar::determinant( mm );
+#endif
+}
+
+mat4 inverse( const mat4 &mm ) {
+#if defined( MATHS_FUNCS_SSE )
+	if ( 0.0f == determinant( mm ) ) {
+		fprintf( stderr, "WARNING. matrix has no determinant. can not invert\n" );
+		return mm;
+	}
+	mat4 r;
+	inverse_sse( mm.m, r.m );
+	return r;
+#else
+	return maths_scalar::inverse( mm );
+#endif
+}
+
+// the same steps as maths_scalar::slerp, with the 4-wide dot and blend
+versor slerp( versor &q, versor &r, float t ) {
+#if defined( MATHS_FUNCS_SSE ) || defined( MATHS_FUNCS_NEON )
+	float cos_half_theta = dot4( q.q, r.q );
+	if ( cos_half_theta < 0.0f ) {
+		for ( int i = 0; i < 4; i++ ) {
+			q.q[i] *= -1.0f;
+		}
+		cos_half_theta = -cos_half_theta;
+	}
+	if ( fabs( cos_half_theta ) >= 1.0f ) {
+		return q;
+	}
+	float sin_half_theta = sqrt( 1.0f - cos_half_theta * cos_half_theta );
+	versor result;
+	if ( fabs( sin_half_theta ) < 0.001f ) {
+		blend4( q.q, 1.0f - t, r.q, t, result.q );
+		return result;
+	}
+	float half_theta = acos( cos_half_theta );
+	float a = sin( ( 1.0f - t ) * half_theta ) / sin_half_theta;
+	float b = sin( t * half_theta ) / sin_half_theta;
+	blend4( q.q, a, r.q, b, result.q );
+	return result;
+#else
+	return maths_scalar::slerp( q, r, t );
+#endif
+}
+
+void transform_points( const mat4 &m, const vec3 *in, vec3 *out, size_t count ) {
+#if defined( MATHS_FUNCS_SSE )
+	__m128 c0 = _mm_loadu_ps( m.m ), c1 = _mm_loadu_ps( m.m + 4 );
+	__m128 c2 = _mm_loadu_ps( m.m + 8 ), c3 = _mm_loadu_ps( m.m + 12 );
+	for ( size_t i = 0; i < count; i++ ) {
+		__m128 r = _mm_add_ps(
+			_mm_add_ps( _mm_mul_ps( c0, _mm_set1_ps( in[i].v[0] ) ), _mm_mul_ps( c1, _mm_set1_ps( in[i].v[1] ) ) ),
+			_mm_add_ps( _mm_mul_ps( c2, _mm_set1_ps( in[i].v[2] ) ), c3 ) );
+		// 12 bytes out: x and y, then z
+		_mm_storel_pi( (__m64 *)out[i].v, r );
+		_mm_store_ss( out[i].v + 2, _mm_movehl_ps( r, r ) );
+	}
+#elif defined( MATHS_FUNCS_NEON )
+	float32x4_t c0 = vld1q_f32( m.m ), c1 = vld1q_f32( m.m + 4 );
+	float32x4_t c2 = vld1q_f32( m.m + 8 ), c3 = vld1q_f32( m.m + 12 );
+	for ( size_t i = 0; i < count; i++ ) {
+		float32x4_t r = vmlaq_n_f32( c3, c0, in[i].v[0] );
+		r = vmlaq_n_f32( r, c1, in[i].v[1] );
+		r = vmlaq_n_f32( r, c2, in[i].v[2] );
+		vst1_f32( out[i].v, vget_low_f32( r ) );
+		out[i].v[2] = vgetq_lane_f32( r, 2 );
+	}
+#else
+	maths_scalar::transform_points( m, in, out, count );
+#endif
+}
+
+void transform_vec4s( const mat4 &m, const vec4 *in, vec4 *out, size_t count ) {
+#if defined( MATHS_FUNCS_SSE )
+	__m128 c0 = _mm_loadu_ps( m.m ), c1 = _mm_loadu_ps( m.m + 4 );
+	__m128 c2 = _mm_loadu_ps( m.m + 8 ), c3 = _mm_loadu_ps( m.m + 12 );
+	size_t i = 0;
+#if defined( MATHS_FUNCS_AVX )
+	// two vectors per 8-wide register, the matrix columns repeated in both halves
+	__m256 w0 = _mm256_insertf128_ps( _mm256_castps128_ps256( c0 ), c0, 1 );
+	__m256 w1 = _mm256_insertf128_ps( _mm256_castps128_ps256( c1 ), c1, 1 );
+	__m256 w2 = _mm256_insertf128_ps( _mm256_castps128_ps256( c2 ), c2, 1 );
+	__m256 w3 = _mm256_insertf128_ps( _mm256_castps128_ps256( c3 ), c3, 1 );
+	for ( ; i + 2 <= count; i += 2 ) {
+		__m256 v = _mm256_loadu_ps( in[i].v ); // in[i] and in[i + 1]
+		__m256 r = _mm256_add_ps(
+			_mm256_add_ps( _mm256_mul_ps( w0, _mm256_shuffle_ps( v, v, 0x00 ) ),
+										 _mm256_mul_ps( w1, _mm256_shuffle_ps( v, v, 0x55 ) ) ),
+			_mm256_add_ps( _mm256_mul_ps( w2, _mm256_shuffle_ps( v, v, 0xAA ) ),
+										 _mm256_mul_ps( w3, _mm256_shuffle_ps( v, v, 0xFF ) ) ) );
+		_mm256_storeu_ps( out[i].v, r );
+	}
+#endif
+	for ( ; i < count; i++ ) {
+		_mm_storeu_ps( out[i].v, combine( c0, c1, c2, c3, _mm_loadu_ps( in[i].v ) ) );
+	}
+#elif defined( MATHS_FUNCS_NEON )
+	for ( size_t i = 0; i < count; i++ ) {
+		mul_mat4_vec4( m.m, in[i].v, out[i].v );
+	}
+#else
+	maths_scalar::transform_vec4s( m, in, out, count );
+#endif
+}
+
+void multiply_mat4s( const mat4 *a, const mat4 *b, mat4 *out, size_t count ) {
+#if defined( MATHS_FUNCS_SSE ) || defined( MATHS_FUNCS_NEON )
+	for ( size_t i = 0; i < count; i++ ) {
+		mul_mat4_mat4( a[i].m, b[i].m, out[i].m );
+	}
+#else
+	maths_scalar::multiply_mat4s( a, b, out, count );
+#endif
+}
+
+const char *maths_backend() {
+#if defined( MATHS_FUNCS_AVX )
+	return "AVX";
+#elif defined( MATHS_FUNCS_SSE )
+	return "SSE";
+#elif defined( MATHS_FUNCS_NEON )
+	return "NEON";
+#else
+	return "scalar";
+#endif
+}
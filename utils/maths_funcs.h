@@ -16,6 +16,21 @@
 #ifndef _MATHS_FUNCS_H_
 #define _MATHS_FUNCS_H_
 
+#include <stddef.h>
+
+// SIMD backend, picked at compile time behind the same API: SSE on x86 (with AVX for the mat4 products and the batch
+// functions when the compiler targets it, e.g. -mavx or /arch:AVX), NEON on ARM, plain floats anywhere else or when
+// MATHS_FUNCS_SCALAR is defined. The scalar code is always compiled too, in namespace maths_scalar below.
+#if !defined( MATHS_FUNCS_SCALAR ) && \
+	( defined( __SSE__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 1 ) )
+#define MATHS_FUNCS_SSE
+#if defined( __AVX__ )
+#define MATHS_FUNCS_AVX
+#endif
+#elif !defined( MATHS_FUNCS_SCALAR ) && ( defined( __ARM_NEON ) || defined( __ARM_NEON__ ) )
+#define MATHS_FUNCS_NEON
+#endif
+
 // const used to convert degrees into radians
 #define TAU 2.0 * M_PI
 #define ONE_DEG_IN_RAD ( 2.0 * M_PI ) / 360.0 // 0.017444444
@@ -150,4 +165,25 @@ versor slerp( const versor &q, const versor &r );
 versor normalise( versor &q );
 void print( const versor &q );
 versor slerp( versor &q, versor &r, float t );
+// batch functions
+// out[i] = m * vec4( in[i], 1 ) without the w row (points through an affine transform); in may be out
+void transform_points( const mat4 &m, const vec3 *in, vec3 *out, size_t count );
+// out[i] = m * in[i]; in may be out
+void transform_vec4s( const mat4 &m, const vec4 *in, vec4 *out, size_t count );
+// out[i] = a[i] * b[i]; out may be a or b
+void multiply_mat4s( const mat4 *a, const mat4 *b, mat4 *out, size_t count );
+// "AVX", "SSE", "NEON" or "scalar"
+const char *maths_backend();
+
+// the plain float versions of what the SIMD backend replaces: the reference it is tested and benchmarked against
+namespace maths_scalar {
+vec4 multiply( const mat4 &m, const vec4 &v );
+mat4 multiply( const mat4 &a, const mat4 &b );
+float determinant( const mat4 &mm );
+mat4 inverse( const mat4 &mm );
+versor slerp( versor &q, versor &r, float t );
+void transform_points( const mat4 &m, const vec3 *in, vec3 *out, size_t count );
+void transform_vec4s( const mat4 &m, const vec4 *in, vec4 *out, size_t count );
+void multiply_mat4s( const mat4 *a, const mat4 *b, mat4 *out, size_t count );
+}
 #endif
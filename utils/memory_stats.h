@@ -0,0 +1,156 @@
+#ifndef MEMORY_STATS_H
+#define MEMORY_STATS_H
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "psapi.lib")
+#endif
+#else
+#include <unistd.h>
+#endif
+
+#include <GL/gl3w.h> // here: we need compile gl3w.c - utils dir
+
+#include <gl_state.h>
+#include <mesh.h>
+#include <texture_registry.h>
+
+#include <cstddef>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Bytes held by a model (or anything else), split by where they live. CPU bytes are container capacities; GPU bytes
+// are what the buffers and textures were created with, a lower bound of what the driver reserves (alignment, RGB
+// stored as RGBA, ...).
+struct MemoryStats {
+    size_t cpuVertexBytes;   // Mesh::vertices still held after the upload
+    size_t cpuIndexBytes;    // Mesh::indices and LOD indices, same
+    size_t cpuOtherBytes;    // picking BVHs, skinning copies, animation keys
+    size_t gpuBufferBytes;   // vertex and index buffers; a mesh's range of a GeometryArena counts as its own
+    size_t gpuTextureBytes;  // every mip level
+
+    MemoryStats() : cpuVertexBytes(0), cpuIndexBytes(0), cpuOtherBytes(0), gpuBufferBytes(0), gpuTextureBytes(0) {}
+
+    size_t cpuBytes() const { return cpuVertexBytes + cpuIndexBytes + cpuOtherBytes; }
+    size_t gpuBytes() const { return gpuBufferBytes + gpuTextureBytes; }
+
+    MemoryStats &operator+=(const MemoryStats &other)
+    {
+        cpuVertexBytes += other.cpuVertexBytes;
+        cpuIndexBytes += other.cpuIndexBytes;
+        cpuOtherBytes += other.cpuOtherBytes;
+        gpuBufferBytes += other.gpuBufferBytes;
+        gpuTextureBytes += other.gpuTextureBytes;
+        return *this;
+    }
+};
+
+inline std::string FormatBytes(size_t bytes)
+{
+    char text[32];
+    if(bytes >= (size_t)10 << 20)
+        std::snprintf(text, sizeof(text), "%.1f MiB", bytes / (1024.0 * 1024.0));
+    else
+        std::snprintf(text, sizeof(text), "%.1f KiB", bytes / 1024.0);
+    return text;
+}
+
+// one line: label, CPU bytes by kind, GPU bytes by kind
+inline void PrintMemoryStats(std::ostream &out, const std::string &label, const MemoryStats &stats)
+{
+    out << "MEMORY:: " << label << ": CPU " << FormatBytes(stats.cpuBytes()) << " (vertices " << FormatBytes(stats.cpuVertexBytes)
+        << ", indices " << FormatBytes(stats.cpuIndexBytes) << ", other " << FormatBytes(stats.cpuOtherBytes) << "), GPU "
+        << FormatBytes(stats.gpuBytes()) << " (buffers " << FormatBytes(stats.gpuBufferBytes) << ", textures "
+        << FormatBytes(stats.gpuTextureBytes) << ")" << std::endl;
+}
+
+// size of a 2D texture summed over its mip levels, as the driver reports them. Binds it to unit 0: context thread only.
+inline size_t TextureBytes(GLuint texture)
+{
+    if(!texture)
+        return 0;
+    GLint maxSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+    SharedGLState().bindTexture(0, GL_TEXTURE_2D, texture);
+    size_t bytes = 0;
+    for(GLint level = 0, size = maxSize; size > 0; level++, size >>= 1)
+    {
+        GLint width = 0, height = 0, compressed = GL_FALSE;
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_WIDTH, &width);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_HEIGHT, &height);
+        if(width == 0 || height == 0)
+            break;
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED, &compressed);
+        if(compressed)
+        {
+            GLint imageSize = 0;
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &imageSize);
+            bytes += (size_t)imageSize;
+            continue;
+        }
+        static const GLenum SIZES[] = { GL_TEXTURE_RED_SIZE, GL_TEXTURE_GREEN_SIZE, GL_TEXTURE_BLUE_SIZE, GL_TEXTURE_ALPHA_SIZE,
+                                        GL_TEXTURE_DEPTH_SIZE, GL_TEXTURE_STENCIL_SIZE };
+        GLint bits = 0;
+        for(unsigned int i = 0; i < sizeof(SIZES) / sizeof(SIZES[0]); i++)
+        {
+            GLint channel = 0;
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, level, SIZES[i], &channel);
+            bits += channel;
+        }
+        bytes += (size_t)width * height * ((bits + 7) / 8);
+    }
+    return bytes;
+}
+
+// resident set size of this process (working set on Windows); 0 where it cannot be queried
+inline size_t ProcessResidentBytes()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if(!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+    return counters.WorkingSetSize;
+#else
+    FILE *statm = std::fopen("/proc/self/statm", "r");
+    if(!statm)
+        return 0;
+    unsigned long total = 0, resident = 0;
+    int read = std::fscanf(statm, "%lu %lu", &total, &resident);
+    std::fclose(statm);
+    return read == 2 ? (size_t)resident * (size_t)sysconf(_SC_PAGESIZE) : 0;
+#endif
+}
+
+// what is shared by every model: the GeometryArenas (allocated capacity, of which the meshes' ranges are the used
+// part), the textures of a TextureRegistry, and the process's resident set
+inline void PrintProcessMemory(std::ostream &out, const TextureRegistry &registry = TextureRegistry::shared())
+{
+    const VertexFormat formats[] = { VERTEX_FORMAT_FLOAT, VERTEX_FORMAT_PACKED };
+    const GLenum indexTypes[] = { GL_UNSIGNED_SHORT, GL_UNSIGNED_INT };
+    size_t arenaUsed = 0, arenaCapacity = 0;
+    for(unsigned int f = 0; f < 2; f++)
+        for(unsigned int t = 0; t < 2; t++)
+        {
+            const GeometryArena &arena = SharedGeometryArena(formats[f], indexTypes[t]);
+            arenaUsed += arena.vertexBytes() + arena.indexBufferBytes();
+            arenaCapacity += arena.capacityBytes();
+        }
+    std::vector<unsigned int> textures = registry.textureIds();
+    size_t textureBytes = 0;
+    for(size_t i = 0; i < textures.size(); i++)
+        textureBytes += TextureBytes(textures[i]);
+    out << "MEMORY:: process: geometry arenas " << FormatBytes(arenaUsed) << " used of " << FormatBytes(arenaCapacity)
+        << ", " << textures.size() << " registry textures " << FormatBytes(textureBytes) << ", resident "
+        << FormatBytes(ProcessResidentBytes()) << std::endl;
+}
+#endif
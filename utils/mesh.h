@@ -8,12 +8,19 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
-#include <learnopengl/shader.h>
+#include <shader.h>
+#include <vertex_format.h>
+#include <frustum.h>
+#include <mesh_simplifier.h>
+#include <geometry_arena.h>
+#include <gl_state.h>
 
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <algorithm>
+#include <utility>
 #include <vector>
 using namespace std;
 
@@ -36,6 +43,304 @@ struct Texture {
     aiString path;
 };
 
+// Every sampler type owns a fixed range of texture units: texture_diffuseN is always bound to unit N-1,
+// texture_specularN to unit MAX_SAMPLERS_PER_TYPE + N-1, and so on. That way the sampler uniforms of a program
+// only have to be assigned once (BindSamplerUnits) and drawing a mesh is just binding textures to known units.
+const unsigned int MAX_SAMPLERS_PER_TYPE = 4;
+const unsigned int SAMPLER_TYPE_COUNT = 4;
+const char *const SAMPLER_TYPE_NAMES[SAMPLER_TYPE_COUNT] = { "texture_diffuse", "texture_specular", "texture_normal", "texture_height" };
+const unsigned int MAX_PACKET_TEXTURES = MAX_SAMPLERS_PER_TYPE * SAMPLER_TYPE_COUNT;
+
+// assigns every texture_<type>N sampler of the program its fixed unit; the program must be in use
+inline void BindSamplerUnits(Shader &shader)
+{
+    for(unsigned int type = 0; type < SAMPLER_TYPE_COUNT; type++)
+    {
+        for(unsigned int n = 0; n < MAX_SAMPLERS_PER_TYPE; n++)
+        {
+            UniformHandle sampler = shader.uniform(string(SAMPLER_TYPE_NAMES[type]) + to_string(n + 1));
+            if(sampler.valid())
+                shader.setInt(sampler, (int)(type * MAX_SAMPLERS_PER_TYPE + n));
+        }
+    }
+}
+
+struct TextureBinding {
+    GLuint unit;
+    GLuint texture;
+};
+
+// everything needed to draw a mesh, resolved once at load time. Plain data: arrays of packets are drawn
+// in a tight loop (DrawPackets) without any strings, uniform lookups or allocations.
+struct DrawPacket {
+    GLuint vao;
+    GLsizei indexCount;
+    GLenum indexType;
+    GLintptr indexOffset;   // bytes into the element buffer (of the mesh, or of its GeometryArena)
+    GLint baseVertex;       // added to every index; the mesh's first vertex in a GeometryArena, else 0
+    GLuint textureCount;
+    TextureBinding textures[MAX_PACKET_TEXTURES];
+    glm::vec3 positionScale; // VERTEX_FORMAT_PACKED dequantisation (identity for float vertices)
+    glm::vec3 positionBias;
+};
+
+// what the draw paths below asked GL for since the last ResetDrawCounters; 04_model_loading resets them every frame
+struct DrawCounters {
+    unsigned int drawCalls;     // glDraw*/glMultiDraw* calls
+    unsigned int mergedDraws;   // meshes drawn by those calls (more than drawCalls once multi-draws merge them)
+    unsigned int vaoBinds;
+    unsigned int textureBinds;
+};
+
+inline DrawCounters &drawCounters()
+{
+    static DrawCounters counters;
+    return counters;
+}
+
+inline void ResetDrawCounters()
+{
+    DrawCounters zero = { 0, 0, 0, 0 };
+    drawCounters() = zero;
+}
+
+// the matrix normals and tangents are transformed with: the inverse transpose of the model matrix's upper 3x3. It
+// goes to the vertex shader's "normalMatrix" once per draw rather than being inverted for every vertex.
+inline glm::mat3 NormalMatrix(const glm::mat4 &model)
+{
+    return glm::transpose(glm::inverse(glm::mat3(model)));
+}
+
+// per-draw uniforms DrawPackets sets from each packet; handles the program doesn't have are skipped
+struct PacketUniforms {
+    UniformHandle positionScale;
+    UniformHandle positionBias;
+};
+
+inline PacketUniforms ResolvePacketUniforms(const Shader &shader)
+{
+    PacketUniforms uniforms;
+    uniforms.positionScale = shader.uniform("positionScale");
+    uniforms.positionBias = shader.uniform("positionBias");
+    return uniforms;
+}
+
+// sets the packet's per-draw uniforms and binds its textures and VAO, through SharedGLState so the ones already bound
+// (by the packet before, usually) are skipped
+inline void BindPacket(const DrawPacket &packet, const PacketUniforms &uniforms)
+{
+    GLStateCache &state = SharedGLState();
+    if(uniforms.positionScale.valid())
+    {
+        glUniform3fv(uniforms.positionScale.location, 1, &packet.positionScale[0]);
+        glUniform3fv(uniforms.positionBias.location, 1, &packet.positionBias[0]);
+    }
+    for(GLuint t = 0; t < packet.textureCount; t++)
+        if(state.bindTexture(packet.textures[t].unit, GL_TEXTURE_2D, packet.textures[t].texture))
+            drawCounters().textureBinds++;
+    if(state.bindVertexArray(packet.vao))
+        drawCounters().vaoBinds++;
+}
+
+// issues a single packet; the VAO and textures it binds stay bound (SharedGLState knows, nothing is reset)
+inline void SubmitPacket(const DrawPacket &packet, const PacketUniforms &uniforms)
+{
+    BindPacket(packet, uniforms);
+    glDrawElementsBaseVertex(GL_TRIANGLES, packet.indexCount, packet.indexType, (const void*)packet.indexOffset, packet.baseVertex);
+    drawCounters().drawCalls++;
+    drawCounters().mergedDraws++;
+}
+
+// draws the packets; sampler units must have been assigned with BindSamplerUnits for the program in use
+inline void DrawPackets(const DrawPacket *packets, size_t count, const PacketUniforms &uniforms = PacketUniforms())
+{
+    for(size_t i = 0; i < count; i++)
+        SubmitPacket(packets[i], uniforms);
+}
+
+// same, for the subset packets[order[0]], packets[order[1]], ... (e.g. the meshes that survived culling)
+inline void DrawPackets(const DrawPacket *packets, const unsigned int *order, size_t count, const PacketUniforms &uniforms = PacketUniforms())
+{
+    for(size_t i = 0; i < count; i++)
+        SubmitPacket(packets[order[i]], uniforms);
+}
+
+// draws every packet instanceCount times in one call each (glDrawElementsInstanced); the VAOs need their instance
+// attributes attached (InstanceBuffer::attach) and the program must read them (1.model_loading.vs built with INSTANCED)
+inline void DrawPacketsInstanced(const DrawPacket *packets, size_t count, GLsizei instanceCount, const PacketUniforms &uniforms = PacketUniforms())
+{
+    for(size_t i = 0; i < count; i++)
+    {
+        BindPacket(packets[i], uniforms);
+        glDrawElementsInstancedBaseVertex(GL_TRIANGLES, packets[i].indexCount, packets[i].indexType, (const void*)packets[i].indexOffset,
+                                          instanceCount, packets[i].baseVertex);
+        drawCounters().drawCalls++;
+        drawCounters().mergedDraws++;
+    }
+}
+
+// orders packets by the state they draw with (VAO, index type, textures, dequantisation), ignoring the index range;
+// packets comparing equal can be drawn by one glMultiDrawElementsBaseVertex
+inline int ComparePacketState(const DrawPacket &a, const DrawPacket &b)
+{
+    if(a.vao != b.vao)
+        return a.vao < b.vao ? -1 : 1;
+    if(a.indexType != b.indexType)
+        return a.indexType < b.indexType ? -1 : 1;
+    if(a.textureCount != b.textureCount)
+        return a.textureCount < b.textureCount ? -1 : 1;
+    for(GLuint t = 0; t < a.textureCount; t++)
+    {
+        if(a.textures[t].unit != b.textures[t].unit)
+            return a.textures[t].unit < b.textures[t].unit ? -1 : 1;
+        if(a.textures[t].texture != b.textures[t].texture)
+            return a.textures[t].texture < b.textures[t].texture ? -1 : 1;
+    }
+    for(int c = 0; c < 3; c++)
+    {
+        if(a.positionScale[c] != b.positionScale[c])
+            return a.positionScale[c] < b.positionScale[c] ? -1 : 1;
+        if(a.positionBias[c] != b.positionBias[c])
+            return a.positionBias[c] < b.positionBias[c] ? -1 : 1;
+    }
+    return 0;
+}
+
+// Draws packets grouped by everything but their index range, each group with one glMultiDrawElementsBaseVertex.
+// Packets from the same GeometryArena that share their textures (and dequantisation) fall into one group, so a model
+// costs about one draw per material instead of one per mesh. Binds go through BindPacket, so the ones that would not
+// change anything are skipped. Packets with their own VAO (no arena) simply end up one per group.
+class PacketBatcher
+{
+public:
+    // gives packets that may share a multi-draw the same group id; returns the number of groups
+    static unsigned int assignGroups(const DrawPacket *packets, size_t count, vector<unsigned int> &groups)
+    {
+        vector<unsigned int> sorted(count);
+        for(size_t i = 0; i < count; i++)
+            sorted[i] = (unsigned int)i;
+        std::sort(sorted.begin(), sorted.end(), [packets](unsigned int a, unsigned int b) { return ComparePacketState(packets[a], packets[b]) < 0; });
+        groups.resize(count);
+        unsigned int groupCount = 0;
+        for(size_t i = 0; i < count; i++)
+        {
+            if(i > 0 && ComparePacketState(packets[sorted[i - 1]], packets[sorted[i]]) != 0)
+                groupCount++;
+            groups[sorted[i]] = groupCount;
+        }
+        return count ? groupCount + 1 : 0;
+    }
+
+    // draws packets[order[0..count)] (all packets if order is null) given their assignGroups ids
+    void draw(const DrawPacket *packets, const unsigned int *order, size_t count, const unsigned int *groups, unsigned int groupCount,
+              const PacketUniforms &uniforms = PacketUniforms())
+    {
+        // stable counting sort of the draws by group
+        groupStart.assign(groupCount + 1, 0);
+        for(size_t i = 0; i < count; i++)
+            groupStart[groups[order ? order[i] : i] + 1]++;
+        for(unsigned int g = 0; g < groupCount; g++)
+            groupStart[g + 1] += groupStart[g];
+        sorted.resize(count);
+        cursor.assign(groupStart.begin(), groupStart.end() - 1);
+        for(size_t i = 0; i < count; i++)
+        {
+            unsigned int packet = order ? order[i] : (unsigned int)i;
+            sorted[cursor[groups[packet]]++] = packet;
+        }
+
+        for(unsigned int g = 0; g < groupCount; g++)
+        {
+            unsigned int first = groupStart[g], end = groupStart[g + 1];
+            if(first == end)
+                continue;
+            const DrawPacket &packet = packets[sorted[first]];
+            BindPacket(packet, uniforms);
+            if(end - first == 1)
+                glDrawElementsBaseVertex(GL_TRIANGLES, packet.indexCount, packet.indexType, (const void*)packet.indexOffset, packet.baseVertex);
+            else
+            {
+                counts.clear();
+                offsets.clear();
+                baseVertices.clear();
+                for(unsigned int i = first; i < end; i++)
+                {
+                    counts.push_back(packets[sorted[i]].indexCount);
+                    offsets.push_back((const void*)packets[sorted[i]].indexOffset);
+                    baseVertices.push_back(packets[sorted[i]].baseVertex);
+                }
+                glMultiDrawElementsBaseVertex(GL_TRIANGLES, counts.data(), packet.indexType, offsets.data(), (GLsizei)counts.size(), baseVertices.data());
+            }
+            drawCounters().drawCalls++;
+            drawCounters().mergedDraws += end - first;
+        }
+    }
+
+private:
+    vector<unsigned int> groupStart, cursor, sorted;
+    vector<GLsizei> counts;
+    vector<const void*> offsets;
+    vector<GLint> baseVertices;
+};
+
+// vertex attribute layouts of the two VertexFormats, for the VAO and the GL_ARRAY_BUFFER currently bound
+inline void SetFloatVertexAttributes()
+{
+    // A great thing about structs is that their memory layout is sequential for all its items.
+    // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
+    // again translates to 3/2 floats which translates to a byte array.
+    // vertex Positions
+    glEnableVertexAttribArray(0);	
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+    // vertex normals
+    glEnableVertexAttribArray(1);	
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+    // vertex texture coords
+    glEnableVertexAttribArray(2);	
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+    // vertex tangent
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
+    // vertex bitangent
+    glEnableVertexAttribArray(4);
+    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+}
+
+inline void SetPackedVertexAttributes()
+{
+    // vertex Positions (snorm16 in the mesh bounds, w = bitangent sign)
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 4, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Position));
+    // vertex normals (octahedral)
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Normal));
+    // vertex texture coords (half float)
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, TexCoords));
+    // vertex tangent (octahedral); the bitangent is rebuilt in the shader
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Tangent));
+}
+
+// where a Mesh puts its vertices and indices
+enum MeshStorage {
+    MESH_STORAGE_OWN,       // a VAO, VBO and EBO of its own
+    MESH_STORAGE_ARENA,     // a range of the shared GeometryArena of its vertex format; VAO is the arena's
+    MESH_STORAGE_EXTERNAL   // nothing is uploaded: another owner (SkinnedGeometry) holds the data and fills in the packet
+};
+
+// the arena meshes of a vertex format and index type are suballocated from; created on first use
+inline GeometryArena &SharedGeometryArena(VertexFormat format, GLenum indexType)
+{
+    static GeometryArena floatShort(sizeof(Vertex), GL_UNSIGNED_SHORT, SetFloatVertexAttributes);
+    static GeometryArena floatInt(sizeof(Vertex), GL_UNSIGNED_INT, SetFloatVertexAttributes);
+    static GeometryArena packedShort(sizeof(PackedVertex), GL_UNSIGNED_SHORT, SetPackedVertexAttributes);
+    static GeometryArena packedInt(sizeof(PackedVertex), GL_UNSIGNED_INT, SetPackedVertexAttributes);
+    if(format == VERTEX_FORMAT_PACKED)
+        return indexType == GL_UNSIGNED_SHORT ? packedShort : packedInt;
+    return indexType == GL_UNSIGNED_SHORT ? floatShort : floatInt;
+}
+
 class Mesh {
 public:
     /*  Mesh Data  */
@@ -43,100 +348,195 @@ public:
     vector<unsigned int> indices;
     vector<Texture> textures;
     unsigned int VAO;
+    DrawPacket packet;
+    VertexFormat format;          // layout of the uploaded vertex buffer; vertices above always stay float
+    PackedVertexDecode decode;    // only meaningful for VERTEX_FORMAT_PACKED
+    GLenum indexType;             // of the uploaded index buffer: GL_UNSIGNED_SHORT for meshes with fewer than 65536 vertices
+    MeshBounds bounds;            // model space box and sphere, for culling
+    MeshLodChain lodChain;        // simplified levels after LOD 0 (indices); uploaded behind indices in the same element buffer
 
     /*  Functions  */
-    // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    // constructor; storage says where the buffers go (see MeshStorage)
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, VertexFormat format = VERTEX_FORMAT_FLOAT,
+         MeshLodChain lodChain = MeshLodChain(), MeshStorage storage = MESH_STORAGE_OWN)
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
+        this->vertices = std::move(vertices);
+        this->indices = std::move(indices);
+        this->textures = std::move(textures);
+        this->format = format;
+        this->lodChain = std::move(lodChain);
+        decode.scale = glm::vec3(1.0f);
+        decode.bias = glm::vec3(0.0f);
+        bounds = computeMeshBounds(this->vertices);
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
-        setupMesh();
+        setupMesh(storage);
+        buildDrawPacket();
     }
 
-    // render the mesh
-    void Draw(Shader shader) 
+    // render the mesh. Assigns the sampler units first, so this also works for a lone mesh;
+    // Model::Draw does that once per program instead and draws all its packets in one go.
+    void Draw(Shader &shader) 
     {
-        // bind appropriate textures
-        unsigned int diffuseNr  = 1;
-        unsigned int specularNr = 1;
-        unsigned int normalNr   = 1;
-        unsigned int heightNr   = 1;
-        for(unsigned int i = 0; i < textures.size(); i++)
+        BindSamplerUnits(shader);
+        DrawPackets(&packet, 1, ResolvePacketUniforms(shader));
+    }
+
+    // number of levels including LOD 0
+    unsigned int lodCount() const
+    {
+        return (unsigned int)lodChain.levels.size() + 1;
+    }
+
+    // packet drawing the given level instead of the full mesh (level 0)
+    DrawPacket lodPacket(unsigned int level) const
+    {
+        DrawPacket result = packet;
+        if(level > 0)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-            // retrieve texture number (the N in diffuse_textureN)
-            stringstream ss;
-            string number;
-            string name = textures[i].type;
-            if(name == "texture_diffuse")
-                ss << diffuseNr++; // transfer unsigned int to stream
-            else if(name == "texture_specular")
-                ss << specularNr++; // transfer unsigned int to stream
-            else if(name == "texture_normal")
-                ss << normalNr++; // transfer unsigned int to stream
-             else if(name == "texture_height")
-                ss << heightNr++; // transfer unsigned int to stream
-            number = ss.str(); 
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            const MeshLod &lod = lodChain.levels[level - 1];
+            result.indexCount = (GLsizei)lod.indexCount;
+            result.indexOffset += (GLintptr)lod.indexOffset * (indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int));
         }
-        
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
+        return result;
+    }
+
+    // CPU bytes of vertices, indices and LOD indices (capacities: what the heap really holds)
+    size_t cpuVertexBytes() const { return vertices.capacity() * sizeof(Vertex); }
+    size_t cpuIndexBytes() const { return (indices.capacity() + lodChain.indices.capacity()) * sizeof(unsigned int); }
+    // bytes uploaded for this mesh: its own buffers, or its range of the arena
+    size_t gpuBufferBytes() const { return gpuVertexBytes + gpuIndexBytes; }
+    size_t vertexCount() const { return uploadedVertices; }
+
+    // frees vertices, indices and the LOD indices once nothing needs them on the CPU any more; the packet, LOD levels
+    // and bounds stay, so the mesh still draws and culls. Anything reading the arrays (mesh cache writing, picking
+    // BVHs, SkinnedGeometry) must have been built before.
+    void releaseCpuCopies()
+    {
+        vector<Vertex>().swap(vertices);
+        vector<unsigned int>().swap(indices);
+        vector<unsigned int>().swap(lodChain.indices);
     }
 
 private:
     /*  Render data  */
-    unsigned int VBO, EBO;
+    unsigned int VBO, EBO;  // 0 when the mesh lives in a GeometryArena
+    GeometryRange range;    // where the mesh starts in its buffers
+    size_t uploadedVertices;
+    size_t gpuVertexBytes, gpuIndexBytes;
 
     /*  Functions    */
-    // initializes all the buffer objects/arrays
-    void setupMesh()
+    // initializes all the buffer objects/arrays: the mesh's own, a range of the shared GeometryArena, or none
+    void setupMesh(MeshStorage storage)
     {
+        // 16-bit indices halve the index buffer whenever every vertex can be addressed with them.
+        // The LOD levels share the vertex buffer and follow LOD 0 in the same element buffer.
+        indexType = vertices.size() < 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+        size_t indexCount = indices.size() + lodChain.indices.size();
+        uploadedVertices = vertices.size();
+        range.baseVertex = 0;
+        range.indexOffset = 0;
+        if(storage == MESH_STORAGE_EXTERNAL)
+        {
+            gpuVertexBytes = gpuIndexBytes = 0;
+            VAO = VBO = EBO = 0;
+            return;
+        }
+        vector<unsigned short> shortIndices;
+        vector<unsigned int> allIndices;
+        const void *indexData;
+        size_t indexSize;
+        if(indexType == GL_UNSIGNED_SHORT)
+        {
+            shortIndices.reserve(indexCount);
+            shortIndices.insert(shortIndices.end(), indices.begin(), indices.end());
+            shortIndices.insert(shortIndices.end(), lodChain.indices.begin(), lodChain.indices.end());
+            indexData = shortIndices.data();
+            indexSize = sizeof(unsigned short);
+        }
+        else if(lodChain.indices.empty())
+        {
+            indexData = indices.data();
+            indexSize = sizeof(unsigned int);
+        }
+        else
+        {
+            allIndices.reserve(indexCount);
+            allIndices.insert(allIndices.end(), indices.begin(), indices.end());
+            allIndices.insert(allIndices.end(), lodChain.indices.begin(), lodChain.indices.end());
+            indexData = allIndices.data();
+            indexSize = sizeof(unsigned int);
+        }
+
+        // 20 bytes instead of 56 per packed vertex; 1.model_loading.vs decodes them when compiled with PACKED_VERTICES
+        vector<PackedVertex> packed;
+        const void *vertexData = vertices.data();
+        size_t vertexSize = sizeof(Vertex);
+        if(format == VERTEX_FORMAT_PACKED)
+        {
+            packVertices(vertices, packed, decode);
+            vertexData = packed.data();
+            vertexSize = sizeof(PackedVertex);
+        }
+
+        gpuVertexBytes = vertices.size() * vertexSize;
+        gpuIndexBytes = indexCount * indexSize;
+        if(storage == MESH_STORAGE_ARENA)
+        {
+            GeometryArena &arena = SharedGeometryArena(format, indexType);
+            range = arena.allocate(vertexData, vertices.size(), indexData, indexCount);
+            VAO = arena.vertexArray();
+            VBO = EBO = 0;
+            return;
+        }
+
         // create buffers/arrays
         glGenVertexArrays(1, &VAO);
         glGenBuffers(1, &VBO);
         glGenBuffers(1, &EBO);
 
-        glBindVertexArray(VAO);
-        // load data into vertex buffers
+        SharedGLState().bindVertexArray(VAO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * indexSize, indexData, GL_STATIC_DRAW);
+
+        // load data into vertex buffers and set the vertex attribute pointers
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        // A great thing about structs is that their memory layout is sequential for all its items.
-        // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
-        // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);  
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * vertexSize, vertexData, GL_STATIC_DRAW);
+        if(format == VERTEX_FORMAT_PACKED)
+            SetPackedVertexAttributes();
+        else
+            SetFloatVertexAttributes();
+        SharedGLState().bindVertexArray(0);
+    }
 
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-
-        // set the vertex attribute pointers
-        // vertex Positions
-        glEnableVertexAttribArray(0);	
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        // vertex normals
-        glEnableVertexAttribArray(1);	
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-        // vertex texture coords
-        glEnableVertexAttribArray(2);	
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-        // vertex tangent
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-        // vertex bitangent
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
-
-        glBindVertexArray(0);
+    // resolves the textures to their fixed sampler units (see MAX_SAMPLERS_PER_TYPE)
+    void buildDrawPacket()
+    {
+        packet.vao = VAO;
+        packet.indexCount = (GLsizei)indices.size();
+        packet.indexType = indexType;
+        packet.indexOffset = range.indexOffset;
+        packet.baseVertex = range.baseVertex;
+        packet.textureCount = 0;
+        packet.positionScale = decode.scale;
+        packet.positionBias = decode.bias;
+        unsigned int used[SAMPLER_TYPE_COUNT] = { 0 };
+        for(unsigned int i = 0; i < textures.size(); i++)
+        {
+            for(unsigned int type = 0; type < SAMPLER_TYPE_COUNT; type++)
+            {
+                if(textures[i].type != SAMPLER_TYPE_NAMES[type])
+                    continue;
+                // the Nth texture of a type goes to texture_<type>N; more than the shader can name are dropped
+                if(used[type] < MAX_SAMPLERS_PER_TYPE)
+                {
+                    TextureBinding &binding = packet.textures[packet.textureCount++];
+                    binding.unit = type * MAX_SAMPLERS_PER_TYPE + used[type]++;
+                    binding.texture = textures[i].id;
+                }
+                break;
+            }
+        }
     }
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,443 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <mesh.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+// Binary mesh cache written next to a model after its first Assimp import (<model>.meshcache).
+// The file is laid out so it can be memory mapped and copied straight into the Vertex/index arrays:
+//
+//   MeshCacheHeader | source path | MeshCacheEntry[meshCount] | MeshCacheTexture[textureCount] | MeshCacheLod[lodCount] |
+//   strings | vertex/index blobs
+//
+// A mesh's index blob holds its LOD 0 indices followed by the indices of its LOD chain (mesh_simplifier.h), so the
+// simplification only ever runs on the first import.
+//
+// A cache is only used when magic, version, vertex size, the MeshCacheKey, source path, source mtime and source size
+// all match; anything else is treated as a miss and the model is re-imported (and the cache rewritten).
+// Rigged models (meshes with bones) are never cached; version 4 retires the bind pose only caches written for them before.
+const uint32_t MESH_CACHE_MAGIC   = 0x4843534D; // "MSCH"
+const uint32_t MESH_CACHE_VERSION = 4;
+const uint64_t MESH_CACHE_ALIGN   = 16;
+
+struct MeshCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vertexSize;        // sizeof(Vertex) of the writer
+    uint32_t postProcessFlags;  // aiProcess_* flags the data was imported with
+    uint32_t pipelineFlags;     // CPU stages applied after the import (MESH_PIPELINE_* in model.h)
+    uint32_t pipelineParameters; // hash of the parameters of those stages
+    uint64_t sourceMTime;
+    uint64_t sourceSize;
+    uint32_t sourcePathLength;  // path bytes follow the header (not null terminated)
+    uint32_t meshCount;
+    uint32_t textureCount;
+    uint32_t stringBytes;
+    uint32_t lodCount;
+    uint32_t reserved;
+    uint64_t fileSize;
+};
+
+// everything besides the source file that decides what the cached data looks like
+struct MeshCacheKey {
+    uint32_t postProcessFlags;
+    uint32_t pipelineFlags;
+    uint32_t pipelineParameters;
+};
+
+struct MeshCacheEntry {
+    uint64_t vertexOffset;      // absolute file offset, MESH_CACHE_ALIGN aligned
+    uint64_t indexOffset;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t firstTexture;      // range in the MeshCacheTexture table
+    uint32_t textureCount;
+    uint32_t lodIndexCount;     // LOD chain indices stored after the indexCount LOD 0 ones
+    uint32_t firstLod;          // range in the MeshCacheLod table
+    uint32_t lodCount;
+    uint32_t reserved;
+};
+
+struct MeshCacheLod {
+    uint32_t indexOffset;       // MeshLod of the mesh's chain
+    uint32_t indexCount;
+    float error;
+    uint32_t reserved;
+};
+
+struct MeshCacheTexture {
+    uint32_t typeOffset;        // offsets into the string block
+    uint32_t typeLength;
+    uint32_t pathOffset;
+    uint32_t pathLength;
+};
+
+// stat() of the source file, used to key the cache
+inline bool meshCacheSourceStamp(const std::string &path, uint64_t &mtime, uint64_t &size)
+{
+#ifdef _WIN32
+    struct _stat64 st;
+    if (_stat64(path.c_str(), &st) != 0)
+        return false;
+#else
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+        return false;
+#endif
+    mtime = (uint64_t)st.st_mtime;
+    size = (uint64_t)st.st_size;
+    return true;
+}
+
+inline std::string meshCachePath(const std::string &sourcePath)
+{
+    return sourcePath + ".meshcache";
+}
+
+// read-only memory mapping of a whole file
+class MappedFile
+{
+public:
+    MappedFile() : data(nullptr), size(0)
+#ifdef _WIN32
+        , file(INVALID_HANDLE_VALUE), mapping(NULL)
+#endif
+    {
+    }
+    ~MappedFile() { close(); }
+
+    bool open(const std::string &path)
+    {
+        close();
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+        {
+            close();
+            return false;
+        }
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping == NULL)
+        {
+            close();
+            return false;
+        }
+        data = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        size = (size_t)fileSize.QuadPart;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0)
+        {
+            ::close(fd);
+            return false;
+        }
+        void *ptr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd); // the mapping keeps its own reference
+        if (ptr == MAP_FAILED)
+            return false;
+        data = (const unsigned char*)ptr;
+        size = (size_t)st.st_size;
+#endif
+        if (!data)
+        {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close()
+    {
+#ifdef _WIN32
+        if (data)
+            UnmapViewOfFile(data);
+        if (mapping != NULL)
+            CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+        mapping = NULL;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (data)
+            munmap((void*)data, size);
+#endif
+        data = nullptr;
+        size = 0;
+    }
+
+    const unsigned char *data;
+    size_t size;
+
+private:
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+    MappedFile(const MappedFile&);
+    MappedFile &operator=(const MappedFile&);
+};
+
+// a mapped and validated cache file; all pointers stay valid while the reader is alive
+class MeshCacheReader
+{
+public:
+    MeshCacheReader() : header(nullptr), entries(nullptr), textures(nullptr), lods(nullptr), strings(nullptr) {}
+
+    // maps the cache for sourcePath and checks it against the current source file and the key
+    bool open(const std::string &sourcePath, const MeshCacheKey &key)
+    {
+        uint64_t mtime, size;
+        if (!meshCacheSourceStamp(sourcePath, mtime, size))
+            return false;
+        if (!file.open(meshCachePath(sourcePath)))
+            return false;
+        if (file.size < sizeof(MeshCacheHeader))
+            return fail();
+
+        header = (const MeshCacheHeader*)file.data;
+        if (header->magic != MESH_CACHE_MAGIC || header->version != MESH_CACHE_VERSION ||
+            header->vertexSize != sizeof(Vertex) || header->postProcessFlags != key.postProcessFlags ||
+            header->pipelineFlags != key.pipelineFlags || header->pipelineParameters != key.pipelineParameters ||
+            header->sourceMTime != mtime || header->sourceSize != size || header->fileSize != file.size)
+            return fail();
+
+        uint64_t offset = sizeof(MeshCacheHeader);
+        if (header->sourcePathLength != sourcePath.size() ||
+            std::memcmp(file.data + offset, sourcePath.data(), sourcePath.size()) != 0)
+            return fail();
+        offset += header->sourcePathLength;
+        offset = align(offset);
+
+        uint64_t tablesEnd = offset + header->meshCount * sizeof(MeshCacheEntry) + header->textureCount * sizeof(MeshCacheTexture) +
+                             header->lodCount * sizeof(MeshCacheLod) + header->stringBytes;
+        if (tablesEnd > file.size)
+            return fail();
+        entries = (const MeshCacheEntry*)(file.data + offset);
+        offset += header->meshCount * sizeof(MeshCacheEntry);
+        textures = (const MeshCacheTexture*)(file.data + offset);
+        offset += header->textureCount * sizeof(MeshCacheTexture);
+        lods = (const MeshCacheLod*)(file.data + offset);
+        offset += header->lodCount * sizeof(MeshCacheLod);
+        strings = (const char*)(file.data + offset);
+
+        // bounds check every blob once so the loader can trust the entries
+        for (uint32_t i = 0; i < header->meshCount; i++)
+        {
+            const MeshCacheEntry &e = entries[i];
+            if (e.vertexOffset + (uint64_t)e.vertexCount * sizeof(Vertex) > file.size ||
+                e.indexOffset + ((uint64_t)e.indexCount + e.lodIndexCount) * sizeof(unsigned int) > file.size ||
+                (uint64_t)e.firstTexture + e.textureCount > header->textureCount ||
+                (uint64_t)e.firstLod + e.lodCount > header->lodCount)
+                return fail();
+            for (uint32_t j = 0; j < e.lodCount; j++)
+            {
+                const MeshCacheLod &l = lods[e.firstLod + j];
+                if ((uint64_t)l.indexOffset < e.indexCount || (uint64_t)l.indexOffset + l.indexCount > (uint64_t)e.indexCount + e.lodIndexCount)
+                    return fail();
+            }
+        }
+        for (uint32_t i = 0; i < header->textureCount; i++)
+        {
+            const MeshCacheTexture &t = textures[i];
+            if ((uint64_t)t.typeOffset + t.typeLength > header->stringBytes || (uint64_t)t.pathOffset + t.pathLength > header->stringBytes)
+                return fail();
+        }
+        return true;
+    }
+
+    unsigned int meshCount() const { return header ? header->meshCount : 0; }
+    const MeshCacheEntry &entry(unsigned int i) const { return entries[i]; }
+    const Vertex *vertices(const MeshCacheEntry &e) const { return (const Vertex*)(file.data + e.vertexOffset); }
+    const unsigned int *indices(const MeshCacheEntry &e) const { return (const unsigned int*)(file.data + e.indexOffset); }
+    // the LOD chain indices, right after the e.indexCount LOD 0 ones
+    const unsigned int *lodIndices(const MeshCacheEntry &e) const { return indices(e) + e.indexCount; }
+    const MeshCacheLod &lod(const MeshCacheEntry &e, unsigned int level) const { return lods[e.firstLod + level]; }
+    std::string textureType(unsigned int i) const { return std::string(strings + textures[i].typeOffset, textures[i].typeLength); }
+    std::string texturePath(unsigned int i) const { return std::string(strings + textures[i].pathOffset, textures[i].pathLength); }
+
+    static uint64_t align(uint64_t offset) { return (offset + MESH_CACHE_ALIGN - 1) & ~(MESH_CACHE_ALIGN - 1); }
+
+private:
+    bool fail()
+    {
+        file.close();
+        header = nullptr;
+        return false;
+    }
+
+    MappedFile file;
+    const MeshCacheHeader *header;
+    const MeshCacheEntry *entries;
+    const MeshCacheTexture *textures;
+    const MeshCacheLod *lods;
+    const char *strings;
+};
+
+// writes the cache for sourcePath; a failed write only costs the next start another Assimp import.
+// MeshT is Mesh, or anything with the same vertices/indices/textures/lodChain members (offline tools have no GL for a Mesh).
+template<typename MeshT>
+bool writeMeshCache(const std::string &sourcePath, const MeshCacheKey &key, const std::vector<MeshT> &meshes)
+{
+    MeshCacheHeader header;
+    std::memset(&header, 0, sizeof(header));
+    header.magic = MESH_CACHE_MAGIC;
+    header.version = MESH_CACHE_VERSION;
+    header.vertexSize = sizeof(Vertex);
+    header.postProcessFlags = key.postProcessFlags;
+    header.pipelineFlags = key.pipelineFlags;
+    header.pipelineParameters = key.pipelineParameters;
+    if (!meshCacheSourceStamp(sourcePath, header.sourceMTime, header.sourceSize))
+        return false;
+    header.sourcePathLength = (uint32_t)sourcePath.size();
+    header.meshCount = (uint32_t)meshes.size();
+
+    // texture table and string block
+    std::vector<MeshCacheTexture> textures;
+    std::string strings;
+    for (unsigned int i = 0; i < meshes.size(); i++)
+    {
+        for (unsigned int j = 0; j < meshes[i].textures.size(); j++)
+        {
+            const Texture &texture = meshes[i].textures[j];
+            MeshCacheTexture t;
+            t.typeOffset = (uint32_t)strings.size();
+            t.typeLength = (uint32_t)texture.type.size();
+            strings += texture.type;
+            t.pathOffset = (uint32_t)strings.size();
+            t.pathLength = (uint32_t)texture.path.length;
+            strings.append(texture.path.C_Str(), texture.path.length);
+            textures.push_back(t);
+        }
+    }
+    header.textureCount = (uint32_t)textures.size();
+    header.stringBytes = (uint32_t)strings.size();
+
+    // LOD table
+    std::vector<MeshCacheLod> lods;
+    for (unsigned int i = 0; i < meshes.size(); i++)
+    {
+        const MeshLodChain &chain = meshes[i].lodChain;
+        for (unsigned int j = 0; j < chain.levels.size(); j++)
+        {
+            MeshCacheLod l;
+            l.indexOffset = chain.levels[j].indexOffset;
+            l.indexCount = chain.levels[j].indexCount;
+            l.error = chain.levels[j].error;
+            l.reserved = 0;
+            lods.push_back(l);
+        }
+    }
+    header.lodCount = (uint32_t)lods.size();
+
+    // lay out the geometry blobs after the tables
+    uint64_t offset = MeshCacheReader::align(sizeof(MeshCacheHeader) + header.sourcePathLength);
+    offset += header.meshCount * sizeof(MeshCacheEntry) + header.textureCount * sizeof(MeshCacheTexture) +
+              header.lodCount * sizeof(MeshCacheLod) + header.stringBytes;
+    std::vector<MeshCacheEntry> entries(meshes.size());
+    uint32_t firstTexture = 0, firstLod = 0;
+    for (unsigned int i = 0; i < meshes.size(); i++)
+    {
+        MeshCacheEntry &e = entries[i];
+        e.vertexCount = (uint32_t)meshes[i].vertices.size();
+        e.indexCount = (uint32_t)meshes[i].indices.size();
+        e.firstTexture = firstTexture;
+        e.textureCount = (uint32_t)meshes[i].textures.size();
+        firstTexture += e.textureCount;
+        e.lodIndexCount = (uint32_t)meshes[i].lodChain.indices.size();
+        e.firstLod = firstLod;
+        e.lodCount = (uint32_t)meshes[i].lodChain.levels.size();
+        e.reserved = 0;
+        firstLod += e.lodCount;
+        offset = MeshCacheReader::align(offset);
+        e.vertexOffset = offset;
+        offset += (uint64_t)e.vertexCount * sizeof(Vertex);
+        offset = MeshCacheReader::align(offset);
+        e.indexOffset = offset;
+        offset += ((uint64_t)e.indexCount + e.lodIndexCount) * sizeof(unsigned int);
+    }
+    header.fileSize = offset;
+
+    // write to a temporary name and rename, so a crash never leaves a truncated cache behind
+    std::string cachePath = meshCachePath(sourcePath);
+    std::string tempPath = cachePath + ".tmp";
+    {
+        std::ofstream out(tempPath.c_str(), std::ios::binary | std::ios::trunc);
+        if (!out)
+            return false;
+        static const char zeros[MESH_CACHE_ALIGN] = { 0 };
+        uint64_t written = 0;
+        // pads the stream up to the given absolute offset
+        auto padTo = [&](uint64_t target) {
+            while (written < target)
+            {
+                uint64_t n = target - written < MESH_CACHE_ALIGN ? target - written : MESH_CACHE_ALIGN;
+                out.write(zeros, (std::streamsize)n);
+                written += n;
+            }
+        };
+        auto put = [&](const void *data, uint64_t bytes) {
+            if (bytes)
+                out.write((const char*)data, (std::streamsize)bytes);
+            written += bytes;
+        };
+
+        put(&header, sizeof(header));
+        put(sourcePath.data(), sourcePath.size());
+        padTo(MeshCacheReader::align(written));
+        put(entries.data(), entries.size() * sizeof(MeshCacheEntry));
+        put(textures.data(), textures.size() * sizeof(MeshCacheTexture));
+        put(lods.data(), lods.size() * sizeof(MeshCacheLod));
+        put(strings.data(), strings.size());
+        for (unsigned int i = 0; i < meshes.size(); i++)
+        {
+            padTo(entries[i].vertexOffset);
+            put(meshes[i].vertices.data(), (uint64_t)entries[i].vertexCount * sizeof(Vertex));
+            padTo(entries[i].indexOffset);
+            put(meshes[i].indices.data(), (uint64_t)entries[i].indexCount * sizeof(unsigned int));
+            put(meshes[i].lodChain.indices.data(), (uint64_t)entries[i].lodIndexCount * sizeof(unsigned int));
+        }
+        if (!out)
+        {
+            out.close();
+            std::remove(tempPath.c_str());
+            return false;
+        }
+    }
+    std::remove(cachePath.c_str()); // rename() does not overwrite on Windows
+    if (std::rename(tempPath.c_str(), cachePath.c_str()) != 0)
+    {
+        std::remove(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
+#endif
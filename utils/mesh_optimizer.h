@@ -0,0 +1,367 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Index/vertex passes for triangle lists, run once after import. Pure CPU: no GL, safe on any thread.
+//  0. weldVertices:         merges duplicate vertices (Assimp emits one per face corner without JoinIdenticalVertices)
+//  1. optimizeVertexCache:  Tipsify (Sander, Nehab & Barczak 2007) - reorders triangles for the post-transform cache
+//  2. optimizeOverdraw:     splits that order into clusters and draws outward facing clusters first
+//  3. optimizeVertexFetch:  renumbers vertices in first-use order so fetches walk the vertex buffer linearly
+// optimizeMesh runs all three and reports the cache efficiency before and after.
+
+// FIFO cache size the passes optimise for and the statistics simulate; a common size for desktop GPUs
+const unsigned int MESH_OPTIMIZER_CACHE_SIZE = 16;
+// an overdraw cluster may cost up to this factor of its Tipsify cluster's cache misses
+const float MESH_OPTIMIZER_OVERDRAW_THRESHOLD = 1.05f;
+
+struct VertexCacheStats {
+    float acmr; // average cache miss ratio: transformed vertices per triangle (0.5 ideal, 3 worst)
+    float atvr; // average transform to vertex ratio: transformed vertices per referenced vertex (1 ideal)
+};
+
+struct MeshOptimizationReport {
+    VertexCacheStats before;
+    VertexCacheStats after;
+    size_t verticesRemoved; // vertices no triangle referenced, dropped by optimizeVertexFetch
+};
+
+// simulates a FIFO post-transform cache over a triangle list
+inline VertexCacheStats analyzeVertexCache(const unsigned int *indices, size_t indexCount, size_t vertexCount, unsigned int cacheSize = MESH_OPTIMIZER_CACHE_SIZE)
+{
+    VertexCacheStats stats = { 0.0f, 0.0f };
+    if (indexCount < 3)
+        return stats;
+    std::vector<size_t> cachedAt(vertexCount, 0); // miss counter value when the vertex entered the cache, 0 = never
+    size_t misses = 0, referenced = 0;
+    for (size_t i = 0; i < indexCount; i++)
+    {
+        unsigned int v = indices[i];
+        if (cachedAt[v] == 0)
+            referenced++;
+        if (cachedAt[v] == 0 || misses + 1 - cachedAt[v] > cacheSize)
+            cachedAt[v] = ++misses;
+    }
+    stats.acmr = (float)misses / (float)(indexCount / 3);
+    stats.atvr = referenced ? (float)misses / (float)referenced : 0.0f;
+    return stats;
+}
+
+// Tipsify: fans around the most recently cached vertex that still has triangles left, falling back to recently used
+// vertices (and finally the lowest numbered live one) at dead ends. Indices are reordered in place, triangle winding
+// is kept. If clusters is given it receives the first triangle of every run started from a dead end; those are the
+// points where the cache state is unrelated to what came before, used by optimizeOverdraw.
+inline void optimizeVertexCache(std::vector<unsigned int> &indices, size_t vertexCount, unsigned int cacheSize = MESH_OPTIMIZER_CACHE_SIZE,
+                                std::vector<unsigned int> *clusters = nullptr)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (clusters)
+        clusters->clear();
+    if (triangleCount == 0)
+        return;
+
+    // vertex -> triangle adjacency
+    std::vector<unsigned int> liveTriangles(vertexCount, 0);
+    for (size_t i = 0; i < triangleCount * 3; i++)
+        liveTriangles[indices[i]]++;
+    std::vector<unsigned int> adjacencyOffsets(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++)
+        adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveTriangles[v];
+    std::vector<unsigned int> adjacency(triangleCount * 3);
+    {
+        std::vector<unsigned int> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (size_t i = 0; i < triangleCount * 3; i++)
+            adjacency[fill[indices[i]]++] = (unsigned int)(i / 3);
+    }
+
+    std::vector<unsigned int> cacheTime(vertexCount, 0);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<unsigned int> deadEnd;
+    std::vector<unsigned int> candidates;
+    std::vector<unsigned int> result;
+    result.reserve(triangleCount * 3);
+    unsigned int time = cacheSize + 1;
+    size_t cursor = 0;
+
+    // first vertex that has triangles left: from the dead-end stack, else by scanning forward
+    auto skipDeadEnd = [&]() -> long long {
+        while (!deadEnd.empty())
+        {
+            unsigned int v = deadEnd.back();
+            deadEnd.pop_back();
+            if (liveTriangles[v] > 0)
+                return v;
+        }
+        for (; cursor < vertexCount; cursor++)
+        {
+            if (liveTriangles[cursor] > 0)
+                return (long long)cursor;
+        }
+        return -1;
+    };
+
+    long long fan = skipDeadEnd();
+    if (clusters)
+        clusters->push_back(0);
+    while (fan >= 0)
+    {
+        candidates.clear();
+        for (unsigned int a = adjacencyOffsets[fan]; a < adjacencyOffsets[fan + 1]; a++)
+        {
+            unsigned int t = adjacency[a];
+            if (emitted[t])
+                continue;
+            for (unsigned int k = 0; k < 3; k++)
+            {
+                unsigned int v = indices[t * 3 + k];
+                result.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                liveTriangles[v]--;
+                if (time - cacheTime[v] > cacheSize)
+                    cacheTime[v] = time++;
+            }
+            emitted[t] = true;
+        }
+
+        // next fan: the candidate that stays in the cache longest while its remaining triangles are emitted
+        long long next = -1;
+        int bestPriority = -1;
+        for (unsigned int c = 0; c < candidates.size(); c++)
+        {
+            unsigned int v = candidates[c];
+            if (liveTriangles[v] == 0)
+                continue;
+            int priority = 0;
+            if (time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize)
+                priority = (int)(time - cacheTime[v]);
+            if (priority > bestPriority)
+            {
+                bestPriority = priority;
+                next = v;
+            }
+        }
+        if (next < 0)
+        {
+            next = skipDeadEnd();
+            if (clusters && next >= 0)
+                clusters->push_back((unsigned int)(result.size() / 3));
+        }
+        fan = next;
+    }
+    indices.swap(result);
+}
+
+// Reorders the clusters of a vertex cache optimised triangle list so outward facing geometry is drawn first and
+// occludes what lies behind it (Sander et al. 2007, with the cluster sort of meshoptimizer).
+// clusters are the hard boundaries from optimizeVertexCache; they are split further wherever the cache miss ratio of
+// a prefix already gets within threshold of the whole cluster, trading a little cache efficiency for finer sorting.
+template<typename V>
+void optimizeOverdraw(std::vector<unsigned int> &indices, const std::vector<V> &vertices, const std::vector<unsigned int> &clusters,
+                      unsigned int cacheSize = MESH_OPTIMIZER_CACHE_SIZE, float threshold = MESH_OPTIMIZER_OVERDRAW_THRESHOLD)
+{
+    unsigned int triangleCount = (unsigned int)(indices.size() / 3);
+    if (triangleCount == 0 || clusters.empty())
+        return;
+
+    // soft boundaries inside every hard cluster. The simulated cache is emptied by moving base past every entry
+    // (cachedAt <= base counts as not cached) instead of clearing the array, which would be quadratic.
+    std::vector<unsigned int> starts;
+    std::vector<size_t> cachedAt(vertices.size(), 0);
+    size_t clock = 0, base = 0;
+    auto miss = [&](unsigned int v) -> bool {
+        if (cachedAt[v] > base && clock - cachedAt[v] < cacheSize)
+            return false;
+        cachedAt[v] = ++clock;
+        return true;
+    };
+    for (unsigned int c = 0; c < clusters.size(); c++)
+    {
+        unsigned int begin = clusters[c];
+        unsigned int end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+        if (begin >= end)
+            continue;
+        base = clock;
+        unsigned int misses = 0;
+        for (unsigned int i = begin * 3; i < end * 3; i++)
+            misses += miss(indices[i]);
+        float clusterThreshold = threshold * (float)misses / (float)(end - begin);
+
+        starts.push_back(begin);
+        base = clock;
+        misses = 0;
+        unsigned int first = begin;
+        for (unsigned int t = begin; t < end; t++)
+        {
+            for (unsigned int k = 0; k < 3; k++)
+                misses += miss(indices[t * 3 + k]);
+            if (t + 1 < end && (float)misses / (float)(t - first + 1) <= clusterThreshold)
+            {
+                starts.push_back(t + 1);
+                first = t + 1;
+                base = clock;
+                misses = 0;
+            }
+        }
+    }
+
+    // mesh centroid and, per cluster, area weighted centroid and normal
+    glm::vec3 meshCentroid(0.0f);
+    for (unsigned int i = 0; i < triangleCount * 3; i++)
+        meshCentroid += vertices[indices[i]].Position;
+    meshCentroid /= (float)(triangleCount * 3);
+
+    struct Cluster {
+        unsigned int begin, end;
+        float sortKey;
+    };
+    std::vector<Cluster> order(starts.size());
+    for (unsigned int c = 0; c < starts.size(); c++)
+    {
+        Cluster &cluster = order[c];
+        cluster.begin = starts[c];
+        cluster.end = c + 1 < starts.size() ? starts[c + 1] : triangleCount;
+        glm::vec3 centroid(0.0f), normal(0.0f);
+        float area = 0.0f;
+        for (unsigned int t = cluster.begin; t < cluster.end; t++)
+        {
+            const glm::vec3 &p0 = vertices[indices[t * 3 + 0]].Position;
+            const glm::vec3 &p1 = vertices[indices[t * 3 + 1]].Position;
+            const glm::vec3 &p2 = vertices[indices[t * 3 + 2]].Position;
+            glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+            float a = glm::length(n);
+            centroid += (p0 + p1 + p2) * (a / 3.0f);
+            normal += n;
+            area += a;
+        }
+        centroid = area > 0.0f ? centroid / area : meshCentroid;
+        float length = glm::length(normal);
+        cluster.sortKey = length > 0.0f ? glm::dot(centroid - meshCentroid, normal / length) : 0.0f;
+    }
+    std::stable_sort(order.begin(), order.end(), [](const Cluster &a, const Cluster &b) { return a.sortKey > b.sortKey; });
+
+    std::vector<unsigned int> result;
+    result.reserve(indices.size());
+    for (unsigned int c = 0; c < order.size(); c++)
+        result.insert(result.end(), indices.begin() + order[c].begin * 3, indices.begin() + order[c].end * 3);
+    indices.swap(result);
+}
+
+// Merges duplicate vertices and rewrites the indices to the survivors (the first vertex of each group is kept).
+// epsilon == 0 merges bit-identical vertices only; epsilon > 0 snaps every component to an epsilon grid and merges
+// vertices landing in the same cell, so values closer than epsilon usually (not always, near cell borders) merge.
+// V must consist of floats only, like Vertex. Returns the number of vertices removed.
+template<typename V>
+size_t weldVertices(std::vector<V> &vertices, std::vector<unsigned int> &indices, float epsilon = 0.0f)
+{
+    static_assert(sizeof(V) % sizeof(float) == 0, "weldVertices expects a vertex made of floats");
+    const size_t components = sizeof(V) / sizeof(float);
+    size_t count = vertices.size();
+    if (count == 0)
+        return 0;
+
+    // per vertex key: the raw bits, or the grid cell of every component
+    std::vector<uint32_t> keys(count * components);
+    for (size_t i = 0; i < count; i++)
+    {
+        const float *values = (const float*)&vertices[i];
+        uint32_t *key = &keys[i * components];
+        if (epsilon > 0.0f)
+        {
+            for (size_t c = 0; c < components; c++)
+                key[c] = (uint32_t)(int32_t)std::floor(values[c] / epsilon + 0.5f);
+        }
+        else
+            std::memcpy(key, values, sizeof(V));
+    }
+
+    // open addressing table of first occurrences
+    size_t tableSize = 1;
+    while (tableSize < count * 2)
+        tableSize *= 2;
+    const unsigned int empty = ~0u;
+    std::vector<unsigned int> table(tableSize, empty);
+    std::vector<unsigned int> remap(count);
+    std::vector<V> result;
+    result.reserve(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        const uint32_t *key = &keys[i * components];
+        uint32_t hash = 2166136261u;
+        for (size_t c = 0; c < components; c++)
+            hash = (hash ^ key[c]) * 16777619u;
+        size_t slot = hash & (tableSize - 1);
+        for (;;)
+        {
+            unsigned int candidate = table[slot];
+            if (candidate == empty)
+            {
+                table[slot] = (unsigned int)i;
+                remap[i] = (unsigned int)result.size();
+                result.push_back(vertices[i]);
+                break;
+            }
+            if (std::memcmp(&keys[candidate * components], key, components * sizeof(uint32_t)) == 0)
+            {
+                remap[i] = remap[candidate];
+                break;
+            }
+            slot = (slot + 1) & (tableSize - 1);
+        }
+    }
+    for (size_t i = 0; i < indices.size(); i++)
+        indices[i] = remap[indices[i]];
+    size_t removed = count - result.size();
+    vertices.swap(result);
+    return removed;
+}
+
+// renumbers vertices in the order the index buffer first uses them and drops unreferenced ones;
+// returns the number of vertices removed
+template<typename V>
+size_t optimizeVertexFetch(std::vector<V> &vertices, std::vector<unsigned int> &indices)
+{
+    const unsigned int unused = ~0u;
+    std::vector<unsigned int> remap(vertices.size(), unused);
+    std::vector<V> result;
+    result.reserve(vertices.size());
+    for (size_t i = 0; i < indices.size(); i++)
+    {
+        unsigned int &target = remap[indices[i]];
+        if (target == unused)
+        {
+            target = (unsigned int)result.size();
+            result.push_back(vertices[indices[i]]);
+        }
+        indices[i] = target;
+    }
+    size_t removed = vertices.size() - result.size();
+    vertices.swap(result);
+    return removed;
+}
+
+// runs the three passes on one mesh (a triangle list) and measures the post-transform cache before and after
+template<typename V>
+MeshOptimizationReport optimizeMesh(std::vector<V> &vertices, std::vector<unsigned int> &indices, unsigned int cacheSize = MESH_OPTIMIZER_CACHE_SIZE)
+{
+    MeshOptimizationReport report;
+    report.before = analyzeVertexCache(indices.data(), indices.size(), vertices.size(), cacheSize);
+    report.verticesRemoved = 0;
+    if (indices.size() >= 3 && indices.size() % 3 == 0)
+    {
+        std::vector<unsigned int> clusters;
+        optimizeVertexCache(indices, vertices.size(), cacheSize, &clusters);
+        optimizeOverdraw(indices, vertices, clusters, cacheSize);
+        report.verticesRemoved = optimizeVertexFetch(vertices, indices);
+    }
+    report.after = analyzeVertexCache(indices.data(), indices.size(), vertices.size(), cacheSize);
+    return report;
+}
+#endif
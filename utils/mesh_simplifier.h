@@ -0,0 +1,442 @@
+#ifndef MESH_SIMPLIFIER_H
+#define MESH_SIMPLIFIER_H
+
+#include <glm/glm.hpp>
+
+#include <mesh_optimizer.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Level of detail generation by quadric error metric edge collapse (Garland & Heckbert 1997), run once after import.
+// Pure CPU: no GL, safe on any thread.
+//
+// Vertices are never moved or created: a collapse u -> v retargets u's triangle corners to the existing vertex v, so
+// every LOD is just another index buffer over the same vertex buffer. Vertices sharing a position but not their
+// attributes (UV or normal seams) are handled together: a seam vertex may only slide along its seam, and both of its
+// copies move to the matching copies of the target, so the seam never opens. Open borders only collapse along the
+// border; anything more tangled (non-manifold edges, corners where seams meet) stays put.
+
+// one level of a mesh's LOD chain: a range of the mesh's index buffer and how far (in model units) it may deviate
+// from the full mesh
+struct MeshLod {
+    unsigned int indexOffset; // in indices, from the start of LOD 0
+    unsigned int indexCount;
+    float error;
+};
+
+// the levels after LOD 0; their index ranges follow the mesh's own indices
+struct MeshLodChain {
+    std::vector<unsigned int> indices;
+    std::vector<MeshLod> levels;
+};
+
+// each LOD level needs at least this few triangles, and must drop at least 1 - LOD_MIN_REDUCTION of the previous one's
+const size_t LOD_MIN_TRIANGLES = 32;
+const float LOD_MIN_REDUCTION = 0.9f;
+
+// symmetric 3x3 A, b and c of the quadric p^T A p + 2 b.p + c, plus the summed weight of the planes in it
+struct Quadric {
+    double a00, a01, a02, a11, a12, a22;
+    double b0, b1, b2;
+    double c;
+    double weight;
+};
+
+// plane n.p + d = 0 with unit n
+inline void addPlaneQuadric(Quadric &q, const glm::dvec3 &n, double d, double weight)
+{
+    q.a00 += weight * n.x * n.x; q.a01 += weight * n.x * n.y; q.a02 += weight * n.x * n.z;
+    q.a11 += weight * n.y * n.y; q.a12 += weight * n.y * n.z; q.a22 += weight * n.z * n.z;
+    q.b0 += weight * n.x * d; q.b1 += weight * n.y * d; q.b2 += weight * n.z * d;
+    q.c += weight * d * d;
+    q.weight += weight;
+}
+
+inline void addQuadric(Quadric &q, const Quadric &other)
+{
+    q.a00 += other.a00; q.a01 += other.a01; q.a02 += other.a02;
+    q.a11 += other.a11; q.a12 += other.a12; q.a22 += other.a22;
+    q.b0 += other.b0; q.b1 += other.b1; q.b2 += other.b2;
+    q.c += other.c;
+    q.weight += other.weight;
+}
+
+// weighted mean squared distance of p to the planes in q
+inline double quadricError(const Quadric &q, const glm::vec3 &p)
+{
+    double x = p.x, y = p.y, z = p.z;
+    double e = q.a00 * x * x + q.a11 * y * y + q.a22 * z * z + 2.0 * (q.a01 * x * y + q.a02 * x * z + q.a12 * y * z)
+             + 2.0 * (q.b0 * x + q.b1 * y + q.b2 * z) + q.c;
+    return q.weight > 0.0 ? std::max(e, 0.0) / q.weight : 0.0;
+}
+
+// Simplifies the triangle list indices over vertices (V needs a Position member) down to at most targetIndexCount
+// indices, without any collapse moving the surface further than targetError (model units). Stops early if no
+// collapse within the error is left. result receives the new indices; returns the largest error of the collapses made.
+template<typename V>
+float simplifyMesh(const std::vector<V> &vertices, const std::vector<unsigned int> &indices, size_t targetIndexCount,
+                   float targetError, std::vector<unsigned int> &result)
+{
+    enum { KIND_MANIFOLD, KIND_BORDER, KIND_SEAM, KIND_LOCKED };
+    const double BORDER_WEIGHT = 10.0; // edge quadrics keep borders and seams in place against the area quadrics
+    const unsigned int MAX_PASSES = 100;
+
+    size_t vertexCount = vertices.size();
+    result = indices;
+    if (vertexCount == 0 || indices.size() <= targetIndexCount)
+        return 0.0f;
+
+    // group vertices by position: position[v] is the first vertex of v's group, wedge links each group into a ring
+    std::vector<unsigned int> position(vertexCount), wedge(vertexCount), order(vertexCount);
+    for (size_t i = 0; i < vertexCount; i++)
+        order[i] = (unsigned int)i;
+    auto less = [&](unsigned int a, unsigned int b) {
+        const glm::vec3 &pa = vertices[a].Position, &pb = vertices[b].Position;
+        if (pa.x != pb.x) return pa.x < pb.x;
+        if (pa.y != pb.y) return pa.y < pb.y;
+        if (pa.z != pb.z) return pa.z < pb.z;
+        return a < b;
+    };
+    std::sort(order.begin(), order.end(), less);
+    for (size_t i = 0; i < vertexCount;)
+    {
+        size_t j = i + 1;
+        while (j < vertexCount && vertices[order[j]].Position == vertices[order[i]].Position)
+            j++;
+        for (size_t k = i; k < j; k++)
+        {
+            position[order[k]] = order[i];
+            wedge[order[k]] = order[k + 1 < j ? k + 1 : i];
+        }
+        i = j;
+    }
+
+    std::vector<Quadric> quadrics(vertexCount); // by position group
+    std::memset(quadrics.data(), 0, quadrics.size() * sizeof(Quadric));
+    std::vector<unsigned char> kind(vertexCount);
+    std::vector<unsigned int> triangleStart(vertexCount + 1), triangleList;
+    std::vector<uint64_t> vertexEdges, positionEdges;
+    std::vector<unsigned int> openCount(vertexCount), borderCount(vertexCount);
+    std::vector<unsigned char> referenced(vertexCount), nonManifold(vertexCount), touched(vertexCount);
+    std::vector<unsigned int> remap(vertexCount);
+
+    struct Collapse {
+        float error;
+        unsigned int from, to;
+        bool operator<(const Collapse &other) const { return error < other.error; }
+    };
+    std::vector<Collapse> collapses;
+
+    auto edgeKey = [](unsigned int a, unsigned int b) { return ((uint64_t)a << 32) | b; };
+    auto hasEdge = [](const std::vector<uint64_t> &edges, uint64_t key) { return std::binary_search(edges.begin(), edges.end(), key); };
+    auto normalOf = [](const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c) { return glm::cross(b - a, c - a); };
+
+    float maxError = 0.0f;
+    for (unsigned int pass = 0; pass < MAX_PASSES && result.size() > targetIndexCount; pass++)
+    {
+        size_t triangleCount = result.size() / 3;
+
+        // vertex -> triangles
+        std::fill(triangleStart.begin(), triangleStart.end(), 0u);
+        for (size_t i = 0; i < result.size(); i++)
+            triangleStart[result[i] + 1]++;
+        for (size_t v = 0; v < vertexCount; v++)
+            triangleStart[v + 1] += triangleStart[v];
+        triangleList.resize(result.size());
+        {
+            std::vector<unsigned int> fill(triangleStart.begin(), triangleStart.end() - 1);
+            for (size_t i = 0; i < result.size(); i++)
+                triangleList[fill[result[i]]++] = (unsigned int)(i / 3);
+        }
+
+        // classify: an edge without its reverse is open; open between positions it is a border, open only between
+        // vertices (the other side uses other copies of the same positions) it is a seam
+        vertexEdges.clear();
+        positionEdges.clear();
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            for (int e = 0; e < 3; e++)
+            {
+                unsigned int a = result[3 * t + e], b = result[3 * t + (e + 1) % 3];
+                vertexEdges.push_back(edgeKey(a, b));
+                positionEdges.push_back(edgeKey(position[a], position[b]));
+            }
+        }
+        std::sort(vertexEdges.begin(), vertexEdges.end());
+        std::sort(positionEdges.begin(), positionEdges.end());
+        std::fill(openCount.begin(), openCount.end(), 0u);
+        std::fill(borderCount.begin(), borderCount.end(), 0u);
+        std::fill(referenced.begin(), referenced.end(), (unsigned char)0);
+        std::fill(nonManifold.begin(), nonManifold.end(), (unsigned char)0);
+        for (size_t i = 1; i < positionEdges.size(); i++)
+        {
+            if (positionEdges[i] == positionEdges[i - 1])
+                nonManifold[positionEdges[i] >> 32] = nonManifold[positionEdges[i] & 0xffffffffu] = 1;
+        }
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            for (int e = 0; e < 3; e++)
+            {
+                unsigned int a = result[3 * t + e], b = result[3 * t + (e + 1) % 3];
+                referenced[a] = 1;
+                if (!hasEdge(vertexEdges, edgeKey(b, a)))
+                {
+                    openCount[a]++;
+                    openCount[b]++;
+                }
+                if (!hasEdge(positionEdges, edgeKey(position[b], position[a])))
+                {
+                    borderCount[position[a]]++;
+                    borderCount[position[b]]++;
+                }
+            }
+        }
+        for (size_t v = 0; v < vertexCount; v++)
+        {
+            if (position[v] != v)
+                continue;
+            unsigned int wedges = 0, seamWedges = 0;
+            unsigned int w = (unsigned int)v;
+            do
+            {
+                if (referenced[w])
+                {
+                    wedges++;
+                    seamWedges += openCount[w] == 2;
+                    if (openCount[w] != 0 && openCount[w] != 2)
+                        seamWedges += 100; // anything but a simple seam locks
+                }
+                w = wedge[w];
+            } while (w != v);
+            unsigned char k;
+            if (nonManifold[v])
+                k = KIND_LOCKED;
+            else if (borderCount[v])
+                k = (borderCount[v] == 2 && wedges == 1) ? KIND_BORDER : KIND_LOCKED;
+            else if (seamWedges)
+                k = (wedges == 2 && seamWedges == 2) ? KIND_SEAM : KIND_LOCKED;
+            else
+                k = wedges == 1 ? KIND_MANIFOLD : KIND_LOCKED;
+            w = (unsigned int)v;
+            do
+            {
+                kind[w] = k;
+                w = wedge[w];
+            } while (w != v);
+        }
+
+        // quadrics come from the original surface: planes of its triangles, plus planes through its borders and seams
+        // perpendicular to the surface. Later passes only merge them along the collapses.
+        if (pass == 0)
+        {
+            for (size_t t = 0; t < triangleCount; t++)
+            {
+                unsigned int corner[3] = { result[3 * t], result[3 * t + 1], result[3 * t + 2] };
+                glm::dvec3 p[3] = { glm::dvec3(vertices[corner[0]].Position), glm::dvec3(vertices[corner[1]].Position), glm::dvec3(vertices[corner[2]].Position) };
+                glm::dvec3 n = glm::cross(p[1] - p[0], p[2] - p[0]);
+                double length = glm::length(n);
+                if (length <= 0.0)
+                    continue;
+                n /= length;
+                for (int e = 0; e < 3; e++)
+                    addPlaneQuadric(quadrics[position[corner[e]]], n, -glm::dot(n, p[0]), length * 0.5);
+                for (int e = 0; e < 3; e++)
+                {
+                    unsigned int a = corner[e], b = corner[(e + 1) % 3];
+                    if (hasEdge(vertexEdges, edgeKey(b, a)))
+                        continue;
+                    glm::dvec3 edge = p[(e + 1) % 3] - p[e];
+                    glm::dvec3 m = glm::cross(edge, n);
+                    double edgeLength = glm::length(m);
+                    if (edgeLength <= 0.0)
+                        continue;
+                    m /= edgeLength;
+                    double weight = glm::dot(edge, edge) * BORDER_WEIGHT;
+                    addPlaneQuadric(quadrics[position[a]], m, -glm::dot(m, p[e]), weight);
+                    addPlaneQuadric(quadrics[position[b]], m, -glm::dot(m, p[e]), weight);
+                }
+            }
+        }
+
+        // candidate collapses along every edge, both directions, cheapest first
+        collapses.clear();
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            for (int e = 0; e < 3; e++)
+            {
+                unsigned int a = result[3 * t + e], b = result[3 * t + (e + 1) % 3];
+                bool vertexOpen = !hasEdge(vertexEdges, edgeKey(b, a));
+                bool positionOpen = !hasEdge(positionEdges, edgeKey(position[b], position[a]));
+                for (int direction = 0; direction < 2; direction++)
+                {
+                    unsigned int from = direction ? b : a, to = direction ? a : b;
+                    bool allowed;
+                    switch (kind[from])
+                    {
+                    case KIND_MANIFOLD: allowed = true; break;
+                    case KIND_BORDER:   allowed = positionOpen; break;
+                    case KIND_SEAM:     allowed = vertexOpen && !positionOpen && (kind[to] == KIND_SEAM || kind[to] == KIND_LOCKED); break;
+                    default:            allowed = false; break;
+                    }
+                    if (!allowed)
+                        continue;
+                    Collapse collapse;
+                    collapse.error = (float)std::sqrt(quadricError(quadrics[position[from]], vertices[to].Position));
+                    collapse.from = from;
+                    collapse.to = to;
+                    if (collapse.error <= targetError)
+                        collapses.push_back(collapse);
+                }
+            }
+        }
+        if (collapses.empty())
+            break;
+        std::sort(collapses.begin(), collapses.end());
+
+        // apply them greedily; a position takes part in at most one collapse per pass
+        for (size_t v = 0; v < vertexCount; v++)
+            remap[v] = (unsigned int)v;
+        std::fill(touched.begin(), touched.end(), (unsigned char)0);
+        size_t removeGoal = triangleCount - targetIndexCount / 3, removed = 0;
+        size_t applied = 0;
+        for (size_t c = 0; c < collapses.size() && removed < removeGoal; c++)
+        {
+            unsigned int from = collapses[c].from, to = collapses[c].to;
+            unsigned int pf = position[from], pt = position[to];
+            if (pf == pt || touched[pf] || touched[pt])
+                continue;
+
+            // every copy of from moves to the copy of to it shares a triangle with
+            unsigned int sources[2], targets[2], count = 0;
+            bool valid = true;
+            unsigned int w = pf;
+            do
+            {
+                if (referenced[w])
+                {
+                    unsigned int target = ~0u;
+                    for (unsigned int i = triangleStart[w]; i < triangleStart[w + 1] && target == ~0u; i++)
+                    {
+                        for (int k = 0; k < 3; k++)
+                        {
+                            unsigned int corner = remap[result[3 * triangleList[i] + k]];
+                            if (position[corner] == pt)
+                                target = corner;
+                        }
+                    }
+                    if (target == ~0u || count == 2)
+                        valid = false;
+                    else
+                    {
+                        sources[count] = w;
+                        targets[count++] = target;
+                    }
+                }
+                w = wedge[w];
+            } while (w != pf && valid);
+            if (!valid || count == 0 || (count == 2 && targets[0] == targets[1]))
+                continue;
+
+            // reject collapses that flip (or squash flat) a surviving triangle
+            const glm::vec3 &newPosition = vertices[to].Position;
+            for (unsigned int s = 0; s < count && valid; s++)
+            {
+                for (unsigned int i = triangleStart[sources[s]]; i < triangleStart[sources[s] + 1] && valid; i++)
+                {
+                    unsigned int corner[3];
+                    bool collapsing = false;
+                    for (int k = 0; k < 3; k++)
+                    {
+                        corner[k] = remap[result[3 * triangleList[i] + k]];
+                        collapsing |= position[corner[k]] == pt;
+                    }
+                    if (collapsing)
+                        continue;
+                    glm::vec3 p[3], q[3];
+                    for (int k = 0; k < 3; k++)
+                    {
+                        p[k] = vertices[corner[k]].Position;
+                        q[k] = position[corner[k]] == pf ? newPosition : p[k];
+                    }
+                    glm::vec3 before = normalOf(p[0], p[1], p[2]), after = normalOf(q[0], q[1], q[2]);
+                    if (glm::dot(before, after) <= 0.25f * glm::length(before) * glm::length(after))
+                        valid = false;
+                }
+            }
+            if (!valid)
+                continue;
+
+            for (unsigned int s = 0; s < count; s++)
+                remap[sources[s]] = targets[s];
+            addQuadric(quadrics[pt], quadrics[pf]);
+            touched[pf] = touched[pt] = 1;
+            removed += kind[from] == KIND_BORDER ? 1 : 2;
+            maxError = std::max(maxError, collapses[c].error);
+            applied++;
+        }
+        if (!applied)
+            break;
+
+        // rewrite the triangles, dropping the ones that collapsed
+        size_t write = 0;
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            unsigned int a = remap[result[3 * t]], b = remap[result[3 * t + 1]], c = remap[result[3 * t + 2]];
+            if (position[a] == position[b] || position[b] == position[c] || position[c] == position[a])
+                continue;
+            result[write++] = a;
+            result[write++] = b;
+            result[write++] = c;
+        }
+        result.resize(write);
+    }
+    return maxError;
+}
+
+// Builds up to levelCount LODs after LOD 0 (the given indices), each aiming for reduction times the triangles of the
+// previous one. The errors add up along the chain and the last level stays within maxError times the mesh's bounding
+// box diagonal. Levels are optimised for the post-transform cache; the chain ends early once simplifying stops paying.
+template<typename V>
+MeshLodChain buildLodChain(const std::vector<V> &vertices, const std::vector<unsigned int> &indices, unsigned int levelCount,
+                           float reduction, float maxError)
+{
+    MeshLodChain chain;
+    if (vertices.empty() || indices.size() < 3)
+        return chain;
+    glm::vec3 low = vertices[0].Position, high = vertices[0].Position;
+    for (size_t i = 1; i < vertices.size(); i++)
+    {
+        low = glm::min(low, vertices[i].Position);
+        high = glm::max(high, vertices[i].Position);
+    }
+    float errorBudget = maxError * glm::length(high - low);
+
+    std::vector<unsigned int> current = indices, next;
+    float error = 0.0f;
+    for (unsigned int level = 0; level < levelCount; level++)
+    {
+        size_t targetTriangles = (size_t)(current.size() / 3 * reduction);
+        if (targetTriangles < LOD_MIN_TRIANGLES)
+            break;
+        float levelError = simplifyMesh(vertices, current, targetTriangles * 3, errorBudget - error, next);
+        if (next.size() > current.size() * LOD_MIN_REDUCTION)
+            break;
+        optimizeVertexCache(next, vertices.size());
+        error += levelError;
+
+        MeshLod lod;
+        lod.indexOffset = (unsigned int)(indices.size() + chain.indices.size());
+        lod.indexCount = (unsigned int)next.size();
+        lod.error = error;
+        chain.levels.push_back(lod);
+        chain.indices.insert(chain.indices.end(), next.begin(), next.end());
+        current.swap(next);
+    }
+    return chain;
+}
+#endif
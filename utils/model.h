@@ -10,93 +10,420 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
-#include <learnopengl/mesh.h>
-#include <learnopengl/shader.h>
+#include <mesh.h>
+#include <mesh_cache.h>
+#include <mesh_optimizer.h>
+#include <mesh_simplifier.h>
+#include <frustum.h>
+#include <instance_buffer.h>
+#include <render_queue.h>
+#include <bvh.h>
+#include <triangle_bvh.h>
+#include <thread_pool.h>
+#include <texture_streamer.h>
+#include <texture_registry.h>
+#include <shader.h>
+#include <skeleton.h>
+#include <animation_sampler.h>
+#include <skinning.h>
+#include <memory_stats.h>
 
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <queue>
+#include <unordered_set>
 #include <vector>
 using namespace std;
 
 unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false);
 
+// post-processing steps every model is imported with; part of the mesh cache key
+const unsigned int MODEL_IMPORT_FLAGS = aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
+
+// CPU stages run on the imported meshes before they are cached; the combination is part of the mesh cache key
+const unsigned int MESH_PIPELINE_OPTIMIZE = 1u << 0; // optimizeMesh: vertex cache, overdraw and vertex fetch order
+const unsigned int MESH_PIPELINE_WELD     = 1u << 1; // weldVertices: merge duplicate vertices (runs first)
+const unsigned int MESH_PIPELINE_LOD      = 1u << 2; // buildLodChain: simplified index buffers for distant meshes (runs last)
+
+// from this many meshes on, culling walks the mesh BVH instead of testing every mesh
+const unsigned int MODEL_BVH_MIN_MESHES = 64;
+
+// options controlling how a model is imported
+struct ModelLoadOptions
+{
+    bool useMeshCache = true;   // read/write the binary <model>.meshcache next to the source file instead of running Assimp every start
+    unsigned int workerCount = 0; // threads converting aiMeshes into Vertex/index arrays: 0 = one per hardware thread, 1 = serial
+    TextureStreamer *textureStreamer = nullptr; // if set, textures are decoded in the background and show a placeholder until uploaded
+    TextureRegistry *textureRegistry = nullptr; // texture dedup table; nullptr = TextureRegistry::shared(), common to all models
+    VertexFormat vertexFormat = VERTEX_FORMAT_FLOAT; // GPU vertex layout; VERTEX_FORMAT_PACKED needs a shader built with PACKED_VERTICES
+    bool optimizeMeshes = false; // reorder indices/vertices for the post-transform cache, overdraw and fetch (mesh_optimizer.h); prints ACMR/ATVR
+    bool weldVertices = true;    // merge duplicate vertices; with fewer than 65536 left a mesh gets 16-bit indices
+    float weldEpsilon = 0.0f;    // 0 = only bit-identical vertices, else the per component tolerance (see weldVertices)
+    bool buildPickingBvh = false; // build a triangle BVH per mesh after loading, so Model::pick can ray cast the model
+    unsigned int lodLevels = 0;  // simplified levels generated per mesh after LOD 0 (mesh_simplifier.h); 0 = no LODs
+    float lodReduction = 0.5f;   // each level aims for this fraction of the previous level's triangles
+    float lodMaxError = 0.02f;   // the coarsest level stays within this fraction of the mesh's bounding box diagonal
+    bool geometryArena = true;   // suballocate the meshes from the shared GeometryArena of their vertex format, so draws sharing textures merge into multi-draws
+    SkinningMode skinning = SKINNING_CPU; // how Model::Animate poses a rigged model; SKINNING_GPU needs a shader built with SKINNED
+    float animationFrameRate = 0.0f; // > 0: Animate plays the clips resampled at this rate and quantised (CompressClip); 0 = the imported keys
+    bool releaseCpuCopies = false; // free the meshes' vertex/index arrays once uploaded (Mesh::releaseCpuCopies); pick and the mesh cache still work
+
+    // the MESH_PIPELINE_* stages these options select
+    unsigned int pipelineFlags() const
+    {
+        return (optimizeMeshes ? MESH_PIPELINE_OPTIMIZE : 0u) | (weldVertices ? MESH_PIPELINE_WELD : 0u) |
+               (lodLevels ? MESH_PIPELINE_LOD : 0u);
+    }
+
+    // identifies the cached data these options produce
+    MeshCacheKey cacheKey() const
+    {
+        MeshCacheKey key;
+        key.postProcessFlags = MODEL_IMPORT_FLAGS;
+        key.pipelineFlags = pipelineFlags();
+        // FNV-1a over the parameters of the enabled stages
+        uint32_t hash = 2166136261u;
+        auto mix = [&hash](const void *data, size_t bytes) {
+            for(size_t i = 0; i < bytes; i++)
+                hash = (hash ^ ((const unsigned char*)data)[i]) * 16777619u;
+        };
+        if(weldVertices)
+            mix(&weldEpsilon, sizeof(weldEpsilon));
+        if(lodLevels)
+        {
+            mix(&lodLevels, sizeof(lodLevels));
+            mix(&lodReduction, sizeof(lodReduction));
+            mix(&lodMaxError, sizeof(lodMaxError));
+        }
+        key.pipelineParameters = hash;
+        return key;
+    }
+};
+
+// how the LOD drawing Model::Draw picks a level per mesh; can be changed between frames
+struct LodSettings
+{
+    float pixelError = 1.0f;         // draw the coarsest level whose error projects to at most this many pixels
+    unsigned int triangleBudget = 0; // 0 = unlimited; else coarsen further (least visible error first) until the frame fits
+};
+
+// the camera the LOD error is projected with
+struct LodView
+{
+    glm::vec3 eye;          // world space position (Camera::Position)
+    float fovY;             // vertical field of view in radians (glm::radians(Camera::Zoom))
+    float viewportHeight;   // in pixels
+};
+
+// what the CPU mesh pipeline did to one mesh
+struct MeshPipelineReport {
+    size_t importedVertices;
+    size_t weldedVertices;      // removed by weldVertices
+    bool optimized;
+    MeshOptimizationReport optimization;
+    size_t triangles;           // LOD 0
+    size_t lodLevels;           // generated after LOD 0
+    size_t lodTriangles;        // of the coarsest level (or LOD 0 without levels)
+    float lodError;             // of the coarsest level, model units
+};
+
+// what Model::pick hit
+struct ModelPick {
+    unsigned int mesh;      // index into Model::meshes
+    RayHit hit;             // triangle of that mesh; hit.distance is in units of the direction passed to pick
+    glm::vec3 position;     // origin + hit.distance * direction, in the ray's space
+};
+
 class Model 
 {
 public:
     /*  Model Data */
-    vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
+    vector<Texture> textures_loaded;	// every distinct texture this model uses; loading itself is deduplicated by the TextureRegistry
     vector<Mesh> meshes;
     string directory;
     bool gammaCorrection;
+    ModelLoadOptions options;
+    vector<DrawPacket> packets;   // one per mesh, same order
+    LodSettings lodSettings;      // level selection of the LodView Draw; may change between frames
+    Skeleton skeleton;            // node hierarchy and bones; no bones unless some mesh is rigged
+    vector<AnimationClip> animations;
 
     /*  Functions   */
     // constructor, expects a filepath to a 3D model.
-    Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
+    Model(string const &path, bool gamma = false, ModelLoadOptions const &options = ModelLoadOptions()) : gammaCorrection(gamma), options(options), samplerProgram(0), textureGeneration(0), attachedInstanceFormat(-1), activeClip(-1)
     {
         loadModel(path);
+        packets.reserve(meshes.size());
+        vector<BoundingBox> boxes(meshes.size());
+        for(unsigned int i = 0; i < meshes.size(); i++)
+        {
+            packets.push_back(meshes[i].packet);
+            bounds.add(meshes[i].bounds);
+            boxes[i].min = meshes[i].bounds.min;
+            boxes[i].max = meshes[i].bounds.max;
+        }
+        bvh.build(boxes.data(), boxes.size());
+        if(options.buildPickingBvh)
+            buildTriangleBvhs();
+        visibility.resize(meshes.size());
+        visiblePackets.reserve(meshes.size());
+        lodPackets = packets;
+        groupCount = PacketBatcher::assignGroups(packets.data(), packets.size(), packetGroups);
+        for(size_t i = 0; i < packets.size(); i++)
+            if(std::find(packetVaos.begin(), packetVaos.end(), packets[i].vao) == packetVaos.end())
+                packetVaos.push_back(packets[i].vao);
+        lastCull.visible = (unsigned int)meshes.size();
+        lastCull.culled = 0;
+        lastTriangles = 0;
+        // last: the mesh cache, the picking BVHs and SkinnedGeometry were all built from the arrays above
+        if(options.releaseCpuCopies)
+        {
+            size_t released = 0;
+            for(size_t i = 0; i < meshes.size(); i++)
+            {
+                released += meshes[i].cpuVertexBytes() + meshes[i].cpuIndexBytes();
+                meshes[i].releaseCpuCopies();
+            }
+            cout << "MEMORY:: released " << FormatBytes(released) << " of CPU geometry" << endl;
+        }
     }
 
-    // draws the model, and thus all its meshes
-    void Draw(Shader shader)
+    // draws the model, and thus all its meshes. The shader must be in use.
+    void Draw(Shader &shader)
     {
-        for(unsigned int i = 0; i < meshes.size(); i++)
-            meshes[i].Draw(shader);
+        useProgram(shader);
+        batcher.draw(packets.data(), nullptr, packets.size(), packetGroups.data(), groupCount, packetUniforms);
+        lastTriangles = 0;
+        for(size_t i = 0; i < packets.size(); i++)
+            lastTriangles += packets[i].indexCount / 3;
     }
-    
-private:
-    /*  Functions   */
-    // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
-    void loadModel(string const &path)
+
+    // same, skipping the meshes whose bounds lie outside the view frustum. viewProjection is projection * view and
+    // model the matrix the shader places the model with; the frustum is brought into model space once, so the
+    // per-mesh bounds are tested as they are (and neither they nor the BVH change when the model moves).
+    void Draw(Shader &shader, const glm::mat4 &viewProjection, const glm::mat4 &model)
     {
-        // read file via ASSIMP
-        Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
-        // check for errors
-        if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
+        useProgram(shader);
+        cull(viewProjection, model);
+        batcher.draw(packets.data(), visiblePackets.data(), visiblePackets.size(), packetGroups.data(), groupCount, packetUniforms);
+        lastTriangles = 0;
+        for(size_t i = 0; i < visiblePackets.size(); i++)
+            lastTriangles += packets[visiblePackets[i]].indexCount / 3;
+    }
+
+    // same, drawing each visible mesh at the coarsest LOD level (ModelLoadOptions::lodLevels) whose error, projected
+    // from the mesh's distance to view.eye, stays within lodSettings.pixelError pixels; then, if a triangle budget is
+    // set, coarsens the meshes whose next level shows the least error until the frame fits (or nothing is left to drop).
+    void Draw(Shader &shader, const glm::mat4 &viewProjection, const glm::mat4 &model, const LodView &view)
+    {
+        useProgram(shader);
+        cull(viewProjection, model);
+        lastTriangles = selectLods(model, view);
+        batcher.draw(lodPackets.data(), visiblePackets.data(), visiblePackets.size(), packetGroups.data(), groupCount, packetUniforms);
+    }
+
+    // culls and picks the LOD levels like the Draw above, but instead of drawing adds the visible meshes to queue, keyed
+    // by program, textures, VAO and distance to view.eye, to be sorted and drawn with the rest of the frame by
+    // queue.flush(). The submitted packets live in the model and stay valid until its next Draw or Enqueue.
+    void Enqueue(RenderQueue &queue, Shader &shader, const glm::mat4 &viewProjection, const glm::mat4 &model, const LodView &view)
+    {
+        unsigned int program = queue.program(shader);
+        unsigned int transform = queue.addTransform(model);
+        if(skinnedGeometry)
+            skinnedGeometry->bindPalette(); // stays bound for the flush, so one SKINNING_GPU model per queue
+        cull(viewProjection, model);
+        lastTriangles = selectLods(model, view);
+        for(size_t i = 0; i < visiblePackets.size(); i++)
+            queue.submit(program, lodPackets[visiblePackets[i]], transform, lodDistances[i]);
+    }
+
+    // draws count copies of the model with one glDrawElementsInstanced per mesh, copy i placed by transforms[i] instead of
+    // the model uniform. The shader must be 1.model_loading.vs built with INSTANCED. The transforms are uploaded into the
+    // model's instance buffer on every call; there is no culling or LOD selection, every copy draws every mesh at LOD 0.
+    void DrawInstanced(Shader &shader, const glm::mat4 *transforms, size_t count)
+    {
+        drawInstanced(shader, transforms, count, INSTANCE_MAT4);
+    }
+
+    // same with compact transforms, for a shader built with INSTANCED_TRS
+    void DrawInstanced(Shader &shader, const InstanceTRS *instances, size_t count)
+    {
+        drawInstanced(shader, instances, count, INSTANCE_TRS);
+    }
+
+    // true if some mesh is rigged: every mesh then draws from the model's SkinnedGeometry, posed by Animate
+    bool skinned() const
+    {
+        return skinnedGeometry != nullptr;
+    }
+
+    // poses a skinned model seconds into animations[clip] (looping; the bind pose if there is no such clip) for the
+    // draws that follow: samples the clip, builds the bone palette and, with SKINNING_CPU, skins every vertex across
+    // the model's thread pool into the streaming vertex buffer. Culling and picking keep using the bind pose bounds.
+    void Animate(unsigned int clip, float seconds)
+    {
+        if(!skinnedGeometry)
+            return;
+        if(clip < animations.size())
         {
-            cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
+            if(clip < compressedAnimations.size())
+                SampleCompressedClip(compressedAnimations[clip], skeleton, seconds, poseLocal);
+            else
+                SampleClip(animations[clip], skeleton, seconds, animationCursor, poseLocal);
+            BuildSkinPalette(skeleton, poseLocal, poseGlobal, palette);
+            activeClip = (int)clip;
+        }
+        else if(activeClip >= 0 || palette.empty())
+        {
+            BuildBindPalette(skeleton, poseGlobal, palette);
+            activeClip = -1;
+        }
+        if(!skinningPool && skinnedGeometry->mode() == SKINNING_CPU)
+        {
+            unsigned int threads = options.workerCount ? options.workerCount : ThreadPool::defaultWorkerCount();
+            if(threads > 1)
+                skinningPool.reset(new ThreadPool(threads - 1)); // the calling thread works too
+        }
+        skinnedGeometry->pose(palette.data(), palette.size(), skinningPool.get());
+    }
+
+    // meshes drawn and culled by the last culling Draw
+    CullStats cullStats() const
+    {
+        return lastCull;
+    }
+
+    // triangles submitted by the last Draw
+    size_t drawnTriangles() const
+    {
+        return lastTriangles;
+    }
+
+    // swaps in the textures the registry found to be duplicates after loading: with a TextureStreamer a duplicate is
+    // only recognised once a decoder read its file. Cheap when nothing changed; call it after TextureStreamer::update.
+    void updateTextures()
+    {
+        TextureRegistry &registry = options.textureRegistry ? *options.textureRegistry : TextureRegistry::shared();
+        unsigned int generation = registry.aliasGeneration();
+        if(generation == textureGeneration)
             return;
+        textureGeneration = generation;
+        for(size_t i = 0; i < meshes.size(); i++)
+        {
+            Mesh &mesh = meshes[i];
+            for(size_t t = 0; t < mesh.textures.size(); t++)
+                mesh.textures[t].id = registry.resolve(mesh.textures[t].id);
+            for(GLuint t = 0; t < mesh.packet.textureCount; t++)
+                mesh.packet.textures[t].texture = registry.resolve(mesh.packet.textures[t].texture);
+            packets[i].textureCount = mesh.packet.textureCount;
+            std::copy(mesh.packet.textures, mesh.packet.textures + mesh.packet.textureCount, packets[i].textures);
         }
-        // retrieve the directory path of the filepath
-        directory = path.substr(0, path.find_last_of('/'));
+        vector<Texture> loaded;
+        textureIds.clear();
+        for(size_t i = 0; i < textures_loaded.size(); i++)
+        {
+            Texture texture = textures_loaded[i];
+            texture.id = registry.resolve(texture.id);
+            if(textureIds.insert(texture.id).second)
+                loaded.push_back(texture);
+        }
+        textures_loaded.swap(loaded);
+        // packets that now share their textures can merge
+        groupCount = PacketBatcher::assignGroups(packets.data(), packets.size(), packetGroups);
+    }
 
-        // process ASSIMP's root node recursively
-        processNode(scene->mRootNode, scene);
+    // hierarchy over the model space mesh boxes; primitive i is meshes[i]. For frustum, ray (picking) and box queries.
+    const Bvh &meshBvh() const
+    {
+        return bvh;
     }
 
-    // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-    void processNode(aiNode *node, const aiScene *scene)
+    // what the model holds on the CPU and the GPU. Textures are counted once per model (textures_loaded), so models
+    // sharing them through the TextureRegistry each report them; PrintProcessMemory counts them once. Queries the
+    // texture sizes from GL: context thread only.
+    MemoryStats memoryStats() const
     {
-        // process each mesh located at the current node
-        for(unsigned int i = 0; i < node->mNumMeshes; i++)
+        MemoryStats stats;
+        for(size_t i = 0; i < meshes.size(); i++)
         {
-            // the node object only contains indices to index the actual objects in the scene. 
-            // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
-            aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            stats.cpuVertexBytes += meshes[i].cpuVertexBytes();
+            stats.cpuIndexBytes += meshes[i].cpuIndexBytes();
+            stats.gpuBufferBytes += meshes[i].gpuBufferBytes();
         }
-        // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
-        for(unsigned int i = 0; i < node->mNumChildren; i++)
+        for(size_t i = 0; i < textures_loaded.size(); i++)
+            stats.gpuTextureBytes += TextureBytes(textures_loaded[i].id);
+        for(size_t i = 0; i < triangleBvhs.size(); i++)
+            stats.cpuOtherBytes += triangleBvhs[i].memoryBytes();
+        if(skinnedGeometry)
+        {
+            stats.cpuOtherBytes += skinnedGeometry->cpuBytes();
+            stats.gpuBufferBytes += skinnedGeometry->gpuBufferBytes();
+        }
+        for(size_t i = 0; i < animations.size(); i++)
+            stats.cpuOtherBytes += AnimationClipBytes(animations[i]);
+        for(size_t i = 0; i < compressedAnimations.size(); i++)
+            stats.cpuOtherBytes += compressedAnimations[i].bytes();
+        return stats;
+    }
+
+    // the memoryStats line under the given label, preceded by one line per mesh if perMesh
+    void printMemoryStats(ostream &out, const string &label, bool perMesh = false) const
+    {
+        for(size_t i = 0; perMesh && i < meshes.size(); i++)
         {
-            processNode(node->mChildren[i], scene);
+            const Mesh &mesh = meshes[i];
+            out << "MEMORY::   mesh " << i << ": " << mesh.vertexCount() << " vertices, CPU "
+                << FormatBytes(mesh.cpuVertexBytes() + mesh.cpuIndexBytes()) << ", GPU buffers " << FormatBytes(mesh.gpuBufferBytes()) << endl;
         }
+        PrintMemoryStats(out, label, memoryStats());
+    }
 
+    // casts the ray origin + t * direction (t >= 0, world space) at the model placed with the given model matrix and
+    // returns the closest triangle it hits. Needs ModelLoadOptions::buildPickingBvh; always misses without it.
+    bool pick(const glm::vec3 &origin, const glm::vec3 &direction, const glm::mat4 &model, ModelPick &result) const
+    {
+        if(triangleBvhs.empty())
+            return false;
+        // an affine transform keeps t, so the hit distance found in model space is valid for the world space ray too
+        glm::mat4 toModel = glm::inverse(model);
+        glm::vec3 localOrigin = glm::vec3(toModel * glm::vec4(origin, 1.0f));
+        glm::vec3 localDirection = glm::vec3(toModel * glm::vec4(direction, 0.0f));
+        float closest = FLT_MAX;
+        bool found = false;
+        bvh.queryRay(localOrigin, localDirection, closest, [&](unsigned int mesh, float) {
+            if(triangleBvhs[mesh].intersect(localOrigin, localDirection, closest, result.hit))
+            {
+                closest = result.hit.distance;
+                result.mesh = mesh;
+                found = true;
+            }
+            return closest;
+        });
+        if(found)
+            result.position = origin + closest * direction;
+        return found;
     }
 
-    Mesh processMesh(aiMesh *mesh, const aiScene *scene)
+    // fills the vertex and index data of a single mesh (Vertex, or SkinnedVertex with the influences left at 0).
+    // Pure CPU work: safe to run on any thread.
+    template<typename V>
+    static void processMesh(const aiMesh *mesh, vector<V> &vertices, vector<unsigned int> &indices)
     {
-        // data to fill
-        vector<Vertex> vertices;
-        vector<unsigned int> indices;
-        vector<Texture> textures;
+        vertices.reserve(mesh->mNumVertices);
+        indices.reserve(mesh->mNumFaces * 3);
 
         // Walk through each of the mesh's vertices
         for(unsigned int i = 0; i < mesh->mNumVertices; i++)
         {
-            Vertex vertex;
+            V vertex = V();
             glm::vec3 vector; // we declare a placeholder vector since assimp uses its own vector class that doesn't directly convert to glm's vec3 class so we transfer the data to this placeholder glm::vec3 first.
             // positions
             vector.x = mesh->mVertices[i].x;
@@ -135,11 +462,398 @@ private:
         // now wak through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
         for(unsigned int i = 0; i < mesh->mNumFaces; i++)
         {
-            aiFace face = mesh->mFaces[i];
+            const aiFace &face = mesh->mFaces[i];
             // retrieve all indices of the face and store them in the indices vector
             for(unsigned int j = 0; j < face.mNumIndices; j++)
                 indices.push_back(face.mIndices[j]);
         }
+    }
+
+    // runs the MESH_PIPELINE_* stages the options select on one converted mesh; the LOD chain is only built if lods is
+    // given. Pure CPU work: safe to run on any thread.
+    template<typename V>
+    static MeshPipelineReport runMeshPipeline(const ModelLoadOptions &options, vector<V> &vertices, vector<unsigned int> &indices,
+                                              MeshLodChain *lods = nullptr)
+    {
+        MeshPipelineReport report;
+        std::memset(&report, 0, sizeof(report));
+        report.importedVertices = vertices.size();
+        if(options.weldVertices)
+            report.weldedVertices = weldVertices(vertices, indices, options.weldEpsilon);
+        if(options.optimizeMeshes)
+        {
+            report.optimized = true;
+            report.optimization = optimizeMesh(vertices, indices);
+        }
+        report.triangles = report.lodTriangles = indices.size() / 3;
+        if(options.lodLevels && lods)
+        {
+            *lods = buildLodChain(vertices, indices, options.lodLevels, options.lodReduction, options.lodMaxError);
+            report.lodLevels = lods->levels.size();
+            if(report.lodLevels)
+            {
+                report.lodTriangles = lods->levels.back().indexCount / 3;
+                report.lodError = lods->levels.back().error;
+            }
+        }
+        return report;
+    }
+
+    // one line per optimised mesh with its ACMR/ATVR, plus the welding and LOD totals
+    static void printPipelineReports(const vector<MeshPipelineReport> &reports)
+    {
+        size_t imported = 0, welded = 0, withLods = 0, levels = 0, fullTriangles = 0, coarseTriangles = 0;
+        float lodError = 0.0f;
+        for(size_t i = 0; i < reports.size(); i++)
+        {
+            const MeshPipelineReport &report = reports[i];
+            imported += report.importedVertices;
+            welded += report.weldedVertices;
+            if(report.lodLevels)
+            {
+                withLods++;
+                levels += report.lodLevels;
+                lodError = std::max(lodError, report.lodError);
+            }
+            fullTriangles += report.triangles;
+            coarseTriangles += report.lodTriangles;
+            if(!report.optimized)
+                continue;
+            const MeshOptimizationReport &o = report.optimization;
+            cout << "MESH_OPTIMIZER:: mesh " << i << ": ACMR " << o.before.acmr << " -> " << o.after.acmr
+                 << ", ATVR " << o.before.atvr << " -> " << o.after.atvr;
+            if(o.verticesRemoved)
+                cout << ", " << o.verticesRemoved << " unreferenced vertices removed";
+            cout << endl;
+        }
+        if(welded)
+            cout << "MESH_OPTIMIZER:: welded " << imported << " -> " << imported - welded << " vertices" << endl;
+        if(withLods)
+            cout << "MESH_LOD:: " << levels << " levels over " << withLods << " meshes, " << fullTriangles << " -> " << coarseTriangles
+                 << " triangles at the coarsest, largest error " << lodError << endl;
+    }
+    
+private:
+    /*  Functions   */
+    // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
+    void loadModel(string const &path)
+    {
+        // retrieve the directory path of the filepath
+        directory = path.substr(0, path.find_last_of('/'));
+
+        // warm start: skip Assimp entirely if an up to date cache sits next to the model
+        if(options.useMeshCache && loadFromCache(path))
+            return;
+
+        // read file via ASSIMP
+        Assimp::Importer importer;
+        const aiScene* scene = importer.ReadFile(path, MODEL_IMPORT_FLAGS);
+        // check for errors
+        if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
+        {
+            cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
+            return;
+        }
+
+        // process ASSIMP's root node recursively
+        processScene(scene);
+
+        // the cache holds no bones or animations: rigged models are imported every time
+        if(options.useMeshCache && !skinned() && !writeMeshCache(path, options.cacheKey(), meshes))
+            cout << "WARNING::MODEL:: could not write mesh cache " << meshCachePath(path) << endl;
+    }
+
+    // rebuilds the meshes from a mapped <model>.meshcache; returns false (and loads nothing) if the cache is missing or stale
+    bool loadFromCache(string const &path)
+    {
+        MeshCacheReader cache;
+        if(!cache.open(path, options.cacheKey()))
+            return false;
+
+        meshes.reserve(cache.meshCount());
+        for(unsigned int i = 0; i < cache.meshCount(); i++)
+        {
+            const MeshCacheEntry &entry = cache.entry(i);
+            const Vertex *v = cache.vertices(entry);
+            const unsigned int *idx = cache.indices(entry);
+            vector<Vertex> vertices(v, v + entry.vertexCount);
+            vector<unsigned int> indices(idx, idx + entry.indexCount);
+            vector<Texture> textures;
+            for(unsigned int j = 0; j < entry.textureCount; j++)
+                textures.push_back(loadTexture(cache.texturePath(entry.firstTexture + j).c_str(), cache.textureType(entry.firstTexture + j)));
+            MeshLodChain lods;
+            lods.indices.assign(cache.lodIndices(entry), cache.lodIndices(entry) + entry.lodIndexCount);
+            for(unsigned int j = 0; j < entry.lodCount; j++)
+            {
+                const MeshCacheLod &cached = cache.lod(entry, j);
+                MeshLod lod = { cached.indexOffset, cached.indexCount, cached.error };
+                lods.levels.push_back(lod);
+            }
+            meshes.push_back(Mesh(std::move(vertices), std::move(indices), std::move(textures), options.vertexFormat, std::move(lods), meshStorage()));
+        }
+        return true;
+    }
+
+    // sampler uniforms only need assigning the first time we draw with a program
+    void useProgram(Shader &shader)
+    {
+        if(shader.ID != samplerProgram)
+        {
+            BindSamplerUnits(shader);
+            packetUniforms = ResolvePacketUniforms(shader);
+            if(skinnedGeometry)
+                shader.bindUniformBlock("SkinBlock", UNIFORM_BLOCK_SKIN);
+            samplerProgram = shader.ID;
+        }
+        if(skinnedGeometry)
+            skinnedGeometry->bindPalette();
+    }
+
+    // fills visiblePackets with the meshes inside the frustum of viewProjection * model, in mesh order
+    void cull(const glm::mat4 &viewProjection, const glm::mat4 &model)
+    {
+        Frustum frustum = extractFrustum(viewProjection * model);
+        visiblePackets.clear();
+        if(meshes.size() >= MODEL_BVH_MIN_MESHES)
+        {
+            bvh.queryFrustum(frustum, [this](unsigned int mesh) { visiblePackets.push_back(mesh); });
+            std::sort(visiblePackets.begin(), visiblePackets.end()); // draw in mesh order, like the linear path
+            lastCull.visible = (unsigned int)visiblePackets.size();
+            lastCull.culled = (unsigned int)meshes.size() - lastCull.visible;
+        }
+        else
+        {
+            lastCull = bounds.cull(frustum, visibility.data());
+            for(unsigned int i = 0; i < visibility.size(); i++)
+            {
+                if(visibility[i])
+                    visiblePackets.push_back(i);
+            }
+        }
+    }
+
+    // picks the level of every visible mesh for the LOD Draw / Enqueue and stores its packet in lodPackets; returns the
+    // triangles they add up to
+    size_t selectLods(const glm::mat4 &model, const LodView &view)
+    {
+        // model units at distance 1 -> pixels; the model matrix scales the errors by its largest axis
+        float pixelsPerUnit = view.viewportHeight / (2.0f * std::tan(view.fovY * 0.5f));
+        float scale = std::sqrt(std::max(glm::dot(glm::vec3(model[0]), glm::vec3(model[0])),
+                                std::max(glm::dot(glm::vec3(model[1]), glm::vec3(model[1])), glm::dot(glm::vec3(model[2]), glm::vec3(model[2])))));
+        lodScales.resize(visiblePackets.size());
+        lodDistances.resize(visiblePackets.size());
+        lodChoice.resize(visiblePackets.size());
+        size_t triangles = 0;
+        for(size_t i = 0; i < visiblePackets.size(); i++)
+        {
+            const Mesh &mesh = meshes[visiblePackets[i]];
+            glm::vec3 center = glm::vec3(model * glm::vec4(mesh.bounds.center, 1.0f));
+            float distance = std::max(glm::length(center - view.eye) - mesh.bounds.radius * scale, 1e-4f);
+            lodDistances[i] = distance;
+            lodScales[i] = scale * pixelsPerUnit / distance; // pixels per model unit of error
+            unsigned int level = 0;
+            while(level + 1 < mesh.lodCount() && mesh.lodChain.levels[level].error * lodScales[i] <= lodSettings.pixelError)
+                level++;
+            lodChoice[i] = level;
+            triangles += lodTriangles(mesh, level);
+        }
+
+        if(lodSettings.triangleBudget && triangles > lodSettings.triangleBudget)
+        {
+            // (projected error of the next coarser level, visible index)
+            typedef std::pair<float, unsigned int> Candidate;
+            std::priority_queue<Candidate, vector<Candidate>, std::greater<Candidate> > coarser;
+            for(unsigned int i = 0; i < visiblePackets.size(); i++)
+            {
+                const Mesh &mesh = meshes[visiblePackets[i]];
+                if(lodChoice[i] + 1 < mesh.lodCount())
+                    coarser.push(Candidate(mesh.lodChain.levels[lodChoice[i]].error * lodScales[i], i));
+            }
+            while(triangles > lodSettings.triangleBudget && !coarser.empty())
+            {
+                unsigned int i = coarser.top().second;
+                coarser.pop();
+                const Mesh &mesh = meshes[visiblePackets[i]];
+                triangles -= lodTriangles(mesh, lodChoice[i]);
+                lodChoice[i]++;
+                triangles += lodTriangles(mesh, lodChoice[i]);
+                if(lodChoice[i] + 1 < mesh.lodCount())
+                    coarser.push(Candidate(mesh.lodChain.levels[lodChoice[i]].error * lodScales[i], i));
+            }
+        }
+
+        for(size_t i = 0; i < visiblePackets.size(); i++)
+            lodPackets[visiblePackets[i]] = meshes[visiblePackets[i]].lodPacket(lodChoice[i]);
+        return triangles;
+    }
+
+    void drawInstanced(Shader &shader, const void *instances, size_t count, InstanceFormat format)
+    {
+        useProgram(shader);
+        lastTriangles = 0;
+        if(count == 0)
+            return;
+        instanceBuffer.upload(instances, count * instanceStride(format));
+        // an arena VAO is shared with every other model in the arena, which may have pointed it at its own instance buffer
+        if(attachedInstanceFormat != (int)format || options.geometryArena)
+        {
+            for(size_t i = 0; i < packetVaos.size(); i++)
+            {
+                SharedGLState().bindVertexArray(packetVaos[i]);
+                instanceBuffer.attach(format);
+            }
+            SharedGLState().bindVertexArray(0);
+            attachedInstanceFormat = (int)format;
+        }
+        DrawPacketsInstanced(packets.data(), packets.size(), (GLsizei)count, packetUniforms);
+        for(size_t i = 0; i < packets.size(); i++)
+            lastTriangles += packets[i].indexCount / 3 * count;
+    }
+
+    MeshStorage meshStorage() const
+    {
+        return options.geometryArena ? MESH_STORAGE_ARENA : MESH_STORAGE_OWN;
+    }
+
+    static size_t lodTriangles(const Mesh &mesh, unsigned int level)
+    {
+        return (level ? mesh.lodChain.levels[level - 1].indexCount : (size_t)mesh.packet.indexCount) / 3;
+    }
+
+    // one TriangleBvh per mesh, for pick(). CPU only, so it runs across a thread pool like the mesh conversion:
+    // one task per mesh when there are enough of them, else each (large) mesh spreads its own build over the pool.
+    void buildTriangleBvhs()
+    {
+        triangleBvhs.resize(meshes.size());
+        unsigned int threads = options.workerCount ? options.workerCount : ThreadPool::defaultWorkerCount();
+        if(threads <= 1)
+        {
+            for(size_t i = 0; i < meshes.size(); i++)
+                triangleBvhs[i].build(meshes[i].vertices, meshes[i].indices);
+            return;
+        }
+        ThreadPool pool(threads - 1); // the calling thread works too
+        if(meshes.size() >= threads)
+            pool.parallelFor(meshes.size(), [this](size_t i) { triangleBvhs[i].build(meshes[i].vertices, meshes[i].indices); });
+        else
+        {
+            for(size_t i = 0; i < meshes.size(); i++)
+                triangleBvhs[i].build(meshes[i].vertices, meshes[i].indices, &pool);
+        }
+    }
+
+    // converts all meshes of the scene. The CPU-side aiMesh -> Vertex/index conversion runs across a thread pool,
+    // one task per mesh; textures and the GL upload (Mesh::setupMesh) stay on this (the context) thread.
+    // Meshes end up in the same order as a serial depth-first walk of the node tree.
+    // If any mesh has bones, the skeleton and animations are imported too and every mesh goes through the pipeline
+    // as SkinnedVertex, so welding and reordering carry the influences along; meshes without bones follow their node.
+    void processScene(const aiScene *scene)
+    {
+        vector<const aiMesh*> order;
+        vector<unsigned int> owners;
+        unsigned int nodeCount = 0;
+        processNode(scene->mRootNode, scene, order, owners, nodeCount);
+
+        bool rigged = false;
+        for(size_t i = 0; i < order.size(); i++)
+            rigged = rigged || order[i]->mNumBones > 0;
+        vector<unsigned int> fallbackBones(order.size());
+        if(rigged)
+        {
+            ImportSkeleton(scene, skeleton);
+            ImportAnimations(scene, skeleton, animations);
+            if(options.animationFrameRate > 0.0f)
+            {
+                compressedAnimations.resize(animations.size());
+                size_t keyBytes = 0, compressedBytes = 0;
+                for(size_t i = 0; i < animations.size(); i++)
+                {
+                    CompressClip(animations[i], options.animationFrameRate, compressedAnimations[i]);
+                    keyBytes += AnimationClipBytes(animations[i]);
+                    compressedBytes += compressedAnimations[i].bytes();
+                }
+                cout << "ANIMATION:: " << animations.size() << " clips resampled at " << options.animationFrameRate << " frames/s, "
+                     << keyBytes << " -> " << compressedBytes << " bytes" << endl;
+            }
+            for(size_t i = 0; i < order.size(); i++)
+                fallbackBones[i] = order[i]->mNumBones ? skeleton.boneIndex.at(order[i]->mBones[0]->mName.C_Str())
+                                                       : skeleton.addRigidBone(owners[i]);
+        }
+
+        vector< vector<Vertex> > vertices(order.size());
+        vector< vector<BoneInfluence> > influences(order.size());
+        vector< vector<unsigned int> > indices(order.size());
+        vector<MeshLodChain> lods(order.size());
+        vector<MeshPipelineReport> reports(order.size());
+        auto convert = [&](size_t i) {
+            if(!rigged)
+            {
+                processMesh(order[i], vertices[i], indices[i]);
+                reports[i] = runMeshPipeline(options, vertices[i], indices[i], &lods[i]);
+                return;
+            }
+            vector<SkinnedVertex> skinnedVertices;
+            processMesh(order[i], skinnedVertices, indices[i]);
+            ImportBoneWeights(order[i], skeleton, fallbackBones[i], skinnedVertices);
+            reports[i] = runMeshPipeline(options, skinnedVertices, indices[i], &lods[i]);
+            SplitSkinnedVertices(skinnedVertices, vertices[i], influences[i]);
+        };
+        unsigned int threads = options.workerCount ? options.workerCount : ThreadPool::defaultWorkerCount();
+        if(threads <= 1 || order.size() < 2)
+        {
+            for(size_t i = 0; i < order.size(); i++)
+                convert(i);
+        }
+        else
+        {
+            ThreadPool pool(threads - 1); // the calling thread works too
+            pool.parallelFor(order.size(), convert);
+        }
+        printPipelineReports(reports);
+
+        meshes.reserve(meshes.size() + order.size());
+        // skinning reads and writes float vertices, and SkinnedGeometry uploads rigged meshes itself
+        VertexFormat format = rigged ? VERTEX_FORMAT_FLOAT : options.vertexFormat;
+        MeshStorage storage = rigged ? MESH_STORAGE_EXTERNAL : meshStorage();
+        for(size_t i = 0; i < order.size(); i++)
+        {
+            vector<Texture> textures = processMaterial(order[i], scene);
+            meshes.push_back(Mesh(std::move(vertices[i]), std::move(indices[i]), std::move(textures), format, std::move(lods[i]), storage));
+        }
+        if(rigged)
+        {
+            skinnedGeometry.reset(new SkinnedGeometry(meshes, influences, options.skinning));
+            cout << "SKINNING:: " << skeleton.bones.size() << " bones, " << skeleton.nodes.size() << " nodes, " << animations.size()
+                 << " animations, " << skinnedGeometry->vertexCount() << " vertices skinned on the " << (options.skinning == SKINNING_GPU ? "GPU" : "CPU") << endl;
+        }
+    }
+
+    // processes a node in a recursive fashion. Collects each individual mesh located at the node and repeats this process on its children nodes (if any).
+    // owners gets the depth-first index of each mesh's node, which is its index in Skeleton::nodes (ImportSkeleton walks the same way).
+    void processNode(const aiNode *node, const aiScene *scene, vector<const aiMesh*> &order, vector<unsigned int> &owners, unsigned int &nodeCount)
+    {
+        unsigned int nodeIndex = nodeCount++;
+        // collect each mesh located at the current node
+        for(unsigned int i = 0; i < node->mNumMeshes; i++)
+        {
+            // the node object only contains indices to index the actual objects in the scene. 
+            // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
+            order.push_back(scene->mMeshes[node->mMeshes[i]]);
+            owners.push_back(nodeIndex);
+        }
+        // after we've collected all of the meshes (if any) we then recursively process each of the children nodes
+        for(unsigned int i = 0; i < node->mNumChildren; i++)
+        {
+            processNode(node->mChildren[i], scene, order, owners, nodeCount);
+        }
+
+    }
+
+    // loads the textures referenced by the mesh's material. Creates GL textures: context thread only.
+    vector<Texture> processMaterial(const aiMesh *mesh, const aiScene *scene)
+    {
+        vector<Texture> textures;
+
         // process materials
         aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];    
         // we assume a convention for sampler names in the shaders. Each diffuse texture should be named
@@ -161,10 +875,8 @@ private:
         // 4. height maps
         std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
         textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
-        
-        
-        // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+
+        return textures;
     }
 
     // checks all material textures of a given type and loads the textures if they're not loaded yet.
@@ -176,29 +888,62 @@ private:
         {
             aiString str;
             mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for(unsigned int j = 0; j < textures_loaded.size(); j++)
-            {
-                if(std::strcmp(textures_loaded[j].path.C_Str(), str.C_Str()) == 0)
-                {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
-                }
-            }
-            if(!skip)
-            {   // if texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str;
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
-            }
+            textures.push_back(loadTexture(str.C_Str(), typeName));
         }
         return textures;
     }
+
+    // returns the texture at the given model-relative path. The registry only loads it if no model loaded
+    // the same file (by absolute path or by contents) before.
+    Texture loadTexture(const char *path, string const &typeName)
+    {
+        TextureRegistry &registry = options.textureRegistry ? *options.textureRegistry : TextureRegistry::shared();
+        Texture texture;
+        texture.id = registry.acquire(this->directory + '/' + path, placeholderFor(typeName), options.textureStreamer);
+        texture.type = typeName;
+        texture.path = aiString(path);
+        if(textureIds.insert(texture.id).second)
+            textures_loaded.push_back(texture);
+        return texture;
+    }
+
+    unordered_set<unsigned int> textureIds; // ids in textures_loaded
+    unsigned int samplerProgram;            // program whose sampler units were last assigned by Draw
+    unsigned int textureGeneration;         // TextureRegistry::aliasGeneration the ids were last resolved at
+    PacketUniforms packetUniforms;          // per-draw uniform handles of samplerProgram
+    BoundsArray bounds;                     // meshes[i].bounds, laid out for cull()
+    Bvh bvh;                                // over the meshes[i].bounds boxes
+    vector<TriangleBvh> triangleBvhs;       // per mesh, if options.buildPickingBvh
+    vector<unsigned char> visibility;       // per mesh, written by cull()
+    vector<unsigned int> visiblePackets;    // indices into packets of the meshes that passed
+    vector<DrawPacket> lodPackets;          // packets at the level the LOD Draw picked (valid for visiblePackets)
+    vector<unsigned int> packetGroups;      // per packet, PacketBatcher::assignGroups id; an LOD level keeps its mesh's group
+    unsigned int groupCount;
+    vector<GLuint> packetVaos;              // distinct packets[i].vao (a single one with the arena)
+    PacketBatcher batcher;
+    vector<float> lodScales;                // per visible mesh: pixels per model unit of error
+    vector<float> lodDistances;             // per visible mesh: distance from the eye to its bounding sphere
+    vector<unsigned int> lodChoice;         // per visible mesh: picked level
+    CullStats lastCull;
+    size_t lastTriangles;
+    InstanceBuffer instanceBuffer;          // transforms of the last DrawInstanced
+    int attachedInstanceFormat;             // InstanceFormat the mesh VAOs read instanceBuffer as, -1 before the first DrawInstanced
+    unique_ptr<SkinnedGeometry> skinnedGeometry; // if skinned()
+    unique_ptr<ThreadPool> skinningPool;    // SKINNING_CPU workers, created by the first Animate (none on one hardware thread)
+    vector<glm::mat4> poseLocal, poseGlobal, palette; // per node / per node / per bone, rebuilt by Animate
+    int activeClip;                         // clip the palette was last sampled from, -1 for the bind pose
+    AnimationCursor animationCursor;        // keys of animations[activeClip] the last Animate sampled at
+    vector<CompressedClip> compressedAnimations; // per clip, if options.animationFrameRate is set
+
+    // what a streamed texture of the given sampler type shows until it is ready
+    static TexturePlaceholder placeholderFor(string const &typeName)
+    {
+        if(typeName == "texture_diffuse")
+            return PLACEHOLDER_GREY;
+        if(typeName == "texture_normal")
+            return PLACEHOLDER_FLAT;
+        return PLACEHOLDER_BLACK;
+    }
 };
 
 
@@ -222,7 +967,7 @@ unsigned int TextureFromFile(const char *path, const string &directory, bool gam
         else if (nrComponents == 4)
             format = GL_RGBA;
 
-        glBindTexture(GL_TEXTURE_2D, textureID);
+        SharedGLState().bindTexture(0, GL_TEXTURE_2D, textureID);
         glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
         glGenerateMipmap(GL_TEXTURE_2D);
 
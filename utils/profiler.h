@@ -0,0 +1,387 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <GL/gl3w.h> // here: we need compile gl3w.c - utils dir
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Frame profiler: nested scopes timed on the CPU with the steady clock and on the GPU with GL timestamp queries,
+// gathered into a tree of named scopes with rolling statistics (drawn by ProfilerOverlay, profiler_overlay.h) and a
+// trace of the last frames that writeChromeTrace saves for chrome://tracing or ui.perfetto.dev.
+//
+//   profiler.beginFrame();                                      // opens the "frame" scope
+//   { CpuScope scope(profiler, "input"); processInput(window); }
+//   { ProfileScope scope(profiler, "Model::Draw"); ... }         // CPU and GPU
+//   profiler.endFrame();
+//
+// A GPU scope writes two GL_TIMESTAMP queries (timestamps nest, GL_TIME_ELAPSED queries can't). The queries of a frame
+// go to one of two sets by frame parity and a set is read back when its turn comes again, a frame later. If the GPU
+// hasn't finished that frame by then its samples are dropped instead of waited for, so reading never stalls.
+
+const unsigned int PROFILER_HISTORY = 120;      // frames the rolling statistics cover
+const unsigned int PROFILER_TRACE_FRAMES = 300; // frames of events writeChromeTrace saves
+
+enum ProfileClock {
+    PROFILE_CPU = 1,
+    PROFILE_GPU = 2
+};
+
+// one named scope at one place of the tree; the same name under another parent is another node
+struct ProfilerNode {
+    std::string name;
+    int parent;                     // -1 for "frame"
+    unsigned int depth;
+    bool cpu, gpu;                  // ever timed on that clock
+    float cpuMs[PROFILER_HISTORY];  // per frame (ring indexed by frame number) the total of its scopes, 0 if none ran
+    float gpuMs[PROFILER_HISTORY];
+};
+
+struct ProfilerStats {
+    float last;     // newest complete frame
+    float average;  // over the rolling window
+    float max;
+};
+
+// a finished scope, in microseconds since the profiler was created (GPU times moved onto the CPU clock)
+struct ProfilerEvent {
+    unsigned int node;
+    uint64_t frame;
+    double start, end;
+};
+
+class Profiler
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    // needs the GL context current; a disabled profiler turns every call into a no-op
+    explicit Profiler(bool enabled = true) : enabled(enabled), gpuSupported(false), frame(0), gpuNewest(0), gpuDropped(0),
+                                             epoch(Clock::now()), gpuEpoch(0)
+    {
+        for(unsigned int i = 0; i < PROFILER_HISTORY; i++)
+            gpuValid[i] = false;
+        if(!enabled)
+            return;
+        GLint bits = 0;
+        glGetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &bits);
+        gpuSupported = bits > 0;
+        if(gpuSupported)
+        {
+            GLint64 now = 0;
+            glGetInteger64v(GL_TIMESTAMP, &now);
+            epoch = Clock::now();
+            gpuEpoch = (uint64_t)now;
+        }
+        else
+            std::cout << "PROFILER:: no GL timestamp queries, CPU scopes only" << std::endl;
+    }
+
+    ~Profiler()
+    {
+        for(unsigned int i = 0; i < 2; i++)
+            if(!gpuFrames[i].queries.empty())
+                glDeleteQueries((GLsizei)gpuFrames[i].queries.size(), gpuFrames[i].queries.data());
+    }
+
+    bool isEnabled() const { return enabled; }
+    bool hasGpuTimes() const { return gpuSupported; }
+
+    // collects the GPU times of two frames ago and opens the "frame" scope
+    void beginFrame()
+    {
+        if(!enabled)
+            return;
+        GpuFrame &set = gpuFrames[frame % 2];
+        if(set.used)
+            collect(set);
+        set.frame = frame;
+        set.used = 0;
+        unsigned int slot = frame % PROFILER_HISTORY;
+        for(size_t i = 0; i < nodes.size(); i++)
+        {
+            nodes[i].cpuMs[slot] = 0.0f;
+            nodes[i].gpuMs[slot] = 0.0f;
+        }
+        gpuValid[slot] = false;
+        begin("frame", PROFILE_CPU | PROFILE_GPU);
+    }
+
+    void endFrame()
+    {
+        if(!enabled)
+            return;
+        while(!open.empty()) // closes "frame" and whatever was left open
+            end();
+        frame++;
+        while(!cpuTrace.empty() && cpuTrace.front().frame + PROFILER_TRACE_FRAMES < frame)
+            cpuTrace.pop_front();
+        while(!gpuTrace.empty() && gpuTrace.front().frame + PROFILER_TRACE_FRAMES < frame)
+            gpuTrace.pop_front();
+    }
+
+    // opens a scope under the innermost open one, timed on the clocks in PROFILE_* flags; name must outlive the call
+    void begin(const char *name, unsigned int clocks)
+    {
+        if(!enabled)
+            return;
+        OpenScope scope;
+        scope.node = findNode(name, open.empty() ? -1 : (int)open.back().node);
+        scope.gpuSlot = -1;
+        if((clocks & PROFILE_GPU) && gpuSupported)
+        {
+            GpuFrame &set = gpuFrames[frame % 2];
+            if(set.queries.size() < 2 * (set.used + 1))
+            {
+                set.queries.resize(2 * (set.used + 1));
+                glGenQueries(2, &set.queries[2 * set.used]);
+            }
+            set.nodes.resize(set.used + 1);
+            set.nodes[set.used] = scope.node;
+            glQueryCounter(set.queries[2 * set.used], GL_TIMESTAMP);
+            scope.gpuSlot = (int)set.used++;
+            nodes[scope.node].gpu = true;
+        }
+        scope.cpu = (clocks & PROFILE_CPU) != 0;
+        if(scope.cpu)
+        {
+            nodes[scope.node].cpu = true;
+            scope.start = Clock::now();
+        }
+        open.push_back(scope);
+    }
+
+    void end()
+    {
+        if(!enabled || open.empty())
+            return;
+        OpenScope scope = open.back();
+        open.pop_back();
+        if(scope.cpu)
+        {
+            Clock::time_point now = Clock::now();
+            nodes[scope.node].cpuMs[frame % PROFILER_HISTORY] += std::chrono::duration<float, std::milli>(now - scope.start).count();
+            ProfilerEvent event = { scope.node, frame, microseconds(scope.start), microseconds(now) };
+            cpuTrace.push_back(event);
+        }
+        if(scope.gpuSlot >= 0)
+            glQueryCounter(gpuFrames[frame % 2].queries[2 * scope.gpuSlot + 1], GL_TIMESTAMP);
+    }
+
+    const std::vector<ProfilerNode> &scopes() const { return nodes; }
+
+    // node indices depth first, children in the order they first ran: the order the overlay lists them in
+    std::vector<unsigned int> treeOrder() const
+    {
+        std::vector<unsigned int> order;
+        for(size_t i = 0; i < nodes.size(); i++)
+            if(nodes[i].parent < 0)
+                addSubtree((unsigned int)i, order);
+        return order;
+    }
+
+    // over the complete frames of the rolling window; GPU statistics skip the frames whose samples were dropped
+    ProfilerStats cpuStats(unsigned int node) const
+    {
+        return stats(nodes[node].cpuMs, frame, nullptr);
+    }
+
+    ProfilerStats gpuStats(unsigned int node) const
+    {
+        return stats(nodes[node].gpuMs, gpuNewest, gpuValid);
+    }
+
+    uint64_t frameCount() const { return frame; }
+    uint64_t droppedGpuFrames() const { return gpuDropped; }
+
+    // the events of the last PROFILER_TRACE_FRAMES frames in Chrome's trace event format, CPU and GPU as two threads
+    bool writeChromeTrace(const std::string &path) const
+    {
+        std::ofstream out(path.c_str(), std::ios::trunc);
+        if(!out)
+        {
+            std::cout << "ERROR::PROFILER:: cannot write " << path << std::endl;
+            return false;
+        }
+        out << std::fixed << std::setprecision(3);
+        out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+        out << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 1, \"args\": {\"name\": \"CPU\"}},\n";
+        out << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 2, \"args\": {\"name\": \"GPU\"}}";
+        auto write = [&](const std::deque<ProfilerEvent> &events, int thread) {
+            for(size_t i = 0; i < events.size(); i++)
+            {
+                const ProfilerEvent &e = events[i];
+                out << ",\n{\"name\": \"" << escaped(nodes[e.node].name) << "\", \"cat\": \"" << (thread == 1 ? "cpu" : "gpu")
+                    << "\", \"ph\": \"X\", \"ts\": " << e.start << ", \"dur\": " << e.end - e.start << ", \"pid\": 1, \"tid\": " << thread
+                    << ", \"args\": {\"frame\": " << e.frame << "}}";
+            }
+        };
+        write(cpuTrace, 1);
+        write(gpuTrace, 2);
+        out << "\n]}\n";
+        std::cout << "PROFILER:: " << cpuTrace.size() + gpuTrace.size() << " events written to " << path << std::endl;
+        return (bool)out;
+    }
+
+private:
+    struct OpenScope {
+        unsigned int node;
+        bool cpu;
+        Clock::time_point start;
+        int gpuSlot;    // scope index in the frame's GpuFrame, -1 if not timed on the GPU
+    };
+
+    // the queries of one frame: scope i wrote queries[2i] and queries[2i + 1]
+    struct GpuFrame {
+        uint64_t frame;
+        unsigned int used;
+        std::vector<GLuint> queries;
+        std::vector<unsigned int> nodes;
+
+        GpuFrame() : frame(0), used(0) {}
+    };
+
+    unsigned int findNode(const char *name, int parent)
+    {
+        for(size_t i = 0; i < nodes.size(); i++)
+            if(nodes[i].parent == parent && nodes[i].name == name)
+                return (unsigned int)i;
+        ProfilerNode node;
+        node.name = name;
+        node.parent = parent;
+        node.depth = parent < 0 ? 0 : nodes[parent].depth + 1;
+        node.cpu = false;
+        node.gpu = false;
+        std::fill(node.cpuMs, node.cpuMs + PROFILER_HISTORY, 0.0f);
+        std::fill(node.gpuMs, node.gpuMs + PROFILER_HISTORY, 0.0f);
+        nodes.push_back(node);
+        return (unsigned int)nodes.size() - 1;
+    }
+
+    // timestamps complete in order: once the last query of a set is available, so are the others
+    void collect(const GpuFrame &set)
+    {
+        GLint available = 0;
+        glGetQueryObjectiv(set.queries[2 * set.used - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        gpuNewest = set.frame + 1;
+        if(!available)
+        {
+            gpuDropped++;
+            return;
+        }
+        unsigned int slot = set.frame % PROFILER_HISTORY;
+        for(unsigned int i = 0; i < set.used; i++)
+        {
+            GLuint64 start = 0, end = 0;
+            glGetQueryObjectui64v(set.queries[2 * i], GL_QUERY_RESULT, &start);
+            glGetQueryObjectui64v(set.queries[2 * i + 1], GL_QUERY_RESULT, &end);
+            nodes[set.nodes[i]].gpuMs[slot] += (end - start) / 1.0e6f;
+            ProfilerEvent event = { set.nodes[i], set.frame, ((double)start - gpuEpoch) / 1.0e3, ((double)end - gpuEpoch) / 1.0e3 };
+            gpuTrace.push_back(event);
+        }
+        gpuValid[slot] = true;
+    }
+
+    // frames [end - window, end) of a ring
+    static ProfilerStats stats(const float *ms, uint64_t end, const bool *valid)
+    {
+        ProfilerStats s = { 0.0f, 0.0f, 0.0f };
+        uint64_t window = std::min<uint64_t>(end, PROFILER_HISTORY - 1); // the slot of the frame being recorded is excluded
+        unsigned int counted = 0;
+        for(uint64_t f = end - window; f < end; f++)
+        {
+            unsigned int slot = f % PROFILER_HISTORY;
+            if(valid && !valid[slot])
+                continue;
+            s.last = ms[slot];
+            s.average += ms[slot];
+            s.max = std::max(s.max, ms[slot]);
+            counted++;
+        }
+        if(counted)
+            s.average /= counted;
+        return s;
+    }
+
+    void addSubtree(unsigned int node, std::vector<unsigned int> &order) const
+    {
+        order.push_back(node);
+        for(size_t i = 0; i < nodes.size(); i++)
+            if(nodes[i].parent == (int)node)
+                addSubtree((unsigned int)i, order);
+    }
+
+    double microseconds(Clock::time_point t) const
+    {
+        return std::chrono::duration<double, std::micro>(t - epoch).count();
+    }
+
+    static std::string escaped(const std::string &text)
+    {
+        std::string out;
+        for(size_t i = 0; i < text.size(); i++)
+        {
+            if(text[i] == '"' || text[i] == '\\')
+                out += '\\';
+            out += text[i];
+        }
+        return out;
+    }
+
+    bool enabled, gpuSupported;
+    uint64_t frame;             // number of the frame being recorded
+    uint64_t gpuNewest;         // frames before this one have had their GPU times collected (or dropped)
+    uint64_t gpuDropped;
+    bool gpuValid[PROFILER_HISTORY];
+    Clock::time_point epoch;    // CPU and GPU clocks read together at creation
+    uint64_t gpuEpoch;
+    std::vector<ProfilerNode> nodes;
+    std::vector<OpenScope> open;
+    GpuFrame gpuFrames[2];
+    std::deque<ProfilerEvent> cpuTrace, gpuTrace;
+
+    Profiler(const Profiler&);
+    Profiler &operator=(const Profiler&);
+};
+
+// times the enclosing block on the clocks given
+class ProfileScope
+{
+public:
+    ProfileScope(Profiler &profiler, const char *name, unsigned int clocks = PROFILE_CPU | PROFILE_GPU) : profiler(profiler)
+    {
+        profiler.begin(name, clocks);
+    }
+
+    ~ProfileScope()
+    {
+        profiler.end();
+    }
+
+private:
+    Profiler &profiler;
+
+    ProfileScope(const ProfileScope&);
+    ProfileScope &operator=(const ProfileScope&);
+};
+
+class CpuScope : public ProfileScope
+{
+public:
+    CpuScope(Profiler &profiler, const char *name) : ProfileScope(profiler, name, PROFILE_CPU) {}
+};
+
+class GpuScope : public ProfileScope
+{
+public:
+    GpuScope(Profiler &profiler, const char *name) : ProfileScope(profiler, name, PROFILE_GPU) {}
+};
+
+#endif
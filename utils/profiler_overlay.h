@@ -0,0 +1,287 @@
+#ifndef PROFILER_OVERLAY_H
+#define PROFILER_OVERLAY_H
+
+#include <GL/gl3w.h> // here: we need compile gl3w.c - utils dir
+#include <ft2build.h> // common/include/freetype must be on the include path
+#include FT_FREETYPE_H
+
+#include <gl_state.h>
+#include <profiler.h>
+#include <shader.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Draws the rolling statistics of a Profiler in the top left corner: one line per scope, indented by depth, with its
+// CPU average and maximum and its GPU average over the last PROFILER_HISTORY frames. The printable ASCII glyphs are
+// rasterised once with FreeType into a single-channel atlas; a frame's text is one vertex buffer of quads streamed
+// with glBufferData orphaning and drawn in a single call. A font that fails to load leaves the overlay drawing
+// nothing.
+class ProfilerOverlay
+{
+public:
+    ProfilerOverlay(const char *fontPath, const char *vertexPath, const char *fragmentPath, unsigned int pixelHeight = 14)
+        : shader(vertexPath, fragmentPath), ready(false), atlas(0), vao(0), vbo(0), lineHeight(pixelHeight + 4)
+    {
+        FT_Library library;
+        if(FT_Init_FreeType(&library))
+        {
+            std::cout << "ERROR::PROFILER_OVERLAY:: could not initialise FreeType" << std::endl;
+            return;
+        }
+        FT_Face face;
+        if(FT_New_Face(library, fontPath, 0, &face))
+        {
+            std::cout << "ERROR::PROFILER_OVERLAY:: could not load font " << fontPath << std::endl;
+            FT_Done_FreeType(library);
+            return;
+        }
+        FT_Set_Pixel_Sizes(face, 0, pixelHeight);
+        ascender = (int)(face->size->metrics.ascender >> 6);
+        buildAtlas(face);
+        FT_Done_Face(face);
+        FT_Done_FreeType(library);
+
+        glGenVertexArrays(1, &vao);
+        glGenBuffers(1, &vbo);
+        SharedGLState().bindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(OverlayVertex), (void*)offsetof(OverlayVertex, x));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(OverlayVertex), (void*)offsetof(OverlayVertex, u));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(OverlayVertex), (void*)offsetof(OverlayVertex, color));
+        SharedGLState().bindVertexArray(0);
+
+        shader.use();
+        shader.setInt("glyphs", 0);
+        screenSizeLoc = shader.uniform("screenSize");
+        ready = true;
+    }
+
+    ~ProfilerOverlay()
+    {
+        glDeleteTextures(1, &atlas);
+        glDeleteVertexArrays(1, &vao);
+        glDeleteBuffers(1, &vbo);
+        SharedGLState().invalidate(); // the cache may still name the atlas on unit 0 or the VAO
+    }
+
+    bool isReady() const { return ready; }
+
+    // draws over whatever the frame holds, in a framebuffer of width x height pixels
+    void draw(const Profiler &profiler, unsigned int width, unsigned int height)
+    {
+        if(!ready || !profiler.isEnabled() || width == 0 || height == 0)
+            return;
+        text.clear();
+        const float margin = 6.0f;
+        const std::vector<ProfilerNode> &nodes = profiler.scopes();
+        std::vector<unsigned int> order = profiler.treeOrder();
+
+        // column positions from the widest indented name
+        float nameWidth = measure("scope");
+        for(size_t i = 0; i < order.size(); i++)
+            nameWidth = std::max(nameWidth, nodes[order[i]].depth * 12.0f + measure(nodes[order[i]].name.c_str()));
+        float column = measure("000.00 ms") + 12.0f;
+        float x0 = margin * 2.0f, cpuX = x0 + nameWidth + 16.0f, maxX = cpuX + column, gpuX = maxX + column;
+        float right = profiler.hasGpuTimes() ? gpuX + column : maxX + column;
+
+        const uint32_t white = packColor(255, 255, 255, 255), grey = packColor(160, 160, 160, 255);
+        float y = margin * 2.0f;
+        addText(x0, y, "scope", grey);
+        addText(cpuX, y, "cpu avg", grey);
+        addText(maxX, y, "cpu max", grey);
+        if(profiler.hasGpuTimes())
+            addText(gpuX, y, "gpu avg", grey);
+        char number[32];
+        for(size_t i = 0; i < order.size(); i++)
+        {
+            const ProfilerNode &node = nodes[order[i]];
+            y += lineHeight;
+            addText(x0 + node.depth * 12.0f, y, node.name.c_str(), white);
+            if(node.cpu)
+            {
+                ProfilerStats cpu = profiler.cpuStats(order[i]);
+                std::snprintf(number, sizeof(number), "%.2f ms", cpu.average);
+                addText(cpuX, y, number, white);
+                std::snprintf(number, sizeof(number), "%.2f ms", cpu.max);
+                addText(maxX, y, number, white);
+            }
+            if(profiler.hasGpuTimes() && node.gpu)
+            {
+                std::snprintf(number, sizeof(number), "%.2f ms", profiler.gpuStats(order[i]).average);
+                addText(gpuX, y, number, white);
+            }
+        }
+        y += lineHeight;
+        std::snprintf(number, sizeof(number), "%u frames", (unsigned int)std::min<uint64_t>(profiler.frameCount(), PROFILER_HISTORY - 1));
+        addText(x0, y, number, grey);
+
+        // the panel goes first so the text blends over it
+        std::vector<OverlayVertex> vertices;
+        vertices.reserve(text.size() + 6);
+        addQuad(vertices, margin, margin, right, y + lineHeight + 2.0f, solidU, solidV, solidU, solidV, packColor(0, 0, 0, 170));
+        vertices.insert(vertices.end(), text.begin(), text.end());
+
+        GLStateCache &glState = SharedGLState();
+        shader.use();
+        shader.setVec2(screenSizeLoc, (float)width, (float)height);
+        glState.disable(GL_DEPTH_TEST);
+        glState.enable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glState.bindVertexArray(vao);
+        glState.bindTexture(0, GL_TEXTURE_2D, atlas);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(OverlayVertex), vertices.data(), GL_STREAM_DRAW);
+        glDrawArrays(GL_TRIANGLES, 0, (GLsizei)vertices.size());
+        glState.disable(GL_BLEND);
+        glState.enable(GL_DEPTH_TEST);
+    }
+
+private:
+    static const unsigned int ATLAS_WIDTH = 512;
+    static const unsigned int FIRST_GLYPH = 32, LAST_GLYPH = 126;
+
+    struct Glyph {
+        float u0, v0, u1, v1;   // atlas rectangle
+        int width, height;
+        int left, top;          // bearing: from the pen to the bitmap's top left, y up
+        float advance;          // pixels
+    };
+
+    struct OverlayVertex {
+        float x, y;
+        float u, v;
+        uint32_t color;         // RGBA8
+    };
+
+    static uint32_t packColor(unsigned int r, unsigned int g, unsigned int b, unsigned int a)
+    {
+        unsigned char bytes[4] = { (unsigned char)r, (unsigned char)g, (unsigned char)b, (unsigned char)a };
+        uint32_t color;
+        memcpy(&color, bytes, 4);
+        return color;
+    }
+
+    // rows of glyphs left to right; a 2x2 fully covered block at the origin for the panel
+    void buildAtlas(FT_Face face)
+    {
+        unsigned int x = 4, y = 0, rowHeight = 2, height = 2;
+        std::vector<unsigned char> bitmaps;
+        std::vector<unsigned int> offsets(LAST_GLYPH - FIRST_GLYPH + 1);
+        std::vector<unsigned int> positions(2 * (LAST_GLYPH - FIRST_GLYPH + 1));
+        for(unsigned int c = FIRST_GLYPH; c <= LAST_GLYPH; c++)
+        {
+            Glyph &g = glyphs[c - FIRST_GLYPH];
+            g = Glyph();
+            if(FT_Load_Char(face, c, FT_LOAD_RENDER))
+                continue;
+            const FT_Bitmap &bitmap = face->glyph->bitmap;
+            g.width = (int)bitmap.width;
+            g.height = (int)bitmap.rows;
+            g.left = face->glyph->bitmap_left;
+            g.top = face->glyph->bitmap_top;
+            g.advance = (face->glyph->advance.x >> 6) * 1.0f;
+            if(x + g.width + 1 > ATLAS_WIDTH)
+            {
+                x = 0;
+                y += rowHeight + 1;
+                rowHeight = 0;
+            }
+            positions[2 * (c - FIRST_GLYPH)] = x;
+            positions[2 * (c - FIRST_GLYPH) + 1] = y;
+            offsets[c - FIRST_GLYPH] = (unsigned int)bitmaps.size();
+            for(int row = 0; row < g.height; row++) // FreeType rows may be padded: copy them tight
+                bitmaps.insert(bitmaps.end(), bitmap.buffer + row * bitmap.pitch, bitmap.buffer + row * bitmap.pitch + g.width);
+            x += g.width + 1;
+            rowHeight = std::max(rowHeight, (unsigned int)g.height);
+            height = std::max(height, y + rowHeight);
+        }
+        std::vector<unsigned char> pixels(ATLAS_WIDTH * height, 0);
+        for(unsigned int i = 0; i < 2; i++)
+            pixels[i * ATLAS_WIDTH] = pixels[i * ATLAS_WIDTH + 1] = 255;
+        for(unsigned int c = FIRST_GLYPH; c <= LAST_GLYPH; c++)
+        {
+            Glyph &g = glyphs[c - FIRST_GLYPH];
+            unsigned int gx = positions[2 * (c - FIRST_GLYPH)], gy = positions[2 * (c - FIRST_GLYPH) + 1];
+            for(int row = 0; row < g.height; row++)
+                std::copy(&bitmaps[offsets[c - FIRST_GLYPH] + row * g.width], &bitmaps[offsets[c - FIRST_GLYPH] + row * g.width] + g.width,
+                          &pixels[(gy + row) * ATLAS_WIDTH + gx]);
+            g.u0 = gx / (float)ATLAS_WIDTH;
+            g.v0 = gy / (float)height;
+            g.u1 = (gx + g.width) / (float)ATLAS_WIDTH;
+            g.v1 = (gy + g.height) / (float)height;
+        }
+        solidU = 1.0f / ATLAS_WIDTH;
+        solidV = 1.0f / height;
+
+        glGenTextures(1, &atlas);
+        SharedGLState().bindTexture(0, GL_TEXTURE_2D, atlas);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, ATLAS_WIDTH, height, 0, GL_RED, GL_UNSIGNED_BYTE, pixels.data());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST); // glyphs are drawn at their raster size
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+
+    float measure(const char *s) const
+    {
+        float width = 0.0f;
+        for(; *s; s++)
+            if(*s >= (char)FIRST_GLYPH && *s <= (char)LAST_GLYPH)
+                width += glyphs[*s - FIRST_GLYPH].advance;
+        return width;
+    }
+
+    static void addQuad(std::vector<OverlayVertex> &out, float x0, float y0, float x1, float y1, float u0, float v0, float u1, float v1, uint32_t color)
+    {
+        OverlayVertex a = { x0, y0, u0, v0, color }, b = { x1, y0, u1, v0, color };
+        OverlayVertex c = { x1, y1, u1, v1, color }, d = { x0, y1, u0, v1, color };
+        out.push_back(a);
+        out.push_back(b);
+        out.push_back(c);
+        out.push_back(a);
+        out.push_back(c);
+        out.push_back(d);
+    }
+
+    // text with its top at y (pixels, y down)
+    void addText(float x, float y, const char *s, uint32_t color)
+    {
+        float baseline = y + ascender;
+        for(; *s; s++)
+        {
+            if(*s < (char)FIRST_GLYPH || *s > (char)LAST_GLYPH)
+                continue;
+            const Glyph &g = glyphs[*s - FIRST_GLYPH];
+            if(g.width && g.height)
+                addQuad(text, x + g.left, baseline - g.top, x + g.left + g.width, baseline - g.top + g.height, g.u0, g.v0, g.u1, g.v1, color);
+            x += g.advance;
+        }
+    }
+
+    Shader shader;
+    bool ready;
+    GLuint atlas, vao, vbo;
+    UniformHandle screenSizeLoc;
+    Glyph glyphs[LAST_GLYPH - FIRST_GLYPH + 1];
+    float solidU, solidV;   // texel inside the covered block
+    int ascender;
+    float lineHeight;
+    std::vector<OverlayVertex> text; // this frame's glyph quads
+
+    ProfilerOverlay(const ProfilerOverlay&);
+    ProfilerOverlay &operator=(const ProfilerOverlay&);
+};
+
+#endif
@@ -0,0 +1,366 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <GL/gl3w.h> // here: we need compile gl3w.c - utils dir
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <mesh.h>
+#include <gl_state.h>
+#include <shader.h>
+#include <uniform_ring.h>
+
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+// A RenderQueue sort key, most significant bits first:
+//   program  (10 bits) slot of the program in the queue
+//   material (22 bits) id of the texture set (and packed vertex dequantisation)
+//   vao      (16 bits) vertex array name
+//   depth    (16 bits) DepthBucket of the distance to the eye, so equal state draws front to back
+// Sorting by key keeps every program, then every material, then every VAO together, which is the order of how
+// expensive they are to switch. The key only orders; what is actually bound is decided by comparing the packets.
+const unsigned int RENDER_KEY_PROGRAM_BITS = 10;
+const unsigned int RENDER_KEY_MATERIAL_BITS = 22;
+const unsigned int RENDER_KEY_VAO_BITS = 16;
+const unsigned int RENDER_KEY_DEPTH_BITS = 16;
+
+inline uint64_t MakeRenderKey(unsigned int program, unsigned int material, unsigned int vao, unsigned int depth)
+{
+    const uint64_t programMask = (1ull << RENDER_KEY_PROGRAM_BITS) - 1;
+    const uint64_t materialMask = (1ull << RENDER_KEY_MATERIAL_BITS) - 1;
+    const uint64_t vaoMask = (1ull << RENDER_KEY_VAO_BITS) - 1;
+    const uint64_t depthMask = (1ull << RENDER_KEY_DEPTH_BITS) - 1;
+    return ((program & programMask) << (RENDER_KEY_MATERIAL_BITS + RENDER_KEY_VAO_BITS + RENDER_KEY_DEPTH_BITS)) |
+           ((material & materialMask) << (RENDER_KEY_VAO_BITS + RENDER_KEY_DEPTH_BITS)) |
+           ((vao & vaoMask) << RENDER_KEY_DEPTH_BITS) |
+           (depth & depthMask);
+}
+
+// 16 bit bucket of a distance >= 0: the top half of its float bits (exponent and 7 mantissa bits), which order like
+// the distances themselves with a resolution of about 1% at any scale
+inline unsigned int DepthBucket(float distance)
+{
+    if(!(distance > 0.0f))
+        return 0;
+    uint32_t bits;
+    memcpy(&bits, &distance, sizeof(bits));
+    return bits >> 16;
+}
+
+struct RenderItem {
+    uint64_t key;
+    unsigned int command; // index into the queue's commands
+};
+
+// LSD radix sort of items by key, 8 bits per pass. All eight byte histograms are built in one read of the items, and
+// the passes whose byte is the same for every item (usually the program, most of the material) are skipped. Stable.
+inline void RadixSortRenderItems(std::vector<RenderItem> &items, std::vector<RenderItem> &scratch)
+{
+    size_t count = items.size();
+    if(count < 2)
+        return;
+    size_t histograms[8][256];
+    memset(histograms, 0, sizeof(histograms));
+    for(size_t i = 0; i < count; i++)
+        for(unsigned int pass = 0; pass < 8; pass++)
+            histograms[pass][(items[i].key >> (pass * 8)) & 0xff]++;
+
+    scratch.resize(count);
+    for(unsigned int pass = 0; pass < 8; pass++)
+    {
+        size_t *histogram = histograms[pass];
+        unsigned int shift = pass * 8;
+        if(histogram[(items[0].key >> shift) & 0xff] == count)
+            continue;
+        size_t offset = 0;
+        for(unsigned int b = 0; b < 256; b++)
+        {
+            size_t n = histogram[b];
+            histogram[b] = offset;
+            offset += n;
+        }
+        for(size_t i = 0; i < count; i++)
+            scratch[histogram[(items[i].key >> shift) & 0xff]++] = items[i];
+        items.swap(scratch);
+    }
+}
+
+// what the last RenderQueue::flush did
+struct RenderQueueStats {
+    unsigned int items;             // packets submitted
+    unsigned int drawCalls;         // glDrawElementsBaseVertex / glMultiDrawElementsBaseVertex issued for them
+    unsigned int stateChanges;      // program, VAO, active texture, texture and uniform buffer range binds that reached GL
+    unsigned int stateChangesSaved; // how many fewer than drawing every item on its own (each binding its program,
+                                    // VAO, textures and, with a ring, its DrawBlock range) would have issued
+};
+
+// Collects the draws of a frame (from any number of models and programs), sorts them by a 64-bit key and submits them
+// in key order through a GLStateCache. Consecutive items that draw with the same state (ComparePacketState) and
+// transform are merged into one glMultiDrawElementsBaseVertex, as PacketBatcher does within a model.
+// Per frame: clear(), then program() / addTransform() / submit() from each model (Model::Enqueue), then flush().
+// The uniforms other than the model matrix (view, projection, lights) are the caller's to set on each program before
+// flush, as with Model::Draw, or to put in the ring's FrameUniforms for programs built with UNIFORM_BLOCKS.
+class RenderQueue
+{
+public:
+    RenderQueue()
+    {
+        memset(&lastStats, 0, sizeof(lastStats));
+    }
+
+    // drops the previous frame's items and transforms
+    void clear()
+    {
+        commands.clear();
+        items.clear();
+        transforms.clear();
+        normalMatrices.clear();
+    }
+
+    // slot of shader's program for submit; the first time a program is seen its sampler units, uniform blocks and
+    // per-draw uniform handles are resolved (units and block bindings are assigned on its first flush). The Shader
+    // must outlive the queue.
+    unsigned int program(Shader &shader)
+    {
+        for(unsigned int i = 0; i < programs.size(); i++)
+            if(programs[i].shader->ID == shader.ID)
+                return i;
+        ProgramSlot slot;
+        slot.shader = &shader;
+        slot.uniforms = ResolvePacketUniforms(shader);
+        slot.model = shader.uniform("model");
+        slot.normalMatrix = shader.uniform("normalMatrix");
+        slot.samplersAssigned = false;
+        slot.hasDrawBlock = glGetUniformBlockIndex(shader.ID, "DrawBlock") != GL_INVALID_INDEX;
+        programs.push_back(slot);
+        return (unsigned int)programs.size() - 1;
+    }
+
+    // a model matrix for submit, uploaded to the program's "model" uniform (and its NormalMatrix to "normalMatrix")
+    // when the items drawn switch to it
+    unsigned int addTransform(const glm::mat4 &model)
+    {
+        transforms.push_back(model);
+        normalMatrices.push_back(NormalMatrix(model));
+        return (unsigned int)transforms.size() - 1;
+    }
+
+    // queues packet, which must stay unchanged until flush; depth is its distance to the eye
+    void submit(unsigned int program, const DrawPacket &packet, unsigned int transform, float depth)
+    {
+        RenderCommand command;
+        command.packet = &packet;
+        command.program = program;
+        command.transform = transform;
+        RenderItem item;
+        item.key = MakeRenderKey(program, materialId(packet), packet.vao, DepthBucket(depth));
+        item.command = (unsigned int)commands.size();
+        commands.push_back(command);
+        items.push_back(item);
+    }
+
+    // sorts and draws everything submitted since clear(); the queue keeps its items until the next clear().
+    // With a ring, programs that have a DrawBlock (UNIFORM_BLOCKS) get their model matrix and dequantisation from
+    // DrawUniforms written to the ring for the whole flush up front (one upload; runs of draws with the same
+    // transform and dequantisation share a block) instead of glUniform calls between the draws. The ring's frame must
+    // have room for an aligned DrawUniforms per item.
+    void flush(GLStateCache &state = SharedGLState(), UniformRing *ring = nullptr)
+    {
+        unsigned int issuedBefore = state.counters().issued;
+        unsigned int requested = 0;
+        for(size_t i = 0; i < commands.size(); i++)
+        {
+            requested += 2 + 2 * commands[i].packet->textureCount;
+            if(ring && programs[commands[i].program].hasDrawBlock)
+                requested++; // its DrawBlock range
+        }
+        RadixSortRenderItems(items, scratch);
+
+        // the runs of items drawn by one call
+        groups.clear();
+        for(size_t first = 0; first < items.size(); )
+        {
+            const RenderCommand &command = commands[items[first].command];
+            size_t end = first + 1;
+            while(end < items.size() && canMerge(command, commands[items[end].command]))
+                end++;
+            DrawGroup group;
+            group.first = first;
+            group.end = end;
+            group.block = -1;
+            groups.push_back(group);
+            first = end;
+        }
+        if(ring)
+            writeDrawBlocks(*ring);
+
+        memset(&lastStats, 0, sizeof(lastStats));
+        lastStats.items = (unsigned int)items.size();
+        unsigned int currentProgram = ~0u, currentTransform = ~0u;
+        for(size_t g = 0; g < groups.size(); g++)
+        {
+            size_t first = groups[g].first, end = groups[g].end;
+            const RenderCommand &command = commands[items[first].command];
+            const DrawPacket &packet = *command.packet;
+
+            ProgramSlot &slot = programs[command.program];
+            state.useProgram(slot.shader->ID);
+            if(!slot.samplersAssigned)
+            {
+                BindSamplerUnits(*slot.shader);
+                BindUniformBlocks(*slot.shader);
+                slot.samplersAssigned = true;
+            }
+            if(groups[g].block >= 0)
+                ring->bind(UNIFORM_BLOCK_DRAW, groups[g].block, sizeof(DrawUniforms));
+            else
+            {
+                if(command.program != currentProgram || command.transform != currentTransform)
+                {
+                    if(slot.model.valid())
+                        glUniformMatrix4fv(slot.model.location, 1, GL_FALSE, glm::value_ptr(transforms[command.transform]));
+                    if(slot.normalMatrix.valid())
+                        glUniformMatrix3fv(slot.normalMatrix.location, 1, GL_FALSE, glm::value_ptr(normalMatrices[command.transform]));
+                    currentProgram = command.program;
+                    currentTransform = command.transform;
+                }
+                if(slot.uniforms.positionScale.valid())
+                {
+                    glUniform3fv(slot.uniforms.positionScale.location, 1, &packet.positionScale[0]);
+                    glUniform3fv(slot.uniforms.positionBias.location, 1, &packet.positionBias[0]);
+                }
+            }
+            for(GLuint t = 0; t < packet.textureCount; t++)
+                if(state.bindTexture(packet.textures[t].unit, GL_TEXTURE_2D, packet.textures[t].texture))
+                    drawCounters().textureBinds++;
+            if(state.bindVertexArray(packet.vao))
+                drawCounters().vaoBinds++;
+
+            if(end - first == 1)
+                glDrawElementsBaseVertex(GL_TRIANGLES, packet.indexCount, packet.indexType, (const void*)packet.indexOffset, packet.baseVertex);
+            else
+            {
+                counts.clear();
+                offsets.clear();
+                baseVertices.clear();
+                for(size_t i = first; i < end; i++)
+                {
+                    const DrawPacket &merged = *commands[items[i].command].packet;
+                    counts.push_back(merged.indexCount);
+                    offsets.push_back((const void*)merged.indexOffset);
+                    baseVertices.push_back(merged.baseVertex);
+                }
+                glMultiDrawElementsBaseVertex(GL_TRIANGLES, counts.data(), packet.indexType, offsets.data(), (GLsizei)counts.size(), baseVertices.data());
+            }
+            drawCounters().drawCalls++;
+            drawCounters().mergedDraws += (unsigned int)(end - first);
+            lastStats.drawCalls++;
+        }
+        lastStats.stateChanges = state.counters().issued - issuedBefore;
+        lastStats.stateChangesSaved = requested > lastStats.stateChanges ? requested - lastStats.stateChanges : 0;
+    }
+
+    const RenderQueueStats &stats() const { return lastStats; }
+    size_t size() const { return items.size(); }
+
+private:
+    struct ProgramSlot {
+        Shader *shader;
+        PacketUniforms uniforms;
+        UniformHandle model;
+        UniformHandle normalMatrix;
+        bool samplersAssigned;
+        bool hasDrawBlock; // built with UNIFORM_BLOCKS
+    };
+
+    struct RenderCommand {
+        const DrawPacket *packet;
+        unsigned int program;
+        unsigned int transform;
+    };
+
+    struct DrawGroup {
+        size_t first, end;  // items[first, end) drawn by one call
+        GLintptr block;     // offset of its DrawUniforms in the ring, -1 if set through uniforms
+    };
+
+    // DrawUniforms of every group whose program has a DrawBlock, then one upload for all of them
+    void writeDrawBlocks(UniformRing &ring)
+    {
+        const RenderCommand *previous = nullptr;
+        GLintptr block = -1;
+        for(size_t g = 0; g < groups.size(); g++)
+        {
+            const RenderCommand &command = commands[items[groups[g].first].command];
+            if(!programs[command.program].hasDrawBlock)
+                continue;
+            if(!previous || command.transform != previous->transform ||
+               command.packet->positionScale != previous->packet->positionScale ||
+               command.packet->positionBias != previous->packet->positionBias)
+            {
+                DrawUniforms uniforms = {};
+                uniforms.model = transforms[command.transform];
+                uniforms.positionScale = command.packet->positionScale;
+                uniforms.positionBias = command.packet->positionBias;
+                const glm::mat3 &normalMatrix = normalMatrices[command.transform];
+                for(int c = 0; c < 3; c++)
+                    uniforms.normalMatrix[c] = glm::vec4(normalMatrix[c], 0.0f);
+                block = ring.allocate(&uniforms, sizeof(uniforms));
+                previous = &command;
+            }
+            groups[g].block = block;
+        }
+        ring.upload();
+    }
+
+    static bool canMerge(const RenderCommand &a, const RenderCommand &b)
+    {
+        return a.program == b.program && a.transform == b.transform && ComparePacketState(*a.packet, *b.packet) == 0;
+    }
+
+    // dense id of the packet's texture set and dequantisation, stable for the lifetime of the queue
+    unsigned int materialId(const DrawPacket &packet)
+    {
+        uint64_t hash = 14695981039346656037ULL; // FNV-1a
+        mix(hash, &packet.textureCount, sizeof(packet.textureCount));
+        mix(hash, packet.textures, packet.textureCount * sizeof(TextureBinding));
+        mix(hash, &packet.positionScale[0], sizeof(packet.positionScale));
+        mix(hash, &packet.positionBias[0], sizeof(packet.positionBias));
+        std::unordered_map<uint64_t, unsigned int>::iterator it = materials.find(hash);
+        if(it != materials.end())
+            return it->second;
+        unsigned int id = (unsigned int)materials.size();
+        materials[hash] = id;
+        return id;
+    }
+
+    static void mix(uint64_t &hash, const void *data, size_t bytes)
+    {
+        const unsigned char *p = (const unsigned char*)data;
+        for(size_t i = 0; i < bytes; i++)
+        {
+            hash ^= p[i];
+            hash *= 1099511628211ULL;
+        }
+    }
+
+    std::vector<ProgramSlot> programs;
+    std::unordered_map<uint64_t, unsigned int> materials;
+    std::vector<glm::mat4> transforms;
+    std::vector<glm::mat3> normalMatrices;
+    std::vector<RenderCommand> commands;
+    std::vector<RenderItem> items, scratch;
+    std::vector<DrawGroup> groups;
+    std::vector<GLsizei> counts;
+    std::vector<const void*> offsets;
+    std::vector<GLint> baseVertices;
+    RenderQueueStats lastStats;
+
+    RenderQueue(const RenderQueue&);
+    RenderQueue &operator=(const RenderQueue&);
+};
+#endif
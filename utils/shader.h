@@ -3,19 +3,42 @@
 
 #include <GL/gl3w.h> // here: we need compile gl3w.c - utils dir
 #include <glm/glm.hpp>
+#include <gl_state.h>
 
+#include <algorithm>
+#include <cstring>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <vector>
+
+// a uniform location resolved once; hold on to it and pass it to the Shader setters in the render loop
+struct UniformHandle
+{
+    GLint location;
+    UniformHandle() : location(-1) {}
+    explicit UniformHandle(GLint location) : location(location) {}
+    bool valid() const { return location >= 0; }
+};
+
+// an active uniform of a linked program, as reported by glGetActiveUniform
+struct UniformInfo
+{
+    std::string name;   // array elements are listed as "name[i]", element 0 also as plain "name"
+    GLint location;
+    GLenum type;
+    GLint size;
+};
 
 class Shader
 {
 public:
     unsigned int ID;
     // constructor generates the shader on the fly
+    // defines: optional extra source lines (e.g. "#define PACKED_VERTICES\n") inserted after #version in every stage
     // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
+    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr, const char* defines = nullptr)
     {
         // 1. retrieve the vertex/fragment source code from filePath
         std::string vertexCode;
@@ -57,6 +80,12 @@ public:
         {
             std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
         }
+        if(defines != nullptr)
+        {
+            injectDefines(vertexCode, defines);
+            injectDefines(fragmentCode, defines);
+            injectDefines(geometryCode, defines);
+        }
         const char* vShaderCode = vertexCode.c_str();
         const char * fShaderCode = fragmentCode.c_str();
         // 2. compile shaders
@@ -97,73 +126,211 @@ public:
         if(geometryPath != nullptr)
             glDeleteShader(geometry);
 
+        // resolve every uniform location once, so the setters never have to ask the driver again
+        reflectUniforms();
     }
-    // activate the shader
+    // activate the shader; skipped if it already is active (SharedGLState)
     // ------------------------------------------------------------------------
     void use() 
     { 
-        glUseProgram(ID); 
+        SharedGLState().useProgram(ID); 
+    }
+    // uniform lookup
+    // ------------------------------------------------------------------------
+    // resolves a uniform name against the table built at link time; an unknown (or optimised out) name gives an invalid handle
+    UniformHandle uniform(const char *name) const
+    {
+        std::vector<UniformInfo>::const_iterator it = std::lower_bound(uniformTable.begin(), uniformTable.end(), name,
+            [](const UniformInfo &info, const char *key) { return std::strcmp(info.name.c_str(), key) < 0; });
+        if(it != uniformTable.end() && it->name == name)
+            return UniformHandle(it->location);
+        return UniformHandle();
+    }
+    UniformHandle uniform(const std::string &name) const
+    {
+        return uniform(name.c_str());
+    }
+    // all active uniforms, sorted by name
+    const std::vector<UniformInfo> &uniforms() const
+    {
+        return uniformTable;
+    }
+    // points the named uniform block at an indexed GL_UNIFORM_BUFFER binding; false if the program has no such block
+    bool bindUniformBlock(const char *name, GLuint binding) const
+    {
+        GLuint index = glGetUniformBlockIndex(ID, name);
+        if(index == GL_INVALID_INDEX)
+            return false;
+        glUniformBlockBinding(ID, index, binding);
+        return true;
     }
     // utility uniform functions
     // ------------------------------------------------------------------------
+    void setBool(UniformHandle handle, bool value) const
+    {         
+        glUniform1i(handle.location, (int)value); 
+    }
     void setBool(const std::string &name, bool value) const
     {         
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value); 
+        setBool(uniform(name), value); 
     }
     // ------------------------------------------------------------------------
+    void setInt(UniformHandle handle, int value) const
+    { 
+        glUniform1i(handle.location, value); 
+    }
     void setInt(const std::string &name, int value) const
     { 
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value); 
+        setInt(uniform(name), value); 
     }
     // ------------------------------------------------------------------------
+    void setFloat(UniformHandle handle, float value) const
+    { 
+        glUniform1f(handle.location, value); 
+    }
     void setFloat(const std::string &name, float value) const
     { 
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value); 
+        setFloat(uniform(name), value); 
     }
     // ------------------------------------------------------------------------
+    void setVec2(UniformHandle handle, const glm::vec2 &value) const
+    { 
+        glUniform2fv(handle.location, 1, &value[0]); 
+    }
     void setVec2(const std::string &name, const glm::vec2 &value) const
     { 
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        setVec2(uniform(name), value); 
+    }
+    void setVec2(UniformHandle handle, float x, float y) const
+    { 
+        glUniform2f(handle.location, x, y); 
     }
     void setVec2(const std::string &name, float x, float y) const
     { 
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y); 
+        setVec2(uniform(name), x, y); 
     }
     // ------------------------------------------------------------------------
+    void setVec3(UniformHandle handle, const glm::vec3 &value) const
+    { 
+        glUniform3fv(handle.location, 1, &value[0]); 
+    }
     void setVec3(const std::string &name, const glm::vec3 &value) const
     { 
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        setVec3(uniform(name), value); 
+    }
+    void setVec3(UniformHandle handle, float x, float y, float z) const
+    { 
+        glUniform3f(handle.location, x, y, z); 
     }
     void setVec3(const std::string &name, float x, float y, float z) const
     { 
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z); 
+        setVec3(uniform(name), x, y, z); 
     }
     // ------------------------------------------------------------------------
+    void setVec4(UniformHandle handle, const glm::vec4 &value) const
+    { 
+        glUniform4fv(handle.location, 1, &value[0]); 
+    }
     void setVec4(const std::string &name, const glm::vec4 &value) const
     { 
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        setVec4(uniform(name), value); 
     }
-    void setVec4(const std::string &name, float x, float y, float z, float w) 
+    void setVec4(UniformHandle handle, float x, float y, float z, float w) const
     { 
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w); 
+        glUniform4f(handle.location, x, y, z, w); 
+    }
+    void setVec4(const std::string &name, float x, float y, float z, float w) const
+    { 
+        setVec4(uniform(name), x, y, z, w); 
     }
     // ------------------------------------------------------------------------
+    void setMat2(UniformHandle handle, const glm::mat2 &mat) const
+    {
+        glUniformMatrix2fv(handle.location, 1, GL_FALSE, &mat[0][0]);
+    }
     void setMat2(const std::string &name, const glm::mat2 &mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        setMat2(uniform(name), mat);
     }
     // ------------------------------------------------------------------------
+    void setMat3(UniformHandle handle, const glm::mat3 &mat) const
+    {
+        glUniformMatrix3fv(handle.location, 1, GL_FALSE, &mat[0][0]);
+    }
     void setMat3(const std::string &name, const glm::mat3 &mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        setMat3(uniform(name), mat);
     }
     // ------------------------------------------------------------------------
+    void setMat4(UniformHandle handle, const glm::mat4 &mat) const
+    {
+        glUniformMatrix4fv(handle.location, 1, GL_FALSE, &mat[0][0]);
+    }
     void setMat4(const std::string &name, const glm::mat4 &mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        setMat4(uniform(name), mat);
     }
 
 private:
+    std::vector<UniformInfo> uniformTable; // flat, sorted by name
+
+    // builds the uniform table from the linked program (uniforms inside blocks have no location and are skipped)
+    // ------------------------------------------------------------------------
+    void reflectUniforms()
+    {
+        uniformTable.clear();
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<GLchar> buffer(maxLength > 0 ? maxLength : 1);
+        for(GLint i = 0; i < count; i++)
+        {
+            GLsizei length = 0;
+            UniformInfo info;
+            glGetActiveUniform(ID, (GLuint)i, (GLsizei)buffer.size(), &length, &info.size, &info.type, buffer.data());
+            info.name.assign(buffer.data(), length);
+            info.location = glGetUniformLocation(ID, info.name.c_str());
+            if(info.location < 0)
+                continue;
+            // arrays of basic types are reported once as "name[0]": list the base name and every element
+            if(info.name.size() < 3 || info.name.compare(info.name.size() - 3, 3, "[0]") != 0)
+            {
+                uniformTable.push_back(info);
+                continue;
+            }
+            std::string base = info.name.substr(0, info.name.size() - 3);
+            UniformInfo element = info;
+            element.name = base;
+            uniformTable.push_back(element);
+            for(GLint j = 0; j < info.size; j++)
+            {
+                element.name = base + "[" + std::to_string(j) + "]";
+                element.location = glGetUniformLocation(ID, element.name.c_str());
+                element.size = info.size - j;
+                uniformTable.push_back(element);
+            }
+        }
+        std::sort(uniformTable.begin(), uniformTable.end(), [](const UniformInfo &a, const UniformInfo &b) { return a.name < b.name; });
+    }
+
+    // inserts the define lines right after the #version directive (which must stay the first statement)
+    // ------------------------------------------------------------------------
+    static void injectDefines(std::string &code, const char* defines)
+    {
+        if(code.empty())
+            return;
+        size_t at = 0;
+        if(code.compare(0, 8, "#version") == 0)
+        {
+            at = code.find('\n');
+            at = at == std::string::npos ? code.size() : at + 1;
+        }
+        std::string lines = defines;
+        if(!lines.empty() && lines[lines.size() - 1] != '\n')
+            lines += '\n';
+        code.insert(at, lines);
+    }
+
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(GLuint shader, std::string type)
@@ -3,6 +3,7 @@
 
 #include <GL/gl3w.h> // here: we need compile gl3w.c - utils dir
 #include <glm/glm.hpp>
+#include <gl_state.h>
 
 #include <string>
 #include <fstream>
@@ -72,11 +73,11 @@ public:
         glDeleteShader(fragment);
 
     }
-    // activate the shader
+    // activate the shader; skipped if it already is active (SharedGLState)
     // ------------------------------------------------------------------------
     void use() const
     { 
-        glUseProgram(ID); 
+        SharedGLState().useProgram(ID); 
     }
     // utility uniform functions
     // ------------------------------------------------------------------------
@@ -2,6 +2,7 @@
 #define SHADER_H
 
 #include <GL/gl3w.h> // here: we need compile gl3w.c - utils dir
+#include <gl_state.h>
 
 #include <string>
 #include <fstream>
@@ -70,11 +71,11 @@ public:
         glDeleteShader(vertex);
         glDeleteShader(fragment);
     }
-    // activate the shader
+    // activate the shader; skipped if it already is active (SharedGLState)
     // ------------------------------------------------------------------------
     void use() 
     { 
-        glUseProgram(ID); 
+        SharedGLState().useProgram(ID); 
     }
     // utility uniform functions
     // ------------------------------------------------------------------------
@@ -0,0 +1,380 @@
+#ifndef SKELETON_H
+#define SKELETON_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <assimp/scene.h>
+
+#include <mesh.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Skeletal animation data of a rigged model: the node hierarchy, the bones the vertices are weighted to and the
+// animation clips that move the nodes. Posing a model is two passes over flat arrays:
+//   SampleClip         - local transform of every node at a time in a clip
+//   BuildSkinPalette   - global transforms (parents first, so one linear walk), then one skinning matrix per bone
+// The palette is what the CPU skinning kernel (skinning.h) and the SKINNED variant of 1.model_loading.vs read.
+
+// bones a vertex is weighted to at most; weaker influences are dropped and the rest renormalised
+const unsigned int MAX_BONE_INFLUENCES = 4;
+
+// per vertex bone ids (into Skeleton::bones) and weights, in strongest first order; unused slots weigh 0
+struct BoneInfluence {
+    uint16_t bones[MAX_BONE_INFLUENCES];
+    float weights[MAX_BONE_INFLUENCES];
+};
+
+// a Vertex with its influences, the form skinned meshes take through the CPU mesh pipeline (model.h). Only floats, so
+// weldVertices keeps vertices with different weights apart; bone ids are exact in a float up to 2^24.
+struct SkinnedVertex {
+    glm::vec3 Position;
+    glm::vec3 Normal;
+    glm::vec2 TexCoords;
+    glm::vec3 Tangent;
+    glm::vec3 Bitangent;
+    glm::vec4 Bones;
+    glm::vec4 Weights;
+};
+
+struct SkeletonNode {
+    std::string name;
+    int parent;             // index into Skeleton::nodes, always lower than this node's; -1 for the root
+    glm::mat4 transform;    // bind pose, relative to the parent (aiNode::mTransformation)
+};
+
+struct Bone {
+    unsigned int node;      // the node that moves it
+    glm::mat4 offset;       // mesh space -> bone space in the bind pose (aiBone::mOffsetMatrix)
+};
+
+struct Skeleton {
+    std::vector<SkeletonNode> nodes;   // depth first, so parents come before their children
+    std::vector<Bone> bones;
+    glm::mat4 globalInverse;           // inverse of the root transform, brings the posed bones back to model space
+    std::unordered_map<std::string, unsigned int> nodeIndex;
+    std::unordered_map<std::string, unsigned int> boneIndex;
+
+    bool empty() const { return bones.empty(); }
+
+    // index of the named node, -1 if there is none
+    int findNode(const std::string &name) const
+    {
+        std::unordered_map<std::string, unsigned int>::const_iterator it = nodeIndex.find(name);
+        return it == nodeIndex.end() ? -1 : (int)it->second;
+    }
+
+    // the bone of the named node, added on first use
+    unsigned int addBone(const std::string &name, const glm::mat4 &offset)
+    {
+        std::unordered_map<std::string, unsigned int>::const_iterator it = boneIndex.find(name);
+        if(it != boneIndex.end())
+            return it->second;
+        int node = findNode(name);
+        Bone bone;
+        bone.node = node < 0 ? 0u : (unsigned int)node;
+        bone.offset = offset;
+        if(node < 0)
+            std::cout << "ERROR::SKELETON::BONE_WITHOUT_NODE " << name << std::endl;
+        bones.push_back(bone);
+        boneIndex[name] = (unsigned int)bones.size() - 1;
+        return (unsigned int)bones.size() - 1;
+    }
+
+    // a bone carrying a mesh that isn't rigged rigidly along with its node; one per node
+    unsigned int addRigidBone(unsigned int node)
+    {
+        for(size_t i = 0; i < bones.size(); i++)
+            if(bones[i].node == node && bones[i].offset == glm::mat4())
+                return (unsigned int)i;
+        Bone bone;
+        bone.node = node;
+        bone.offset = glm::mat4();
+        bones.push_back(bone);
+        return (unsigned int)bones.size() - 1;
+    }
+};
+
+// the keys of one property of a channel, structure of arrays: key searches and cursor steps (animation_sampler.h)
+// only walk the packed times
+template<typename T>
+struct AnimationTrack {
+    std::vector<float> times;   // ticks, ascending
+    std::vector<T> values;
+
+    void add(float time, const T &value)
+    {
+        times.push_back(time);
+        values.push_back(value);
+    }
+    size_t size() const { return times.size(); }
+};
+
+// the keys moving one node; each track holds at least one key
+struct AnimationChannel {
+    unsigned int node;
+    AnimationTrack<glm::vec3> positions;
+    AnimationTrack<glm::quat> rotations;
+    AnimationTrack<glm::vec3> scales;
+};
+
+struct AnimationClip {
+    std::string name;
+    float duration;         // ticks
+    float ticksPerSecond;
+    std::vector<AnimationChannel> channels;
+    std::vector<int> nodeChannel; // per skeleton node, its channel or -1 if the clip leaves it at the bind pose
+};
+
+inline glm::mat4 ToGlm(const aiMatrix4x4 &m)
+{
+    return glm::transpose(glm::make_mat4(&m.a1)); // aiMatrix4x4 is row major
+}
+
+// appends node and its subtree, parents first
+inline void ImportSkeletonNode(const aiNode *node, int parent, Skeleton &skeleton)
+{
+    SkeletonNode entry;
+    entry.name = node->mName.C_Str();
+    entry.parent = parent;
+    entry.transform = ToGlm(node->mTransformation);
+    skeleton.nodes.push_back(entry);
+    unsigned int index = (unsigned int)skeleton.nodes.size() - 1;
+    skeleton.nodeIndex.insert(std::make_pair(entry.name, index)); // duplicate names keep the first node
+    for(unsigned int i = 0; i < node->mNumChildren; i++)
+        ImportSkeletonNode(node->mChildren[i], (int)index, skeleton);
+}
+
+// builds the node hierarchy and the bone table of every mesh in the scene. Bones are numbered in the order the
+// meshes list them, the same bone shared by several meshes once. Leaves the bones empty if no mesh is rigged.
+inline void ImportSkeleton(const aiScene *scene, Skeleton &skeleton)
+{
+    ImportSkeletonNode(scene->mRootNode, -1, skeleton);
+    skeleton.globalInverse = glm::inverse(skeleton.nodes[0].transform);
+    for(unsigned int m = 0; m < scene->mNumMeshes; m++)
+        for(unsigned int b = 0; b < scene->mMeshes[m]->mNumBones; b++)
+            skeleton.addBone(scene->mMeshes[m]->mBones[b]->mName.C_Str(), ToGlm(scene->mMeshes[m]->mBones[b]->mOffsetMatrix));
+}
+
+// converts the scene's animations, resolving their channels to skeleton nodes
+inline void ImportAnimations(const aiScene *scene, const Skeleton &skeleton, std::vector<AnimationClip> &clips)
+{
+    for(unsigned int a = 0; a < scene->mNumAnimations; a++)
+    {
+        const aiAnimation *animation = scene->mAnimations[a];
+        AnimationClip clip;
+        clip.name = animation->mName.C_Str();
+        clip.duration = (float)animation->mDuration;
+        clip.ticksPerSecond = animation->mTicksPerSecond > 0.0 ? (float)animation->mTicksPerSecond : 25.0f;
+        clip.nodeChannel.assign(skeleton.nodes.size(), -1);
+        for(unsigned int c = 0; c < animation->mNumChannels; c++)
+        {
+            const aiNodeAnim *source = animation->mChannels[c];
+            int node = skeleton.findNode(source->mNodeName.C_Str());
+            if(node < 0 || !source->mNumPositionKeys || !source->mNumRotationKeys || !source->mNumScalingKeys)
+                continue;
+            AnimationChannel channel;
+            channel.node = (unsigned int)node;
+            for(unsigned int k = 0; k < source->mNumPositionKeys; k++)
+            {
+                const aiVectorKey &key = source->mPositionKeys[k];
+                channel.positions.add((float)key.mTime, glm::vec3(key.mValue.x, key.mValue.y, key.mValue.z));
+            }
+            for(unsigned int k = 0; k < source->mNumRotationKeys; k++)
+            {
+                const aiQuatKey &key = source->mRotationKeys[k];
+                channel.rotations.add((float)key.mTime, glm::quat(key.mValue.w, key.mValue.x, key.mValue.y, key.mValue.z));
+            }
+            for(unsigned int k = 0; k < source->mNumScalingKeys; k++)
+            {
+                const aiVectorKey &key = source->mScalingKeys[k];
+                channel.scales.add((float)key.mTime, glm::vec3(key.mValue.x, key.mValue.y, key.mValue.z));
+            }
+            clip.nodeChannel[node] = (int)clip.channels.size();
+            clip.channels.push_back(channel);
+        }
+        clips.push_back(clip);
+    }
+}
+
+// adds an influence to a vertex, keeping the MAX_BONE_INFLUENCES strongest in descending order
+inline void AddBoneInfluence(SkinnedVertex &vertex, unsigned int bone, float weight)
+{
+    int slot = MAX_BONE_INFLUENCES;
+    while(slot > 0 && vertex.Weights[slot - 1] < weight)
+        slot--;
+    if(slot == (int)MAX_BONE_INFLUENCES)
+        return;
+    for(int i = MAX_BONE_INFLUENCES - 1; i > slot; i--)
+    {
+        vertex.Bones[i] = vertex.Bones[i - 1];
+        vertex.Weights[i] = vertex.Weights[i - 1];
+    }
+    vertex.Bones[slot] = (float)bone;
+    vertex.Weights[slot] = weight;
+}
+
+// fills the influences of a mesh's vertices (already converted, Bones/Weights zero) from its aiBones. Vertices left
+// without any weight (all of them if the mesh isn't rigged) follow fallbackBone rigidly. Pure CPU work: safe to run on
+// any thread.
+inline void ImportBoneWeights(const aiMesh *mesh, const Skeleton &skeleton, unsigned int fallbackBone, std::vector<SkinnedVertex> &vertices)
+{
+    for(unsigned int b = 0; b < mesh->mNumBones; b++)
+    {
+        const aiBone *bone = mesh->mBones[b];
+        unsigned int index = skeleton.boneIndex.at(bone->mName.C_Str());
+        for(unsigned int w = 0; w < bone->mNumWeights; w++)
+            if(bone->mWeights[w].mVertexId < vertices.size() && bone->mWeights[w].mWeight > 0.0f)
+                AddBoneInfluence(vertices[bone->mWeights[w].mVertexId], index, bone->mWeights[w].mWeight);
+    }
+    for(size_t i = 0; i < vertices.size(); i++)
+    {
+        glm::vec4 &weights = vertices[i].Weights;
+        float sum = weights.x + weights.y + weights.z + weights.w;
+        if(sum > 0.0f)
+            weights /= sum;
+        else
+        {
+            vertices[i].Bones = glm::vec4((float)fallbackBone, 0.0f, 0.0f, 0.0f);
+            weights = glm::vec4(1.0f, 0.0f, 0.0f, 0.0f);
+        }
+    }
+}
+
+// splits pipeline output back into the plain vertices the Mesh keeps and the influences skinning reads
+inline void SplitSkinnedVertices(const std::vector<SkinnedVertex> &skinned, std::vector<Vertex> &vertices, std::vector<BoneInfluence> &influences)
+{
+    vertices.resize(skinned.size());
+    influences.resize(skinned.size());
+    for(size_t i = 0; i < skinned.size(); i++)
+    {
+        const SkinnedVertex &s = skinned[i];
+        vertices[i].Position = s.Position;
+        vertices[i].Normal = s.Normal;
+        vertices[i].TexCoords = s.TexCoords;
+        vertices[i].Tangent = s.Tangent;
+        vertices[i].Bitangent = s.Bitangent;
+        for(unsigned int j = 0; j < MAX_BONE_INFLUENCES; j++)
+        {
+            influences[i].bones[j] = (uint16_t)s.Bones[j];
+            influences[i].weights[j] = s.Weights[j];
+        }
+    }
+}
+
+// index of the key at or before time (0 before the first key), by binary search
+inline size_t FindAnimationKey(const std::vector<float> &times, float time)
+{
+    size_t upper = std::upper_bound(times.begin(), times.end(), time) - times.begin();
+    return upper ? upper - 1 : 0;
+}
+
+// factor between key index and the next one at time, clamped to [0, 1]
+inline float AnimationKeyFactor(const std::vector<float> &times, size_t index, float time)
+{
+    if(index + 1 >= times.size())
+        return 0.0f;
+    float span = times[index + 1] - times[index];
+    return span > 0.0f ? glm::clamp((time - times[index]) / span, 0.0f, 1.0f) : 0.0f;
+}
+
+// value of a track at time, given the key at or before it
+inline glm::vec3 InterpolateTrack(const AnimationTrack<glm::vec3> &track, size_t key, float time)
+{
+    float f = AnimationKeyFactor(track.times, key, time);
+    return f > 0.0f ? glm::mix(track.values[key], track.values[key + 1], f) : track.values[key];
+}
+
+inline glm::quat InterpolateTrack(const AnimationTrack<glm::quat> &track, size_t key, float time)
+{
+    float f = AnimationKeyFactor(track.times, key, time);
+    return f > 0.0f ? glm::normalize(glm::slerp(track.values[key], track.values[key + 1], f)) : track.values[key];
+}
+
+template<typename T>
+T SampleTrack(const AnimationTrack<T> &track, float time)
+{
+    return InterpolateTrack(track, FindAnimationKey(track.times, time), time);
+}
+
+// translation * rotation * scale, the order Assimp composes a node transform in
+inline glm::mat4 ComposeTransform(const glm::vec3 &position, const glm::quat &rotation, const glm::vec3 &scale)
+{
+    glm::mat4 m = glm::mat4_cast(rotation);
+    m[0] *= scale.x;
+    m[1] *= scale.y;
+    m[2] *= scale.z;
+    m[3] = glm::vec4(position, 1.0f);
+    return m;
+}
+
+// seconds into a clip of duration ticks in ticks, wrapped into [0, duration) so the clip loops
+inline float LoopTicks(float seconds, float duration, float ticksPerSecond)
+{
+    float ticks = seconds * ticksPerSecond;
+    if(duration > 0.0f)
+    {
+        ticks = std::fmod(ticks, duration);
+        if(ticks < 0.0f)
+            ticks += duration;
+    }
+    return ticks;
+}
+
+// LoopTicks of clip
+inline float ClipTicks(const AnimationClip &clip, float seconds)
+{
+    return LoopTicks(seconds, clip.duration, clip.ticksPerSecond);
+}
+
+// local transform of every skeleton node seconds into clip (looping); nodes the clip doesn't animate keep their
+// bind pose. Binary searches every track: fine for one pose, animation_sampler.h plays many instances cheaper
+inline void SampleClip(const AnimationClip &clip, const Skeleton &skeleton, float seconds, std::vector<glm::mat4> &local)
+{
+    float ticks = ClipTicks(clip, seconds);
+    local.resize(skeleton.nodes.size());
+    for(size_t i = 0; i < skeleton.nodes.size(); i++)
+    {
+        int c = i < clip.nodeChannel.size() ? clip.nodeChannel[i] : -1;
+        if(c < 0)
+        {
+            local[i] = skeleton.nodes[i].transform;
+            continue;
+        }
+        const AnimationChannel &channel = clip.channels[c];
+        local[i] = ComposeTransform(SampleTrack(channel.positions, ticks), SampleTrack(channel.rotations, ticks),
+                                    SampleTrack(channel.scales, ticks));
+    }
+}
+
+// composes the local transforms into global ones (one pass, parents come first) and writes the skinning matrix of
+// every bone: mesh space bind pose -> posed model space
+inline void BuildSkinPalette(const Skeleton &skeleton, const std::vector<glm::mat4> &local, std::vector<glm::mat4> &global,
+                             std::vector<glm::mat4> &palette)
+{
+    global.resize(skeleton.nodes.size());
+    for(size_t i = 0; i < skeleton.nodes.size(); i++)
+    {
+        int parent = skeleton.nodes[i].parent;
+        global[i] = parent < 0 ? local[i] : global[parent] * local[i];
+    }
+    palette.resize(skeleton.bones.size());
+    for(size_t b = 0; b < skeleton.bones.size(); b++)
+        palette[b] = skeleton.globalInverse * global[skeleton.bones[b].node] * skeleton.bones[b].offset;
+}
+
+// the palette of the bind pose itself (every matrix the identity, up to rounding)
+inline void BuildBindPalette(const Skeleton &skeleton, std::vector<glm::mat4> &global, std::vector<glm::mat4> &palette)
+{
+    std::vector<glm::mat4> local(skeleton.nodes.size());
+    for(size_t i = 0; i < skeleton.nodes.size(); i++)
+        local[i] = skeleton.nodes[i].transform;
+    BuildSkinPalette(skeleton, local, global, palette);
+}
+#endif
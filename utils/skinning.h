@@ -0,0 +1,273 @@
+#ifndef SKINNING_H
+#define SKINNING_H
+
+#include <GL/gl3w.h> // here: we need compile gl3w.c - utils dir
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <mesh.h>
+#include <skeleton.h>
+#include <gl_state.h>
+#include <uniform_ring.h>
+#include <thread_pool.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+#include <vector>
+
+// SSE kernel on x86 unless SKINNING_SCALAR is defined; plain glm everywhere else
+#if !defined(SKINNING_SCALAR) && (defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1))
+#define SKINNING_SSE
+#include <xmmintrin.h>
+#endif
+
+// where a rigged model's vertices are moved to their pose
+enum SkinningMode {
+    SKINNING_CPU,   // SkinVertices across a thread pool, written into a streaming vertex buffer; any shader draws it
+    SKINNING_GPU    // the bone palette goes to a uniform block; needs 1.model_loading.vs built with SKINNED
+};
+
+// bones the SKINNED shader's SkinBlock holds (its MAX_SKIN_BONES): 256 mat4 fill the 16 KB every GL 3.3
+// implementation supports for a uniform block
+const unsigned int MAX_SKIN_BONES = 256;
+
+// vertices per task when skinning across a thread pool: a few hundred KB of output, enough to hide the scheduling
+const size_t SKINNING_CHUNK = 4096;
+
+// reference kernel: out[i] is bind[i] moved by the weighted sum of its bones' palette matrices. Normals, tangents
+// and bitangents go through the blended matrix as it is; the shader normalises them.
+inline void SkinVerticesScalar(const Vertex *bind, const BoneInfluence *influences, const glm::mat4 *palette, Vertex *out, size_t count)
+{
+    for(size_t i = 0; i < count; i++)
+    {
+        const BoneInfluence &influence = influences[i];
+        glm::mat4 skin = palette[influence.bones[0]] * influence.weights[0];
+        for(unsigned int j = 1; j < MAX_BONE_INFLUENCES && influence.weights[j] > 0.0f; j++)
+            skin += palette[influence.bones[j]] * influence.weights[j];
+        glm::mat3 rotation = glm::mat3(skin);
+        out[i].Position = glm::vec3(skin * glm::vec4(bind[i].Position, 1.0f));
+        out[i].Normal = rotation * bind[i].Normal;
+        out[i].TexCoords = bind[i].TexCoords;
+        out[i].Tangent = rotation * bind[i].Tangent;
+        out[i].Bitangent = rotation * bind[i].Bitangent;
+    }
+}
+
+#ifdef SKINNING_SSE
+// writes the xyz of v to p[0..2] (a Vertex field is only 3 floats, so a 4 wide store would run into the next one)
+inline void SkinStore3(float *p, __m128 v)
+{
+    _mm_storel_pi((__m64*)p, v);
+    _mm_store_ss(p + 2, _mm_movehl_ps(v, v));
+}
+
+// columns c0..c2 times (x, y, z)
+inline __m128 SkinTransform3(__m128 c0, __m128 c1, __m128 c2, const glm::vec3 &v)
+{
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(v.x)), _mm_mul_ps(c1, _mm_set1_ps(v.y))), _mm_mul_ps(c2, _mm_set1_ps(v.z)));
+}
+#endif
+
+// SkinVerticesScalar with the matrix blend and the four transforms done on whole columns. Influences are sorted
+// strongest first, so the blend stops at the first zero weight. out may be write-combined (a mapped buffer): every
+// byte of it is written once, in order.
+inline void SkinVertices(const Vertex *bind, const BoneInfluence *influences, const glm::mat4 *palette, Vertex *out, size_t count)
+{
+#ifdef SKINNING_SSE
+    const float *matrices = glm::value_ptr(palette[0]);
+    for(size_t i = 0; i < count; i++)
+    {
+        const BoneInfluence &influence = influences[i];
+        const float *m = matrices + 16 * influence.bones[0];
+        __m128 w = _mm_set1_ps(influence.weights[0]);
+        __m128 c0 = _mm_mul_ps(w, _mm_loadu_ps(m));
+        __m128 c1 = _mm_mul_ps(w, _mm_loadu_ps(m + 4));
+        __m128 c2 = _mm_mul_ps(w, _mm_loadu_ps(m + 8));
+        __m128 c3 = _mm_mul_ps(w, _mm_loadu_ps(m + 12));
+        for(unsigned int j = 1; j < MAX_BONE_INFLUENCES && influence.weights[j] > 0.0f; j++)
+        {
+            m = matrices + 16 * influence.bones[j];
+            w = _mm_set1_ps(influence.weights[j]);
+            c0 = _mm_add_ps(c0, _mm_mul_ps(w, _mm_loadu_ps(m)));
+            c1 = _mm_add_ps(c1, _mm_mul_ps(w, _mm_loadu_ps(m + 4)));
+            c2 = _mm_add_ps(c2, _mm_mul_ps(w, _mm_loadu_ps(m + 8)));
+            c3 = _mm_add_ps(c3, _mm_mul_ps(w, _mm_loadu_ps(m + 12)));
+        }
+        const Vertex &v = bind[i];
+        Vertex &o = out[i];
+        SkinStore3(&o.Position.x, _mm_add_ps(SkinTransform3(c0, c1, c2, v.Position), c3));
+        SkinStore3(&o.Normal.x, SkinTransform3(c0, c1, c2, v.Normal));
+        o.TexCoords = v.TexCoords;
+        SkinStore3(&o.Tangent.x, SkinTransform3(c0, c1, c2, v.Tangent));
+        SkinStore3(&o.Bitangent.x, SkinTransform3(c0, c1, c2, v.Bitangent));
+    }
+#else
+    SkinVerticesScalar(bind, influences, palette, out, count);
+#endif
+}
+
+// SkinVertices split into SKINNING_CHUNK sized tasks over pool (the calling thread works too); serial without a pool
+inline void SkinVerticesParallel(const Vertex *bind, const BoneInfluence *influences, const glm::mat4 *palette, Vertex *out, size_t count,
+                                 ThreadPool *pool, size_t chunk = SKINNING_CHUNK)
+{
+    if(!pool || pool->size() == 0 || count <= chunk)
+    {
+        SkinVertices(bind, influences, palette, out, count);
+        return;
+    }
+    pool->parallelFor((count + chunk - 1) / chunk, [=](size_t c) {
+        size_t first = c * chunk;
+        SkinVertices(bind + first, influences + first, palette, out + first, std::min(chunk, count - first));
+    });
+}
+
+// The GL side of a rigged model: all its meshes in one vertex buffer and one 32-bit index buffer (LOD levels
+// included) behind one VAO, so skinned draws keep merging into multi-draws. The meshes' packets are pointed at it.
+//
+// SKINNING_CPU: the vertex buffer is GL_STREAM_DRAW; pose() orphans it (glMapBufferRange with
+//               GL_MAP_INVALIDATE_BUFFER_BIT) and the skinning tasks write the posed vertices straight into the mapping.
+// SKINNING_GPU: the vertex buffer holds the bind pose, a second one the BoneInfluences (attributes 9 and 10), and
+//               pose() uploads the palette to a uniform buffer that bindPalette() binds to UNIFORM_BLOCK_SKIN.
+class SkinnedGeometry
+{
+public:
+    // influences[i] belongs to meshes[i].vertices. The meshes were built with MESH_STORAGE_EXTERNAL: these buffers are
+    // their only GPU copy
+    SkinnedGeometry(vector<Mesh> &meshes, const vector< vector<BoneInfluence> > &influences, SkinningMode mode)
+        : skinning(mode), vao(0), vbo(0), influenceVbo(0), ebo(0), paletteUbo(0), bufferBytes(0)
+    {
+        vector<unsigned int> indices;
+        for(size_t i = 0; i < meshes.size(); i++)
+        {
+            Mesh &mesh = meshes[i];
+            DrawPacket &packet = mesh.packet;
+            packet.vao = 0; // set below, once it exists
+            packet.indexType = GL_UNSIGNED_INT;
+            packet.indexOffset = (GLintptr)(indices.size() * sizeof(unsigned int));
+            packet.baseVertex = (GLint)bindVertices.size();
+            packet.positionScale = glm::vec3(1.0f);
+            packet.positionBias = glm::vec3(0.0f);
+            mesh.indexType = GL_UNSIGNED_INT; // lodPacket offsets into this buffer now
+            indices.insert(indices.end(), mesh.indices.begin(), mesh.indices.end());
+            indices.insert(indices.end(), mesh.lodChain.indices.begin(), mesh.lodChain.indices.end());
+            bindVertices.insert(bindVertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+            vertexInfluences.insert(vertexInfluences.end(), influences[i].begin(), influences[i].end());
+        }
+
+        GLStateCache &state = SharedGLState();
+        glGenVertexArrays(1, &vao);
+        glGenBuffers(1, &vbo);
+        glGenBuffers(1, &ebo);
+        state.bindVertexArray(vao);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+        // until the first pose() the streaming buffer shows the bind pose too
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBufferData(GL_ARRAY_BUFFER, bindVertices.size() * sizeof(Vertex), bindVertices.data(), mode == SKINNING_CPU ? GL_STREAM_DRAW : GL_STATIC_DRAW);
+        bufferBytes = indices.size() * sizeof(unsigned int) + bindVertices.size() * sizeof(Vertex);
+        SetFloatVertexAttributes();
+        if(mode == SKINNING_GPU)
+        {
+            glGenBuffers(1, &influenceVbo);
+            glBindBuffer(GL_ARRAY_BUFFER, influenceVbo);
+            glBufferData(GL_ARRAY_BUFFER, vertexInfluences.size() * sizeof(BoneInfluence), vertexInfluences.data(), GL_STATIC_DRAW);
+            bufferBytes += vertexInfluences.size() * sizeof(BoneInfluence) + MAX_SKIN_BONES * sizeof(glm::mat4);
+            glEnableVertexAttribArray(9);
+            glVertexAttribIPointer(9, 4, GL_UNSIGNED_SHORT, sizeof(BoneInfluence), (void*)offsetof(BoneInfluence, bones));
+            glEnableVertexAttribArray(10);
+            glVertexAttribPointer(10, 4, GL_FLOAT, GL_FALSE, sizeof(BoneInfluence), (void*)offsetof(BoneInfluence, weights));
+
+            glGenBuffers(1, &paletteUbo);
+            glBindBuffer(GL_UNIFORM_BUFFER, paletteUbo);
+            glBufferData(GL_UNIFORM_BUFFER, MAX_SKIN_BONES * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        }
+        state.bindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        for(size_t i = 0; i < meshes.size(); i++)
+            meshes[i].packet.vao = vao;
+        if(mode == SKINNING_GPU)
+        {
+            unsigned int bones = 0;
+            for(size_t i = 0; i < vertexInfluences.size(); i++)
+                for(unsigned int j = 0; j < MAX_BONE_INFLUENCES; j++)
+                    bones = std::max(bones, vertexInfluences[i].bones[j] + 1u);
+            if(bones > MAX_SKIN_BONES)
+                cout << "ERROR::SKINNING::TOO_MANY_BONES " << bones << " bones, SKINNING_GPU holds " << MAX_SKIN_BONES << endl;
+            vector<glm::mat4> identity(MAX_SKIN_BONES); // the bind pose until the first pose()
+            uploadPalette(identity.data(), identity.size());
+        }
+    }
+
+    ~SkinnedGeometry()
+    {
+        glDeleteVertexArrays(1, &vao);
+        glDeleteBuffers(1, &vbo);
+        glDeleteBuffers(1, &influenceVbo);
+        glDeleteBuffers(1, &ebo);
+        glDeleteBuffers(1, &paletteUbo);
+        SharedGLState().invalidate(); // the cache may still name the VAO, or the palette at UNIFORM_BLOCK_SKIN
+    }
+
+    // moves the vertices to the pose of palette (one matrix per Skeleton bone, BuildSkinPalette): skins them across
+    // pool into the streaming buffer, or uploads the palette for the shader. The context thread only.
+    void pose(const glm::mat4 *palette, size_t boneCount, ThreadPool *pool)
+    {
+        if(skinning == SKINNING_GPU)
+        {
+            uploadPalette(palette, boneCount);
+            return;
+        }
+        if(bindVertices.empty())
+            return;
+        GLsizeiptr bytes = (GLsizeiptr)(bindVertices.size() * sizeof(Vertex));
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        Vertex *mapped = (Vertex*)glMapBufferRange(GL_ARRAY_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if(!mapped)
+        {
+            cout << "ERROR::SKINNING::MAP_FAILED" << endl;
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            return;
+        }
+        SkinVerticesParallel(bindVertices.data(), vertexInfluences.data(), palette, mapped, bindVertices.size(), pool);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // SKINNING_GPU: binds the palette to UNIFORM_BLOCK_SKIN for the draws that follow
+    void bindPalette()
+    {
+        if(paletteUbo)
+            SharedGLState().bindUniformBuffer(UNIFORM_BLOCK_SKIN, paletteUbo, 0, (GLsizeiptr)(MAX_SKIN_BONES * sizeof(glm::mat4)));
+    }
+
+    SkinningMode mode() const { return skinning; }
+    size_t vertexCount() const { return bindVertices.size(); }
+    GLuint vertexArray() const { return vao; }
+    size_t cpuBytes() const { return bindVertices.capacity() * sizeof(Vertex) + vertexInfluences.capacity() * sizeof(BoneInfluence); }
+    size_t gpuBufferBytes() const { return bufferBytes; }
+
+private:
+    SkinningMode skinning;
+    vector<Vertex> bindVertices;            // all meshes, in packet order; what the CPU kernel reads
+    vector<BoneInfluence> vertexInfluences; // same order
+    GLuint vao, vbo, influenceVbo, ebo, paletteUbo;
+    size_t bufferBytes;                     // vertices, influences, indices and palette as created
+
+    // the first MAX_SKIN_BONES matrices of palette (the constructor reported it if vertices use more)
+    void uploadPalette(const glm::mat4 *palette, size_t boneCount)
+    {
+        boneCount = std::min(boneCount, (size_t)MAX_SKIN_BONES);
+        glBindBuffer(GL_UNIFORM_BUFFER, paletteUbo);
+        glBufferData(GL_UNIFORM_BUFFER, MAX_SKIN_BONES * sizeof(glm::mat4), NULL, GL_STREAM_DRAW); // orphan
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, boneCount * sizeof(glm::mat4), palette);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    SkinnedGeometry(const SkinnedGeometry&);
+    SkinnedGeometry &operator=(const SkinnedGeometry&);
+};
+#endif
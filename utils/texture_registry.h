@@ -0,0 +1,312 @@
+#ifndef TEXTURE_REGISTRY_H
+#define TEXTURE_REGISTRY_H
+
+#include <GL/gl3w.h> // here: we need compile gl3w.c - utils dir
+
+#ifndef STBI_INCLUDE_STB_IMAGE_H // this stb_image has no guard around its implementation part
+#include <stb_image.h>
+#endif
+#include <texture_streamer.h>
+#include <gl_state.h>
+
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#ifndef _WIN32
+#include <climits>
+#endif
+
+// Process-wide table of loaded 2D textures, shared by every Model.
+// A texture is looked up first by its canonical absolute path, then by a hash of the file contents, so the same
+// image referenced through different relative paths (or copied next to another model) is uploaded only once; a hash
+// match is only trusted after comparing the size and the bytes.
+// With a streamer, reading and hashing happen on its decoder threads, so a duplicate is only recognised after acquire
+// returned: its texture then becomes an alias of the earlier one (see resolve) and is never decoded.
+// Lookups are hash-table based; all calls must come from the GL context thread (the decoders lock the tables).
+class TextureRegistry
+{
+public:
+    struct Stats {
+        unsigned long pathHits;     // same canonical path seen before: no file access at all
+        unsigned long contentHits;  // new path, but identical bytes were loaded before: file read, no decode/upload
+        unsigned long misses;       // decoded and uploaded
+        unsigned long long bytesSaved; // decoded image bytes that did not have to be uploaded again
+    };
+
+    static TextureRegistry &shared()
+    {
+        static TextureRegistry registry;
+        return registry;
+    }
+
+    TextureRegistry() : generation(0) { std::memset(&counters, 0, sizeof(counters)); }
+
+    // returns the GL texture for the file, decoding and uploading it only if its contents were never seen before.
+    // With a streamer the decode happens in the background and a placeholder is bound meanwhile.
+    unsigned int acquire(const std::string &filename, TexturePlaceholder placeholder = PLACEHOLDER_GREY, TextureStreamer *streamer = nullptr)
+    {
+        std::string key = canonicalPath(filename);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::unordered_map<std::string, Entry>::const_iterator byPathIt = byPath.find(key);
+            if (byPathIt != byPath.end())
+            {
+                counters.pathHits++;
+                counters.bytesSaved += byPathIt->second.bytes;
+                return resolveLocked(byPathIt->second.id);
+            }
+        }
+
+        if (streamer)
+        {
+            unsigned int id = streamer->request(filename, placeholder,
+                [this, key](unsigned int textureID, const std::vector<unsigned char> &contents) { return admit(key, textureID, contents); });
+            std::lock_guard<std::mutex> lock(mutex);
+            byPath[key].id = id; // admit may have filled in the bytes already
+            return id;
+        }
+
+        std::vector<unsigned char> contents;
+        if (!ReadFileContents(key, contents))
+        {
+            std::cout << "Texture failed to load at path: " << filename << std::endl;
+            Entry missing;
+            missing.bytes = missing.fileSize = 0;
+            glGenTextures(1, &missing.id); // an empty texture, like TextureFromFile gives for a missing file
+            std::lock_guard<std::mutex> lock(mutex);
+            counters.misses++;
+            byPath[key] = missing;
+            return missing.id;
+        }
+
+        uint64_t hash = contentHash(contents.data(), contents.size());
+        Entry candidate;
+        bool indexed = findContent(hash, candidate);
+        if (indexed && sameContents(candidate, contents))
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            counters.contentHits++;
+            counters.bytesSaved += candidate.bytes;
+            byPath[key] = candidate;
+            return candidate.id;
+        }
+
+        Entry entry;
+        entry.bytes = imageBytes(contents);
+        entry.path = key;
+        entry.fileSize = contents.size();
+        entry.id = textureFromMemory(filename, contents);
+        std::lock_guard<std::mutex> lock(mutex);
+        counters.misses++;
+        byPath[key] = entry;
+        if (!indexed)
+            byContent[hash] = entry; // on a hash collision the first file keeps the slot
+        return entry.id;
+    }
+
+    // the texture to bind for an id acquire returned: itself, or the earlier texture a streamed duplicate turned out
+    // to be. Model::updateTextures swaps its ids whenever aliasGeneration changes.
+    unsigned int resolve(unsigned int id) const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return resolveLocked(id);
+    }
+
+    // increases with every alias recorded
+    unsigned int aliasGeneration() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return generation;
+    }
+
+    Stats stats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return counters;
+    }
+
+    unsigned int uniqueTextures() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return (unsigned int)byContent.size();
+    }
+
+    // the GL textures of the unique images, for memory accounting
+    std::vector<unsigned int> textureIds() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<unsigned int> ids;
+        ids.reserve(byContent.size());
+        for (std::unordered_map<uint64_t, Entry>::const_iterator it = byContent.begin(); it != byContent.end(); ++it)
+            ids.push_back(it->second.id);
+        return ids;
+    }
+
+    void printStats(std::ostream &out) const
+    {
+        Stats current = stats();
+        out << "TEXTURE_REGISTRY:: " << uniqueTextures() << " unique textures, "
+            << current.pathHits << " path hits, " << current.contentHits << " content hits, "
+            << current.misses << " misses, " << (current.bytesSaved >> 10) << " KiB of uploads saved" << std::endl;
+    }
+
+    // absolute, normalised form of a path used as the registry key
+    static std::string canonicalPath(const std::string &path)
+    {
+        std::string result;
+#ifdef _WIN32
+        char buffer[_MAX_PATH];
+        result = _fullpath(buffer, path.c_str(), _MAX_PATH) ? buffer : path;
+        for (unsigned int i = 0; i < result.size(); i++)
+        {
+            // NTFS paths are case-insensitive
+            result[i] = result[i] == '\\' ? '/' : (char)std::tolower((unsigned char)result[i]);
+        }
+#else
+        char buffer[PATH_MAX];
+        result = realpath(path.c_str(), buffer) ? buffer : path;
+#endif
+        return result;
+    }
+
+    // 64-bit FNV-1a style hash, folded over 8-byte words for speed
+    static uint64_t contentHash(const unsigned char *data, size_t size)
+    {
+        uint64_t hash = 14695981039346656037ULL;
+        const uint64_t prime = 1099511628211ULL;
+        size_t i = 0;
+        for (; i + 8 <= size; i += 8)
+        {
+            uint64_t word;
+            std::memcpy(&word, data + i, 8);
+            hash = (hash ^ word) * prime;
+            hash ^= hash >> 29;
+        }
+        for (; i < size; i++)
+            hash = (hash ^ data[i]) * prime;
+        return (hash ^ size) * prime;
+    }
+
+private:
+    struct Entry {
+        unsigned int id;
+        size_t bytes;       // decoded base level size
+        std::string path;   // canonical path of the file the texture was decoded from
+        size_t fileSize;    // of that file
+    };
+
+    unsigned int resolveLocked(unsigned int id) const
+    {
+        std::unordered_map<unsigned int, unsigned int>::const_iterator it = aliases.find(id);
+        return it == aliases.end() ? id : it->second;
+    }
+
+    bool findContent(uint64_t hash, Entry &entry) const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::unordered_map<uint64_t, Entry>::const_iterator it = byContent.find(hash);
+        if (it == byContent.end())
+            return false;
+        entry = it->second;
+        return true;
+    }
+
+    // whether the file behind entry holds exactly contents; reads it again, so call it without the lock held
+    static bool sameContents(const Entry &entry, const std::vector<unsigned char> &contents)
+    {
+        std::vector<unsigned char> other;
+        return entry.fileSize == contents.size() && ReadFileContents(entry.path, other) && other == contents;
+    }
+
+    // decoder thread, for a streamed request: indexes the contents, or, if identical bytes were loaded before, makes
+    // textureID an alias of that texture and returns false so it is not decoded
+    bool admit(const std::string &key, unsigned int textureID, const std::vector<unsigned char> &contents)
+    {
+        uint64_t hash = contentHash(contents.data(), contents.size());
+        size_t bytes = imageBytes(contents);
+        Entry candidate;
+        if (!findContent(hash, candidate) || !sameContents(candidate, contents))
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            counters.misses++;
+            byPath[key].bytes = bytes;
+            Entry entry;
+            entry.id = textureID;
+            entry.bytes = bytes;
+            entry.path = key;
+            entry.fileSize = contents.size();
+            byContent.insert(std::make_pair(hash, entry)); // keeps an earlier file (another decoder, or a collision)
+            return true;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        counters.contentHits++;
+        counters.bytesSaved += bytes;
+        byPath[key].bytes = bytes;
+        aliases[textureID] = candidate.id;
+        generation++;
+        return false;
+    }
+
+    // decoded size from the image header only
+    static size_t imageBytes(const std::vector<unsigned char> &contents)
+    {
+        int width, height, components;
+        if (!stbi_info_from_memory(contents.data(), (int)contents.size(), &width, &height, &components))
+            return 0;
+        return (size_t)width * height * components;
+    }
+
+    // synchronous decode and upload, same texture setup as TextureFromFile
+    static unsigned int textureFromMemory(const std::string &filename, const std::vector<unsigned char> &contents)
+    {
+        unsigned int textureID;
+        glGenTextures(1, &textureID);
+
+        int width, height, nrComponents;
+        unsigned char *data = stbi_load_from_memory(contents.data(), (int)contents.size(), &width, &height, &nrComponents, 0);
+        if (data)
+        {
+            GLenum format = GL_RGB;
+            if (nrComponents == 1)
+                format = GL_RED;
+            else if (nrComponents == 3)
+                format = GL_RGB;
+            else if (nrComponents == 4)
+                format = GL_RGBA;
+
+            SharedGLState().bindTexture(0, GL_TEXTURE_2D, textureID);
+            glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+            glGenerateMipmap(GL_TEXTURE_2D);
+
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+            stbi_image_free(data);
+        }
+        else
+        {
+            std::cout << "Texture failed to load at path: " << filename << std::endl;
+        }
+        return textureID;
+    }
+
+    mutable std::mutex mutex; // guards everything below: streamed requests are admitted on decoder threads
+    std::unordered_map<std::string, Entry> byPath;
+    std::unordered_map<uint64_t, Entry> byContent;
+    std::unordered_map<unsigned int, unsigned int> aliases; // streamed duplicate -> texture it duplicates
+    unsigned int generation;
+    Stats counters;
+
+    TextureRegistry(const TextureRegistry&);
+    TextureRegistry &operator=(const TextureRegistry&);
+};
+#endif
@@ -0,0 +1,267 @@
+#ifndef TEXTURE_STREAMER_H
+#define TEXTURE_STREAMER_H
+
+#include <GL/gl3w.h> // here: we need compile gl3w.c - utils dir
+
+#ifndef STBI_INCLUDE_STB_IMAGE_H // this stb_image has no guard around its implementation part
+#include <stb_image.h>
+#endif
+#include <thread_pool.h>
+#include <gl_state.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// colour a texture shows until its real image has been uploaded
+enum TexturePlaceholder {
+    PLACEHOLDER_GREY,   // diffuse
+    PLACEHOLDER_FLAT,   // tangent-space normal map pointing straight up (0.5, 0.5, 1.0)
+    PLACEHOLDER_BLACK   // specular / height
+};
+
+// reads a whole file into contents; false if it is missing or empty
+inline bool ReadFileContents(const std::string &path, std::vector<unsigned char> &contents)
+{
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file)
+        return false;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (size <= 0)
+    {
+        fclose(file);
+        return false;
+    }
+    contents.resize((size_t)size);
+    size_t read = fread(contents.data(), 1, contents.size(), file);
+    fclose(file);
+    return read == contents.size();
+}
+
+// Streams textures in the background: stb_image decoding runs on worker threads, the decoded pixels come back to the
+// render thread through a bounded queue and are uploaded from update(), a limited number of bytes per frame.
+//
+// request() hands out the final GL texture name right away, backed by a 1x1 placeholder; the real image is later
+// uploaded into the same texture object, so meshes can keep the id they got at load time.
+// Everything except the decoding must be called on the thread that owns the GL context.
+class TextureStreamer
+{
+public:
+    // runs on a worker with the texture's file contents before they are decoded; returning false drops the image
+    // (the texture keeps its placeholder). TextureRegistry uses it to find duplicates off the render thread.
+    typedef std::function<bool(unsigned int textureID, const std::vector<unsigned char> &contents)> ContentFilter;
+
+    // maxQueuedBytes bounds the memory held by decoded-but-not-yet-uploaded images; decoders wait when it is full
+    explicit TextureStreamer(unsigned int workerCount = 0, size_t maxQueuedBytes = 256u * 1024u * 1024u)
+        : maxQueuedBytes(maxQueuedBytes), queuedBytes(0), outstanding(0), cancelled(false), uploadedBytes(0)
+    {
+        decoders.reset(new ThreadPool(workerCount));
+    }
+
+    ~TextureStreamer()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            cancelled = true;
+        }
+        spaceAvailable.notify_all();
+        decoders.reset(); // joins the workers; tasks that did not start yet see the cancel flag and return
+        for (unsigned int i = 0; i < ready.size(); i++)
+            stbi_image_free(ready[i].pixels);
+    }
+
+    // creates the texture object with a placeholder and queues the file for reading and decoding; returns the GL
+    // texture name. With a filter the whole file is read first and handed to it.
+    unsigned int request(const std::string &filename, TexturePlaceholder placeholder = PLACEHOLDER_GREY,
+                         ContentFilter filter = ContentFilter())
+    {
+        unsigned int textureID;
+        glGenTextures(1, &textureID);
+        uploadPlaceholder(textureID, placeholder);
+
+        outstanding++;
+        decoders->enqueue([this, filename, textureID, filter]() { decodeFile(filename, textureID, filter); });
+        return textureID;
+    }
+
+    // same, for a file whose (still encoded) contents were already read into memory
+    unsigned int request(const std::string &filename, std::vector<unsigned char> &&contents, TexturePlaceholder placeholder = PLACEHOLDER_GREY)
+    {
+        unsigned int textureID;
+        glGenTextures(1, &textureID);
+        uploadPlaceholder(textureID, placeholder);
+
+        outstanding++;
+        decoders->enqueue([this, filename, contents = std::move(contents), textureID]() { decode(filename, contents, textureID); });
+        return textureID;
+    }
+
+    // uploads decoded images until byteBudget bytes (base level) were sent this call; at least one image is
+    // uploaded whenever one is ready, so a single huge texture can't stall streaming. Returns the number uploaded.
+    unsigned int update(size_t byteBudget)
+    {
+        unsigned int uploaded = 0;
+        size_t spent = 0;
+        while (spent < byteBudget || uploaded == 0)
+        {
+            DecodedImage image;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (ready.empty())
+                    break;
+                image = ready.front();
+                ready.pop_front();
+                queuedBytes -= image.bytes;
+            }
+            spaceAvailable.notify_all();
+
+            upload(image);
+            spent += image.bytes;
+            uploaded++;
+        }
+        return uploaded;
+    }
+
+    // blocks until every requested texture has been uploaded (used where no frames are rendered meanwhile)
+    void finish()
+    {
+        while (pending() > 0)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                imageReady.wait(lock, [this]() { return !ready.empty() || outstanding.load() == 0; });
+            }
+            update((size_t)-1);
+        }
+    }
+
+    // requests not uploaded yet (decoding, queued or waiting for budget)
+    unsigned int pending() const { return outstanding.load(); }
+    // total bytes uploaded since creation
+    size_t bytesUploaded() const { return uploadedBytes; }
+
+private:
+    struct DecodedImage {
+        unsigned int textureID;
+        int width, height, components;
+        unsigned char *pixels; // owned, stbi_image_free'd after upload
+        size_t bytes;
+    };
+
+    // worker thread: read the file for the filter, then decode it unless the filter dropped it
+    void decodeFile(const std::string &filename, unsigned int textureID, const ContentFilter &filter)
+    {
+        if (!filter)
+        {
+            decode(filename, std::vector<unsigned char>(), textureID);
+            return;
+        }
+        std::vector<unsigned char> contents;
+        bool load = false;
+        if (!cancelled)
+        {
+            if (!ReadFileContents(filename, contents))
+                std::cout << "Texture failed to load at path: " << filename << std::endl;
+            else
+                load = filter(textureID, contents);
+        }
+        decode(filename, contents, textureID, load);
+    }
+
+    // worker thread: decode (from contents if given, else from the file, unless load is false) and wait for room in
+    // the queue. An image without pixels only retires its request.
+    void decode(const std::string &filename, const std::vector<unsigned char> &contents, unsigned int textureID, bool load = true)
+    {
+        DecodedImage image;
+        image.textureID = textureID;
+        image.pixels = nullptr;
+        image.width = image.height = image.components = 0;
+        image.bytes = 0;
+        if (load && !cancelled)
+        {
+            if (contents.empty())
+                image.pixels = stbi_load(filename.c_str(), &image.width, &image.height, &image.components, 0);
+            else
+                image.pixels = stbi_load_from_memory(contents.data(), (int)contents.size(), &image.width, &image.height, &image.components, 0);
+            if (image.pixels)
+                image.bytes = (size_t)image.width * image.height * image.components;
+            else
+                std::cout << "Texture failed to load at path: " << filename << std::endl;
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        // an image larger than the whole queue is let through alone instead of blocking forever
+        spaceAvailable.wait(lock, [&]() { return cancelled || queuedBytes == 0 || queuedBytes + image.bytes <= maxQueuedBytes; });
+        if (cancelled)
+        {
+            stbi_image_free(image.pixels);
+            return;
+        }
+        ready.push_back(image);
+        queuedBytes += image.bytes;
+        lock.unlock();
+        imageReady.notify_all();
+    }
+
+    // render thread: replace the placeholder with the decoded image
+    void upload(DecodedImage &image)
+    {
+        if (image.pixels)
+        {
+            GLenum format = GL_RGB;
+            if (image.components == 1)
+                format = GL_RED;
+            else if (image.components == 3)
+                format = GL_RGB;
+            else if (image.components == 4)
+                format = GL_RGBA;
+
+            SharedGLState().bindTexture(0, GL_TEXTURE_2D, image.textureID);
+            glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.pixels);
+            glGenerateMipmap(GL_TEXTURE_2D);
+            uploadedBytes += image.bytes;
+            stbi_image_free(image.pixels);
+        }
+        outstanding--; // a failed decode keeps its placeholder for good
+    }
+
+    static void uploadPlaceholder(unsigned int textureID, TexturePlaceholder placeholder)
+    {
+        static const unsigned char colors[3][4] = {
+            { 128, 128, 128, 255 },
+            { 128, 128, 255, 255 },
+            {   0,   0,   0, 255 }
+        };
+        SharedGLState().bindTexture(0, GL_TEXTURE_2D, textureID);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, colors[placeholder]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
+
+    std::unique_ptr<ThreadPool> decoders;
+    std::deque<DecodedImage> ready;
+    std::mutex mutex;
+    std::condition_variable spaceAvailable;
+    std::condition_variable imageReady;
+    size_t maxQueuedBytes;
+    size_t queuedBytes;
+    std::atomic<unsigned int> outstanding;
+    std::atomic<bool> cancelled;
+    size_t uploadedBytes;
+
+    TextureStreamer(const TextureStreamer&);
+    TextureStreamer &operator=(const TextureStreamer&);
+};
+#endif
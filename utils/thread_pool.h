@@ -0,0 +1,124 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A small fixed-size pool of worker threads for CPU-side loading work (mesh conversion, image decoding, ...).
+// Nothing submitted here may touch OpenGL: the GL context only lives on the thread that created the window.
+class ThreadPool
+{
+public:
+    // workerCount == 0 uses one worker per hardware thread
+    explicit ThreadPool(unsigned int workerCount = 0) : stopping(false)
+    {
+        if (workerCount == 0)
+            workerCount = defaultWorkerCount();
+        for (unsigned int i = 0; i < workerCount; i++)
+            workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wakeup.notify_all();
+        for (unsigned int i = 0; i < workers.size(); i++)
+            workers[i].join();
+    }
+
+    unsigned int size() const { return (unsigned int)workers.size(); }
+
+    static unsigned int defaultWorkerCount()
+    {
+        unsigned int n = std::thread::hardware_concurrency();
+        return n ? n : 1;
+    }
+
+    // queues a task; it runs on some worker at some later point
+    void enqueue(std::function<void()> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back(std::move(task));
+        }
+        wakeup.notify_one();
+    }
+
+    // runs body(i) for every i in [0, count) and returns once all of them finished.
+    // The calling thread helps out, so this also works (serially) on a pool with no free workers.
+    void parallelFor(size_t count, const std::function<void(size_t)> &body)
+    {
+        if (count == 0)
+            return;
+
+        struct Job {
+            std::atomic<size_t> next;
+            std::atomic<size_t> done;
+            std::mutex mutex;
+            std::condition_variable finished;
+        };
+        auto job = std::make_shared<Job>();
+        job->next = 0;
+        job->done = 0;
+
+        auto run = [job, count, &body]() {
+            size_t finishedHere = 0;
+            for (size_t i = job->next++; i < count; i = job->next++)
+            {
+                body(i);
+                finishedHere++;
+            }
+            if (finishedHere && job->done.fetch_add(finishedHere) + finishedHere == count)
+            {
+                std::lock_guard<std::mutex> lock(job->mutex);
+                job->finished.notify_all();
+            }
+        };
+
+        size_t helpers = workers.size() < count - 1 ? workers.size() : count - 1;
+        for (size_t i = 0; i < helpers; i++)
+            enqueue(run);
+        run();
+
+        std::unique_lock<std::mutex> lock(job->mutex);
+        job->finished.wait(lock, [&]() { return job->done.load() == count; });
+    }
+
+private:
+    void workerLoop()
+    {
+        for (;;)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wakeup.wait(lock, [this]() { return stopping || !tasks.empty(); });
+                if (stopping && tasks.empty())
+                    return;
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()> > tasks;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    bool stopping;
+
+    ThreadPool(const ThreadPool&);
+    ThreadPool &operator=(const ThreadPool&);
+};
+#endif
@@ -0,0 +1,302 @@
+#ifndef TRIANGLE_BVH_H
+#define TRIANGLE_BVH_H
+
+#include <glm/glm.hpp>
+
+#include <bvh.h>
+#include <thread_pool.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define TRIANGLE_BVH_SSE
+#include <xmmintrin.h>
+#endif
+
+// Ray casting against the triangles of one mesh, for picking. The tree is built with the binned SAH of bvh.h and then
+// collapsed into a 4-wide BVH: every node holds the boxes of up to four children side by side, so one SSE slab test
+// decides all four at once (plain loops where SSE is not available).
+
+// closest intersection found by TriangleBvh::intersect
+struct RayHit {
+    float distance;        // along the ray, in units of the direction's length
+    unsigned int triangle; // index of the triangle in the mesh, i.e. its vertices are indices[3 * triangle ...]
+    float u, v;            // barycentrics of the hit: position = (1 - u - v) * v0 + u * v1 + v * v2
+};
+
+// 128 bytes: the six bound arrays, then per child the node index (interior) or first triangle (leaf, count > 0).
+// Unused slots have an infinite box, so no ray ever enters them.
+struct Bvh4Node {
+    float minX[4], minY[4], minZ[4];
+    float maxX[4], maxY[4], maxZ[4];
+    unsigned int child[4];
+    unsigned int count[4];
+};
+
+class TriangleBvh
+{
+public:
+    static const unsigned int EMPTY_SLOT = 0xffffffffu;
+
+    // builds over the triangles indices[0..2], [3..5], ... of vertices (V needs a Position member). With a pool the
+    // triangle boxes and the SAH build are spread over its workers.
+    template<typename V>
+    void build(const std::vector<V> &vertices, const std::vector<unsigned int> &indices, ThreadPool *pool = nullptr)
+    {
+        size_t triangleCount = indices.size() / 3;
+        std::vector<BoundingBox> boxes(triangleCount);
+        auto boundTriangles = [&](size_t chunk) {
+            size_t end = std::min(triangleCount, (chunk + 1) * CHUNK_SIZE);
+            for (size_t i = chunk * CHUNK_SIZE; i < end; i++)
+            {
+                const glm::vec3 &a = vertices[indices[3 * i]].Position;
+                const glm::vec3 &b = vertices[indices[3 * i + 1]].Position;
+                const glm::vec3 &c = vertices[indices[3 * i + 2]].Position;
+                boxes[i].min = glm::min(a, glm::min(b, c));
+                boxes[i].max = glm::max(a, glm::max(b, c));
+            }
+        };
+        size_t chunks = (triangleCount + CHUNK_SIZE - 1) / CHUNK_SIZE;
+        if (pool)
+            pool->parallelFor(chunks, boundTriangles);
+        else
+        {
+            for (size_t chunk = 0; chunk < chunks; chunk++)
+                boundTriangles(chunk);
+        }
+
+        Bvh binary;
+        binary.build(boxes.data(), boxes.size(), pool);
+
+        // triangles in leaf order, so every leaf is one contiguous run
+        triangles.resize(triangleCount);
+        for (size_t i = 0; i < triangleCount; i++)
+        {
+            unsigned int t = binary.leafPrimitive((unsigned int)i);
+            const glm::vec3 &a = vertices[indices[3 * t]].Position;
+            triangles[i].v0 = a;
+            triangles[i].e1 = vertices[indices[3 * t + 1]].Position - a;
+            triangles[i].e2 = vertices[indices[3 * t + 2]].Position - a;
+            triangles[i].index = t;
+        }
+
+        nodes.clear();
+        if (!triangleCount)
+            return;
+        nodes.reserve(binary.nodeCount() / 2 + 1);
+        if (binary.node(0).count)
+        {
+            // a single leaf: still needs a node to hang it from
+            nodes.push_back(emptyNode());
+            setSlot(0, 0, binary.node(0), binary.node(0).first);
+        }
+        else
+            collapse(binary, 0);
+    }
+
+    // closest hit along origin + t * direction with t in [0, tMax); hit is only written on a hit. Triangles are hit from
+    // either side.
+    bool intersect(const glm::vec3 &origin, const glm::vec3 &direction, float tMax, RayHit &hit) const
+    {
+        if (nodes.empty())
+            return false;
+        glm::vec3 inverseDirection = 1.0f / direction;
+        bool found = false;
+        StackEntry stack[STACK_SIZE];
+        int top = 0;
+        stack[top].child = 0;
+        stack[top].count = 0;
+        stack[top++].tNear = 0.0f;
+        while (top > 0)
+        {
+            StackEntry entry = stack[--top];
+            if (entry.tNear >= tMax)
+                continue;
+            if (entry.count)
+            {
+                for (unsigned int i = entry.child; i < entry.child + entry.count; i++)
+                {
+                    if (intersectTriangle(triangles[i], origin, direction, tMax, hit))
+                        found = true;
+                }
+                continue;
+            }
+
+            const Bvh4Node &node = nodes[entry.child];
+            float tNear[4];
+            unsigned int hits = testChildren(node, origin, inverseDirection, tMax, tNear);
+            // push the children that were entered, farthest first so the nearest is popped next
+            unsigned int order[4], n = 0;
+            for (unsigned int c = 0; c < 4; c++)
+            {
+                if ((hits & (1u << c)) && node.child[c] != EMPTY_SLOT)
+                {
+                    unsigned int k = n++;
+                    while (k > 0 && tNear[order[k - 1]] < tNear[c])
+                    {
+                        order[k] = order[k - 1];
+                        k--;
+                    }
+                    order[k] = c;
+                }
+            }
+            for (unsigned int k = 0; k < n; k++)
+            {
+                stack[top].child = node.child[order[k]];
+                stack[top].count = node.count[order[k]];
+                stack[top++].tNear = tNear[order[k]];
+            }
+        }
+        return found;
+    }
+
+    size_t triangleCount() const { return triangles.size(); }
+    size_t nodeCount() const { return nodes.size(); }
+    size_t memoryBytes() const { return nodes.size() * sizeof(Bvh4Node) + triangles.size() * sizeof(Triangle); }
+
+private:
+    static const size_t CHUNK_SIZE = 16384; // triangles bounded per task
+    static const int STACK_SIZE = 4 * Bvh::MAX_DEPTH;
+
+    // precomputed for Moller-Trumbore
+    struct Triangle {
+        glm::vec3 v0, e1, e2;
+        unsigned int index;
+    };
+    struct StackEntry {
+        unsigned int child;
+        unsigned int count;
+        float tNear;
+    };
+
+    std::vector<Bvh4Node> nodes;
+    std::vector<Triangle> triangles;
+
+    static Bvh4Node emptyNode()
+    {
+        Bvh4Node node;
+        const float inf = std::numeric_limits<float>::infinity();
+        for (int c = 0; c < 4; c++)
+        {
+            node.minX[c] = node.minY[c] = node.minZ[c] = inf;
+            node.maxX[c] = node.maxY[c] = node.maxZ[c] = inf;
+            node.child[c] = EMPTY_SLOT;
+            node.count[c] = 0;
+        }
+        return node;
+    }
+
+    void setSlot(unsigned int index, unsigned int slot, const BvhNode &source, unsigned int child)
+    {
+        Bvh4Node &node = nodes[index];
+        node.minX[slot] = source.min.x; node.minY[slot] = source.min.y; node.minZ[slot] = source.min.z;
+        node.maxX[slot] = source.max.x; node.maxY[slot] = source.max.y; node.maxZ[slot] = source.max.z;
+        node.child[slot] = child;
+        node.count[slot] = source.count;
+    }
+
+    // turns the binary interior node into a 4-wide node: its two children are opened, largest surface area first,
+    // until there are four slots or only leaves left. Returns the new node's index.
+    unsigned int collapse(const Bvh &binary, unsigned int source)
+    {
+        unsigned int slots[4] = { binary.node(source).first, binary.node(source).first + 1, 0, 0 };
+        unsigned int used = 2;
+        while (used < 4)
+        {
+            int widest = -1;
+            float widestArea = -1.0f;
+            for (unsigned int s = 0; s < used; s++)
+            {
+                const BvhNode &candidate = binary.node(slots[s]);
+                BoundingBox box;
+                box.min = candidate.min;
+                box.max = candidate.max;
+                if (!candidate.count && boxArea(box) > widestArea)
+                {
+                    widest = (int)s;
+                    widestArea = boxArea(box);
+                }
+            }
+            if (widest < 0)
+                break;
+            unsigned int opened = slots[widest];
+            slots[widest] = binary.node(opened).first;
+            slots[used++] = binary.node(opened).first + 1;
+        }
+
+        unsigned int index = (unsigned int)nodes.size();
+        nodes.push_back(emptyNode());
+        for (unsigned int s = 0; s < used; s++)
+        {
+            const BvhNode &child = binary.node(slots[s]);
+            unsigned int target = child.count ? child.first : collapse(binary, slots[s]);
+            setSlot(index, s, child, target);
+        }
+        return index;
+    }
+
+    // slab test of the ray against the four child boxes; bit c of the result is set if child c is entered before tMax
+    static unsigned int testChildren(const Bvh4Node &node, const glm::vec3 &origin, const glm::vec3 &inverseDirection, float tMax, float tNear[4])
+    {
+#ifdef TRIANGLE_BVH_SSE
+        __m128 ox = _mm_set1_ps(origin.x), oy = _mm_set1_ps(origin.y), oz = _mm_set1_ps(origin.z);
+        __m128 ix = _mm_set1_ps(inverseDirection.x), iy = _mm_set1_ps(inverseDirection.y), iz = _mm_set1_ps(inverseDirection.z);
+        __m128 x0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minX), ox), ix);
+        __m128 x1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxX), ox), ix);
+        __m128 y0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minY), oy), iy);
+        __m128 y1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxY), oy), iy);
+        __m128 z0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minZ), oz), iz);
+        __m128 z1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxZ), oz), iz);
+        __m128 enter = _mm_max_ps(_mm_max_ps(_mm_min_ps(x0, x1), _mm_min_ps(y0, y1)), _mm_max_ps(_mm_min_ps(z0, z1), _mm_setzero_ps()));
+        __m128 exit = _mm_min_ps(_mm_min_ps(_mm_max_ps(x0, x1), _mm_max_ps(y0, y1)), _mm_min_ps(_mm_max_ps(z0, z1), _mm_set1_ps(tMax)));
+        _mm_storeu_ps(tNear, enter);
+        return (unsigned int)_mm_movemask_ps(_mm_cmple_ps(enter, exit));
+#else
+        unsigned int hits = 0;
+        for (int c = 0; c < 4; c++)
+        {
+            float x0 = (node.minX[c] - origin.x) * inverseDirection.x, x1 = (node.maxX[c] - origin.x) * inverseDirection.x;
+            float y0 = (node.minY[c] - origin.y) * inverseDirection.y, y1 = (node.maxY[c] - origin.y) * inverseDirection.y;
+            float z0 = (node.minZ[c] - origin.z) * inverseDirection.z, z1 = (node.maxZ[c] - origin.z) * inverseDirection.z;
+            float enter = std::max(std::max(std::min(x0, x1), std::min(y0, y1)), std::max(std::min(z0, z1), 0.0f));
+            float exit = std::min(std::min(std::max(x0, x1), std::max(y0, y1)), std::min(std::max(z0, z1), tMax));
+            tNear[c] = enter;
+            if (enter <= exit)
+                hits |= 1u << c;
+        }
+        return hits;
+#endif
+    }
+
+    // Moller-Trumbore; on a hit closer than tMax updates hit and shrinks tMax
+    static bool intersectTriangle(const Triangle &triangle, const glm::vec3 &origin, const glm::vec3 &direction, float &tMax, RayHit &hit)
+    {
+        glm::vec3 p = glm::cross(direction, triangle.e2);
+        float determinant = glm::dot(triangle.e1, p);
+        if (determinant == 0.0f)
+            return false;
+        float inverse = 1.0f / determinant;
+        glm::vec3 s = origin - triangle.v0;
+        float u = glm::dot(s, p) * inverse;
+        if (u < 0.0f || u > 1.0f)
+            return false;
+        glm::vec3 q = glm::cross(s, triangle.e1);
+        float v = glm::dot(direction, q) * inverse;
+        if (v < 0.0f || u + v > 1.0f)
+            return false;
+        float t = glm::dot(triangle.e2, q) * inverse;
+        if (t < 0.0f || t >= tMax)
+            return false;
+        tMax = t;
+        hit.distance = t;
+        hit.triangle = triangle.index;
+        hit.u = u;
+        hit.v = v;
+        return true;
+    }
+};
+#endif
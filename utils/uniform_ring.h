@@ -0,0 +1,235 @@
+#ifndef UNIFORM_RING_H
+#define UNIFORM_RING_H
+
+#include <GL/gl3w.h> // here: we need compile gl3w.c - utils dir
+
+#include <glm/glm.hpp>
+
+#include <gl_state.h>
+#include <shader.h>
+
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+// uniform buffer binding points of the blocks of 1.model_loading.vs/.fs built with UNIFORM_BLOCKS
+const GLuint UNIFORM_BLOCK_FRAME = 0;
+const GLuint UNIFORM_BLOCK_DRAW = 1;
+// the bone palette of SKINNED (utils/skinning.h); a buffer of its own, not part of the ring
+const GLuint UNIFORM_BLOCK_SKIN = 2;
+
+// std140 mirror of FrameBlock: camera and lighting, written once per frame. A vec3 followed by a float fills one
+// 16 byte slot in std140 exactly as glm lays them out, so the structs can be copied into the buffer as they are.
+struct FrameUniforms {
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::vec3 viewPos;
+    float lerpIntensity;
+    glm::vec3 lightPos;
+    float reserved0;
+    glm::vec3 lightColor;
+    float reserved1;
+    glm::vec3 matColor;
+    float reserved2;
+};
+static_assert(sizeof(FrameUniforms) == 192, "FrameUniforms must match the std140 FrameBlock");
+
+// std140 mirror of DrawBlock: what changes between the draws of a frame
+struct DrawUniforms {
+    glm::mat4 model;
+    glm::vec3 positionScale; // VERTEX_FORMAT_PACKED dequantisation, (1, 1, 1) and (0, 0, 0) for float vertices
+    float reserved0;
+    glm::vec3 positionBias;
+    float reserved1;
+    glm::vec4 normalMatrix[3]; // columns of the mat3 (NormalMatrix of model), std140 pads each to a vec4
+};
+static_assert(sizeof(DrawUniforms) == 144, "DrawUniforms must match the std140 DrawBlock");
+
+// attaches the program's FrameBlock, DrawBlock and SkinBlock (whichever it has) to their binding points; once after linking
+inline void BindUniformBlocks(const Shader &shader)
+{
+    shader.bindUniformBlock("FrameBlock", UNIFORM_BLOCK_FRAME);
+    shader.bindUniformBlock("DrawBlock", UNIFORM_BLOCK_DRAW);
+    shader.bindUniformBlock("SkinBlock", UNIFORM_BLOCK_SKIN);
+}
+
+// Streams uniform block data: everything a frame needs is written to one region of a GL_UNIFORM_BUFFER and the draws
+// bind ranges of it, so a frame costs one upload instead of a glUniform* call per value per draw.
+//
+// Follows the streaming buffer policy of gl_state.h. Where PersistentMappingSupported(), the buffer holds
+// UNIFORM_RING_FRAMES regions and stays mapped: allocate() writes straight into the region of the current frame, and a
+// fence placed at endFrame() keeps a region from being rewritten before the GPU has drawn the frame that used it. On
+// plain GL 3.3 the data is staged on the CPU and upload() orphans the buffer.
+//
+// Per frame: beginFrame(bytes), allocate() the blocks, upload(), bind ranges and draw, endFrame().
+class UniformRing
+{
+public:
+    static const unsigned int UNIFORM_RING_FRAMES = 3;
+
+    // bytesPerFrame: initial size of a frame's region (beginFrame grows it); persistentIfAvailable = false forces
+    // the GL 3.3 path
+    explicit UniformRing(size_t bytesPerFrame, bool persistentIfAvailable = true, GLStateCache &state = SharedGLState())
+        : state(state), buffer(0), mapped(nullptr), regionSize(0), frame(0), cursor(0), waits(0)
+    {
+        GLint value = 0;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &value);
+        alignment = value > 0 ? (size_t)value : 256;
+        usePersistent = persistentIfAvailable && PersistentMappingSupported();
+        for(unsigned int i = 0; i < UNIFORM_RING_FRAMES; i++)
+            fences[i] = 0;
+        create(aligned(bytesPerFrame));
+    }
+
+    // needs the context still current: deletes the fences, the mapping and the buffer
+    ~UniformRing()
+    {
+        release();
+        state.invalidate(); // the binding points may still name the buffer
+    }
+
+    // bytes rounded up to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, the spacing of blocks in the ring
+    size_t aligned(size_t bytes) const
+    {
+        return (bytes + alignment - 1) / alignment * alignment;
+    }
+
+    // starts a frame that allocates at most bytes (sum of aligned() sizes). Waits for the GPU to finish the frame
+    // that used this region UNIFORM_RING_FRAMES frames ago; grows the ring first if the region is too small.
+    void beginFrame(size_t bytes)
+    {
+        if(bytes > regionSize)
+            grow(aligned(bytes));
+        frame = (frame + 1) % UNIFORM_RING_FRAMES;
+        cursor = 0;
+        if(usePersistent && fences[frame])
+        {
+            GLenum result = glClientWaitSync(fences[frame], 0, 0);
+            if(result == GL_TIMEOUT_EXPIRED)
+            {
+                waits++;
+                while(glClientWaitSync(fences[frame], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED)
+                    ;
+            }
+            glDeleteSync(fences[frame]);
+            fences[frame] = 0;
+        }
+    }
+
+    // copies bytes of data into this frame's region; returns the buffer offset to bind, -1 if the frame is full
+    GLintptr allocate(const void *data, size_t bytes)
+    {
+        size_t size = aligned(bytes);
+        if(cursor + size > regionSize)
+        {
+            std::cout << "ERROR::UNIFORM_RING::FRAME_FULL " << regionSize << " bytes per frame, pass more to beginFrame" << std::endl;
+            return -1;
+        }
+        GLintptr offset = (GLintptr)cursor;
+        if(usePersistent)
+        {
+            offset += (GLintptr)(frame * regionSize);
+            memcpy(mapped + offset, data, bytes);
+        }
+        else
+            memcpy(staging.data() + cursor, data, bytes);
+        cursor += size;
+        return offset;
+    }
+
+    // makes everything allocated this frame visible to GL: nothing to do for the coherent mapping, an orphan and
+    // a glBufferSubData of the staged bytes otherwise. Calling it again after more allocations re-sends the whole frame.
+    void upload()
+    {
+        if(usePersistent || cursor == 0)
+            return;
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferData(GL_UNIFORM_BUFFER, (GLsizeiptr)regionSize, NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, (GLsizeiptr)cursor, staging.data());
+    }
+
+    // binds bytes at offset (from allocate) to a uniform block binding point
+    void bind(GLuint binding, GLintptr offset, size_t bytes)
+    {
+        state.bindUniformBuffer(binding, buffer, offset, (GLsizeiptr)bytes);
+    }
+
+    // fences the frame's region once its draws have been issued
+    void endFrame()
+    {
+        if(usePersistent)
+            fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    bool persistent() const { return usePersistent; }
+    size_t frameBytes() const { return cursor; }    // allocated so far this frame
+    size_t capacity() const { return regionSize; }  // bytes per frame
+    unsigned int stalls() const { return waits; }   // beginFrame calls that had to wait for the GPU
+
+private:
+    GLStateCache &state;
+    GLuint buffer;
+    unsigned char *mapped;         // persistent mapping of all the regions
+    std::vector<unsigned char> staging; // GL 3.3: the frame's bytes until upload()
+    size_t alignment, regionSize;
+    unsigned int frame;
+    size_t cursor;
+    bool usePersistent;
+    GLsync fences[UNIFORM_RING_FRAMES];
+    unsigned int waits;
+
+    void create(size_t size)
+    {
+        regionSize = size;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        if(usePersistent)
+        {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            GLsizeiptr total = (GLsizeiptr)(regionSize * UNIFORM_RING_FRAMES);
+            glBufferStorage(GL_UNIFORM_BUFFER, total, NULL, flags);
+            mapped = (unsigned char*)glMapBufferRange(GL_UNIFORM_BUFFER, 0, total, flags);
+        }
+        else
+        {
+            glBufferData(GL_UNIFORM_BUFFER, (GLsizeiptr)regionSize, NULL, GL_STREAM_DRAW);
+            staging.resize(regionSize);
+        }
+    }
+
+    // replaces the buffer by a bigger one once every frame in flight is done with it
+    void grow(size_t size)
+    {
+        for(unsigned int i = 0; i < UNIFORM_RING_FRAMES; i++)
+            if(fences[i])
+                glClientWaitSync(fences[i], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        release();
+        state.invalidate(); // deleting the buffer reset the binding points it was bound to
+        create(size);
+    }
+
+    // deletes the live fences, unmaps and deletes the buffer; GL keeps the storage until draws in flight are done
+    void release()
+    {
+        for(unsigned int i = 0; i < UNIFORM_RING_FRAMES; i++)
+            if(fences[i])
+            {
+                glDeleteSync(fences[i]);
+                fences[i] = 0;
+            }
+        if(!buffer)
+            return;
+        if(mapped)
+        {
+            glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+            glUnmapBuffer(GL_UNIFORM_BUFFER);
+            mapped = nullptr;
+        }
+        glDeleteBuffers(1, &buffer);
+        buffer = 0;
+    }
+
+    UniformRing(const UniformRing&);
+    UniformRing &operator=(const UniformRing&);
+};
+#endif
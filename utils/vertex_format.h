@@ -0,0 +1,229 @@
+#ifndef VERTEX_FORMAT_H
+#define VERTEX_FORMAT_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Vertex layouts a Mesh can upload.
+//  VERTEX_FORMAT_FLOAT:  the full 56 byte Vertex (utils/mesh.h)
+//  VERTEX_FORMAT_PACKED: the 20 byte PackedVertex below; decoded by 1.model_loading.vs compiled with PACKED_VERTICES
+enum VertexFormat {
+    VERTEX_FORMAT_FLOAT = 0,
+    VERTEX_FORMAT_PACKED = 1
+};
+
+struct PackedVertex {
+    int16_t Position[4];    // snorm16 inside the mesh AABB, see PackedVertexDecode; w holds the bitangent sign (+-1)
+    int16_t Normal[2];      // octahedral encoding, snorm16
+    int16_t Tangent[2];     // octahedral encoding, snorm16
+    uint16_t TexCoords[2];  // half float
+};
+
+// turns the snorm position back into model space: position = packed * scale + bias
+struct PackedVertexDecode {
+    glm::vec3 scale;
+    glm::vec3 bias;
+};
+
+// worst case error of a packed mesh against its float source
+struct QuantizationError {
+    float position;         // model units
+    float positionRelative; // position error / AABB diagonal
+    float normalDegrees;
+    float tangentDegrees;
+    float texCoord;         // absolute UV units
+    unsigned int bitangentSignFlips; // vertices whose reconstructed bitangent points the other way than the source one
+};
+
+inline int16_t packSnorm16(float v)
+{
+    v = std::max(-1.0f, std::min(1.0f, v));
+    return (int16_t)std::floor(v * 32767.0f + 0.5f);
+}
+
+inline float unpackSnorm16(int16_t v)
+{
+    return std::max(-1.0f, v / 32767.0f);
+}
+
+// IEEE 754 binary16, round to nearest even; values beyond the half range become infinity
+inline uint16_t floatToHalf(float value)
+{
+    uint32_t f;
+    std::memcpy(&f, &value, 4);
+    uint32_t sign = (f >> 16) & 0x8000u;
+    uint32_t abs = f & 0x7fffffffu;
+    if (abs >= 0x7f800000u) // inf / nan
+        return (uint16_t)(sign | 0x7c00u | (abs > 0x7f800000u ? 0x200u : 0u));
+    if (abs >= 0x477ff000u) // rounds to >= 65520: overflow
+        return (uint16_t)(sign | 0x7c00u);
+    if (abs < 0x38800000u) // subnormal half (or zero)
+    {
+        float magnitude;
+        std::memcpy(&magnitude, &abs, 4);
+        return (uint16_t)(sign | (uint32_t)std::nearbyint(magnitude * 16777216.0f)); // 2^24
+    }
+    uint32_t mantissaOdd = (abs >> 13) & 1u;
+    abs += 0xc8000fffu + mantissaOdd; // rebias exponent (-112 << 23) and round to nearest even
+    return (uint16_t)(sign | (abs >> 13));
+}
+
+inline float halfToFloat(uint16_t h)
+{
+    uint32_t sign = (uint32_t)(h & 0x8000u) << 16;
+    uint32_t exponent = (h >> 10) & 0x1fu;
+    uint32_t mantissa = h & 0x3ffu;
+    uint32_t f;
+    if (exponent == 0)
+    {
+        float magnitude = mantissa / 16777216.0f;
+        std::memcpy(&f, &magnitude, 4);
+        f |= sign;
+    }
+    else if (exponent == 31)
+        f = sign | 0x7f800000u | (mantissa << 13);
+    else
+        f = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    float result;
+    std::memcpy(&result, &f, 4);
+    return result;
+}
+
+// octahedral mapping of a unit vector onto [-1,1]^2
+inline glm::vec2 octEncode(glm::vec3 n)
+{
+    n /= std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+    glm::vec2 e(n.x, n.y);
+    if (n.z < 0.0f)
+    {
+        e.x = (1.0f - std::fabs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f);
+        e.y = (1.0f - std::fabs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+    }
+    return e;
+}
+
+inline glm::vec3 octDecode(glm::vec2 e)
+{
+    glm::vec3 n(e.x, e.y, 1.0f - std::fabs(e.x) - std::fabs(e.y));
+    float t = std::max(-n.z, 0.0f);
+    n.x += n.x >= 0.0f ? -t : t;
+    n.y += n.y >= 0.0f ? -t : t;
+    return glm::normalize(n);
+}
+
+// octahedral encoding that picks, among the neighbouring snorm16 codes, the one decoding closest to n
+inline void packOctahedral(const glm::vec3 &n, int16_t out[2])
+{
+    float length = glm::length(n);
+    if (!(length > 0.0f))
+    {
+        out[0] = 0;
+        out[1] = packSnorm16(1.0f); // any valid direction for degenerate input
+        return;
+    }
+    glm::vec3 unit = n / length;
+    glm::vec2 e = octEncode(unit);
+    int16_t base[2] = { packSnorm16(e.x), packSnorm16(e.y) };
+    float best = -2.0f;
+    for (int dx = -1; dx <= 1; dx++)
+    {
+        for (int dy = -1; dy <= 1; dy++)
+        {
+            int x = std::max(-32767, std::min(32767, base[0] + dx));
+            int y = std::max(-32767, std::min(32767, base[1] + dy));
+            float d = glm::dot(unit, octDecode(glm::vec2(unpackSnorm16((int16_t)x), unpackSnorm16((int16_t)y))));
+            if (d > best)
+            {
+                best = d;
+                out[0] = (int16_t)x;
+                out[1] = (int16_t)y;
+            }
+        }
+    }
+}
+
+// packs a mesh given as Vertex-like structs (anything with Position, Normal, TexCoords, Tangent, Bitangent);
+// decode receives the position dequantisation for the shader
+template<typename V>
+void packVertices(const std::vector<V> &vertices, std::vector<PackedVertex> &packed, PackedVertexDecode &decode)
+{
+    glm::vec3 lo(0.0f), hi(0.0f);
+    if (!vertices.empty())
+        lo = hi = vertices[0].Position;
+    for (size_t i = 1; i < vertices.size(); i++)
+    {
+        lo = glm::min(lo, vertices[i].Position);
+        hi = glm::max(hi, vertices[i].Position);
+    }
+    decode.bias = (lo + hi) * 0.5f;
+    decode.scale = glm::max((hi - lo) * 0.5f, glm::vec3(1e-20f)); // flat axes still decode to the bias
+
+    packed.resize(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++)
+    {
+        const V &v = vertices[i];
+        PackedVertex &p = packed[i];
+        glm::vec3 q = (v.Position - decode.bias) / decode.scale;
+        p.Position[0] = packSnorm16(q.x);
+        p.Position[1] = packSnorm16(q.y);
+        p.Position[2] = packSnorm16(q.z);
+        // the shader rebuilds the bitangent as cross(N, T) * sign
+        p.Position[3] = glm::dot(glm::cross(v.Normal, v.Tangent), v.Bitangent) < 0.0f ? -32767 : 32767;
+        packOctahedral(v.Normal, p.Normal);
+        packOctahedral(v.Tangent, p.Tangent);
+        p.TexCoords[0] = floatToHalf(v.TexCoords.x);
+        p.TexCoords[1] = floatToHalf(v.TexCoords.y);
+    }
+}
+
+// CPU mirror of the shader decode, for tools and tests
+inline void unpackVertex(const PackedVertex &p, const PackedVertexDecode &decode,
+                         glm::vec3 &position, glm::vec3 &normal, glm::vec2 &texCoords, glm::vec3 &tangent, float &bitangentSign)
+{
+    position = glm::vec3(unpackSnorm16(p.Position[0]), unpackSnorm16(p.Position[1]), unpackSnorm16(p.Position[2])) * decode.scale + decode.bias;
+    bitangentSign = p.Position[3] < 0 ? -1.0f : 1.0f;
+    normal = octDecode(glm::vec2(unpackSnorm16(p.Normal[0]), unpackSnorm16(p.Normal[1])));
+    tangent = octDecode(glm::vec2(unpackSnorm16(p.Tangent[0]), unpackSnorm16(p.Tangent[1])));
+    texCoords = glm::vec2(halfToFloat(p.TexCoords[0]), halfToFloat(p.TexCoords[1]));
+}
+
+// angle between two directions in degrees (0 if either is degenerate)
+inline float angleDegrees(const glm::vec3 &a, const glm::vec3 &b)
+{
+    float la = glm::length(a), lb = glm::length(b);
+    if (!(la > 0.0f) || !(lb > 0.0f))
+        return 0.0f;
+    float c = std::max(-1.0f, std::min(1.0f, glm::dot(a, b) / (la * lb)));
+    return std::acos(c) * 57.29577951f;
+}
+
+// worst case error of packed against vertices (both the same length, packed made by packVertices)
+template<typename V>
+QuantizationError measureQuantizationError(const std::vector<V> &vertices, const std::vector<PackedVertex> &packed, const PackedVertexDecode &decode)
+{
+    QuantizationError error;
+    std::memset(&error, 0, sizeof(error));
+    for (size_t i = 0; i < vertices.size() && i < packed.size(); i++)
+    {
+        const V &v = vertices[i];
+        glm::vec3 position, normal, tangent;
+        glm::vec2 texCoords;
+        float sign;
+        unpackVertex(packed[i], decode, position, normal, texCoords, tangent, sign);
+        error.position = std::max(error.position, glm::length(position - v.Position));
+        error.normalDegrees = std::max(error.normalDegrees, angleDegrees(normal, v.Normal));
+        error.tangentDegrees = std::max(error.tangentDegrees, angleDegrees(tangent, v.Tangent));
+        error.texCoord = std::max(error.texCoord, std::max(std::fabs(texCoords.x - v.TexCoords.x), std::fabs(texCoords.y - v.TexCoords.y)));
+        if (glm::dot(glm::cross(normal, tangent) * sign, v.Bitangent) < 0.0f)
+            error.bitangentSignFlips++;
+    }
+    float diagonal = glm::length(decode.scale) * 2.0f;
+    error.positionRelative = diagonal > 0.0f ? error.position / diagonal : 0.0f;
+    return error;
+}
+#endif
@@ -2,9 +2,22 @@
 
 out vec4 FragColor;
 
+#ifdef UNIFORM_BLOCKS
+// FrameUniforms (utils/uniform_ring.h), the same block as in the vertex shader
+layout (std140) uniform FrameBlock {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+    float lerpIntensity;
+    vec3 lightPos;
+    vec3 lightColor;
+    vec3 matColor;
+};
+#else
 uniform vec3 lightPos; 
 uniform vec3 viewPos;
 uniform vec3 lightColor;
+#endif
 
 in VS_OUT {
     vec3 FragPos;
@@ -18,9 +31,11 @@ uniform sampler2D texture_diffuse1;
 
 uniform sampler2D texture_normal1; 
 
+#ifndef UNIFORM_BLOCKS
 uniform vec3 matColor;
 
 uniform float lerpIntensity;
+#endif
 
 void main()
 {   
@@ -1,9 +1,38 @@
 #version 330 core
+#ifdef PACKED_VERTICES
+// VERTEX_FORMAT_PACKED (utils/vertex_format.h): snorm16 position in the mesh bounds with the bitangent sign in w,
+// octahedral normal/tangent, half float texture coordinates
+layout (location = 0) in vec4 aPos;
+layout (location = 1) in vec2 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+layout (location = 3) in vec2 aTangent;
+#else
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
 layout (location = 3) in vec3 aTangent;
 layout (location = 4) in vec3 aBitangent;
+#endif
+
+// Model::DrawInstanced (utils/instance_buffer.h): the per-instance transform replaces the model uniform
+#if defined(INSTANCED)
+layout (location = 5) in mat4 aInstanceModel;
+#elif defined(INSTANCED_TRS)
+layout (location = 5) in vec4 aInstanceTranslationScale; // xyz translation, w uniform scale
+layout (location = 6) in vec4 aInstanceRotation;         // unit quaternion
+#endif
+
+#ifdef SKINNED
+// Model loaded with SKINNING_GPU (utils/skinning.h): the four strongest bones of the vertex and the pose's palette
+layout (location = 9) in uvec4 aBoneIds;
+layout (location = 10) in vec4 aBoneWeights;
+#ifndef MAX_SKIN_BONES
+#define MAX_SKIN_BONES 256
+#endif
+layout (std140) uniform SkinBlock {
+    mat4 bones[MAX_SKIN_BONES];
+};
+#endif
 
 out VS_OUT {
     vec3 FragPos;
@@ -13,28 +42,111 @@ out VS_OUT {
     vec3 TangentFragPos;
 } vs_out;
 
+#ifdef UNIFORM_BLOCKS
+// FrameUniforms / DrawUniforms (utils/uniform_ring.h), streamed through a UniformRing
+layout (std140) uniform FrameBlock {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+    float lerpIntensity;
+    vec3 lightPos;
+    vec3 lightColor;
+    vec3 matColor;
+};
+
+layout (std140) uniform DrawBlock {
+    mat4 model;
+    vec3 positionScale;
+    vec3 positionBias;
+    mat3 normalMatrix;
+};
+#else
 uniform mat4 projection;
 uniform mat4 view;
 uniform mat4 model;
+uniform mat3 normalMatrix; // transpose(inverse(mat3(model))), computed once per draw on the CPU (NormalMatrix, mesh.h)
 
 uniform vec3 lightPos;
 uniform vec3 viewPos;
 
+#ifdef PACKED_VERTICES
+uniform vec3 positionScale;
+uniform vec3 positionBias;
+#endif
+#endif
+
+#ifdef PACKED_VERTICES
+vec3 octDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += mix(vec2(t), vec2(-t), greaterThanEqual(n.xy, vec2(0.0)));
+    return normalize(n);
+}
+#endif
+
+#ifdef INSTANCED_TRS
+vec3 quatRotate(vec4 q, vec3 v)
+{
+    return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+#endif
+
 void main()
 {
-    vs_out.FragPos = vec3(model * vec4(aPos, 1.0));   
+#ifdef PACKED_VERTICES
+    vec3 position = aPos.xyz * positionScale + positionBias;
+    vec3 normal = octDecode(aNormal);
+    vec3 tangent = octDecode(aTangent);
+    float bitangentSign = aPos.w < 0.0 ? -1.0 : 1.0;
+#else
+    vec3 position = aPos;
+    vec3 normal = aNormal;
+    vec3 tangent = aTangent;
+    float bitangentSign = 1.0;
+#endif
+#ifdef SKINNED
+    mat4 skin = bones[aBoneIds.x] * aBoneWeights.x + bones[aBoneIds.y] * aBoneWeights.y +
+                bones[aBoneIds.z] * aBoneWeights.z + bones[aBoneIds.w] * aBoneWeights.w;
+    position = vec3(skin * vec4(position, 1.0));
+    normal = mat3(skin) * normal;
+    tangent = mat3(skin) * tangent;
+#endif
+#if defined(INSTANCED_TRS)
+    // uniform scale: the normal matrix is the rotation alone
+    vs_out.FragPos = quatRotate(aInstanceRotation, position * aInstanceTranslationScale.w) + aInstanceTranslationScale.xyz;
+    vec3 T = normalize(quatRotate(aInstanceRotation, tangent));
+    vec3 N = normalize(quatRotate(aInstanceRotation, normal));
+#else
+#if defined(INSTANCED)
+    mat4 modelMatrix = aInstanceModel;
+    // the cofactor matrix is the inverse transpose scaled by the determinant, which the normalize below removes
+    // (but for its sign): three cross products instead of an inverse per vertex
+    mat3 m = mat3(modelMatrix);
+    mat3 normalTransform = mat3(cross(m[1], m[2]), cross(m[2], m[0]), cross(m[0], m[1]));
+    normalTransform *= sign(dot(m[0], normalTransform[0]));
+#else
+    mat4 modelMatrix = model;
+#ifdef NORMAL_MATRIX_PER_VERTEX
+    // the old per-vertex inverse, kept as the baseline of 03_benchmarks/normal_matrix_benchmark
+    mat3 normalTransform = transpose(inverse(mat3(modelMatrix)));
+#else
+    mat3 normalTransform = normalMatrix;
+#endif
+#endif
+    vs_out.FragPos = vec3(modelMatrix * vec4(position, 1.0));   
+
+    vec3 T = normalize(normalTransform * tangent);
+    vec3 N = normalize(normalTransform * normal);
+#endif
     vs_out.TexCoords = aTexCoords;
-    
-    mat3 normalMatrix = transpose(inverse(mat3(model)));
-    vec3 T = normalize(normalMatrix * aTangent);
-    vec3 N = normalize(normalMatrix * aNormal);
     T = normalize(T - dot(T, N) * N);
-    vec3 B = cross(N, T);
+    vec3 B = cross(N, T) * bitangentSign;
     
     mat3 TBN = transpose(mat3(T, B, N));    
     vs_out.TangentLightPos = TBN * lightPos;
     vs_out.TangentViewPos  = TBN * viewPos;
     vs_out.TangentFragPos  = TBN * vs_out.FragPos;
         
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
-}
\ No newline at end of file
+    gl_Position = projection * view * vec4(vs_out.FragPos, 1.0);
+}